@@ -0,0 +1,843 @@
+/*
+ * Copyright 2011-2013 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License
+ */
+
+#include <stdio.h>
+
+#include "bvh.h"
+#include "bvh_params.h"
+
+#include "buffers.h"
+#include "camera.h"
+#include "curves.h"
+#include "device.h"
+#include "graph.h"
+#include "integrator.h"
+#include "light.h"
+#include "mesh.h"
+#include "nodes.h"
+#include "object.h"
+#include "scene.h"
+#include "session.h"
+#include "shader.h"
+
+#include "util_args.h"
+#include "util_foreach.h"
+#include "util_function.h"
+#include "util_math.h"
+#include "util_progress.h"
+#include "util_string.h"
+#include "util_system.h"
+#include "util_task.h"
+#include "util_time.h"
+
+CCL_NAMESPACE_BEGIN
+
+struct BenchOptions {
+	bool task;
+	bool bvh;
+	bool lights;
+	bool mesh;
+	bool network;
+	bool hair;
+	int threads;
+	int tasks;
+	int triangles;
+	int strands;
+	int num_lights;
+	int samples;
+	int repeat;
+} bench_options;
+
+/* Task Scheduler
+ *
+ * Measures scheduling overhead with tiny tasks. Half of the tasks are pushed
+ * from the main thread, the other half are spawned recursively from inside
+ * tasks through nested pools, like BVH building does. */
+
+static void bench_task_work(volatile int *counter)
+{
+	/* a few cycles of work, so we mostly measure the scheduler */
+	int sum = 0;
+
+	for(int i = 0; i < 64; i++)
+		sum += i;
+
+	*counter = sum;
+}
+
+static void bench_task_spawn(int depth, volatile int *counter)
+{
+	if(depth == 0) {
+		bench_task_work(counter);
+		return;
+	}
+
+	TaskPool pool;
+
+	pool.push(function_bind(&bench_task_spawn, depth - 1, counter));
+	pool.push(function_bind(&bench_task_spawn, depth - 1, counter));
+
+	pool.wait_work();
+}
+
+static double bench_task_run(int num_tasks)
+{
+	volatile int counter = 0;
+	TaskPool pool;
+
+	/* recursive tasks for about half of the total, each tree runs 2^depth
+	 * leaf tasks and the inner tasks spawning them */
+	int depth = 8;
+	int tree_size = (2 << depth) - 1;
+	int num_trees = (num_tasks/2)/tree_size;
+
+	/* flat tasks for the remainder, so that exactly num_tasks run */
+	int num_flat = num_tasks - num_trees*tree_size;
+
+	double start = time_dt();
+
+	for(int i = 0; i < num_flat; i++)
+		pool.push(function_bind(&bench_task_work, &counter));
+	for(int i = 0; i < num_trees; i++)
+		pool.push(function_bind(&bench_task_spawn, depth, &counter));
+
+	pool.wait_work();
+
+	double elapsed = time_dt() - start;
+	return num_tasks/elapsed;
+}
+
+static void bench_task()
+{
+	int max_threads = (bench_options.threads)? bench_options.threads: system_cpu_thread_count();
+
+	printf("Task scheduler, %d tasks, best of %d\n", bench_options.tasks, bench_options.repeat);
+	printf("%8s %16s\n", "threads", "tasks/sec");
+
+	for(int num_threads = 1; ; num_threads = min(num_threads*2, max_threads)) {
+		TaskScheduler::init(num_threads);
+
+		double best = 0.0;
+
+		for(int i = 0; i < bench_options.repeat; i++)
+			best = max(best, bench_task_run(bench_options.tasks));
+
+		TaskScheduler::exit();
+
+		printf("%8d %16.0f\n", num_threads, best);
+
+		if(num_threads == max_threads)
+			break;
+	}
+}
+
+/* BVH Build
+ *
+ * Builds BVHs for a few procedurally generated reference meshes, with and
+ * without spatial splits, and reports build time and SAH cost per number of
+ * threads. The meshes are generated so that results are comparable between
+ * machines without needing scene files. */
+
+static uint bench_random(uint& seed)
+{
+	seed = seed*1103515245 + 12345;
+	return seed >> 8;
+}
+
+static float bench_random_float(uint& seed)
+{
+	return (float)bench_random(seed)/(float)(1 << 24);
+}
+
+static void bench_mesh_grid(Mesh *mesh, int num_triangles, bool terrain)
+{
+	/* grid of quads, flat and evenly sized for the sphere, or a height field
+	 * with details at several scales for the terrain */
+	int res = max((int)sqrtf(num_triangles*0.5f), 2);
+
+	mesh->reserve(res*res, (res-1)*(res-1)*2, 0, 0);
+
+	for(int y = 0; y < res; y++) {
+		for(int x = 0; x < res; x++) {
+			float u = (float)x/(float)(res - 1);
+			float v = (float)y/(float)(res - 1);
+
+			if(terrain) {
+				float h = 0.1f*sinf(u*7.0f)*cosf(v*5.0f) + 0.02f*sinf(u*61.0f + v*37.0f) + 0.005f*sinf(u*523.0f)*sinf(v*419.0f);
+				mesh->verts[y*res + x] = make_float3(u, v, h);
+			}
+			else {
+				float theta = u*M_2PI_F;
+				float phi = v*M_PI_F;
+				mesh->verts[y*res + x] = make_float3(sinf(phi)*cosf(theta), sinf(phi)*sinf(theta), cosf(phi));
+			}
+		}
+	}
+
+	for(int y = 0; y < res - 1; y++) {
+		for(int x = 0; x < res - 1; x++) {
+			int v0 = y*res + x;
+			int t = (y*(res - 1) + x)*2;
+
+			mesh->set_triangle(t + 0, v0, v0 + 1, v0 + res, 0, false);
+			mesh->set_triangle(t + 1, v0 + 1, v0 + res + 1, v0 + res, 0, false);
+		}
+	}
+}
+
+static void bench_mesh_scatter(Mesh *mesh, int num_triangles)
+{
+	/* randomly placed triangles of very different sizes and long thin ones,
+	 * typical for architecture and where spatial splits help the most */
+	uint seed = 1;
+
+	mesh->reserve(num_triangles*3, num_triangles, 0, 0);
+
+	for(int i = 0; i < num_triangles; i++) {
+		float3 p = make_float3(bench_random_float(seed), bench_random_float(seed), bench_random_float(seed));
+		float size = (i % 16 == 0)? 0.2f: 0.005f;
+		float3 d1 = make_float3(bench_random_float(seed) - 0.5f, bench_random_float(seed) - 0.5f, bench_random_float(seed) - 0.5f)*size;
+		float3 d2 = make_float3(bench_random_float(seed) - 0.5f, bench_random_float(seed) - 0.5f, bench_random_float(seed) - 0.5f)*size;
+
+		if(i % 7 == 0)
+			d1 *= 20.0f;
+
+		mesh->verts[i*3 + 0] = p;
+		mesh->verts[i*3 + 1] = p + d1;
+		mesh->verts[i*3 + 2] = p + d2;
+		mesh->set_triangle(i, i*3 + 0, i*3 + 1, i*3 + 2, 0, false);
+	}
+}
+
+static double bench_bvh_build(Mesh *mesh, bool spatial_split, float& SAH, size_t& num_nodes, size_t& num_prims)
+{
+	Object object;
+	object.mesh = mesh;
+
+	vector<Object*> objects;
+	objects.push_back(&object);
+
+	BVHParams params;
+	params.use_spatial_split = spatial_split;
+
+	Progress progress;
+	BVH *bvh = BVH::create(params, objects);
+
+	double start = time_dt();
+	bvh->build(progress);
+	double elapsed = time_dt() - start;
+
+	SAH = bvh->pack.SAH;
+	num_nodes = bvh->pack.nodes.size()/BVH_NODE_SIZE;
+	num_prims = bvh->pack.prim_index.size();
+
+	delete bvh;
+
+	return elapsed;
+}
+
+static void bench_bvh()
+{
+	int max_threads = (bench_options.threads)? bench_options.threads: system_cpu_thread_count();
+	const char *mesh_names[] = {"sphere", "terrain", "scatter"};
+
+	printf("BVH build, %d triangles, best of %d\n", bench_options.triangles, bench_options.repeat);
+	printf("%-8s %-8s %8s %10s %12s %10s %10s\n", "mesh", "split", "threads", "time", "SAH", "nodes", "prims");
+
+	for(int m = 0; m < 3; m++) {
+		Mesh mesh;
+
+		if(m == 0)
+			bench_mesh_grid(&mesh, bench_options.triangles, false);
+		else if(m == 1)
+			bench_mesh_grid(&mesh, bench_options.triangles, true);
+		else
+			bench_mesh_scatter(&mesh, bench_options.triangles);
+
+		for(int spatial_split = 0; spatial_split < 2; spatial_split++) {
+			for(int num_threads = 1; ; num_threads = min(num_threads*2, max_threads)) {
+				TaskScheduler::init(num_threads);
+
+				double best = DBL_MAX;
+				float SAH = 0.0f;
+				size_t num_nodes = 0, num_prims = 0;
+
+				for(int i = 0; i < bench_options.repeat; i++)
+					best = min(best, bench_bvh_build(&mesh, spatial_split != 0, SAH, num_nodes, num_prims));
+
+				TaskScheduler::exit();
+
+				printf("%-8s %-8s %8d %9.3fs %12.3f %10lu %10lu\n", mesh_names[m],
+					(spatial_split)? "spatial": "object", num_threads, best, SAH,
+					(unsigned long)num_nodes, (unsigned long)num_prims);
+
+				if(num_threads == max_threads)
+					break;
+			}
+		}
+	}
+}
+
+/* Rendering
+ *
+ * The benchmarks that render share the session setup. They differ in the
+ * scene, created by a callback, and in what is done with finished tiles. */
+
+#define BENCH_RENDER_WIDTH 256
+#define BENCH_RENDER_HEIGHT 192
+
+static void bench_camera(Scene *scene, float3 P, float3 target)
+{
+	Camera *cam = scene->camera;
+	float3 dir = normalize(target - P);
+	float3 right = normalize(cross(dir, make_float3(0.0f, 0.0f, 1.0f)));
+	float3 up = cross(right, dir);
+
+	cam->width = BENCH_RENDER_WIDTH;
+	cam->height = BENCH_RENDER_HEIGHT;
+	cam->matrix = make_transform(right.x, up.x, dir.x, P.x,
+	                             right.y, up.y, dir.y, P.y,
+	                             right.z, up.z, dir.z, P.z,
+	                             0.0f, 0.0f, 0.0f, 1.0f);
+	cam->need_update = true;
+	cam->update();
+}
+
+static void bench_write_tile(RenderTile& rtile, vector<float> *pixels)
+{
+	RenderBuffers *buffers = rtile.buffers;
+	vector<float> tile(rtile.w*rtile.h*4);
+
+	buffers->copy_from_device();
+
+	if(!buffers->get_pass_rect(PASS_COMBINED, 1.0f, rtile.sample, 4, &tile[0]))
+		return;
+
+	for(int y = 0; y < rtile.h; y++) {
+		for(int x = 0; x < rtile.w; x++) {
+			float *in = &tile[(y*rtile.w + x)*4];
+			float *out = &(*pixels)[((rtile.y + y)*BENCH_RENDER_WIDTH + rtile.x + x)*3];
+
+			out[0] = in[0];
+			out[1] = in[1];
+			out[2] = in[2];
+		}
+	}
+}
+
+/* renders with the first device of the given type, and returns the render
+ * time without scene updates, which are the same for the compared variants.
+ * read_scene is called before the scene is freed */
+static double bench_render(SessionParams session_params, const SceneParams& scene_params, DeviceType device_type,
+                           function<void(Scene*)> build_scene, function<void(RenderTile&)> write_tile,
+                           function<void(Scene*)> read_scene = function<void(Scene*)>())
+{
+	session_params.background = true;
+
+	foreach(DeviceInfo& info, Device::available_devices()) {
+		if(info.type == device_type) {
+			session_params.device = info;
+			break;
+		}
+	}
+
+	Session *session = new Session(session_params);
+	Scene *scene = new Scene(scene_params, session_params.device);
+
+	build_scene(scene);
+
+	BufferParams buffer_params;
+	buffer_params.width = BENCH_RENDER_WIDTH;
+	buffer_params.height = BENCH_RENDER_HEIGHT;
+	buffer_params.full_width = BENCH_RENDER_WIDTH;
+	buffer_params.full_height = BENCH_RENDER_HEIGHT;
+
+	session->scene = scene;
+	session->write_render_tile_cb = write_tile;
+	session->reset(buffer_params, session_params.samples);
+
+	double start = time_dt();
+	session->start();
+	session->wait();
+	double elapsed = time_dt() - start;
+
+	elapsed -= scene->update_times.bvh + scene->update_times.device;
+
+	if(read_scene)
+		read_scene(scene);
+
+	delete session;
+
+	return elapsed;
+}
+
+/* Light Sampling
+ *
+ * Renders a ground plane lit by many small point and spot lamps of different
+ * strengths, like a city at night, with uniform light picking and with the
+ * light tree. Noise is measured as RMSE against a high sample count render,
+ * and scaled to the render time of uniform picking so both are compared at
+ * equal time. */
+
+static int bench_lights_shader(Scene *scene, float3 color, float strength)
+{
+	ShaderGraph *graph = new ShaderGraph();
+
+	ShaderNode *emission = graph->add(new EmissionNode());
+	emission->input("Color")->value = color;
+	emission->input("Strength")->value.x = strength;
+
+	graph->connect(emission->output("Emission"), graph->output()->input("Surface"));
+
+	Shader *shader = new Shader();
+	shader->name = "light";
+	shader->set_graph(graph);
+	scene->shaders.push_back(shader);
+
+	return scene->shaders.size() - 1;
+}
+
+static void bench_lights_scene(Scene *scene, bool light_tree, int integrator_seed)
+{
+	/* ground plane */
+	Mesh *mesh = new Mesh();
+	float extent = 10.0f;
+
+	mesh->used_shaders.push_back(scene->default_surface);
+	mesh->reserve(4, 2, 0, 0);
+	mesh->verts[0] = make_float3(-extent, -extent, 0.0f);
+	mesh->verts[1] = make_float3(extent, -extent, 0.0f);
+	mesh->verts[2] = make_float3(extent, extent, 0.0f);
+	mesh->verts[3] = make_float3(-extent, extent, 0.0f);
+	mesh->set_triangle(0, 0, 1, 2, scene->default_surface, false);
+	mesh->set_triangle(1, 0, 2, 3, scene->default_surface, false);
+	scene->meshes.push_back(mesh);
+
+	Object *object = new Object();
+	object->mesh = mesh;
+	object->tfm = transform_identity();
+	scene->objects.push_back(object);
+
+	/* lamps, with strengths spanning two orders of magnitude */
+	const int num_shaders = 8;
+	int shaders[num_shaders];
+
+	for(int i = 0; i < num_shaders; i++) {
+		float strength = powf(10.0f, 2.0f*i/(num_shaders - 1));
+		float3 color = (i % 2)? make_float3(1.0f, 0.7f, 0.4f): make_float3(0.8f, 0.9f, 1.0f);
+
+		shaders[i] = bench_lights_shader(scene, color, strength);
+	}
+
+	uint seed = 1;
+
+	for(int i = 0; i < bench_options.num_lights; i++) {
+		Light *light = new Light();
+
+		light->co = make_float3((bench_random_float(seed)*2.0f - 1.0f)*extent,
+		                        (bench_random_float(seed)*2.0f - 1.0f)*extent,
+		                        0.1f + bench_random_float(seed));
+		light->size = 0.02f;
+		light->shader = shaders[bench_random(seed) % num_shaders];
+
+		/* street lights facing down */
+		if(i % 3 == 0) {
+			light->type = LIGHT_SPOT;
+			light->dir = make_float3(0.0f, 0.0f, -1.0f);
+			light->spot_angle = M_PI_2_F;
+			light->spot_smooth = 0.2f;
+		}
+
+		scene->lights.push_back(light);
+	}
+
+	/* camera looking down at the plane */
+	bench_camera(scene, make_float3(0.0f, -1.4f*extent, 0.9f*extent), make_float3(0.0f, 0.0f, 0.0f));
+
+	scene->integrator->use_light_tree = light_tree;
+	scene->integrator->seed = integrator_seed;
+}
+
+static double bench_lights_render(bool light_tree, int samples, int seed, vector<float>& pixels)
+{
+	SessionParams session_params;
+	session_params.samples = samples;
+	session_params.threads = bench_options.threads;
+
+	pixels.clear();
+	pixels.resize(BENCH_RENDER_WIDTH*BENCH_RENDER_HEIGHT*3, 0.0f);
+
+	return bench_render(session_params, SceneParams(), DEVICE_CPU,
+		function_bind(&bench_lights_scene, _1, light_tree, seed),
+		function_bind(&bench_write_tile, _1, &pixels));
+}
+
+static float bench_lights_rmse(const vector<float>& pixels, const vector<float>& reference)
+{
+	double sum = 0.0;
+
+	for(size_t i = 0; i < pixels.size(); i++) {
+		double d = pixels[i] - reference[i];
+		sum += d*d;
+	}
+
+	return (float)sqrt(sum/pixels.size());
+}
+
+static void bench_lights()
+{
+	int reference_samples = bench_options.samples*64;
+
+	printf("Light sampling, %d lamps, %d samples, reference %d samples, best of %d\n",
+		bench_options.num_lights, bench_options.samples, reference_samples, bench_options.repeat);
+
+	/* different seed so the reference is not correlated with the renders */
+	vector<float> reference, pixels;
+	bench_lights_render(true, reference_samples, 1, reference);
+
+	printf("%-8s %10s %12s %16s\n", "picking", "time", "RMSE", "equal time RMSE");
+
+	double uniform_time = 0.0;
+
+	for(int light_tree = 0; light_tree < 2; light_tree++) {
+		double best = DBL_MAX;
+
+		for(int i = 0; i < bench_options.repeat; i++)
+			best = min(best, bench_lights_render(light_tree != 0, bench_options.samples, 0, pixels));
+
+		if(!light_tree)
+			uniform_time = best;
+
+		/* variance falls linearly with render time */
+		float rmse = bench_lights_rmse(pixels, reference);
+		float rmse_equal_time = rmse*(float)sqrt(best/uniform_time);
+
+		printf("%-8s %9.3fs %12.5f %16.5f\n", (light_tree)? "tree": "uniform", best, rmse, rmse_equal_time);
+	}
+}
+
+/* Mesh Storage
+ *
+ * Renders the terrain reference mesh with regular and compact triangle
+ * storage, and reports device memory per array, render time and the
+ * difference between both images caused by the quantized normals. */
+
+static void bench_mesh_scene(Scene *scene)
+{
+	Mesh *mesh = new Mesh();
+
+	bench_mesh_grid(mesh, bench_options.triangles, true);
+
+	/* smooth shading, to include the vertex normals */
+	for(size_t i = 0; i < mesh->triangles.size(); i++)
+		mesh->smooth[i] = true;
+
+	mesh->used_shaders.push_back(scene->default_surface);
+	scene->meshes.push_back(mesh);
+
+	Object *object = new Object();
+	object->mesh = mesh;
+	object->tfm = transform_identity();
+	scene->objects.push_back(object);
+
+	/* low sun for long shadows over the terrain details */
+	Light *light = new Light();
+	light->type = LIGHT_DISTANT;
+	light->dir = normalize(make_float3(1.0f, 0.5f, -0.4f));
+	light->size = 0.02f;
+	light->shader = bench_lights_shader(scene, make_float3(1.0f, 0.95f, 0.9f), 3.0f);
+	scene->lights.push_back(light);
+
+	/* camera looking over the terrain */
+	bench_camera(scene, make_float3(0.5f, -0.4f, 0.5f), make_float3(0.5f, 0.5f, 0.0f));
+}
+
+static void bench_mesh_memory_report(Scene *scene, string *memory_report)
+{
+	*memory_report = scene->mesh_manager->memory_report(&scene->dscene);
+}
+
+static double bench_mesh_render(bool compact, vector<float>& pixels, string *memory_report)
+{
+	SessionParams session_params;
+	session_params.samples = bench_options.samples;
+	session_params.threads = bench_options.threads;
+
+	SceneParams scene_params;
+	scene_params.use_compact_triangles = compact;
+
+	pixels.clear();
+	pixels.resize(BENCH_RENDER_WIDTH*BENCH_RENDER_HEIGHT*3, 0.0f);
+
+	return bench_render(session_params, scene_params, DEVICE_CPU,
+		function_bind(&bench_mesh_scene, _1),
+		function_bind(&bench_write_tile, _1, &pixels),
+		function_bind(&bench_mesh_memory_report, _1, memory_report));
+}
+
+static void bench_mesh()
+{
+	printf("Mesh storage, %d triangles, %d samples, best of %d\n",
+		bench_options.triangles, bench_options.samples, bench_options.repeat);
+
+	vector<float> reference, pixels;
+
+	for(int compact = 0; compact < 2; compact++) {
+		double best = DBL_MAX;
+		string memory_report;
+
+		for(int i = 0; i < bench_options.repeat; i++)
+			best = min(best, bench_mesh_render(compact != 0, (compact)? pixels: reference, &memory_report));
+
+		printf("\n%s triangles, render %.3fs\n", (compact)? "Compact": "Regular", best);
+		printf("%s", memory_report.c_str());
+	}
+
+	/* same seed, so only storage precision contributes */
+	printf("\nRMSE between regular and compact: %.6f\n", bench_lights_rmse(pixels, reference));
+}
+
+/* Hair
+ *
+ * Renders a patch of strands on a ground plane, seen from the side so that
+ * most camera rays pass through many strands. Line segments use the curve
+ * BVH leaves and the SIMD segment test, cardinal curves are timed for
+ * comparison. */
+
+#define BENCH_HAIR_KEYS 8
+
+static void bench_hair_scene(Scene *scene, int primitive)
+{
+	Mesh *mesh = new Mesh();
+	uint seed = 0;
+
+	for(int i = 0; i < bench_options.strands; i++) {
+		float3 P = make_float3(bench_random_float(seed), bench_random_float(seed), 0.0f);
+		float3 bend = make_float3(bench_random_float(seed) - 0.5f, bench_random_float(seed) - 0.5f, 0.0f)*0.1f;
+		float length = 0.1f + 0.05f*bench_random_float(seed);
+		int first_key = mesh->curve_keys.size();
+
+		for(int k = 0; k < BENCH_HAIR_KEYS; k++) {
+			float t = k/(float)(BENCH_HAIR_KEYS - 1);
+			float3 co = P + bend*t*t + make_float3(0.0f, 0.0f, length*t);
+
+			mesh->add_curve_key(co, 0.002f*(1.0f - 0.8f*t));
+		}
+
+		mesh->add_curve(first_key, BENCH_HAIR_KEYS, 0);
+	}
+
+	mesh->used_shaders.push_back(scene->default_surface);
+	scene->meshes.push_back(mesh);
+
+	Object *object = new Object();
+	object->mesh = mesh;
+	object->tfm = transform_identity();
+	scene->objects.push_back(object);
+
+	scene->curve_system_manager->primitive = primitive;
+	scene->curve_system_manager->need_update = true;
+
+	Light *light = new Light();
+	light->type = LIGHT_DISTANT;
+	light->dir = normalize(make_float3(0.3f, 0.6f, -1.0f));
+	light->size = 0.05f;
+	light->shader = bench_lights_shader(scene, make_float3(1.0f, 0.95f, 0.9f), 3.0f);
+	scene->lights.push_back(light);
+
+	/* camera at the side of the patch, just above the roots */
+	bench_camera(scene, make_float3(0.5f, -0.6f, 0.12f), make_float3(0.5f, 0.5f, 0.06f));
+}
+
+static void bench_hair_bvh_time(Scene *scene, double *bvh_time)
+{
+	*bvh_time = scene->update_times.bvh;
+}
+
+static double bench_hair_render(int primitive, double& bvh_time)
+{
+	SessionParams session_params;
+	session_params.samples = bench_options.samples;
+	session_params.threads = bench_options.threads;
+
+	vector<float> pixels(BENCH_RENDER_WIDTH*BENCH_RENDER_HEIGHT*3, 0.0f);
+
+	return bench_render(session_params, SceneParams(), DEVICE_CPU,
+		function_bind(&bench_hair_scene, _1, primitive),
+		function_bind(&bench_write_tile, _1, &pixels),
+		function_bind(&bench_hair_bvh_time, _1, &bvh_time));
+}
+
+static void bench_hair()
+{
+	printf("Hair, %d strands, %d segments, %d samples, best of %d\n",
+		bench_options.strands, bench_options.strands*(BENCH_HAIR_KEYS - 1), bench_options.samples, bench_options.repeat);
+	printf("%-14s %10s %10s\n", "Primitive", "BVH", "Render");
+
+	const int primitives[] = {CURVE_LINE_SEGMENTS, CURVE_SEGMENTS};
+	const char *names[] = {"line segments", "curves"};
+
+	for(int p = 0; p < 2; p++) {
+		double best = DBL_MAX, best_bvh = DBL_MAX;
+
+		for(int i = 0; i < bench_options.repeat; i++) {
+			double bvh_time;
+			best = min(best, bench_hair_render(primitives[p], bvh_time));
+			best_bvh = min(best_bvh, bvh_time);
+		}
+
+		printf("%-14s %9.3fs %9.3fs\n", names[p], best_bvh, best);
+	}
+}
+
+/* Network Device
+ *
+ * Renders the terrain mesh with small tiles and a single sample through the
+ * network device with each protocol, so that tile transfer and RPC latency
+ * dominate. Requires cycles_server to be running on the local machine. */
+
+#ifdef WITH_NETWORK
+
+#define BENCH_NETWORK_TILE_SIZE 16
+
+static void bench_network_count_tile(RenderTile&, int *num_tiles)
+{
+	(*num_tiles)++;
+}
+
+static double bench_network_render(const char *protocol, int& num_tiles)
+{
+#ifdef WIN32
+	_putenv_s("CYCLES_NETWORK_PROTOCOL", protocol);
+#else
+	setenv("CYCLES_NETWORK_PROTOCOL", protocol, 1);
+#endif
+
+	SessionParams session_params;
+	session_params.samples = 1;
+	session_params.tile_size = make_int2(BENCH_NETWORK_TILE_SIZE, BENCH_NETWORK_TILE_SIZE);
+
+	num_tiles = 0;
+
+	/* scene upload is not part of tile streaming, and not included in the time */
+	return bench_render(session_params, SceneParams(), DEVICE_NETWORK,
+		function_bind(&bench_mesh_scene, _1),
+		function_bind(&bench_network_count_tile, _1, &num_tiles));
+}
+
+static void bench_network()
+{
+	const char *protocols[] = {"text", "binary", "lzo", "lzma"};
+
+	printf("Network device, %dx%d tiles, best of %d\n",
+		BENCH_NETWORK_TILE_SIZE, BENCH_NETWORK_TILE_SIZE, bench_options.repeat);
+	printf("%10s %10s %12s\n", "Protocol", "Time", "Tiles/sec");
+
+	for(size_t i = 0; i < sizeof(protocols)/sizeof(*protocols); i++) {
+		double best = DBL_MAX;
+		int num_tiles = 0;
+
+		for(int j = 0; j < bench_options.repeat; j++)
+			best = min(best, bench_network_render(protocols[i], num_tiles));
+
+		printf("%10s %9.3fs %12.1f\n", protocols[i], best, (best > 0.0)? num_tiles/best: 0.0);
+	}
+}
+
+#endif
+
+static void options_parse(int argc, const char **argv)
+{
+	bench_options.task = false;
+	bench_options.bvh = false;
+	bench_options.lights = false;
+	bench_options.mesh = false;
+	bench_options.network = false;
+	bench_options.hair = false;
+	bench_options.threads = 0;
+	bench_options.tasks = 1000000;
+	bench_options.triangles = 1000000;
+	bench_options.strands = 100000;
+	bench_options.num_lights = 1000;
+	bench_options.samples = 16;
+	bench_options.repeat = 3;
+
+	ArgParse ap;
+	bool help = false;
+
+	ap.options ("Usage: cycles_bench [options]",
+		"--task", &bench_options.task, "Benchmark task scheduler throughput versus thread count",
+		"--bvh", &bench_options.bvh, "Benchmark BVH build time and SAH cost versus thread count",
+		"--lights", &bench_options.lights, "Benchmark noise of uniform and light tree picking with many lamps",
+		"--mesh", &bench_options.mesh, "Benchmark memory and render time of regular and compact triangle storage",
+		"--hair", &bench_options.hair, "Benchmark BVH build and render time of a hair patch",
+#ifdef WITH_NETWORK
+		"--network", &bench_options.network, "Benchmark tiles/sec of each network protocol, requires a local cycles_server",
+#endif
+		"--threads %d", &bench_options.threads, "Maximum number of threads (0 for automatic)",
+		"--tasks %d", &bench_options.tasks, "Number of tasks per task scheduler run",
+		"--triangles %d", &bench_options.triangles, "Number of triangles of each reference mesh",
+		"--strands %d", &bench_options.strands, "Number of strands in the hair scene",
+		"--num-lights %d", &bench_options.num_lights, "Number of lamps in the light sampling scene",
+		"--samples %d", &bench_options.samples, "Number of samples per pixel for light sampling",
+		"--repeat %d", &bench_options.repeat, "Number of runs per measurement, best is reported",
+		"--help", &help, "Print help message",
+		NULL);
+
+	if(ap.parse(argc, argv) < 0) {
+		fprintf(stderr, "%s\n", ap.geterror().c_str());
+		ap.usage();
+		exit(EXIT_FAILURE);
+	}
+	else if(help || !(bench_options.task || bench_options.bvh || bench_options.lights || bench_options.mesh ||
+	                 bench_options.hair || bench_options.network)) {
+		ap.usage();
+		exit(EXIT_SUCCESS);
+	}
+
+	if(bench_options.threads < 0 || bench_options.tasks <= 0 || bench_options.triangles <= 0 ||
+	   bench_options.strands <= 0 || bench_options.num_lights <= 0 || bench_options.samples <= 0 || bench_options.repeat <= 0) {
+		fprintf(stderr, "Invalid benchmark parameters\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+CCL_NAMESPACE_END
+
+using namespace ccl;
+
+int main(int argc, const char **argv)
+{
+	options_parse(argc, argv);
+
+	if(bench_options.task)
+		bench_task();
+	if(bench_options.bvh)
+		bench_bvh();
+	if(bench_options.lights)
+		bench_lights();
+	if(bench_options.mesh)
+		bench_mesh();
+	if(bench_options.hair)
+		bench_hair();
+#ifdef WITH_NETWORK
+	if(bench_options.network)
+		bench_network();
+#endif
+
+	return 0;
+}
+
@@ -19,15 +19,20 @@
 #include "buffers.h"
 #include "camera.h"
 #include "device.h"
+#include "film.h"
+#include "integrator.h"
 #include "scene.h"
 #include "session.h"
+#include "util_color.h"
 
 #include "util_args.h"
 #include "util_foreach.h"
 #include "util_function.h"
+#include "util_image.h"
 #include "util_path.h"
 #include "util_progress.h"
 #include "util_string.h"
+#include "util_task.h"
 #include "util_time.h"
 
 #ifdef WITH_CYCLES_STANDALONE_GUI
@@ -42,10 +47,15 @@ struct Options {
 	Session *session;
 	Scene *scene;
 	string filepath;
+	vector<string> filepaths;
 	int width, height;
 	SceneParams scene_params;
 	SessionParams session_params;
 	bool quiet;
+	bool light_tree;
+	bool batch;
+	int frame_start, frame_end;
+	PassType debug_pass;
 } options;
 
 static void session_print(const string& str)
@@ -79,6 +89,18 @@ static void session_print_status()
 	if(substatus != "")
 		status += ": " + substatus;
 
+	/* image cache hit rate */
+	uint64_t cache_hits, cache_misses;
+	size_t cache_memory;
+
+	options.session->progress.get_image_cache_stats(cache_hits, cache_misses, cache_memory);
+
+	if(cache_hits + cache_misses > 0) {
+		status += string_printf("   Tex Cache %.2fM, %.1f%% hits",
+			(float)cache_memory / 1024.0f / 1024.0f,
+			100.0f * (float)cache_hits / (float)(cache_hits + cache_misses));
+	}
+
 	/* print status */
 	status = string_printf("Sample %d   %s", sample, status.c_str());
 	session_print(status);
@@ -92,6 +114,12 @@ static BufferParams& session_buffer_params()
 	buffer_params.full_width = options.width;
 	buffer_params.full_height = options.height;
 
+	/* passes to estimate noise level for adaptive sampling */
+	if(options.session_params.adaptive_sampling) {
+		Pass::add(PASS_VARIANCE, buffer_params.passes);
+		Pass::add(PASS_SAMPLE_COUNT, buffer_params.passes);
+	}
+
 	return buffer_params;
 }
 
@@ -100,6 +128,9 @@ static void session_init()
 	options.session = new Session(options.session_params);
 	options.session->reset(session_buffer_params(), options.session_params.samples);
 	options.session->scene = options.scene;
+
+	options.scene->film->tag_passes_update(options.scene, session_buffer_params().passes);
+	options.scene->film->tag_update(options.scene);
 	
 	if(options.session_params.background && !options.quiet)
 		options.session->progress.set_update_callback(function_bind(&session_print_status));
@@ -117,6 +148,9 @@ static void scene_init(int width, int height)
 {
 	options.scene = new Scene(options.scene_params, options.session_params.device);
 	xml_read_file(options.scene, options.filepath.c_str());
+
+	if(options.light_tree)
+		options.scene->integrator->use_light_tree = true;
 	
 	if (width == 0 || height == 0) {
 		options.width = options.scene->camera->width;
@@ -194,9 +228,383 @@ static void keyboard(unsigned char key)
 }
 #endif
 
+/* Batch Rendering
+ *
+ * Renders a list of scene files, or a frame range when file paths contain
+ * '#' characters, without user interface. The session, device, loaded
+ * kernels and task scheduler are reused between jobs, only the scene is
+ * recreated. Timings of each phase are printed to stdout as JSON. */
+
+struct BatchJob {
+	string filepath;
+	string output_path;
+	int frame;
+
+	int width, height;
+	int samples;
+
+	bool success;
+	string error;
+
+	/* timings in seconds */
+	double load_time;
+	double bvh_time;
+	double device_time;
+	double render_time;
+	double convert_time;
+	double write_time;
+	double total_time;
+};
+
+static struct BatchState {
+	vector<float> pixels;
+	int width;
+	float exposure;
+	double convert_time;
+} batch;
+
+static string batch_frame_path(const string& path, int frame)
+{
+	/* replace a run of '#' with the zero padded frame number */
+	size_t start = path.find('#');
+
+	if(start == string::npos)
+		return path;
+
+	size_t end = path.find_first_not_of('#', start);
+
+	if(end == string::npos)
+		end = path.size();
+
+	string number = string_printf("%0*d", (int)(end - start), frame);
+
+	return path.substr(0, start) + number + path.substr(end);
+}
+
+static void batch_jobs(vector<BatchJob>& jobs)
+{
+	string output_path = options.session_params.output_path;
+
+	foreach(const string& filepath, options.filepaths) {
+		bool use_frames = (filepath.find('#') != string::npos);
+		int frame_start = (use_frames)? options.frame_start: 0;
+		int frame_end = (use_frames)? options.frame_end: 0;
+
+		for(int frame = frame_start; frame <= frame_end; frame++) {
+			BatchJob job;
+
+			job.filepath = batch_frame_path(filepath, frame);
+			job.frame = frame;
+			job.output_path = output_path;
+			job.width = job.height = job.samples = 0;
+			job.success = false;
+			job.load_time = job.bvh_time = job.device_time = 0.0;
+			job.render_time = job.convert_time = job.write_time = job.total_time = 0.0;
+
+			jobs.push_back(job);
+		}
+	}
+
+	/* without frame numbers in the output path, number images by job */
+	if(output_path != "" && output_path.find('#') == string::npos && jobs.size() > 1) {
+		size_t dot = output_path.rfind('.');
+
+		if(dot == string::npos || dot < output_path.rfind('/'))
+			dot = output_path.size();
+
+		output_path = output_path.substr(0, dot) + "_####" + output_path.substr(dot);
+
+		for(size_t i = 0; i < jobs.size(); i++)
+			jobs[i].frame = i;
+	}
+
+	foreach(BatchJob& job, jobs)
+		job.output_path = batch_frame_path(output_path, job.frame);
+}
+
+static void batch_write_render_tile(RenderTile& rtile)
+{
+	/* film convert, from accumulated samples to pixels */
+	double start = time_dt();
+
+	RenderBuffers *buffers = rtile.buffers;
+	vector<float> tile(rtile.w*rtile.h*4);
+
+	buffers->copy_from_device();
+
+	if(options.debug_pass != PASS_NONE) {
+		/* ray statistics per sample, as gray */
+		if(buffers->get_pass_rect(options.debug_pass, 1.0f, rtile.sample, 1, &tile[0])) {
+			for(int y = 0; y < rtile.h; y++) {
+				float *out = &batch.pixels[((rtile.y + y)*batch.width + rtile.x)*4];
+
+				for(int x = 0; x < rtile.w; x++, out += 4) {
+					float f = tile[y*rtile.w + x];
+					out[0] = out[1] = out[2] = f;
+					out[3] = 1.0f;
+				}
+			}
+		}
+	}
+	else if(buffers->get_pass_rect(PASS_COMBINED, batch.exposure, rtile.sample, 4, &tile[0])) {
+		for(int y = 0; y < rtile.h; y++) {
+			float *in = &tile[y*rtile.w*4];
+			float *out = &batch.pixels[((rtile.y + y)*batch.width + rtile.x)*4];
+
+			memcpy(out, in, sizeof(float)*rtile.w*4);
+		}
+	}
+
+	batch.convert_time += time_dt() - start;
+}
+
+static bool batch_write_image(const string& filepath, int width, int height)
+{
+	ImageOutput *out = ImageOutput::create(filepath);
+
+	if(!out)
+		return false;
+
+	ImageSpec spec(width, height, 4, TypeDesc::FLOAT);
+
+	if(!out->open(filepath, spec)) {
+		delete out;
+		return false;
+	}
+
+	/* formats without floats get display colors */
+	if(out->spec().format != TypeDesc::FLOAT && out->spec().format != TypeDesc::HALF) {
+		for(size_t i = 0; i < batch.pixels.size(); i += 4) {
+			float3 rgb = make_float3(batch.pixels[i], batch.pixels[i+1], batch.pixels[i+2]);
+			rgb = color_scene_linear_to_srgb(rgb);
+
+			batch.pixels[i] = rgb.x;
+			batch.pixels[i+1] = rgb.y;
+			batch.pixels[i+2] = rgb.z;
+		}
+	}
+
+	/* conversion for different top/bottom convention */
+	int scanlinesize = width*4*sizeof(float);
+	bool success = out->write_image(TypeDesc::FLOAT,
+		(uchar*)&batch.pixels[0] + (height-1)*scanlinesize,
+		AutoStride,
+		-scanlinesize,
+		AutoStride);
+
+	out->close();
+	delete out;
+
+	return success;
+}
+
+static void batch_render_job(BatchJob& job)
+{
+	Session *session = options.session;
+	double job_start = time_dt();
+
+	/* load scene, freeing the previous one and its device memory */
+	Scene *scene = new Scene(options.scene_params, options.session_params.device);
+
+	xml_read_file(scene, job.filepath.c_str());
+
+	if(options.light_tree)
+		scene->integrator->use_light_tree = true;
+
+	job.load_time = time_dt() - job_start;
+	job.width = (options.width)? options.width: scene->camera->width;
+	job.height = (options.height)? options.height: scene->camera->height;
+	job.samples = options.session_params.samples;
+
+	delete session->scene;
+	session->scene = scene;
+
+	if(job.width <= 0 || job.height <= 0) {
+		job.error = "Invalid image size";
+		return;
+	}
+
+	BufferParams buffer_params;
+	buffer_params.width = job.width;
+	buffer_params.height = job.height;
+	buffer_params.full_width = job.width;
+	buffer_params.full_height = job.height;
+
+	if(options.session_params.adaptive_sampling) {
+		Pass::add(PASS_VARIANCE, buffer_params.passes);
+		Pass::add(PASS_SAMPLE_COUNT, buffer_params.passes);
+	}
+
+	if(options.debug_pass != PASS_NONE)
+		Pass::add(options.debug_pass, buffer_params.passes);
+
+	batch.pixels.clear();
+	batch.pixels.resize(job.width*job.height*4, 0.0f);
+	batch.width = job.width;
+	batch.exposure = scene->film->exposure;
+	batch.convert_time = 0.0;
+
+	scene->film->tag_passes_update(scene, buffer_params.passes);
+	scene->film->tag_update(scene);
+
+	/* render */
+	double render_start = time_dt();
+
+	session->reset(buffer_params, job.samples);
+	session->start();
+	session->wait();
+
+	double render_time = time_dt() - render_start;
+
+	job.bvh_time = scene->update_times.bvh;
+	job.device_time = scene->update_times.device;
+	job.convert_time = batch.convert_time;
+	job.render_time = max(render_time - job.bvh_time - job.device_time - job.convert_time, 0.0);
+
+	string status, substatus;
+	session->progress.get_status(status, substatus);
+
+	if(session->progress.get_cancel()) {
+		job.error = session->progress.get_cancel_message();
+	}
+	else if(status == "Error") {
+		job.error = substatus;
+	}
+	else {
+		job.success = true;
+
+		/* write image */
+		if(job.output_path != "") {
+			double write_start = time_dt();
+
+			if(!batch_write_image(job.output_path, job.width, job.height)) {
+				job.error = "Failed to write " + job.output_path;
+				job.success = false;
+			}
+
+			job.write_time = time_dt() - write_start;
+		}
+	}
+
+	job.total_time = time_dt() - job_start;
+}
+
+static string json_string(const string& str)
+{
+	string result = "\"";
+
+	foreach(char c, str) {
+		if(c == '"' || c == '\\')
+			result += string("\\") + c;
+		else if((unsigned char)c < 0x20)
+			result += string_printf("\\u%04x", (int)c);
+		else
+			result += c;
+	}
+
+	return result + "\"";
+}
+
+static void batch_print_json(const vector<BatchJob>& jobs, double kernel_time, double total_time)
+{
+	double total_render_time = 0.0;
+	double total_pixel_samples = 0.0;
+	int num_failed = 0;
+
+	printf("{\n");
+	printf("  \"device\": %s,\n", json_string(options.session_params.device.description).c_str());
+	printf("  \"threads\": %d,\n", TaskScheduler::num_threads());
+	printf("  \"kernel_load_time\": %.6f,\n", kernel_time);
+	printf("  \"jobs\": [");
+
+	for(size_t i = 0; i < jobs.size(); i++) {
+		const BatchJob& job = jobs[i];
+		double pixel_samples = (double)job.width*job.height*job.samples;
+
+		if(job.success) {
+			total_render_time += job.render_time;
+			total_pixel_samples += pixel_samples;
+		}
+		else
+			num_failed++;
+
+		printf("%s\n    {\n", (i == 0)? "": ",");
+		printf("      \"file\": %s,\n", json_string(job.filepath).c_str());
+		printf("      \"frame\": %d,\n", job.frame);
+		printf("      \"output\": %s,\n", json_string(job.output_path).c_str());
+		printf("      \"success\": %s,\n", (job.success)? "true": "false");
+		printf("      \"error\": %s,\n", json_string(job.error).c_str());
+		printf("      \"width\": %d,\n", job.width);
+		printf("      \"height\": %d,\n", job.height);
+		printf("      \"samples\": %d,\n", job.samples);
+		printf("      \"time\": {\"scene_load\": %.6f, \"bvh_build\": %.6f, \"device_update\": %.6f, "
+		       "\"path_trace\": %.6f, \"film_convert\": %.6f, \"image_write\": %.6f, \"total\": %.6f},\n",
+		       job.load_time, job.bvh_time, job.device_time, job.render_time,
+		       job.convert_time, job.write_time, job.total_time);
+		printf("      \"samples_per_second\": %.1f\n",
+		       (job.success && job.render_time > 0.0)? pixel_samples/job.render_time: 0.0);
+		printf("    }");
+	}
+
+	printf("\n  ],\n");
+	printf("  \"failed\": %d,\n", num_failed);
+	printf("  \"total_time\": %.6f,\n", total_time);
+	printf("  \"samples_per_second\": %.1f\n",
+	       (total_render_time > 0.0)? total_pixel_samples/total_render_time: 0.0);
+	printf("}\n");
+
+	fflush(stdout);
+}
+
+static int batch_render()
+{
+	double start = time_dt();
+
+	vector<BatchJob> jobs;
+	batch_jobs(jobs);
+
+	/* one session for all jobs, so kernels are loaded once */
+	options.session = new Session(options.session_params);
+	options.session->write_render_tile_cb = function_bind(&batch_write_render_tile, _1);
+
+	double kernel_start = time_dt();
+
+	if(!options.session->load_kernels()) {
+		string status, substatus;
+		options.session->progress.get_status(status, substatus);
+		fprintf(stderr, "%s\n", substatus.c_str());
+
+		session_exit();
+		return EXIT_FAILURE;
+	}
+
+	double kernel_time = time_dt() - kernel_start;
+
+	foreach(BatchJob& job, jobs) {
+		batch_render_job(job);
+
+		if(!job.success)
+			fprintf(stderr, "Failed to render %s: %s\n", job.filepath.c_str(), job.error.c_str());
+	}
+
+	batch_print_json(jobs, kernel_time, time_dt() - start);
+
+	bool success = true;
+
+	foreach(BatchJob& job, jobs)
+		success = success && job.success;
+
+	session_exit();
+
+	return (success)? EXIT_SUCCESS: EXIT_FAILURE;
+}
+
 static int files_parse(int argc, const char *argv[])
 {
-	if(argc > 0)
+	for(int i = 0; i < argc; i++)
+		options.filepaths.push_back(argv[i]);
+
+	if(argc > 0 && options.filepath == "")
 		options.filepath = argv[0];
 
 	return 0;
@@ -209,6 +617,11 @@ static void options_parse(int argc, const char **argv)
 	options.filepath = "";
 	options.session = NULL;
 	options.quiet = false;
+	options.light_tree = false;
+	options.batch = false;
+	options.frame_start = 1;
+	options.frame_end = 1;
+	options.debug_pass = PASS_NONE;
 
 	/* device names */
 	string device_names = "";
@@ -224,6 +637,9 @@ static void options_parse(int argc, const char **argv)
 		device_names += Device::string_from_type(type);
 	}
 
+	/* ray statistics pass */
+	string debug_pass_name = "";
+
 	/* shading system */
 	string ssname = "svm";
 	string shadingsystems = "Shading system to use: svm";
@@ -236,15 +652,30 @@ static void options_parse(int argc, const char **argv)
 	ArgParse ap;
 	bool help = false;
 
-	ap.options ("Usage: cycles [options] file.xml",
+	ap.options ("Usage: cycles [options] file.xml [file.xml ...]",
 		"%*", files_parse, "",
 		"--device %s", &devicename, ("Devices to use: " + device_names).c_str(),
 		"--shadingsys %s", &ssname, "Shading system to use: svm, osl",
 		"--background", &options.session_params.background, "Render in background, without user interface",
 		"--quiet", &options.quiet, "In background mode, don't print progress messages",
+		"--batch", &options.batch, "Render all files without user interface, reusing the device, and print timings as JSON",
+		"--frame-start %d", &options.frame_start, "In batch mode, first frame to substitute for # in file paths",
+		"--frame-end %d", &options.frame_end, "In batch mode, last frame to substitute for # in file paths",
+		"--debug-pass %s", &debug_pass_name, "In batch mode, write ray statistics instead of the image: bvh, primitives, shaders, bounces (needs WITH_CYCLES_RAY_STATS)",
 		"--samples %d", &options.session_params.samples, "Number of samples to render",
 		"--output %s", &options.session_params.output_path, "File path to write output image",
 		"--threads %d", &options.session_params.threads, "CPU Rendering Threads",
+		"--ray-packets", &options.session_params.use_ray_packets, "Trace coherent camera rays in packets on the CPU",
+		"--adaptive", &options.session_params.adaptive_sampling, "Stop rendering tiles once their noise level is below the threshold",
+		"--adaptive-threshold %f", &options.session_params.adaptive_threshold, "Noise level at which adaptive sampling stops a tile",
+		"--adaptive-min-samples %d", &options.session_params.adaptive_min_samples, "Minimum number of samples before adaptive sampling stops a tile",
+		"--texture-cache %d", &options.scene_params.texture_cache_size, "Memory limit in MB for image textures loaded on demand, 0 to disable",
+		"--texture-cache-disk-size %d", &options.scene_params.texture_cache_disk_size, "Maximum size in MB of the tiled texture files on disk, 0 for unlimited",
+		"--bvh-cache", &options.scene_params.use_bvh_cache, "Cache built BVHs to disk and reuse them for unchanged geometry",
+		"--bvh-cache-dir %s", &options.scene_params.bvh_cache_path, "Directory for the BVH cache, can be shared between machines",
+		"--bvh-cache-size %d", &options.scene_params.bvh_cache_size, "Maximum size in MB of the BVH cache directory, 0 for unlimited",
+		"--compact-triangles", &options.scene_params.use_compact_triangles, "Store triangles compactly, using less memory at some render time cost",
+		"--light-tree", &options.light_tree, "Sample lights with a light tree, for scenes with many lights",
 		"--width  %d", &options.width, "Window width in pixel",
 		"--height %d", &options.height, "Window height in pixel",
 		"--list-devices", &list, "List information about all available devices",
@@ -273,6 +704,15 @@ static void options_parse(int argc, const char **argv)
 		exit(EXIT_SUCCESS);
 	}
 
+	if(debug_pass_name == "bvh")
+		options.debug_pass = PASS_BVH_TRAVERSAL_STEPS;
+	else if(debug_pass_name == "primitives")
+		options.debug_pass = PASS_PRIMITIVE_TESTS;
+	else if(debug_pass_name == "shaders")
+		options.debug_pass = PASS_SHADER_EVALUATIONS;
+	else if(debug_pass_name == "bounces")
+		options.debug_pass = PASS_RAY_BOUNCES;
+
 	if(ssname == "osl")
 		options.scene_params.shadingsystem = SceneParams::OSL;
 	else if(ssname == "svm")
@@ -326,6 +766,25 @@ static void options_parse(int argc, const char **argv)
 		fprintf(stderr, "No file path specified\n");
 		exit(EXIT_FAILURE);
 	}
+	else if(options.batch && options.session_params.samples == INT_MAX) {
+		fprintf(stderr, "Batch mode needs a number of samples\n");
+		exit(EXIT_FAILURE);
+	}
+	else if(debug_pass_name != "" && options.debug_pass == PASS_NONE) {
+		fprintf(stderr, "Unknown debug pass: %s\n", debug_pass_name.c_str());
+		exit(EXIT_FAILURE);
+	}
+	else if(options.batch && options.frame_end < options.frame_start) {
+		fprintf(stderr, "Invalid frame range: %d to %d\n", options.frame_start, options.frame_end);
+		exit(EXIT_FAILURE);
+	}
+
+	if(options.batch) {
+		/* batch mode loads scenes per job */
+		options.session_params.background = true;
+		options.quiet = true;
+		return;
+	}
 
 	/* load scene */
 	scene_init(options.width, options.height);
@@ -339,6 +798,9 @@ int main(int argc, const char **argv)
 {
 	path_init();
 	options_parse(argc, argv);
+
+	if(options.batch)
+		return batch_render();
 	
 #ifdef WITH_CYCLES_STANDALONE_GUI
 	if(options.session_params.background) {
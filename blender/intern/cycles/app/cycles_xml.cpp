@@ -283,6 +283,7 @@ static void xml_read_integrator(const XMLReadState& state, pugi::xml_node node)
 	
 	xml_read_int(&integrator->seed, node, "seed");
 	xml_read_float(&integrator->sample_clamp, node, "sample_clamp");
+	xml_read_bool(&integrator->use_light_tree, node, "light_tree");
 }
 
 /* Camera */
@@ -707,10 +708,20 @@ static void xml_read_mesh(const XMLReadState& state, pugi::xml_node node)
 
 		/* subdivide */
 		DiagSplit dsplit;
-		//dsplit.camera = state.scene->camera;
-		//dsplit.dicing_rate = 5.0f;
+		bool adaptive = false;
+		int max_triangles = 0;
+
 		dsplit.dicing_rate = state.dicing_rate;
 		xml_read_float(&dsplit.dicing_rate, node, "dicing_rate");
+		xml_read_int(&max_triangles, node, "max_triangles");
+		dsplit.max_triangles = max(max_triangles, 0);
+
+		/* adaptive dicing uses the camera as read so far */
+		if(xml_read_bool(&adaptive, node, "adaptive") && adaptive) {
+			dsplit.camera = state.scene->camera;
+			dsplit.objecttoworld = state.tfm;
+		}
+
 		sdmesh.tessellate(&dsplit, false, mesh, shader, smooth);
 	}
 	else {
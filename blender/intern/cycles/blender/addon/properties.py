@@ -21,7 +21,8 @@ from bpy.props import (BoolProperty,
                        EnumProperty,
                        FloatProperty,
                        IntProperty,
-                       PointerProperty)
+                       PointerProperty,
+                       StringProperty)
 
 # enums
 
@@ -221,6 +222,13 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
                 default='SOBOL',
                 )
 
+        cls.use_light_tree = BoolProperty(
+                name="Light Tree",
+                description="Pick lights by their estimated contribution to the shading point, "
+                            "reduces noise in scenes with many lights",
+                default=False,
+                )
+
         cls.use_layer_samples = EnumProperty(
                 name="Layer Samples",
                 description="How to use per render layer sample settings",
@@ -337,6 +345,33 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
                 default=0.0,
                 )
 
+        cls.use_adaptive_sampling = BoolProperty(
+                name="Adaptive Sampling",
+                description="Stop rendering tiles once their noise level is below the threshold, "
+                            "only for final renders on the CPU without progressive refine",
+                default=False,
+                )
+        cls.adaptive_threshold = FloatProperty(
+                name="Adaptive Threshold",
+                description="Noise level at which a tile stops sampling, "
+                            "lower values give less noise but take longer to render",
+                min=0.0001, max=1.0,
+                default=0.01,
+                precision=4,
+                )
+        cls.adaptive_min_samples = IntProperty(
+                name="Adaptive Min Samples",
+                description="Minimum number of samples per pixel before a tile can stop sampling",
+                min=1, max=2147483647,
+                default=16,
+                )
+        cls.debug_adaptive_samples = BoolProperty(
+                name="Show Sample Count",
+                description="Output the fraction of samples used by each tile instead of the "
+                            "combined pass, for tuning adaptive sampling",
+                default=False,
+                )
+
         cls.debug_tile_size = IntProperty(
                 name="Tile Size",
                 description="",
@@ -382,11 +417,51 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
                 description="Use BVH spatial splits: longer builder time, faster render",
                 default=False,
                 )
+        cls.use_compact_triangles = BoolProperty(
+                name="Compact Triangles",
+                description="Store triangles with indexed vertices and packed normals instead of "
+                            "precomputed intersection data: less memory, slightly slower render",
+                default=False,
+                )
+        cls.use_ray_packets = BoolProperty(
+                name="Ray Packets",
+                description="Trace camera rays of neighbouring pixels together on the CPU, "
+                            "faster for coherent scenes without hair or motion blur",
+                default=False,
+                )
+        cls.texture_cache_size = IntProperty(
+                name="Texture Cache",
+                description="Memory limit in megabytes for image textures, which are then loaded "
+                            "in tiles on demand instead of all at once (0 to disable, CPU only)",
+                min=0, max=65536,
+                default=0,
+                )
+        cls.texture_cache_disk_size = IntProperty(
+                name="Texture Disk Cache",
+                description="Maximum size in megabytes of the tiled texture files in the user cache "
+                            "directory, least recently used files are removed first (0 for unlimited)",
+                min=0, max=1048576,
+                default=4096,
+                )
         cls.use_cache = BoolProperty(
                 name="Cache BVH",
-                description="Cache last built BVH to disk for faster re-render if no geometry changed",
+                description="Cache built BVHs to disk for faster re-render if no geometry changed",
                 default=False,
                 )
+        cls.cache_directory = StringProperty(
+                name="Cache Directory",
+                description="Absolute directory to store cached BVHs in, can be shared between "
+                            "render farm nodes (empty to use the user cache directory)",
+                subtype='DIR_PATH',
+                default="",
+                )
+        cls.cache_size = IntProperty(
+                name="Cache Size",
+                description="Maximum size of the BVH cache directory in megabytes, least recently "
+                            "used BVHs are removed first (0 for unlimited)",
+                min=0, max=1048576,
+                default=4096,
+                )
         cls.tile_order = EnumProperty(
                 name="Tile Order",
                 description="Tile order for rendering",
@@ -655,10 +730,22 @@ class CyclesMeshSettings(bpy.types.PropertyGroup):
                 )
         cls.dicing_rate = FloatProperty(
                 name="Dicing Rate",
-                description="",
+                description="Size of micropolygons, in pixels for adaptive dicing and object space units otherwise",
                 min=0.001, max=1000.0,
                 default=1.0,
                 )
+        cls.use_adaptive_dicing = BoolProperty(
+                name="Adaptive Dicing",
+                description="Dice finer close to the camera, with the dicing rate in pixels",
+                default=False,
+                )
+        cls.max_triangles = IntProperty(
+                name="Max Triangles",
+                description="Increase the dicing rate when subdivision would generate more triangles "
+                            "than this, 0 for no limit",
+                min=0, max=2147483647,
+                default=0,
+                )
 
     @classmethod
     def unregister(cls):
@@ -143,6 +143,19 @@ class CyclesRender_PT_sampling(CyclesButtonsPanel, Panel):
         if cscene.feature_set == 'EXPERIMENTAL' and (device_type == 'NONE' or cscene.device == 'CPU'):
             layout.row().prop(cscene, "sampling_pattern", text="Pattern")
 
+        if cscene.progressive == 'PATH':
+            layout.row().prop(cscene, "use_light_tree")
+
+        row = layout.row()
+        row.prop(cscene, "use_adaptive_sampling")
+        sub = row.row(align=True)
+        sub.active = cscene.use_adaptive_sampling
+        sub.prop(cscene, "adaptive_threshold", text="Threshold")
+        sub.prop(cscene, "adaptive_min_samples", text="Min")
+
+        if cscene.use_adaptive_sampling:
+            layout.row().prop(cscene, "debug_adaptive_samples")
+
         for rl in scene.render.layers:
             if rl.samples > 0:
                 layout.separator()
@@ -281,12 +294,22 @@ class CyclesRender_PT_performance(CyclesButtonsPanel, Panel):
 
         col.label(text="Final Render:")
         col.prop(cscene, "use_cache")
-        col.prop(rd, "use_persistent_data", text="Persistent Images")
+        sub = col.column()
+        sub.active = cscene.use_cache
+        sub.prop(cscene, "cache_directory", text="")
+        sub.prop(cscene, "cache_size")
+        col.prop(rd, "use_persistent_data", text="Persistent Data")
+        col.prop(cscene, "texture_cache_size")
+        sub = col.column()
+        sub.active = cscene.texture_cache_size != 0
+        sub.prop(cscene, "texture_cache_disk_size")
 
         col.separator()
 
         col.label(text="Acceleration structure:")
         col.prop(cscene, "debug_use_spatial_splits")
+        col.prop(cscene, "use_compact_triangles")
+        col.prop(cscene, "use_ray_packets")
 
 
 class CyclesRender_PT_opengl(CyclesButtonsPanel, Panel):
@@ -561,7 +584,12 @@ class Cycles_PT_mesh_displacement(CyclesButtonsPanel, Panel):
 
         layout.prop(cdata, "displacement_method", text="Method")
         layout.prop(cdata, "use_subdivision")
-        layout.prop(cdata, "dicing_rate")
+
+        sub = layout.column()
+        sub.active = cdata.use_subdivision
+        sub.prop(cdata, "dicing_rate")
+        sub.prop(cdata, "use_adaptive_dicing")
+        sub.prop(cdata, "max_triangles")
 
 
 class Cycles_PT_mesh_normals(CyclesButtonsPanel, Panel):
@@ -27,6 +27,7 @@
 #include "subd_split.h"
 
 #include "util_foreach.h"
+#include "util_function.h"
 
 #include "mikktspace.h"
 
@@ -365,7 +366,7 @@ static void create_mesh(Scene *scene, Mesh *mesh, BL::Mesh b_mesh, const vector<
 	}
 }
 
-static void create_subd_mesh(Mesh *mesh, BL::Mesh b_mesh, PointerRNA *cmesh, const vector<uint>& used_shaders)
+static void create_subd_mesh(Scene *scene, Mesh *mesh, BL::Object b_ob, BL::Mesh b_mesh, PointerRNA *cmesh, const vector<uint>& used_shaders, Progress& progress)
 {
 	/* create subd mesh */
 	SubdMesh sdmesh;
@@ -397,13 +398,42 @@ static void create_subd_mesh(Mesh *mesh, BL::Mesh b_mesh, PointerRNA *cmesh, con
 
 	/* subdivide */
 	DiagSplit dsplit;
-	dsplit.camera = NULL;
 	dsplit.dicing_rate = RNA_float_get(cmesh, "dicing_rate");
+	dsplit.max_triangles = RNA_int_get(cmesh, "max_triangles");
+
+	if(RNA_boolean_get(cmesh, "use_adaptive_dicing")) {
+		/* instanced meshes are diced for the first object using them */
+		dsplit.camera = scene->camera;
+		dsplit.objecttoworld = get_transform(b_ob.matrix_world());
+	}
 
 	sdmesh.tessellate(&dsplit, false, mesh, used_shaders[0], true);
+
+	/* show dicing statistics while synchronizing the object */
+	progress.set_sync_substatus(dsplit.stats.full_report(b_ob.name()));
 }
 
-/* Sync */
+/* Sync
+ *
+ * The conversion of derived meshes runs in a task pool, as it only reads
+ * the derived mesh and writes the Cycles mesh. Creating and freeing derived
+ * meshes and hair sync use the Blender API on the main thread. */
+
+struct BlenderSync::MeshSync {
+	MeshSync(Mesh *mesh_, BL::Object b_ob_, bool object_updated_)
+	: mesh(mesh_), b_ob(b_ob_), b_mesh(PointerRNA_NULL),
+	  object_updated(object_updated_), use_hair(false)
+	{}
+
+	Mesh *mesh;
+	BL::Object b_ob;
+	BL::Mesh b_mesh;
+	bool object_updated;
+	bool use_hair;
+
+	vector<Mesh::Triangle> oldtriangle;
+	vector<Mesh::CurveKey> oldcurve_keys;
+};
 
 Mesh *BlenderSync::sync_mesh(BL::Object b_ob, bool object_updated, bool hide_tris)
 {
@@ -461,12 +491,13 @@ Mesh *BlenderSync::sync_mesh(BL::Object b_ob, bool object_updated, bool hide_tri
 
 	/* create derived mesh */
 	PointerRNA cmesh = RNA_pointer_get(&b_ob_data.ptr, "cycles");
+	MeshSync *sync = new MeshSync(mesh, b_ob, object_updated);
 
-	vector<Mesh::Triangle> oldtriangle = mesh->triangles;
+	sync->oldtriangle.swap(mesh->triangles);
 	
 	/* compares curve_keys rather than strands in order to handle quick hair
 	 * adjustsments in dynamic BVH - other methods could probably do this better*/
-	vector<Mesh::CurveKey> oldcurve_keys = mesh->curve_keys;
+	sync->oldcurve_keys.swap(mesh->curve_keys);
 
 	mesh->clear();
 	mesh->used_shaders = used_shaders;
@@ -480,18 +511,23 @@ Mesh *BlenderSync::sync_mesh(BL::Object b_ob, bool object_updated, bool hide_tri
 		BL::Mesh b_mesh = object_to_mesh(b_data, b_ob, b_scene, true, !preview, need_undeformed);
 
 		if(b_mesh) {
+			sync->b_mesh = b_mesh;
+			sync->use_hair = render_layer.use_hair;
+
 			if(render_layer.use_surfaces && !hide_tris) {
 				if(cmesh.data && experimental && RNA_boolean_get(&cmesh, "use_subdivision"))
-					create_subd_mesh(mesh, b_mesh, &cmesh, used_shaders);
-				else
-					create_mesh(scene, mesh, b_mesh, used_shaders);
-			}
-
-			if(render_layer.use_hair)
-				sync_curves(mesh, b_mesh, b_ob, object_updated);
+					create_subd_mesh(scene, mesh, b_ob, b_mesh, &cmesh, used_shaders, progress);
+				else {
+					/* RNA iterators allocate, while blender allocates on this
+					 * thread too, which is only safe with threaded malloc */
+					if(!mesh_sync_threaded_malloc) {
+						BLI_begin_threaded_malloc();
+						mesh_sync_threaded_malloc = true;
+					}
 
-			/* free derived mesh */
-			b_data.meshes.remove(b_mesh);
+					mesh_sync_pool.push(function_bind(&create_mesh, scene, mesh, b_mesh, used_shaders));
+				}
+			}
 		}
 	}
 
@@ -507,26 +543,66 @@ Mesh *BlenderSync::sync_mesh(BL::Object b_ob, bool object_updated, bool hide_tri
 			mesh->displacement_method = Mesh::DISPLACE_BOTH;
 	}
 
-	/* tag update */
-	bool rebuild = false;
+	/* tag update now so the object sees the change, whether the BVH must
+	 * be rebuilt is known once the mesh is converted */
+	mesh->tag_update(scene, false);
 
-	if(oldtriangle.size() != mesh->triangles.size())
-		rebuild = true;
-	else if(oldtriangle.size()) {
-		if(memcmp(&oldtriangle[0], &mesh->triangles[0], sizeof(Mesh::Triangle)*oldtriangle.size()) != 0)
-			rebuild = true;
+	mesh_sync_queue.push_back(sync);
+
+	/* finish in batches, to limit the number of derived meshes in memory */
+	if(mesh_sync_queue.size() >= (size_t)TaskScheduler::num_threads()*4)
+		sync_mesh_finish();
+
+	return mesh;
+}
+
+void BlenderSync::sync_mesh_finish()
+{
+	mesh_sync_pool.wait_work();
+
+	if(mesh_sync_threaded_malloc) {
+		BLI_end_threaded_malloc();
+		mesh_sync_threaded_malloc = false;
 	}
 
-	if(oldcurve_keys.size() != mesh->curve_keys.size())
-		rebuild = true;
-	else if(oldcurve_keys.size()) {
-		if(memcmp(&oldcurve_keys[0], &mesh->curve_keys[0], sizeof(Mesh::CurveKey)*oldcurve_keys.size()) != 0)
+	foreach(MeshSync *sync, mesh_sync_queue) {
+		Mesh *mesh = sync->mesh;
+
+		if(sync->b_mesh) {
+			/* curves come after the triangles, which reserve clears */
+			if(sync->use_hair)
+				sync_curves(mesh, sync->b_mesh, sync->b_ob, sync->object_updated);
+
+			/* free derived mesh */
+			b_data.meshes.remove(sync->b_mesh);
+		}
+
+		/* tag update */
+		bool rebuild = false;
+		vector<Mesh::Triangle>& oldtriangle = sync->oldtriangle;
+		vector<Mesh::CurveKey>& oldcurve_keys = sync->oldcurve_keys;
+
+		if(oldtriangle.size() != mesh->triangles.size())
 			rebuild = true;
+		else if(oldtriangle.size()) {
+			if(memcmp(&oldtriangle[0], &mesh->triangles[0], sizeof(Mesh::Triangle)*oldtriangle.size()) != 0)
+				rebuild = true;
+		}
+
+		if(oldcurve_keys.size() != mesh->curve_keys.size())
+			rebuild = true;
+		else if(oldcurve_keys.size()) {
+			if(memcmp(&oldcurve_keys[0], &mesh->curve_keys[0], sizeof(Mesh::CurveKey)*oldcurve_keys.size()) != 0)
+				rebuild = true;
+		}
+
+		if(rebuild)
+			mesh->tag_update(scene, rebuild);
+
+		delete sync;
 	}
-	
-	mesh->tag_update(scene, rebuild);
 
-	return mesh;
+	mesh_sync_queue.clear();
 }
 
 void BlenderSync::sync_mesh_motion(BL::Object b_ob, Mesh *mesh, int motion)
@@ -476,6 +476,9 @@ void BlenderSync::sync_objects(BL::SpaceView3D b_v3d, int motion)
 		}
 	}
 
+	/* wait for mesh conversion, also when cancelled to free derived meshes */
+	sync_mesh_finish();
+
 	progress.set_sync_status("");
 
 	if(!cancel && !motion) {
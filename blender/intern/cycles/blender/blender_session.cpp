@@ -50,6 +50,7 @@ BlenderSession::BlenderSession(BL::RenderEngine b_engine_, BL::UserPreferences b
 	background = true;
 	last_redraw_time = 0.0;
 	start_resize_time = 0.0;
+	debug_adaptive_samples = false;
 
 	create_session();
 }
@@ -67,6 +68,7 @@ BlenderSession::BlenderSession(BL::RenderEngine b_engine_, BL::UserPreferences b
 	background = false;
 	last_redraw_time = 0.0;
 	start_resize_time = 0.0;
+	debug_adaptive_samples = false;
 
 	create_session();
 	session->start();
@@ -127,6 +129,8 @@ void BlenderSession::create_session()
 
 void BlenderSession::reset_session(BL::BlendData b_data_, BL::Scene b_scene_)
 {
+	bool scene_changed = (b_data.ptr.data != b_data_.ptr.data || b_scene.ptr.data != b_scene_.ptr.data);
+
 	b_data = b_data_;
 	b_render = b_engine.render();
 	b_scene = b_scene_;
@@ -145,7 +149,7 @@ void BlenderSession::reset_session(BL::BlendData b_data_, BL::Scene b_scene_)
 		 * them rather than trying to distinguish which settings need to be updated
 		 */
 
-		delete session;
+		free_session();
 
 		create_session();
 
@@ -153,7 +157,7 @@ void BlenderSession::reset_session(BL::BlendData b_data_, BL::Scene b_scene_)
 	}
 
 	session->progress.reset();
-	scene->reset();
+	scene->update_times.reset();
 
 	session->tile_manager.set_tile_order(session_params.tile_order);
 
@@ -162,8 +166,23 @@ void BlenderSession::reset_session(BL::BlendData b_data_, BL::Scene b_scene_)
 	 */
 	session->stats.mem_peak = session->stats.mem_used;
 
-	/* sync object should be re-created */
-	sync = new BlenderSync(b_engine, b_data, b_scene, scene, !background, session->progress, session_params.device.type == DEVICE_CPU);
+	if(sync && !scene_changed) {
+		/* scene data was kept from the previous frame, only sync what changed
+		 * since then. unchanged meshes keep their BVH, and if only object
+		 * transforms changed the scene BVH is refit */
+		sync->sync_recalc();
+	}
+	else {
+		if(sync) {
+			session->device_free();
+			delete sync;
+		}
+
+		scene->reset();
+
+		/* sync object should be re-created */
+		sync = new BlenderSync(b_engine, b_data, b_scene, scene, !background, session->progress, session_params.device.type == DEVICE_CPU);
+	}
 
 	/* for final render we will do full data sync per render layer, only
 	 * do some basic syncing here, no objects or materials for speed */
@@ -338,6 +357,12 @@ void BlenderSession::render()
 	SessionParams session_params = BlenderSync::get_session_params(b_engine, b_userpref, b_scene, background);
 	BufferParams buffer_params = BlenderSync::get_buffer_params(b_render, b_scene, b_v3d, b_rv3d, scene->camera, width, height);
 
+	/* adaptive sampling only works when tiles are written with their own sample count */
+	bool adaptive_sampling = session_params.adaptive_sampling && !session_params.progressive_refine;
+
+	PointerRNA cscene = RNA_pointer_get(&b_scene.ptr, "cycles");
+	debug_adaptive_samples = adaptive_sampling && get_boolean(cscene, "debug_adaptive_samples");
+
 	/* render each layer */
 	BL::RenderSettings r = b_scene.render();
 	BL::RenderSettings::layers_iterator b_iter;
@@ -378,6 +403,12 @@ void BlenderSession::render()
 			}
 		}
 
+		/* passes to estimate noise level for adaptive sampling */
+		if(adaptive_sampling) {
+			Pass::add(PASS_VARIANCE, passes);
+			Pass::add(PASS_SAMPLE_COUNT, passes);
+		}
+
 		/* free result without merging */
 		end_render_result(b_engine, b_rr, true);
 
@@ -387,9 +418,13 @@ void BlenderSession::render()
 		scene->integrator->tag_update(scene);
 
 		/* update scene */
+		double sync_start_time = time_dt();
+
 		sync->sync_camera(b_render, b_engine.camera_override(), width, height);
 		sync->sync_data(b_v3d, b_engine.camera_override(), b_rlay_name.c_str());
 
+		scene->update_times.sync += time_dt() - sync_start_time;
+
 		/* update number of samples per layer */
 		int samples = sync->get_layer_samples();
 		bool bound_samples = sync->get_layer_bound_samples();
@@ -411,14 +446,20 @@ void BlenderSession::render()
 	session->write_render_tile_cb = NULL;
 	session->update_render_tile_cb = NULL;
 
-	/* free all memory used (host and device), so we wouldn't leave render
-	 * engine with extra memory allocated
-	 */
+	if(scene->params.persistent_data) {
+		/* keep scene and sync data for the next frame */
+		session->free_tile_buffers();
+	}
+	else {
+		/* free all memory used (host and device), so we wouldn't leave render
+		 * engine with extra memory allocated
+		 */
 
-	session->device_free();
+		session->device_free();
 
-	delete sync;
-	sync = NULL;
+		delete sync;
+		sync = NULL;
+	}
 }
 
 void BlenderSession::do_write_update_render_result(BL::RenderResult b_rr, BL::RenderLayer b_rlay, RenderTile& rtile, bool do_update_only)
@@ -454,7 +495,25 @@ void BlenderSession::do_write_update_render_result(BL::RenderResult b_rr, BL::Re
 	}
 
 	/* copy combined pass */
-	if(buffers->get_pass_rect(PASS_COMBINED, exposure, rtile.sample, 4, &pixels[0]))
+	if(debug_adaptive_samples) {
+		/* fraction of samples used by the tile, as gray */
+		float scale = 1.0f/session->tile_manager.num_samples;
+		int size = params.width*params.height;
+
+		if(buffers->get_pass_rect(PASS_SAMPLE_COUNT, 1.0f, rtile.sample, 1, &pixels[0])) {
+			for(int i = size - 1; i >= 0; i--) {
+				float f = pixels[i]*scale;
+
+				pixels[i*4+0] = f;
+				pixels[i*4+1] = f;
+				pixels[i*4+2] = f;
+				pixels[i*4+3] = 1.0f;
+			}
+
+			b_rlay.rect(&pixels[0]);
+		}
+	}
+	else if(buffers->get_pass_rect(PASS_COMBINED, exposure, rtile.sample, 4, &pixels[0]))
 		b_rlay.rect(&pixels[0]);
 
 	/* tag result as updated */
@@ -636,10 +695,30 @@ void BlenderSession::update_status_progress()
 
 	timestatus = string_printf("Mem:%.2fM, Peak:%.2fM", mem_used, mem_peak);
 
+	uint64_t cache_hits, cache_misses;
+	size_t cache_memory;
+
+	session->progress.get_image_cache_stats(cache_hits, cache_misses, cache_memory);
+
+	if(cache_hits + cache_misses > 0) {
+		float hit_rate = 100.0f * (float)cache_hits / (float)(cache_hits + cache_misses);
+		float cache_mem = (float)cache_memory / 1024.0f / 1024.0f;
+
+		timestatus += string_printf(", Tex Cache:%.2fM (%.1f%% hits)", cache_mem, hit_rate);
+	}
+
 	if(background) {
 		timestatus += " | " + b_scene.name();
 		if(b_rlay_name != "")
 			timestatus += ", "  + b_rlay_name;
+
+		/* time breakdown of scene updates for this frame */
+		SceneUpdateTimes& times = scene->update_times;
+
+		if(times.sync + times.bvh + times.device > 0.0) {
+			timestatus += string_printf(" | Sync:%.2fs, BVH:%.2fs, Upload:%.2fs",
+				times.sync, times.bvh, times.device);
+		}
 	}
 	else {
 		timestatus += " | ";
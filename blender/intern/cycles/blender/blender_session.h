@@ -90,6 +90,9 @@ public:
 	int width, height;
 	double start_resize_time;
 
+	/* write adaptive sampling sample count instead of combined pass */
+	bool debug_adaptive_samples;
+
 protected:
 	void do_write_update_render_result(BL::RenderResult b_rr, BL::RenderLayer b_rlay, RenderTile& rtile, bool do_update_only);
 	void do_write_update_render_tile(RenderTile& rtile, bool do_update_only);
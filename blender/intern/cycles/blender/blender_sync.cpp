@@ -48,6 +48,7 @@ BlenderSync::BlenderSync(BL::RenderEngine b_engine_, BL::BlendData b_data_, BL::
   mesh_map(&scene_->meshes),
   light_map(&scene_->lights),
   particle_system_map(&scene_->particle_systems),
+  mesh_sync_threaded_malloc(false),
   world_map(NULL),
   world_recalc(false),
   experimental(false),
@@ -220,6 +221,13 @@ void BlenderSync::sync_integrator()
 	if(experimental)
 		integrator->sampling_pattern = (SamplingPattern)RNA_enum_get(&cscene, "sampling_pattern");
 
+	/* branched path samples lamps and mesh lights separately, the light tree
+	 * is only shown and supported for path */
+	if(integrator->method == Integrator::PATH)
+		integrator->use_light_tree = get_boolean(cscene, "use_light_tree");
+	else
+		integrator->use_light_tree = false;
+
 	if(integrator->modified(previntegrator))
 		integrator->tag_update(scene);
 }
@@ -345,18 +353,28 @@ SceneParams BlenderSync::get_scene_params(BL::Scene b_scene, bool background)
 	else if(shadingsystem == 1)
 		params.shadingsystem = SceneParams::OSL;
 	
-	if(background)
+	if(background && params.shadingsystem != SceneParams::OSL)
+		params.persistent_data = r.use_persistent_data();
+	else
+		params.persistent_data = false;
+
+	/* persistent data keeps mesh BVH's across frames, which only works when
+	 * object transforms are not applied to the meshes */
+	if(background && !params.persistent_data)
 		params.bvh_type = SceneParams::BVH_STATIC;
+	else if(background)
+		params.bvh_type = SceneParams::BVH_DYNAMIC;
 	else
 		params.bvh_type = (SceneParams::BVHType)RNA_enum_get(&cscene, "debug_bvh_type");
 
 	params.use_bvh_spatial_split = RNA_boolean_get(&cscene, "debug_use_spatial_splits");
+	params.use_compact_triangles = RNA_boolean_get(&cscene, "use_compact_triangles");
 	params.use_bvh_cache = (background)? RNA_boolean_get(&cscene, "use_cache"): false;
+	params.bvh_cache_path = get_string(cscene, "cache_directory");
+	params.bvh_cache_size = get_int(cscene, "cache_size");
 
-	if(background && params.shadingsystem != SceneParams::OSL)
-		params.persistent_data = r.use_persistent_data();
-	else
-		params.persistent_data = false;
+	params.texture_cache_size = get_int(cscene, "texture_cache_size");
+	params.texture_cache_disk_size = get_int(cscene, "texture_cache_disk_size");
 
 	return params;
 }
@@ -474,6 +492,11 @@ SessionParams BlenderSync::get_session_params(BL::RenderEngine b_engine, BL::Use
 	params.text_timeout = get_float(cscene, "debug_text_timeout");
 
 	params.progressive_refine = get_boolean(cscene, "use_progressive_refine");
+	params.use_ray_packets = get_boolean(cscene, "use_ray_packets");
+
+	params.adaptive_sampling = get_boolean(cscene, "use_adaptive_sampling");
+	params.adaptive_threshold = get_float(cscene, "adaptive_threshold");
+	params.adaptive_min_samples = get_int(cscene, "adaptive_min_samples");
 
 	if(background) {
 		if(params.progressive_refine)
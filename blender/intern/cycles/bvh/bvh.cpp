@@ -59,6 +59,14 @@ struct BVHStackEntry
 BVH::BVH(const BVHParams& params_, const vector<Object*>& objects_)
 : params(params_), objects(objects_)
 {
+	build_SAH = 0.0f;
+	cache_mapping = NULL;
+}
+
+BVH::~BVH()
+{
+	/* pack arrays may still reference the mapping, but are not freed */
+	delete cache_mapping;
 }
 
 BVH *BVH::create(const BVHParams& params, const vector<Object*>& objects)
@@ -74,6 +82,7 @@ BVH *BVH::create(const BVHParams& params, const vector<Object*>& objects)
 bool BVH::cache_read(CacheData& key)
 {
 	key.add(system_cpu_bits());
+	key.add(BVH_CACHE_VERSION);
 	key.add(&params, sizeof(params));
 
 	foreach(Object *ob, objects) {
@@ -88,25 +97,33 @@ bool BVH::cache_read(CacheData& key)
 
 	CacheData value;
 
-	if(Cache::global.lookup(key, value)) {
-		cache_filename = key.get_filename();
-
-		value.read(pack.root_index);
-		value.read(pack.SAH);
+	if(!Cache::global.lookup(key, value))
+		return false;
+
+	/* arrays reference the mapped file directly, without copying */
+	bool ok = value.read(pack.root_index)
+	       && value.read(pack.SAH)
+	       && value.read(pack.nodes)
+	       && value.read(pack.object_node)
+	       && value.read(pack.tri_woop)
+	       && value.read(pack.prim_segment)
+	       && value.read(pack.prim_visibility)
+	       && value.read(pack.prim_index)
+	       && value.read(pack.prim_object)
+	       && value.read(pack.is_leaf);
+
+	if(!ok) {
+		pack = PackedBVH();
+		return false;
+	}
 
-		value.read(pack.nodes);
-		value.read(pack.object_node);
-		value.read(pack.tri_woop);
-		value.read(pack.prim_segment);
-		value.read(pack.prim_visibility);
-		value.read(pack.prim_index);
-		value.read(pack.prim_object);
-		value.read(pack.is_leaf);
+	cache_filename = key.get_filename();
 
-		return true;
-	}
+	delete cache_mapping;
+	cache_mapping = value.mapping;
+	value.mapping = NULL;
 
-	return false;
+	return true;
 }
 
 void BVH::cache_write(CacheData& key)
@@ -130,24 +147,6 @@ void BVH::cache_write(CacheData& key)
 	cache_filename = key.get_filename();
 }
 
-void BVH::clear_cache_except()
-{
-	set<string> except;
-
-	if(!cache_filename.empty())
-		except.insert(cache_filename);
-
-	foreach(Object *ob, objects) {
-		Mesh *mesh = ob->mesh;
-		BVH *bvh = mesh->bvh;
-
-		if(bvh && !bvh->cache_filename.empty())
-			except.insert(bvh->cache_filename);
-	}
-
-	Cache::global.clear_except("bvh", except);
-}
-
 /* Building */
 
 void BVH::build(Progress& progress)
@@ -160,8 +159,11 @@ void BVH::build(Progress& progress)
 	if(params.use_cache) {
 		progress.set_substatus("Looking in BVH cache");
 
-		if(cache_read(key))
+		if(cache_read(key)) {
+			if(!params.top_level)
+				build_SAH = compute_SAH();
 			return;
+		}
 	}
 
 	/* build nodes */
@@ -210,14 +212,14 @@ void BVH::build(Progress& progress)
 
 	if(progress.get_cancel()) return;
 
+	/* reference cost to compare refitted nodes against */
+	if(!params.top_level)
+		build_SAH = compute_SAH();
+
 	/* cache write */
 	if(params.use_cache) {
 		progress.set_substatus("Writing BVH cache");
 		cache_write(key);
-
-		/* clear other bvh files from cache */
-		if(params.top_level)
-			clear_cache_except();
 	}
 }
 
@@ -225,15 +227,91 @@ void BVH::build(Progress& progress)
 
 void BVH::refit(Progress& progress)
 {
-	progress.set_substatus("Packing BVH primitives");
-	pack_primitives();
+	/* the top level BVH only contains instances, whose BVH's are unchanged */
+	if(!params.top_level) {
+		progress.set_substatus("Packing BVH primitives");
+		pack_primitives();
 
-	if(progress.get_cancel()) return;
+		if(progress.get_cancel()) return;
+	}
 
 	progress.set_substatus("Refitting BVH nodes");
 	refit_nodes();
 }
 
+bool BVH::refit_need_rebuild()
+{
+	/* refitting keeps the node topology from the original geometry, the more
+	 * it deforms the more overlap there is between nodes */
+	if(params.top_level || build_SAH <= 0.0f)
+		return false;
+
+	return compute_SAH() > build_SAH*(1.0f + params.refit_sah_threshold);
+}
+
+void BVH::refit_primitives(int start, int end, BoundBox& bbox, uint& visibility)
+{
+	if(start < 0) {
+		/* single object instance leaf in top level BVH, the instanced BVH
+		 * itself is stored separately and not affected */
+		Object *ob = objects[pack.prim_object[~start]];
+
+		bbox.grow(ob->bounds);
+		visibility |= ob->visibility;
+		return;
+	}
+
+	for(int prim = start; prim < end; prim++) {
+		int pidx = pack.prim_index[prim];
+		int tob = pack.prim_object[prim];
+		Object *ob = objects[tob];
+
+		if(pidx == -1) {
+			/* object instance */
+			bbox.grow(ob->bounds);
+		}
+		else {
+			/* primitives */
+			const Mesh *mesh = ob->mesh;
+
+			if(pack.prim_segment[prim] != ~0) {
+				/* curves */
+				int str_offset = (params.top_level)? mesh->curve_offset: 0;
+				int k0 = mesh->curves[pidx - str_offset].first_key + pack.prim_segment[prim]; // XXX!
+				int k1 = k0 + 1;
+
+				float3 p[4];
+				p[0] = mesh->curve_keys[max(k0 - 1,mesh->curves[pidx - str_offset].first_key)].co;
+				p[1] = mesh->curve_keys[k0].co;
+				p[2] = mesh->curve_keys[k1].co;
+				p[3] = mesh->curve_keys[min(k1 + 1,mesh->curves[pidx - str_offset].first_key + mesh->curves[pidx - str_offset].num_keys - 1)].co;
+				float3 lower;
+				float3 upper;
+				curvebounds(&lower.x, &upper.x, p, 0);
+				curvebounds(&lower.y, &upper.y, p, 1);
+				curvebounds(&lower.z, &upper.z, p, 2);
+				float mr = max(mesh->curve_keys[k0].radius,mesh->curve_keys[k1].radius);
+				bbox.grow(lower, mr);
+				bbox.grow(upper, mr);
+
+				visibility |= PATH_RAY_CURVE;
+			}
+			else {
+				/* triangles */
+				int tri_offset = (params.top_level)? mesh->tri_offset: 0;
+				const int *vidx = mesh->triangles[pidx - tri_offset].v;
+				const float3 *vpos = &mesh->verts[0];
+
+				bbox.grow(vpos[vidx[0]]);
+				bbox.grow(vpos[vidx[1]]);
+				bbox.grow(vpos[vidx[2]]);
+			}
+		}
+
+		visibility |= ob->visibility;
+	}
+}
+
 /* Triangles */
 
 void BVH::pack_triangle(int idx, float4 woop[3])
@@ -314,22 +392,28 @@ void BVH::pack_primitives()
 {
 	int nsize = TRI_NODE_SIZE;
 	size_t tidx_size = pack.prim_index.size();
+	/* with compact triangles the kernel intersects the indexed vertices
+	 * directly, so no Woop data is stored */
+	bool use_woop = !params.use_compact_triangles;
 
 	pack.tri_woop.clear();
-	pack.tri_woop.resize(tidx_size * nsize);
+	if(use_woop)
+		pack.tri_woop.resize(tidx_size * nsize);
 	pack.prim_visibility.clear();
 	pack.prim_visibility.resize(tidx_size);
 
 	for(unsigned int i = 0; i < tidx_size; i++) {
 		if(pack.prim_index[i] != -1) {
-			float4 woop[3];
+			if(use_woop) {
+				float4 woop[3];
 
-			if(pack.prim_segment[i] != ~0)
-				pack_curve_segment(i, woop);
-			else
-				pack_triangle(i, woop);
-			
-			memcpy(&pack.tri_woop[i * nsize], woop, sizeof(float4)*3);
+				if(pack.prim_segment[i] != ~0)
+					pack_curve_segment(i, woop);
+				else
+					pack_triangle(i, woop);
+
+				memcpy(&pack.tri_woop[i * nsize], woop, sizeof(float4)*3);
+			}
 
 			int tob = pack.prim_object[i];
 			Object *ob = objects[tob];
@@ -339,7 +423,8 @@ void BVH::pack_primitives()
 				pack.prim_visibility[i] |= PATH_RAY_CURVE;
 		}
 		else {
-			memset(&pack.tri_woop[i * nsize], 0, sizeof(float4)*3);
+			if(use_woop)
+				memset(&pack.tri_woop[i * nsize], 0, sizeof(float4)*3);
 			pack.prim_visibility[i] = 0;
 		}
 	}
@@ -600,8 +685,6 @@ void RegularBVH::pack_nodes(const array<int>& prims, const BVHNode *root)
 
 void RegularBVH::refit_nodes()
 {
-	assert(!params.top_level);
-
 	BoundBox bbox = BoundBox::empty;
 	uint visibility = 0;
 	refit_node(0, (pack.is_leaf[0])? true: false, bbox, visibility);
@@ -616,55 +699,7 @@ void RegularBVH::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility
 
 	if(leaf) {
 		/* refit leaf node */
-		for(int prim = c0; prim < c1; prim++) {
-			int pidx = pack.prim_index[prim];
-			int tob = pack.prim_object[prim];
-			Object *ob = objects[tob];
-
-			if(pidx == -1) {
-				/* object instance */
-				bbox.grow(ob->bounds);
-			}
-			else {
-				/* primitives */
-				const Mesh *mesh = ob->mesh;
-
-				if(pack.prim_segment[prim] != ~0) {
-					/* curves */
-					int str_offset = (params.top_level)? mesh->curve_offset: 0;
-					int k0 = mesh->curves[pidx - str_offset].first_key + pack.prim_segment[prim]; // XXX!
-					int k1 = k0 + 1;
-
-					float3 p[4];
-					p[0] = mesh->curve_keys[max(k0 - 1,mesh->curves[pidx - str_offset].first_key)].co;
-					p[1] = mesh->curve_keys[k0].co;
-					p[2] = mesh->curve_keys[k1].co;
-					p[3] = mesh->curve_keys[min(k1 + 1,mesh->curves[pidx - str_offset].first_key + mesh->curves[pidx - str_offset].num_keys - 1)].co;
-					float3 lower;
-					float3 upper;
-					curvebounds(&lower.x, &upper.x, p, 0);
-					curvebounds(&lower.y, &upper.y, p, 1);
-					curvebounds(&lower.z, &upper.z, p, 2);
-					float mr = max(mesh->curve_keys[k0].radius,mesh->curve_keys[k1].radius);
-					bbox.grow(lower, mr);
-					bbox.grow(upper, mr);
-
-					visibility |= PATH_RAY_CURVE;
-				}
-				else {
-					/* triangles */
-					int tri_offset = (params.top_level)? mesh->tri_offset: 0;
-					const int *vidx = mesh->triangles[pidx - tri_offset].v;
-					const float3 *vpos = &mesh->verts[0];
-
-					bbox.grow(vpos[vidx[0]]);
-					bbox.grow(vpos[vidx[1]]);
-					bbox.grow(vpos[vidx[2]]);
-				}
-			}
-
-			visibility |= ob->visibility;
-		}
+		refit_primitives(c0, c1, bbox, visibility);
 
 		pack_node(idx, bbox, bbox, c0, c1, visibility, visibility);
 	}
@@ -684,6 +719,46 @@ void RegularBVH::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility
 	}
 }
 
+static BoundBox regular_bvh_child_bounds(const int4 *data, int i)
+{
+	BoundBox bbox;
+
+	bbox.min = make_float3(__int_as_float(data[0][i]), __int_as_float(data[1][i]), __int_as_float(data[2][i]));
+	bbox.max = make_float3(__int_as_float(data[0][i+2]), __int_as_float(data[1][i+2]), __int_as_float(data[2][i+2]));
+
+	return bbox;
+}
+
+float RegularBVH::compute_SAH()
+{
+	if(pack.nodes.size() == 0)
+		return 0.0f;
+
+	const int4 *data = &pack.nodes[0];
+	BoundBox bbox = regular_bvh_child_bounds(data, 0);
+	bbox.grow(regular_bvh_child_bounds(data, 1));
+
+	return compute_node_SAH(0, (pack.is_leaf[0])? true: false, bbox)/bbox.safe_area();
+}
+
+float RegularBVH::compute_node_SAH(int idx, bool leaf, const BoundBox& bbox)
+{
+	const int4 *data = &pack.nodes[idx*BVH_NODE_SIZE];
+
+	int c0 = data[3].x;
+	int c1 = data[3].y;
+
+	if(leaf)
+		return bbox.safe_area()*params.triangle_cost((c0 < 0)? 1: c1 - c0);
+
+	float SAH = bbox.safe_area()*params.node_cost(2);
+
+	SAH += compute_node_SAH((c0 < 0)? -c0-1: c0, (c0 < 0), regular_bvh_child_bounds(data, 0));
+	SAH += compute_node_SAH((c1 < 0)? -c1-1: c1, (c1 < 0), regular_bvh_child_bounds(data, 1));
+
+	return SAH;
+}
+
 /* QBVH */
 
 QBVH::QBVH(const BVHParams& params_, const vector<Object*>& objects_)
@@ -824,7 +899,106 @@ void QBVH::pack_nodes(const array<int>& prims, const BVHNode *root)
 
 void QBVH::refit_nodes()
 {
-	assert(0); /* todo */
+	BoundBox bbox = BoundBox::empty;
+	uint visibility = 0;
+	refit_node(0, (pack.is_leaf[0])? true: false, bbox, visibility);
+}
+
+void QBVH::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility)
+{
+	float4 *data = (float4*)&pack.nodes[idx*BVH_QNODE_SIZE];
+
+	if(leaf) {
+		/* refit leaf node, bounds are stored in the parent */
+		int c0 = __float_as_int(data[6].x);
+		int c1 = __float_as_int(data[6].y);
+
+		refit_primitives(c0, c1, bbox, visibility);
+	}
+	else {
+		/* refit inner node, unused child slots have index 0 */
+		for(int i = 0; i < 4; i++) {
+			int c = __float_as_int(data[6][i]);
+
+			if(c == 0)
+				continue;
+
+			BoundBox cbox = BoundBox::empty;
+			uint cvisibility = 0;
+
+			refit_node((c < 0)? -c-1: c, (c < 0), cbox, cvisibility);
+
+			data[0][i] = cbox.min.x;
+			data[1][i] = cbox.max.x;
+			data[2][i] = cbox.min.y;
+			data[3][i] = cbox.max.y;
+			data[4][i] = cbox.min.z;
+			data[5][i] = cbox.max.z;
+
+			bbox.grow(cbox);
+			visibility |= cvisibility;
+		}
+	}
+}
+
+static BoundBox qbvh_child_bounds(const float4 *data, int i)
+{
+	BoundBox bbox;
+
+	bbox.min = make_float3(data[0][i], data[2][i], data[4][i]);
+	bbox.max = make_float3(data[1][i], data[3][i], data[5][i]);
+
+	return bbox;
+}
+
+float QBVH::compute_SAH()
+{
+	if(pack.nodes.size() == 0)
+		return 0.0f;
+
+	const float4 *data = (const float4*)&pack.nodes[0];
+
+	if(pack.is_leaf[0]) {
+		int c0 = __float_as_int(data[6].x);
+		int c1 = __float_as_int(data[6].y);
+
+		return params.triangle_cost((c0 < 0)? 1: c1 - c0);
+	}
+
+	BoundBox bbox = BoundBox::empty;
+
+	for(int i = 0; i < 4; i++)
+		if(__float_as_int(data[6][i]) != 0)
+			bbox.grow(qbvh_child_bounds(data, i));
+
+	return compute_node_SAH(0, false, bbox)/bbox.safe_area();
+}
+
+float QBVH::compute_node_SAH(int idx, bool leaf, const BoundBox& bbox)
+{
+	const float4 *data = (const float4*)&pack.nodes[idx*BVH_QNODE_SIZE];
+
+	if(leaf) {
+		int c0 = __float_as_int(data[6].x);
+		int c1 = __float_as_int(data[6].y);
+
+		return bbox.safe_area()*params.triangle_cost((c0 < 0)? 1: c1 - c0);
+	}
+
+	float SAH = 0.0f;
+	int num_children = 0;
+
+	for(int i = 0; i < 4; i++) {
+		int c = __float_as_int(data[6][i]);
+
+		if(c == 0)
+			continue;
+
+		SAH += compute_node_SAH((c < 0)? -c-1: c, (c < 0), qbvh_child_bounds(data, i));
+		num_children++;
+	}
+
+	return SAH + bbox.safe_area()*params.node_cost(num_children);
 }
 
 CCL_NAMESPACE_END
@@ -31,6 +31,7 @@ struct BVHStackEntry;
 class BVHParams;
 class BoundBox;
 class CacheData;
+class CacheMapping;
 class LeafNode;
 class Object;
 class Progress;
@@ -40,6 +41,9 @@ class Progress;
 #define BVH_ALIGN		4096
 #define TRI_NODE_SIZE	3
 
+/* increase when the packed layout changes, to invalidate cached BVHs */
+#define BVH_CACHE_VERSION	1
+
 /* Packed BVH
  *
  * BVH stored as it will be used for traversal on the rendering device. */
@@ -88,13 +92,20 @@ public:
 	vector<Object*> objects;
 	string cache_filename;
 
+	/* memory mapped cache file that pack arrays reference */
+	CacheMapping *cache_mapping;
+
+	/* SAH cost of the packed nodes after building */
+	float build_SAH;
+
 	static BVH *create(const BVHParams& params, const vector<Object*>& objects);
-	virtual ~BVH() {}
+	virtual ~BVH();
 
 	void build(Progress& progress);
 	void refit(Progress& progress);
 
-	void clear_cache_except();
+	/* test if refitting degraded node quality so much that rebuilding is better */
+	bool refit_need_rebuild();
 
 protected:
 	BVH(const BVHParams& params, const vector<Object*>& objects);
@@ -105,6 +116,7 @@ protected:
 
 	/* triangles and strands*/
 	void pack_primitives();
+	void refit_primitives(int start, int end, BoundBox& bbox, uint& visibility);
 	void pack_triangle(int idx, float4 woop[3]);
 	void pack_curve_segment(int idx, float4 woop[3]);
 
@@ -114,6 +126,7 @@ protected:
 	/* for subclasses to implement */
 	virtual void pack_nodes(const array<int>& prims, const BVHNode *root) = 0;
 	virtual void refit_nodes() = 0;
+	virtual float compute_SAH() = 0;
 };
 
 /* Regular BVH
@@ -135,6 +148,10 @@ protected:
 	/* refit */
 	void refit_nodes();
 	void refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility);
+
+	/* SAH */
+	float compute_SAH();
+	float compute_node_SAH(int idx, bool leaf, const BoundBox& bbox);
 };
 
 /* QBVH
@@ -154,6 +171,11 @@ protected:
 
 	/* refit */
 	void refit_nodes();
+	void refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility);
+
+	/* SAH */
+	float compute_SAH();
+	float compute_node_SAH(int idx, bool leaf, const BoundBox& bbox);
 };
 
 CCL_NAMESPACE_END
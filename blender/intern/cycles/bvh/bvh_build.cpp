@@ -46,6 +46,18 @@ public:
 	BVHObjectBinning range;
 };
 
+class BVHSpatialSplitBuildTask : public Task {
+public:
+	BVHSpatialSplitBuildTask(BVHBuild *build, InnerNode *node, int child, const BVHRange& range_, int level)
+	: range(range_)
+	{
+		run = function_bind(&BVHBuild::thread_build_spatial_split_node, build, node, child, &range, &references, level);
+	}
+
+	BVHRange range;
+	vector<BVHReference> references;
+};
+
 /* Constructor / Destructor */
 
 BVHBuild::BVHBuild(const vector<Object*>& objects_,
@@ -198,8 +210,6 @@ BVHNode* BVHBuild::run()
 		params.use_spatial_split = false;
 
 	spatial_min_overlap = root.bounds().safe_area() * params.spatial_split_alpha;
-	spatial_right_bounds.clear();
-	spatial_right_bounds.resize(max(root.size(), (int)BVHParams::NUM_SPATIAL_BINS) - 1);
 
 	/* init progress updates */
 	progress_start_time = time_dt();
@@ -207,19 +217,35 @@ BVHNode* BVHBuild::run()
 	progress_total = references.size();
 	progress_original_total = progress_total;
 
-	prim_segment.resize(references.size());
-	prim_index.resize(references.size());
-	prim_object.resize(references.size());
-
 	/* build recursively */
 	BVHNode *rootnode;
 
 	if(params.use_spatial_split) {
-		/* singlethreaded spatial split build */
-		rootnode = build_node(root, 0);
+		/* multithreaded spatial split build, primitive arrays are filled
+		 * once all tasks are done since the number of duplicates is not
+		 * known before */
+		prim_segment.clear();
+		prim_index.clear();
+		prim_object.clear();
+
+		BVHSpatialStorage storage;
+		rootnode = build_node(root, &references, 0, &storage);
+		spatial_storage_merge(&storage, rootnode);
+		task_pool.wait_work();
+		spatial_subtrees_merge(rootnode);
+
+		/* subtrees left over when cancelled are not reachable from the root */
+		map<BVHNode*, BVHSpatialSubtree*>::iterator it;
+		for(it = spatial_subtrees.begin(); it != spatial_subtrees.end(); it++)
+			delete it->second;
+		spatial_subtrees.clear();
 	}
 	else {
 		/* multithreaded binning build */
+		prim_segment.resize(references.size());
+		prim_index.resize(references.size());
+		prim_object.resize(references.size());
+
 		BVHObjectBinning rootbin(root, (references.size())? &references[0]: NULL);
 		rootnode = build_node(rootbin, 0);
 		task_pool.wait_work();
@@ -231,7 +257,7 @@ BVHNode* BVHBuild::run()
 			rootnode->deleteSubtree();
 			rootnode = NULL;
 		}
-		else if(!params.use_spatial_split) {
+		else {
 			/*rotate(rootnode, 4, 5);*/
 			rootnode->update_visibility();
 		}
@@ -255,6 +281,24 @@ void BVHBuild::progress_update()
 	progress_start_time = time_dt(); 
 }
 
+void BVHBuild::progress_add(BVHSpatialStorage *storage, size_t count, size_t duplicates)
+{
+	/* accumulate per thread, to avoid locking for every node */
+	storage->progress_count += count;
+	storage->progress_duplicates += duplicates;
+
+	if(storage->progress_count >= THREAD_TASK_SIZE) {
+		thread_scoped_lock lock(build_mutex);
+
+		progress_count += storage->progress_count;
+		progress_total += storage->progress_duplicates;
+		storage->progress_count = 0;
+		storage->progress_duplicates = 0;
+
+		progress_update();
+	}
+}
+
 void BVHBuild::thread_build_node(InnerNode *inner, int child, BVHObjectBinning *range, int level)
 {
 	if(progress.get_cancel())
@@ -289,7 +333,7 @@ BVHNode* BVHBuild::build_node(const BVHObjectBinning& range, int level)
 	if(!(range.size() > 0 && params.top_level && level == 0)) {
 		/* make leaf node when threshold reached or SAH tells us */
 		if(params.small_enough_for_leaf(size, level) || (size <= params.max_leaf_size && leafSAH < splitSAH))
-			return create_leaf_node(range);
+			return create_leaf_node(range, references, NULL);
 	}
 
 	/* perform split */
@@ -317,65 +361,163 @@ BVHNode* BVHBuild::build_node(const BVHObjectBinning& range, int level)
 	return inner;
 }
 
-/* single threaded spatial split builder */
-BVHNode* BVHBuild::build_node(const BVHRange& range, int level)
+void BVHBuild::thread_build_spatial_split_node(InnerNode *inner, int child, BVHRange *range,
+                                               vector<BVHReference> *references, int level)
 {
-	/* progress update */
-	progress_update();
 	if(progress.get_cancel())
+		return;
+
+	/* build nodes */
+	BVHSpatialStorage storage;
+	BVHNode *node = build_node(*range, references, level, &storage);
+
+	/* references are no longer needed, free them before waiting on other tasks */
+	vector<BVHReference>().swap(*references);
+
+	spatial_storage_merge(&storage, node);
+
+	/* set child in inner node */
+	inner->children[child] = node;
+}
+
+void BVHBuild::spatial_storage_merge(BVHSpatialStorage *storage, BVHNode *node)
+{
+	thread_scoped_lock lock(build_mutex);
+
+	/* a task either builds its whole subtree, or only an inner node with
+	 * tasks for the children and no leaves, which needs nothing merged */
+	if(node && !storage->leaves.empty()) {
+		BVHSpatialSubtree *subtree = new BVHSpatialSubtree();
+
+		subtree->prim_segment.swap(storage->prim_segment);
+		subtree->prim_index.swap(storage->prim_index);
+		subtree->prim_object.swap(storage->prim_object);
+		subtree->leaves.swap(storage->leaves);
+
+		spatial_subtrees[node] = subtree;
+	}
+
+	/* update progress */
+	progress_count += storage->progress_count;
+	progress_total += storage->progress_duplicates;
+	progress_update();
+}
+
+void BVHBuild::spatial_subtrees_merge(BVHNode *node)
+{
+	if(!node)
+		return;
+
+	map<BVHNode*, BVHSpatialSubtree*>::iterator it = spatial_subtrees.find(node);
+
+	if(it == spatial_subtrees.end()) {
+		/* inner node created by a task, visit children left to right */
+		if(!node->is_leaf()) {
+			InnerNode *inner = (InnerNode*)node;
+
+			spatial_subtrees_merge(inner->children[0]);
+			spatial_subtrees_merge(inner->children[1]);
+		}
+
+		return;
+	}
+
+	/* append primitives and offset leaf indices to match */
+	BVHSpatialSubtree *subtree = it->second;
+	int offset = prim_index.size();
+
+	prim_segment.insert(prim_segment.end(), subtree->prim_segment.begin(), subtree->prim_segment.end());
+	prim_index.insert(prim_index.end(), subtree->prim_index.begin(), subtree->prim_index.end());
+	prim_object.insert(prim_object.end(), subtree->prim_object.begin(), subtree->prim_object.end());
+
+	foreach(LeafNode *leaf, subtree->leaves) {
+		leaf->m_lo += offset;
+		leaf->m_hi += offset;
+	}
+
+	delete subtree;
+	spatial_subtrees.erase(it);
+}
+
+/* spatial split builder, multithreaded for large ranges */
+BVHNode* BVHBuild::build_node(const BVHRange& range, vector<BVHReference> *references, int level, BVHSpatialStorage *storage)
+{
+	/* test for cancel on large ranges, small ones finish quickly */
+	if(range.size() >= THREAD_TASK_SIZE && progress.get_cancel())
 		return NULL;
 
 	/* small enough or too deep => create leaf. */
 	if(!(range.size() > 0 && params.top_level && level == 0)) {
 		if(params.small_enough_for_leaf(range.size(), level)) {
-			progress_count += range.size();
-			return create_leaf_node(range);
+			progress_add(storage, range.size(), 0);
+			return create_leaf_node(range, *references, storage);
 		}
 	}
 
 	/* splitting test */
-	BVHMixedSplit split(this, range, level);
+	BVHMixedSplit split(this, storage, range, references, level);
 
 	if(!(range.size() > 0 && params.top_level && level == 0)) {
 		if(split.no_split) {
-			progress_count += range.size();
-			return create_leaf_node(range);
+			progress_add(storage, range.size(), 0);
+			return create_leaf_node(range, *references, storage);
 		}
 	}
 	
 	/* do split */
 	BVHRange left, right;
-	split.split(this, left, right, range);
+	split.split(this, storage, left, right, range, references);
+
+	progress_add(storage, 0, left.size() + right.size() - range.size());
+
+	if(range.size() < THREAD_TASK_SIZE) {
+		/* local build, left node first */
+		size_t num_references = references->size();
+		BVHNode *leftnode = build_node(left, references, level + 1, storage);
+
+		/* right node (modify start for duplicates added by the left node) */
+		right.set_start(right.start() + (int)(references->size() - num_references));
+		BVHNode *rightnode = build_node(right, references, level + 1, storage);
 
-	progress_total += left.size() + right.size() - range.size();
-	size_t total = progress_total;
+		/* inner node */
+		return new InnerNode(range.bounds(), leftnode, rightnode);
+	}
 
-	/* leaft node */
-	BVHNode *leftnode = build_node(left, level + 1);
+	/* threaded build, each task owns the references of its subtree. ranges
+	 * this large always cover all references passed to the node */
+	assert(range.start() == 0 && left.start() == 0 && right.end() == references->size());
 
-	/* right node (modify start for splits) */
-	right.set_start(right.start() + progress_total - total);
-	BVHNode *rightnode = build_node(right, level + 1);
+	InnerNode *inner = new InnerNode(range.bounds());
 
-	/* inner node */
-	return new InnerNode(range.bounds(), leftnode, rightnode);
+	BVHSpatialSplitBuildTask *right_task = new BVHSpatialSplitBuildTask(this, inner, 1,
+		BVHRange(right.bounds(), 0, right.size()), level + 1);
+	right_task->references.assign(references->begin() + right.start(), references->end());
+
+	BVHSpatialSplitBuildTask *left_task = new BVHSpatialSplitBuildTask(this, inner, 0, left, level + 1);
+	references->resize(left.size());
+	left_task->references.swap(*references);
+
+	task_pool.push(left_task, true);
+	task_pool.push(right_task, true);
+
+	return inner;
 }
 
 /* Create Nodes */
 
-BVHNode *BVHBuild::create_object_leaf_nodes(const BVHReference *ref, int start, int num)
+BVHNode *BVHBuild::create_object_leaf_nodes(const BVHReference *ref, int start, int num, BVHSpatialStorage *storage)
 {
 	if(num == 0) {
 		BoundBox bounds = BoundBox::empty;
 		return new LeafNode(bounds, 0, 0, 0);
 	}
 	else if(num == 1) {
-		if(start == prim_index.size()) {
-			assert(params.use_spatial_split);
+		if(storage) {
+			assert(start == storage->prim_index.size());
 
-			prim_segment.push_back(ref->prim_segment());
-			prim_index.push_back(ref->prim_index());
-			prim_object.push_back(ref->prim_object());
+			storage->prim_segment.push_back(ref->prim_segment());
+			storage->prim_index.push_back(ref->prim_index());
+			storage->prim_object.push_back(ref->prim_object());
 		}
 		else {
 			prim_segment[start] = ref->prim_segment();
@@ -384,12 +526,17 @@ BVHNode *BVHBuild::create_object_leaf_nodes(const BVHReference *ref, int start,
 		}
 
 		uint visibility = objects[ref->prim_object()]->visibility;
-		return new LeafNode(ref->bounds(), visibility, start, start+1);
+		LeafNode *leaf = new LeafNode(ref->bounds(), visibility, start, start+1);
+
+		if(storage)
+			storage->leaves.push_back(leaf);
+
+		return leaf;
 	}
 	else {
 		int mid = num/2;
-		BVHNode *leaf0 = create_object_leaf_nodes(ref, start, mid); 
-		BVHNode *leaf1 = create_object_leaf_nodes(ref+mid, start+mid, num-mid); 
+		BVHNode *leaf0 = create_object_leaf_nodes(ref, start, mid, storage); 
+		BVHNode *leaf1 = create_object_leaf_nodes(ref+mid, start+mid, num-mid, storage); 
 
 		BoundBox bounds = BoundBox::empty;
 		bounds.grow(leaf0->m_bounds);
@@ -399,56 +546,84 @@ BVHNode *BVHBuild::create_object_leaf_nodes(const BVHReference *ref, int start,
 	}
 }
 
-BVHNode* BVHBuild::create_leaf_node(const BVHRange& range)
+BVHNode* BVHBuild::create_leaf_node(const BVHRange& range, vector<BVHReference>& references, BVHSpatialStorage *storage)
 {
-	vector<int>& p_segment = prim_segment;
-	vector<int>& p_index = prim_index;
-	vector<int>& p_object = prim_object;
-	BoundBox bounds = BoundBox::empty;
+	/* with spatial splits, primitives go to the storage of the thread and
+	 * are offset later, otherwise they are stored at the range position */
+	int start = (storage)? (int)storage->prim_index.size(): range.start();
 	int num = 0, ob_num = 0;
-	uint visibility = 0;
 
-	for(int i = 0; i < range.size(); i++) {
-		BVHReference& ref = references[range.start() + i];
+	/* triangles and curve segments go into separate leaves, so that the
+	 * kernel can intersect all segments of a curve leaf in one go */
+	LeafNode *leaves[2] = {NULL, NULL};
+	int num_leaves = 0;
+
+	for(int pass = 0; pass < 2; pass++) {
+		const bool curves = (pass == 1);
+		BoundBox bounds = BoundBox::empty;
+		int leaf_start = start + num;
+		uint visibility = 0;
+
+		for(int i = 0; i < range.size(); i++) {
+			const BVHReference& ref = references[range.start() + i];
 
-		if(ref.prim_index() != -1) {
-			if(range.start() + num == prim_index.size()) {
-				assert(params.use_spatial_split);
+			if(ref.prim_index() == -1 || ((ref.prim_segment() != ~0) != curves))
+				continue;
 
-				p_segment.push_back(ref.prim_segment());
-				p_index.push_back(ref.prim_index());
-				p_object.push_back(ref.prim_object());
+			if(storage) {
+				storage->prim_segment.push_back(ref.prim_segment());
+				storage->prim_index.push_back(ref.prim_index());
+				storage->prim_object.push_back(ref.prim_object());
 			}
 			else {
-				p_segment[range.start() + num] = ref.prim_segment();
-				p_index[range.start() + num] = ref.prim_index();
-				p_object[range.start() + num] = ref.prim_object();
+				prim_segment[start + num] = ref.prim_segment();
+				prim_index[start + num] = ref.prim_index();
+				prim_object[start + num] = ref.prim_object();
 			}
 
 			bounds.grow(ref.bounds());
 			visibility |= objects[ref.prim_object()]->visibility;
 			num++;
 		}
-		else {
-			if(ob_num < i)
-				references[range.start() + ob_num] = ref;
-			ob_num++;
+
+		if(start + num > leaf_start) {
+			LeafNode *leaf = new LeafNode(bounds, visibility, leaf_start, start + num);
+
+			if(storage)
+				storage->leaves.push_back(leaf);
+
+			leaves[num_leaves++] = leaf;
 		}
 	}
 
 	BVHNode *leaf = NULL;
-	
-	if(num > 0) {
-		leaf = new LeafNode(bounds, visibility, range.start(), range.start() + num);
 
-		if(num == range.size())
-			return leaf;
+	if(num_leaves == 2) {
+		BoundBox bounds = leaves[0]->m_bounds;
+		bounds.grow(leaves[1]->m_bounds);
+		leaf = new InnerNode(bounds, leaves[0], leaves[1]);
+	}
+	else if(num_leaves == 1)
+		leaf = leaves[0];
+
+	if(leaf && num == range.size())
+		return leaf;
+
+	/* move object references to the front of the range */
+	for(int i = 0; i < range.size(); i++) {
+		const BVHReference& ref = references[range.start() + i];
+
+		if(ref.prim_index() == -1) {
+			if(ob_num < i)
+				references[range.start() + ob_num] = ref;
+			ob_num++;
+		}
 	}
 
 	/* while there may be multiple triangles in a leaf, for object primitives
 	 * we want there to be the only one, so we keep splitting */
 	const BVHReference *ref = (ob_num)? &references[range.start()]: NULL;
-	BVHNode *oleaf = create_object_leaf_nodes(ref, range.start() + num, ob_num);
+	BVHNode *oleaf = create_object_leaf_nodes(ref, start + num, ob_num, storage);
 	
 	if(leaf)
 		return new InnerNode(range.bounds(), leaf, oleaf);
@@ -24,18 +24,73 @@
 #include "bvh_binning.h"
 
 #include "util_boundbox.h"
+#include "util_map.h"
 #include "util_task.h"
 #include "util_vector.h"
 
 CCL_NAMESPACE_BEGIN
 
 class BVHBuildTask;
+class BVHSpatialSplitBuildTask;
 class BVHParams;
 class InnerNode;
+class LeafNode;
 class Mesh;
 class Object;
 class Progress;
 
+/* BVH Spatial Storage
+ *
+ * Storage used by one thread while building with spatial splits, so that
+ * subtrees can be built in parallel. Leaf primitives are first stored here,
+ * and appended to the output arrays in tree order once all tasks are done. */
+
+class BVHSpatialStorage {
+public:
+	/* binning and partitioning */
+	BVHSpatialBin bins[3][BVHParams::NUM_SPATIAL_BINS];
+	vector<BoundBox> right_bounds;
+	vector<BVHReference> scratch;
+	vector<BVHReference> split_refs;
+	vector<uchar> split_side;
+
+	/* leaf primitives, indices in leaves are relative to these arrays */
+	vector<int> prim_segment;
+	vector<int> prim_index;
+	vector<int> prim_object;
+	vector<LeafNode*> leaves;
+
+	/* progress not yet added to the builder */
+	size_t progress_count;
+	size_t progress_duplicates;
+
+	BVHSpatialStorage()
+	{
+		progress_count = 0;
+		progress_duplicates = 0;
+	}
+
+	/* scratch memory from the largest ranges is not worth keeping around */
+	void free_scratch()
+	{
+		if(scratch.capacity() > 65536) {
+			vector<BVHReference>().swap(scratch);
+			vector<BVHReference>().swap(split_refs);
+			vector<uchar>().swap(split_side);
+		}
+	}
+};
+
+/* leaf primitives of a subtree built by one task, kept until all tasks are
+ * done so the output arrays do not depend on the order tasks finish in */
+
+struct BVHSpatialSubtree {
+	vector<int> prim_segment;
+	vector<int> prim_index;
+	vector<int> prim_object;
+	vector<LeafNode*> leaves;
+};
+
 /* BVH Builder */
 
 class BVHBuild
@@ -58,6 +113,7 @@ protected:
 	friend class BVHObjectSplit;
 	friend class BVHSpatialSplit;
 	friend class BVHBuildTask;
+	friend class BVHSpatialSplitBuildTask;
 
 	/* adding references */
 	void add_reference_mesh(BoundBox& root, BoundBox& center, Mesh *mesh, int i);
@@ -65,18 +121,31 @@ protected:
 	void add_references(BVHRange& root);
 
 	/* building */
-	BVHNode *build_node(const BVHRange& range, int level);
+	BVHNode *build_node(const BVHRange& range, vector<BVHReference> *references, int level, BVHSpatialStorage *storage);
 	BVHNode *build_node(const BVHObjectBinning& range, int level);
-	BVHNode *create_leaf_node(const BVHRange& range);
-	BVHNode *create_object_leaf_nodes(const BVHReference *ref, int start, int num);
+	BVHNode *create_leaf_node(const BVHRange& range, vector<BVHReference>& references, BVHSpatialStorage *storage);
+	BVHNode *create_object_leaf_nodes(const BVHReference *ref, int start, int num, BVHSpatialStorage *storage);
 
-	/* threads */
-	enum { THREAD_TASK_SIZE = 4096 };
+public:
+	/* threads, ranges from THREAD_SPLIT_SIZE also split nodes in parallel */
+	enum {
+		THREAD_TASK_SIZE = 4096,
+		THREAD_SPLIT_SIZE = 65536,
+		THREAD_SPLIT_CHUNK_SIZE = 16384,
+		THREAD_SPLIT_MAX_CHUNKS = 64
+	};
+
+protected:
 	void thread_build_node(InnerNode *node, int child, BVHObjectBinning *range, int level);
+	void thread_build_spatial_split_node(InnerNode *node, int child, BVHRange *range,
+	                                     vector<BVHReference> *references, int level);
+	void spatial_storage_merge(BVHSpatialStorage *storage, BVHNode *node);
+	void spatial_subtrees_merge(BVHNode *node);
 	thread_mutex build_mutex;
 
 	/* progress */
 	void progress_update();
+	void progress_add(BVHSpatialStorage *storage, size_t count, size_t duplicates);
 
 	/* tree rotations */
 	void rotate(BVHNode *node, int max_depth);
@@ -104,8 +173,7 @@ protected:
 
 	/* spatial splitting */
 	float spatial_min_overlap;
-	vector<BoundBox> spatial_right_bounds;
-	BVHSpatialBin spatial_bins[3][BVHParams::NUM_SPATIAL_BINS];
+	map<BVHNode*, BVHSpatialSubtree*> spatial_subtrees;
 
 	/* threads */
 	TaskPool task_pool;
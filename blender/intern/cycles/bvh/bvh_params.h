@@ -48,7 +48,12 @@ public:
 	/* QBVH */
 	int use_qbvh;
 
-	int pad;
+	/* rebuild instead of refit when the SAH cost increased by more than
+	 * this fraction compared to the cost after building */
+	float refit_sah_threshold;
+
+	/* compact triangle storage, skips the Woop triangle precomputation */
+	int use_compact_triangles;
 
 	/* fixed parameters */
 	enum {
@@ -71,7 +76,8 @@ public:
 		top_level = false;
 		use_cache = false;
 		use_qbvh = false;
-		pad = false;
+		refit_sah_threshold = 0.5f;
+		use_compact_triangles = false;
 	}
 
 	/* SAH costs */
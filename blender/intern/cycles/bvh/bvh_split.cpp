@@ -23,27 +23,96 @@
 #include "object.h"
 
 #include "util_algorithm.h"
+#include "util_foreach.h"
+#include "util_function.h"
+#include "util_task.h"
 
 CCL_NAMESPACE_BEGIN
 
+/* Split Chunks
+ *
+ * Ranges near the top of the tree are too large to bin and partition on a
+ * single core, so they are processed in chunks by the task scheduler. Results
+ * are merged in chunk order, so the tree does not depend on the number of
+ * threads. */
+
+static void split_init_chunks(vector<BVHSplitChunk>& chunks, const BVHRange& range)
+{
+	int num_chunks = 1;
+
+	if(range.size() >= BVHBuild::THREAD_SPLIT_SIZE)
+		num_chunks = min(range.size()/(int)BVHBuild::THREAD_SPLIT_CHUNK_SIZE, (int)BVHBuild::THREAD_SPLIT_MAX_CHUNKS);
+
+	chunks.resize(num_chunks);
+
+	for(int c = 0; c < num_chunks; c++) {
+		BVHSplitChunk& chunk = chunks[c];
+
+		chunk.index = c;
+		chunk.start = range.start() + (int)(((int64_t)range.size()*c)/num_chunks);
+		chunk.end = range.start() + (int)(((int64_t)range.size()*(c+1))/num_chunks);
+
+		for(int i = 0; i < 3; i++) {
+			chunk.num[i] = 0;
+			chunk.offset[i] = 0;
+		}
+
+		chunk.bounds[0] = BoundBox::empty;
+		chunk.bounds[1] = BoundBox::empty;
+	}
+}
+
+static void split_run_chunks(vector<BVHSplitChunk>& chunks, const function<void(BVHSplitChunk*)>& run)
+{
+	if(chunks.size() == 1) {
+		run(&chunks[0]);
+		return;
+	}
+
+	TaskPool pool;
+
+	for(size_t c = 0; c < chunks.size(); c++)
+		pool.push(function_bind(run, &chunks[c]));
+
+	pool.wait_work();
+}
+
 /* Object Split */
 
-BVHObjectSplit::BVHObjectSplit(BVHBuild *builder, const BVHRange& range, float nodeSAH)
-: sah(FLT_MAX), dim(0), num_left(0), left_bounds(BoundBox::empty), right_bounds(BoundBox::empty)
+BVHObjectSplit::BVHObjectSplit(BVHBuild *builder, BVHSpatialStorage *storage, const BVHRange& range,
+                               vector<BVHReference> *references, float nodeSAH)
+: sah(FLT_MAX), dim(0), num_left(0), left_bounds(BoundBox::empty), right_bounds(BoundBox::empty),
+  binned(false), split_bin(0), bin_origin(0.0f), bin_scale(0.0f)
+{
+	if(range.size() >= SWEEP_SIZE)
+		bin(builder, storage, range, references, nodeSAH);
+
+	/* sweep small ranges, or when all centroids ended up in one bin */
+	if(sah == FLT_MAX)
+		sweep(builder, storage, range, references, nodeSAH);
+}
+
+void BVHObjectSplit::sweep(BVHBuild *builder, BVHSpatialStorage *storage, const BVHRange& range,
+                           vector<BVHReference> *references, float nodeSAH)
 {
-	const BVHReference *ref_ptr = &builder->references[range.start()];
+	const BVHReference *ref_ptr = &references->at(range.start());
 	float min_sah = FLT_MAX;
 
+	if(storage->right_bounds.size() < range.size())
+		storage->right_bounds.resize(range.size());
+
+	binned = false;
+
 	for(int dim = 0; dim < 3; dim++) {
 		/* sort references */
-		bvh_reference_sort(range.start(), range.end(), &builder->references[0], dim);
+		bvh_reference_sort(range.start(), range.end(), &references->at(0), dim);
 
 		/* sweep right to left and determine bounds. */
 		BoundBox right_bounds = BoundBox::empty;
 
 		for(int i = range.size() - 1; i > 0; i--) {
 			right_bounds.grow(ref_ptr[i].bounds());
-			builder->spatial_right_bounds[i - 1] = right_bounds;
+			storage->right_bounds[i - 1] = right_bounds;
 		}
 
 		/* sweep left to right and select lowest SAH. */
@@ -51,7 +120,7 @@ BVHObjectSplit::BVHObjectSplit(BVHBuild *builder, const BVHRange& range, float n
 
 		for(int i = 1; i < range.size(); i++) {
 			left_bounds.grow(ref_ptr[i - 1].bounds());
-			right_bounds = builder->spatial_right_bounds[i - 1];
+			right_bounds = storage->right_bounds[i - 1];
 
 			float sah = nodeSAH +
 				left_bounds.safe_area() * builder->params.triangle_cost(i) +
@@ -70,73 +139,262 @@ BVHObjectSplit::BVHObjectSplit(BVHBuild *builder, const BVHRange& range, float n
 	}
 }
 
-void BVHObjectSplit::split(BVHBuild *builder, BVHRange& left, BVHRange& right, const BVHRange& range)
+void BVHObjectSplit::bounds_chunk(const vector<BVHReference> *references, BVHSplitChunk *chunk)
+{
+	BoundBox cent_bounds = BoundBox::empty;
+
+	for(int i = chunk->start; i < chunk->end; i++)
+		cent_bounds.grow((*references)[i].bounds().center2());
+
+	chunk->bounds[0] = cent_bounds;
+}
+
+void BVHObjectSplit::bin_chunk(const vector<BVHReference> *references, float3 origin, float3 scale,
+                               BVHSpatialBin *bins, BVHSplitChunk *chunk)
+{
+	const int num_bins = BVHParams::NUM_SPATIAL_BINS;
+
+	/* bins of this chunk */
+	bins += chunk->index*3*num_bins;
+
+	for(int i = 0; i < 3*num_bins; i++) {
+		bins[i].bounds = BoundBox::empty;
+		bins[i].enter = 0;
+		bins[i].exit = 0;
+	}
+
+	for(int i = chunk->start; i < chunk->end; i++) {
+		const BVHReference& ref = (*references)[i];
+		float3 c = ref.bounds().center2();
+
+		for(int dim = 0; dim < 3; dim++) {
+			int b = clamp((int)((c[dim] - origin[dim])*scale[dim]), 0, num_bins - 1);
+			BVHSpatialBin& bin = bins[dim*num_bins + b];
+
+			bin.bounds.grow(ref.bounds());
+			bin.enter++;
+		}
+	}
+}
+
+void BVHObjectSplit::bin(BVHBuild *builder, BVHSpatialStorage *storage, const BVHRange& range,
+                         vector<BVHReference> *references, float nodeSAH)
+{
+	const int num_bins = BVHParams::NUM_SPATIAL_BINS;
+	vector<BVHSplitChunk> chunks;
+
+	split_init_chunks(chunks, range);
+
+	/* centroid bounds */
+	split_run_chunks(chunks, function_bind(&BVHObjectSplit::bounds_chunk, this, references, _1));
+
+	BoundBox cent_bounds = BoundBox::empty;
+
+	foreach(BVHSplitChunk& chunk, chunks)
+		cent_bounds.grow(chunk.bounds[0]);
+
+	float3 origin = cent_bounds.min;
+	float3 size = cent_bounds.size();
+	float3 scale;
+
+	for(int dim = 0; dim < 3; dim++)
+		scale[dim] = (size[dim] > 0.0f)? (float)num_bins/size[dim]: 0.0f;
+
+	/* map centroids to bins, per chunk and then merged */
+	vector<BVHSpatialBin> chunk_bins(chunks.size()*3*num_bins);
+
+	split_run_chunks(chunks, function_bind(&BVHObjectSplit::bin_chunk, this, references, origin, scale,
+		&chunk_bins[0], _1));
+
+	/* each chunk writes its own bins, growing by empty bounds is not a no-op
+	 * so empty bins are skipped here and below */
+	for(size_t c = 1; c < chunks.size(); c++) {
+		for(int i = 0; i < 3*num_bins; i++) {
+			const BVHSpatialBin& chunk_bin = chunk_bins[c*3*num_bins + i];
+
+			if(chunk_bin.enter) {
+				chunk_bins[i].bounds.grow(chunk_bin.bounds);
+				chunk_bins[i].enter += chunk_bin.enter;
+			}
+		}
+	}
+
+	/* select best split plane */
+	for(int dim = 0; dim < 3; dim++) {
+		const BVHSpatialBin *bins = &chunk_bins[dim*num_bins];
+
+		if(scale[dim] == 0.0f)
+			continue;
+
+		/* sweep right to left and determine bounds. */
+		BoundBox bin_right_bounds[BVHParams::NUM_SPATIAL_BINS];
+		BoundBox right_bounds = BoundBox::empty;
+
+		for(int i = num_bins - 1; i > 0; i--) {
+			if(bins[i].enter)
+				right_bounds.grow(bins[i].bounds);
+			bin_right_bounds[i - 1] = right_bounds;
+		}
+
+		/* sweep left to right and select lowest SAH. */
+		BoundBox left_bounds = BoundBox::empty;
+		int num_left = 0;
+
+		for(int i = 1; i < num_bins; i++) {
+			if(bins[i - 1].enter)
+				left_bounds.grow(bins[i - 1].bounds);
+			num_left += bins[i - 1].enter;
+
+			int num_right = range.size() - num_left;
+
+			if(num_left == 0 || num_right == 0)
+				continue;
+
+			float sah = nodeSAH +
+				left_bounds.safe_area() * builder->params.triangle_cost(num_left) +
+				bin_right_bounds[i - 1].safe_area() * builder->params.triangle_cost(num_right);
+
+			if(sah < this->sah) {
+				this->sah = sah;
+				this->dim = dim;
+				this->num_left = num_left;
+				this->left_bounds = left_bounds;
+				this->right_bounds = bin_right_bounds[i - 1];
+				this->binned = true;
+				this->split_bin = i;
+				this->bin_origin = origin[dim];
+				this->bin_scale = scale[dim];
+			}
+		}
+	}
+}
+
+void BVHObjectSplit::partition_count_chunk(const vector<BVHReference> *references, BVHSplitChunk *chunk)
+{
+	int num = 0;
+
+	for(int i = chunk->start; i < chunk->end; i++)
+		if(get_bin((*references)[i]) < split_bin)
+			num++;
+
+	chunk->num[0] = num;
+	chunk->num[1] = (chunk->end - chunk->start) - num;
+}
+
+void BVHObjectSplit::partition_chunk(const vector<BVHReference> *references, BVHReference *out, BVHSplitChunk *chunk)
+{
+	BVHReference *left = out + chunk->offset[0];
+	BVHReference *right = out + chunk->offset[1];
+
+	for(int i = chunk->start; i < chunk->end; i++) {
+		const BVHReference& ref = (*references)[i];
+
+		if(get_bin(ref) < split_bin)
+			*(left++) = ref;
+		else
+			*(right++) = ref;
+	}
+}
+
+void BVHObjectSplit::split(BVHBuild *builder, BVHSpatialStorage *storage, BVHRange& left, BVHRange& right,
+                           const BVHRange& range, vector<BVHReference> *references)
 {
-	/* sort references according to split */
-	bvh_reference_sort(range.start(), range.end(), &builder->references[0], this->dim);
+	if(!binned) {
+		/* sort references according to split */
+		bvh_reference_sort(range.start(), range.end(), &references->at(0), this->dim);
+	}
+	else {
+		/* stable partition into scratch memory by centroid bin */
+		vector<BVHSplitChunk> chunks;
+		split_init_chunks(chunks, range);
+
+		split_run_chunks(chunks, function_bind(&BVHObjectSplit::partition_count_chunk, this, references, _1));
+
+		int offset_left = 0, offset_right = this->num_left;
+
+		foreach(BVHSplitChunk& chunk, chunks) {
+			chunk.offset[0] = offset_left;
+			chunk.offset[1] = offset_right;
+			offset_left += chunk.num[0];
+			offset_right += chunk.num[1];
+		}
+
+		assert(offset_left == this->num_left);
+
+		vector<BVHReference>& scratch = storage->scratch;
+		scratch.resize(range.size());
+
+		split_run_chunks(chunks, function_bind(&BVHObjectSplit::partition_chunk, this, references, &scratch[0], _1));
+
+		if(range.start() == 0 && range.size() == references->size()) {
+			/* range covers all references, happens for large ranges */
+			references->swap(scratch);
+		}
+		else {
+			memcpy(&references->at(range.start()), &scratch[0], sizeof(BVHReference)*range.size());
+		}
+
+		storage->free_scratch();
+	}
 
 	/* split node ranges */
 	left = BVHRange(this->left_bounds, range.start(), this->num_left);
 	right = BVHRange(this->right_bounds, left.end(), range.size() - this->num_left);
-
 }
 
 /* Spatial Split */
 
-BVHSpatialSplit::BVHSpatialSplit(BVHBuild *builder, const BVHRange& range, float nodeSAH)
+BVHSpatialSplit::BVHSpatialSplit(BVHBuild *builder, BVHSpatialStorage *storage, const BVHRange& range,
+                                 vector<BVHReference> *references, float nodeSAH)
 : sah(FLT_MAX), dim(0), pos(0.0f)
 {
+	const int num_bins = BVHParams::NUM_SPATIAL_BINS;
+
 	/* initialize bins. */
-	float3 origin = range.bounds().min;
-	float3 binSize = (range.bounds().max - origin) * (1.0f / (float)BVHParams::NUM_SPATIAL_BINS);
-	float3 invBinSize = 1.0f / binSize;
+	origin = range.bounds().min;
+	bin_size = (range.bounds().max - origin) * (1.0f / (float)num_bins);
+	inv_bin_size = 1.0f / bin_size;
 
-	for(int dim = 0; dim < 3; dim++) {
-		for(int i = 0; i < BVHParams::NUM_SPATIAL_BINS; i++) {
-			BVHSpatialBin& bin = builder->spatial_bins[dim][i];
+	/* chop references into bins, per chunk and then merged. */
+	vector<BVHSplitChunk> chunks;
+	split_init_chunks(chunks, range);
 
-			bin.bounds = BoundBox::empty;
-			bin.enter = 0;
-			bin.exit = 0;
-		}
+	if(chunks.size() == 1) {
+		bin_chunk(builder, references, &storage->bins[0][0], &chunks[0]);
 	}
+	else {
+		vector<BVHSpatialBin> chunk_bins(chunks.size()*3*num_bins);
 
-	/* chop references into bins. */
-	for(unsigned int refIdx = range.start(); refIdx < range.end(); refIdx++) {
-		const BVHReference& ref = builder->references[refIdx];
-		float3 firstBinf = (ref.bounds().min - origin) * invBinSize;
-		float3 lastBinf = (ref.bounds().max - origin) * invBinSize;
-		int3 firstBin = make_int3((int)firstBinf.x, (int)firstBinf.y, (int)firstBinf.z);
-		int3 lastBin = make_int3((int)lastBinf.x, (int)lastBinf.y, (int)lastBinf.z);
+		split_run_chunks(chunks, function_bind(&BVHSpatialSplit::bin_chunk, this, builder, references,
+			&chunk_bins[0], _1));
 
-		firstBin = clamp(firstBin, 0, BVHParams::NUM_SPATIAL_BINS - 1);
-		lastBin = clamp(lastBin, firstBin, BVHParams::NUM_SPATIAL_BINS - 1);
+		for(int i = 0; i < 3*num_bins; i++) {
+			BVHSpatialBin& bin = storage->bins[i/num_bins][i%num_bins];
 
-		for(int dim = 0; dim < 3; dim++) {
-			BVHReference currRef = ref;
+			bin = chunk_bins[i];
 
-			for(int i = firstBin[dim]; i < lastBin[dim]; i++) {
-				BVHReference leftRef, rightRef;
+			for(size_t c = 1; c < chunks.size(); c++) {
+				const BVHSpatialBin& chunk_bin = chunk_bins[c*3*num_bins + i];
 
-				split_reference(builder, leftRef, rightRef, currRef, dim, origin[dim] + binSize[dim] * (float)(i + 1));
-				builder->spatial_bins[dim][i].bounds.grow(leftRef.bounds());
-				currRef = rightRef;
+				/* clipped references can pass through a bin without entering it,
+				 * so test the bounds themselves for being empty */
+				if(chunk_bin.bounds.valid())
+					bin.bounds.grow(chunk_bin.bounds);
+				bin.enter += chunk_bin.enter;
+				bin.exit += chunk_bin.exit;
 			}
-
-			builder->spatial_bins[dim][lastBin[dim]].bounds.grow(currRef.bounds());
-			builder->spatial_bins[dim][firstBin[dim]].enter++;
-			builder->spatial_bins[dim][lastBin[dim]].exit++;
 		}
 	}
 
 	/* select best split plane. */
 	for(int dim = 0; dim < 3; dim++) {
 		/* sweep right to left and determine bounds. */
+		BoundBox bin_right_bounds[BVHParams::NUM_SPATIAL_BINS];
 		BoundBox right_bounds = BoundBox::empty;
 
-		for(int i = BVHParams::NUM_SPATIAL_BINS - 1; i > 0; i--) {
-			right_bounds.grow(builder->spatial_bins[dim][i].bounds);
-			builder->spatial_right_bounds[i - 1] = right_bounds;
+		for(int i = num_bins - 1; i > 0; i--) {
+			right_bounds.grow(storage->bins[dim][i].bounds);
+			bin_right_bounds[i - 1] = right_bounds;
 		}
 
 		/* sweep left to right and select lowest SAH. */
@@ -144,59 +402,175 @@ BVHSpatialSplit::BVHSpatialSplit(BVHBuild *builder, const BVHRange& range, float
 		int leftNum = 0;
 		int rightNum = range.size();
 
-		for(int i = 1; i < BVHParams::NUM_SPATIAL_BINS; i++) {
-			left_bounds.grow(builder->spatial_bins[dim][i - 1].bounds);
-			leftNum += builder->spatial_bins[dim][i - 1].enter;
-			rightNum -= builder->spatial_bins[dim][i - 1].exit;
+		for(int i = 1; i < num_bins; i++) {
+			left_bounds.grow(storage->bins[dim][i - 1].bounds);
+			leftNum += storage->bins[dim][i - 1].enter;
+			rightNum -= storage->bins[dim][i - 1].exit;
 
 			float sah = nodeSAH +
 				left_bounds.safe_area() * builder->params.triangle_cost(leftNum) +
-				builder->spatial_right_bounds[i - 1].safe_area() * builder->params.triangle_cost(rightNum);
+				bin_right_bounds[i - 1].safe_area() * builder->params.triangle_cost(rightNum);
 
 			if(sah < this->sah) {
 				this->sah = sah;
 				this->dim = dim;
-				this->pos = origin[dim] + binSize[dim] * (float)i;
+				this->pos = origin[dim] + bin_size[dim] * (float)i;
 			}
 		}
 	}
 }
 
-void BVHSpatialSplit::split(BVHBuild *builder, BVHRange& left, BVHRange& right, const BVHRange& range)
+void BVHSpatialSplit::bin_chunk(BVHBuild *builder, const vector<BVHReference> *references,
+                                BVHSpatialBin *bins, BVHSplitChunk *chunk)
 {
-	/* Categorize references and compute bounds.
-	 *
-	 * Left-hand side:			[left_start, left_end[
-	 * Uncategorized/split:		[left_end, right_start[
-	 * Right-hand side:			[right_start, refs.size()[ */
-
-	vector<BVHReference>& refs = builder->references;
-	int left_start = range.start();
-	int left_end = left_start;
-	int right_start = range.end();
-	int right_end = range.end();
-	BoundBox left_bounds = BoundBox::empty;
-	BoundBox right_bounds = BoundBox::empty;
+	const int num_bins = BVHParams::NUM_SPATIAL_BINS;
+
+	/* bins of this chunk */
+	bins += chunk->index*3*num_bins;
+
+	for(int i = 0; i < 3*num_bins; i++) {
+		bins[i].bounds = BoundBox::empty;
+		bins[i].enter = 0;
+		bins[i].exit = 0;
+	}
+
+	for(int refIdx = chunk->start; refIdx < chunk->end; refIdx++) {
+		const BVHReference& ref = (*references)[refIdx];
+		float3 firstBinf = (ref.bounds().min - origin) * inv_bin_size;
+		float3 lastBinf = (ref.bounds().max - origin) * inv_bin_size;
+		int3 firstBin = make_int3((int)firstBinf.x, (int)firstBinf.y, (int)firstBinf.z);
+		int3 lastBin = make_int3((int)lastBinf.x, (int)lastBinf.y, (int)lastBinf.z);
+
+		firstBin = clamp(firstBin, 0, num_bins - 1);
+		lastBin = clamp(lastBin, firstBin, num_bins - 1);
+
+		for(int dim = 0; dim < 3; dim++) {
+			BVHSpatialBin *dim_bins = &bins[dim*num_bins];
+			BVHReference currRef = ref;
+
+			for(int i = firstBin[dim]; i < lastBin[dim]; i++) {
+				BVHReference leftRef, rightRef;
+
+				split_reference(builder, leftRef, rightRef, currRef, dim, origin[dim] + bin_size[dim] * (float)(i + 1));
+				dim_bins[i].bounds.grow(leftRef.bounds());
+				currRef = rightRef;
+			}
 
-	for(int i = left_end; i < right_start; i++) {
-		if(refs[i].bounds().max[this->dim] <= this->pos) {
+			dim_bins[lastBin[dim]].bounds.grow(currRef.bounds());
+			dim_bins[firstBin[dim]].enter++;
+			dim_bins[lastBin[dim]].exit++;
+		}
+	}
+}
+
+void BVHSpatialSplit::partition_count_chunk(const vector<BVHReference> *references, BVHSplitChunk *chunk)
+{
+	for(int i = chunk->start; i < chunk->end; i++) {
+		const BoundBox& bounds = (*references)[i].bounds();
+
+		if(bounds.max[this->dim] <= this->pos)
+			chunk->num[0]++;
+		else if(bounds.min[this->dim] >= this->pos)
+			chunk->num[2]++;
+		else
+			chunk->num[1]++;
+	}
+}
+
+void BVHSpatialSplit::partition_chunk(BVHBuild *builder, const vector<BVHReference> *references,
+                                      BVHReference *out, BVHReference *straddle_out, BVHReference *split_refs,
+                                      BVHSplitChunk *chunk)
+{
+	int left = chunk->offset[0];
+	int straddle = chunk->offset[1];
+	int right = chunk->offset[2];
+
+	for(int i = chunk->start; i < chunk->end; i++) {
+		const BVHReference& ref = (*references)[i];
+
+		if(ref.bounds().max[this->dim] <= this->pos) {
 			/* entirely on the left-hand side */
-			left_bounds.grow(refs[i].bounds());
-			swap(refs[i], refs[left_end++]);
+			chunk->bounds[0].grow(ref.bounds());
+			out[left++] = ref;
 		}
-		else if(refs[i].bounds().min[this->dim] >= this->pos) {
+		else if(ref.bounds().min[this->dim] >= this->pos) {
 			/* entirely on the right-hand side */
-			right_bounds.grow(refs[i].bounds());
-			swap(refs[i--], refs[--right_start]);
+			chunk->bounds[1].grow(ref.bounds());
+			out[right++] = ref;
+		}
+		else {
+			/* intersecting both sides, clip here so that deciding to duplicate
+			 * or unsplit afterwards only has to compare bounds */
+			split_reference(builder, split_refs[straddle*2 + 0], split_refs[straddle*2 + 1], ref, this->dim, this->pos);
+			straddle_out[straddle++] = ref;
 		}
 	}
+}
+
+void BVHSpatialSplit::split(BVHBuild *builder, BVHSpatialStorage *storage, BVHRange& left, BVHRange& right,
+                            const BVHRange& range, vector<BVHReference> *references)
+{
+	/* Categorize references and compute bounds.
+	 *
+	 * Left-hand side:			[0, num_left[
+	 * Intersecting both sides:	[num_left, num_left + num_straddle[
+	 * Right-hand side:			[num_left + num_straddle, size[ */
+
+	vector<BVHSplitChunk> chunks;
+	split_init_chunks(chunks, range);
+
+	split_run_chunks(chunks, function_bind(&BVHSpatialSplit::partition_count_chunk, this, references, _1));
+
+	int num_left = 0, num_straddle = 0, num_right = 0;
+
+	foreach(BVHSplitChunk& chunk, chunks) {
+		num_left += chunk.num[0];
+		num_straddle += chunk.num[1];
+		num_right += chunk.num[2];
+	}
 
-	/* duplicate or unsplit references intersecting both sides. */
-	while(left_end < right_start) {
-		/* split reference. */
-		BVHReference lref, rref;
+	int offset_left = 0, offset_straddle = 0, offset_right = num_left + num_straddle;
 
-		split_reference(builder, lref, rref, refs[left_end], this->dim, this->pos);
+	foreach(BVHSplitChunk& chunk, chunks) {
+		chunk.offset[0] = offset_left;
+		chunk.offset[1] = offset_straddle;
+		chunk.offset[2] = offset_right;
+		offset_left += chunk.num[0];
+		offset_straddle += chunk.num[1];
+		offset_right += chunk.num[2];
+	}
+
+	vector<BVHReference>& scratch = storage->scratch;
+	vector<BVHReference>& split_refs = storage->split_refs;
+
+	scratch.resize(range.size());
+	split_refs.resize(max(num_straddle*2, 1));
+
+	split_run_chunks(chunks, function_bind(&BVHSpatialSplit::partition_chunk, this, builder, references,
+		&scratch[0], &scratch[num_left], &split_refs[0], _1));
+
+	BoundBox left_bounds = BoundBox::empty;
+	BoundBox right_bounds = BoundBox::empty;
+
+	foreach(BVHSplitChunk& chunk, chunks) {
+		if(chunk.num[0])
+			left_bounds.grow(chunk.bounds[0]);
+		if(chunk.num[2])
+			right_bounds.grow(chunk.bounds[1]);
+	}
+
+	/* duplicate or unsplit references intersecting both sides, in order since
+	 * each choice depends on the bounds so far. */
+	vector<uchar>& split_side = storage->split_side;
+	split_side.resize(max(num_straddle, 1));
+
+	int left_num = num_left;
+	int right_num = num_right;
+
+	for(int i = 0; i < num_straddle; i++) {
+		const BVHReference& ref = scratch[num_left + i];
+		const BVHReference& lref = split_refs[i*2 + 0];
+		const BVHReference& rref = split_refs[i*2 + 1];
 
 		/* compute SAH for duplicate/unsplit candidates. */
 		BoundBox lub = left_bounds;		// Unsplit to left:		new left-hand bounds.
@@ -204,15 +578,15 @@ void BVHSpatialSplit::split(BVHBuild *builder, BVHRange& left, BVHRange& right,
 		BoundBox ldb = left_bounds;		// Duplicate:			new left-hand bounds.
 		BoundBox rdb = right_bounds;	// Duplicate:			new right-hand bounds.
 
-		lub.grow(refs[left_end].bounds());
-		rub.grow(refs[left_end].bounds());
+		lub.grow(ref.bounds());
+		rub.grow(ref.bounds());
 		ldb.grow(lref.bounds());
 		rdb.grow(rref.bounds());
 
-		float lac = builder->params.triangle_cost(left_end - left_start);
-		float rac = builder->params.triangle_cost(right_end - right_start);
-		float lbc = builder->params.triangle_cost(left_end - left_start + 1);
-		float rbc = builder->params.triangle_cost(right_end - right_start + 1);
+		float lac = builder->params.triangle_cost(left_num);
+		float rac = builder->params.triangle_cost(right_num);
+		float lbc = builder->params.triangle_cost(left_num + 1);
+		float rbc = builder->params.triangle_cost(right_num + 1);
 
 		float unsplitLeftSAH = lub.safe_area() * lbc + right_bounds.safe_area() * rac;
 		float unsplitRightSAH = left_bounds.safe_area() * lac + rub.safe_area() * rbc;
@@ -222,25 +596,58 @@ void BVHSpatialSplit::split(BVHBuild *builder, BVHRange& left, BVHRange& right,
 		if(minSAH == unsplitLeftSAH) {
 			/* unsplit to left */
 			left_bounds = lub;
-			left_end++;
+			left_num++;
+			split_side[i] = 0;
 		}
 		else if(minSAH == unsplitRightSAH) {
 			/* unsplit to right */
 			right_bounds = rub;
-			swap(refs[left_end], refs[--right_start]);
+			right_num++;
+			split_side[i] = 1;
 		}
 		else {
 			/* duplicate */
 			left_bounds = ldb;
 			right_bounds = rdb;
-			refs[left_end++] = lref;
-			refs.insert(refs.begin() + right_end, rref);
-			right_end++;
+			left_num++;
+			right_num++;
+			split_side[i] = 2;
 		}
 	}
 
-	left = BVHRange(left_bounds, left_start, left_end - left_start);
-	right = BVHRange(right_bounds, right_start, right_end - right_start);
+	/* write back, growing the references for duplicates. with a single
+	 * array shared by the local build, ranges to the right move as well */
+	int num_duplicates = left_num + right_num - range.size();
+
+	if(num_duplicates)
+		references->insert(references->begin() + range.end(), num_duplicates, BVHReference());
+
+	BVHReference *out = &references->at(range.start());
+	int l = num_left, r = left_num;
+
+	if(num_left)
+		memcpy(out, &scratch[0], sizeof(BVHReference)*num_left);
+
+	for(int i = 0; i < num_straddle; i++) {
+		if(split_side[i] == 0) {
+			out[l++] = scratch[num_left + i];
+		}
+		else if(split_side[i] == 1) {
+			out[r++] = scratch[num_left + i];
+		}
+		else {
+			out[l++] = split_refs[i*2 + 0];
+			out[r++] = split_refs[i*2 + 1];
+		}
+	}
+
+	if(num_right)
+		memcpy(out + r, &scratch[num_left + num_straddle], sizeof(BVHReference)*num_right);
+
+	storage->free_scratch();
+
+	left = BVHRange(left_bounds, range.start(), left_num);
+	right = BVHRange(right_bounds, range.start() + left_num, right_num);
 }
 
 void BVHSpatialSplit::split_reference(BVHBuild *builder, BVHReference& left, BVHReference& right, const BVHReference& ref, int dim, float pos)
@@ -24,8 +24,25 @@
 CCL_NAMESPACE_BEGIN
 
 class BVHBuild;
+class BVHSpatialStorage;
 
-/* Object Split */
+/* Split Chunk
+ *
+ * Part of a large range processed by one task while splitting a node. */
+
+struct BVHSplitChunk {
+	int index;
+	int start;
+	int end;
+	int num[3];
+	int offset[3];
+	BoundBox bounds[2];
+};
+
+/* Object Split
+ *
+ * Large ranges are binned by reference centroid, small ranges are sorted and
+ * swept to test every possible split position. */
 
 class BVHObjectSplit
 {
@@ -36,10 +53,39 @@ public:
 	BoundBox left_bounds;
 	BoundBox right_bounds;
 
+	/* binned split, references with centroid bin below split_bin go left */
+	bool binned;
+	int split_bin;
+	float bin_origin;
+	float bin_scale;
+
 	BVHObjectSplit() {}
-	BVHObjectSplit(BVHBuild *builder, const BVHRange& range, float nodeSAH);
+	BVHObjectSplit(BVHBuild *builder, BVHSpatialStorage *storage, const BVHRange& range,
+	               vector<BVHReference> *references, float nodeSAH);
+
+	void split(BVHBuild *builder, BVHSpatialStorage *storage, BVHRange& left, BVHRange& right,
+	           const BVHRange& range, vector<BVHReference> *references);
+
+	/* ranges smaller than this are split by sorting */
+	enum { SWEEP_SIZE = 128 };
 
-	void split(BVHBuild *builder, BVHRange& left, BVHRange& right, const BVHRange& range);
+protected:
+	void sweep(BVHBuild *builder, BVHSpatialStorage *storage, const BVHRange& range,
+	           vector<BVHReference> *references, float nodeSAH);
+	void bin(BVHBuild *builder, BVHSpatialStorage *storage, const BVHRange& range,
+	         vector<BVHReference> *references, float nodeSAH);
+
+	__forceinline int get_bin(const BVHReference& ref) const
+	{
+		float c = ref.bounds().min[dim] + ref.bounds().max[dim];
+		return clamp((int)((c - bin_origin)*bin_scale), 0, BVHParams::NUM_SPATIAL_BINS - 1);
+	}
+
+	void bounds_chunk(const vector<BVHReference> *references, BVHSplitChunk *chunk);
+	void bin_chunk(const vector<BVHReference> *references, float3 origin, float3 scale,
+	               BVHSpatialBin *bins, BVHSplitChunk *chunk);
+	void partition_count_chunk(const vector<BVHReference> *references, BVHSplitChunk *chunk);
+	void partition_chunk(const vector<BVHReference> *references, BVHReference *out, BVHSplitChunk *chunk);
 };
 
 /* Spatial Split */
@@ -52,10 +98,23 @@ public:
 	float pos;
 
 	BVHSpatialSplit() : sah(FLT_MAX), dim(0), pos(0.0f) {}
-	BVHSpatialSplit(BVHBuild *builder, const BVHRange& range, float nodeSAH);
+	BVHSpatialSplit(BVHBuild *builder, BVHSpatialStorage *storage, const BVHRange& range,
+	                vector<BVHReference> *references, float nodeSAH);
 
-	void split(BVHBuild *builder, BVHRange& left, BVHRange& right, const BVHRange& range);
+	void split(BVHBuild *builder, BVHSpatialStorage *storage, BVHRange& left, BVHRange& right,
+	           const BVHRange& range, vector<BVHReference> *references);
 	void split_reference(BVHBuild *builder, BVHReference& left, BVHReference& right, const BVHReference& ref, int dim, float pos);
+
+protected:
+	float3 origin;
+	float3 bin_size;
+	float3 inv_bin_size;
+
+	void bin_chunk(BVHBuild *builder, const vector<BVHReference> *references, BVHSpatialBin *bins, BVHSplitChunk *chunk);
+	void partition_count_chunk(const vector<BVHReference> *references, BVHSplitChunk *chunk);
+	void partition_chunk(BVHBuild *builder, const vector<BVHReference> *references,
+	                     BVHReference *out, BVHReference *straddle_out, BVHReference *split_refs,
+	                     BVHSplitChunk *chunk);
 };
 
 /* Mixed Object-Spatial Split */
@@ -72,7 +131,8 @@ public:
 
 	bool no_split;
 
-	__forceinline BVHMixedSplit(BVHBuild *builder, const BVHRange& range, int level)
+	__forceinline BVHMixedSplit(BVHBuild *builder, BVHSpatialStorage *storage, const BVHRange& range,
+	                            vector<BVHReference> *references, int level)
 	{
 		/* find split candidates. */
 		float area = range.bounds().safe_area();
@@ -80,14 +140,14 @@ public:
 		leafSAH = area * builder->params.triangle_cost(range.size());
 		nodeSAH = area * builder->params.node_cost(2);
 
-		object = BVHObjectSplit(builder, range, nodeSAH);
+		object = BVHObjectSplit(builder, storage, range, references, nodeSAH);
 
 		if(builder->params.use_spatial_split && level < BVHParams::MAX_SPATIAL_DEPTH) {
 			BoundBox overlap = object.left_bounds;
 			overlap.intersect(object.right_bounds);
 
 			if(overlap.safe_area() >= builder->spatial_min_overlap)
-				spatial = BVHSpatialSplit(builder, range, nodeSAH);
+				spatial = BVHSpatialSplit(builder, storage, range, references, nodeSAH);
 		}
 
 		/* leaf SAH is the lowest => create leaf. */
@@ -95,12 +155,13 @@ public:
 		no_split = (minSAH == leafSAH && range.size() <= builder->params.max_leaf_size);
 	}
 
-	__forceinline void split(BVHBuild *builder, BVHRange& left, BVHRange& right, const BVHRange& range)
+	__forceinline void split(BVHBuild *builder, BVHSpatialStorage *storage, BVHRange& left, BVHRange& right,
+	                         const BVHRange& range, vector<BVHReference> *references)
 	{
 		if(builder->params.use_spatial_split && minSAH == spatial.sah)
-			spatial.split(builder, left, right, range);
+			spatial.split(builder, storage, left, right, range, references);
 		if(!left.size() || !right.size())
-			object.split(builder, left, right, range);
+			object.split(builder, storage, left, right, range, references);
 	}
 };
 
@@ -32,6 +32,16 @@
 
 CCL_NAMESPACE_BEGIN
 
+/* Draw Texture */
+
+void DeviceDrawTexture::free()
+{
+	if(texture) {
+		glDeleteTextures(1, &texture);
+		texture = 0;
+	}
+}
+
 /* Device */
 
 void Device::pixels_alloc(device_memory& mem)
@@ -52,19 +62,54 @@ void Device::pixels_free(device_memory& mem)
 	mem_free(mem);
 }
 
-void Device::draw_pixels(device_memory& rgba, int y, int w, int h, int dy, int width, int height, bool transparent)
+void Device::draw_pixels(device_memory& rgba, int y, int w, int h, int dy, int width, int height, bool transparent,
+                         const int4 *dirty, DeviceDrawTexture *texture)
 {
-	pixels_copy_from(rgba, y, w, h);
+	size_t elem = (rgba.data_type == TYPE_HALF)? sizeof(half4): sizeof(uchar4);
+	DeviceDrawTexture tmp_texture;
+
+	if(!texture)
+		texture = &tmp_texture;
+
+	if(texture->texture && (texture->w != w || texture->h != h || texture->data_type != rgba.data_type))
+		texture->free();
+
+	if(!texture->texture) {
+		/* new texture, all pixels must be uploaded */
+		pixels_copy_from(rgba, y, w, h);
+
+		glGenTextures(1, &texture->texture);
+		glBindTexture(GL_TEXTURE_2D, texture->texture);
+		if(rgba.data_type == TYPE_HALF)
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F_ARB, w, h, 0, GL_RGBA, GL_HALF_FLOAT, (void*)rgba.data_pointer);
+		else
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, (void*)rgba.data_pointer);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		texture->w = w;
+		texture->h = h;
+		texture->data_type = rgba.data_type;
+	}
+	else {
+		int4 rect = (dirty)? *dirty: make_int4(0, 0, w, h);
 
-	GLuint texid;
-	glGenTextures(1, &texid);
-	glBindTexture(GL_TEXTURE_2D, texid);
-	if(rgba.data_type == TYPE_HALF)
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F_ARB, w, h, 0, GL_RGBA, GL_HALF_FLOAT, (void*)rgba.data_pointer);
-	else
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, (void*)rgba.data_pointer);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glBindTexture(GL_TEXTURE_2D, texture->texture);
+
+		if(rect.z > 0 && rect.w > 0) {
+			/* upload changed rows, with the texture row length as stride */
+			pixels_copy_from(rgba, y + rect.y, w, rect.w);
+
+			uchar *pixels = (uchar*)rgba.data_pointer + ((size_t)rect.y*w + rect.x)*elem;
+
+			glPixelStorei(GL_UNPACK_ROW_LENGTH, w);
+			if(rgba.data_type == TYPE_HALF)
+				glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x, rect.y, rect.z, rect.w, GL_RGBA, GL_HALF_FLOAT, pixels);
+			else
+				glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x, rect.y, rect.z, rect.w, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+			glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+		}
+	}
 
 	glEnable(GL_TEXTURE_2D);
 	
@@ -98,7 +143,8 @@ void Device::draw_pixels(device_memory& rgba, int y, int w, int h, int dy, int w
 
 	glBindTexture(GL_TEXTURE_2D, 0);
 	glDisable(GL_TEXTURE_2D);
-	glDeleteTextures(1, &texid);
+
+	tmp_texture.free();
 }
 
 Device *Device::create(DeviceInfo& info, Stats &stats, bool background)
@@ -31,6 +31,7 @@
 
 CCL_NAMESPACE_BEGIN
 
+class ImageCache;
 class Progress;
 class RenderTile;
 
@@ -111,6 +112,9 @@ public:
 	/* open shading language, only for CPU device */
 	virtual void *osl_memory() { return NULL; }
 
+	/* image texture cache, only for CPU device */
+	virtual bool set_image_cache(ImageCache *image_cache) { return false; }
+
 	/* load/compile kernels, must be called before adding tasks */ 
 	virtual bool load_kernels(bool experimental) { return true; }
 
@@ -119,9 +123,12 @@ public:
 	virtual void task_wait() = 0;
 	virtual void task_cancel() = 0;
 	
-	/* opengl drawing */
+	/* opengl drawing, dirty is the region (x, y, w, h) of the w*h pixels
+	 * that changed since the last draw, NULL to upload all pixels. without
+	 * a texture kept by the caller, a temporary one is used for the draw */
 	virtual void draw_pixels(device_memory& mem, int y, int w, int h,
-		int dy, int width, int height, bool transparent);
+		int dy, int width, int height, bool transparent, const int4 *dirty = NULL,
+		DeviceDrawTexture *texture = NULL);
 
 #ifdef WITH_NETWORK
 	/* networking */
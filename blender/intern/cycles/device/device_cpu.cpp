@@ -33,6 +33,7 @@
 #include "util_debug.h"
 #include "util_foreach.h"
 #include "util_function.h"
+#include "util_image_cache.h"
 #include "util_opengl.h"
 #include "util_progress.h"
 #include "util_system.h"
@@ -54,6 +55,8 @@ public:
 #ifdef WITH_OSL
 		kernel_globals.osl = &osl_globals;
 #endif
+		kernel_globals.image_cache = NULL;
+		kernel_globals.image_cache_tdata = NULL;
 
 		/* do now to avoid thread issues */
 		system_cpu_support_sse2();
@@ -123,6 +126,25 @@ public:
 #endif
 	}
 
+	bool set_image_cache(ImageCache *image_cache)
+	{
+		kernel_globals.image_cache = image_cache;
+		return true;
+	}
+
+	void thread_image_cache_init(KernelGlobals *kg)
+	{
+		if(kg->image_cache)
+			kg->image_cache_tdata = kg->image_cache->thread_init();
+	}
+
+	void thread_image_cache_free(KernelGlobals *kg)
+	{
+		if(kg->image_cache)
+			kg->image_cache->thread_free(kg->image_cache_tdata);
+		kg->image_cache_tdata = NULL;
+	}
+
 	void thread_run(DeviceTask *task)
 	{
 		if(task->type == DeviceTask::PATH_TRACE)
@@ -155,6 +177,12 @@ public:
 		OSLShader::thread_init(&kg, &kernel_globals, &osl_globals);
 #endif
 
+		thread_image_cache_init(&kg);
+
+#ifdef __RAY_STATS__
+		memset(kg.num_rays, 0, sizeof(kg.num_rays));
+#endif
+
 		RenderTile tile;
 		
 		while(task.acquire_tile(this, tile)) {
@@ -162,6 +190,7 @@ public:
 			uint *rng_state = (uint*)tile.rng_state;
 			int start_sample = tile.start_sample;
 			int end_sample = tile.start_sample + tile.num_samples;
+			bool use_ray_packets = task.use_ray_packets;
 
 #ifdef WITH_OPTIMIZED_KERNEL
 			if(system_cpu_support_sse3()) {
@@ -171,16 +200,24 @@ public:
 							break;
 					}
 
-					for(int y = tile.y; y < tile.y + tile.h; y++) {
-						for(int x = tile.x; x < tile.x + tile.w; x++) {
-							kernel_cpu_sse3_path_trace(&kg, render_buffer, rng_state,
-								sample, x, y, tile.offset, tile.stride);
+					if(use_ray_packets) {
+						use_ray_packets = thread_path_trace_packets(&kg, tile, sample, kernel_cpu_sse3_path_trace_packet);
+					}
+					else {
+						for(int y = tile.y; y < tile.y + tile.h; y++) {
+							for(int x = tile.x; x < tile.x + tile.w; x++) {
+								kernel_cpu_sse3_path_trace(&kg, render_buffer, rng_state,
+									sample, x, y, tile.offset, tile.stride);
+							}
 						}
 					}
 
 					tile.sample = sample + 1;
 
 					task.update_progress(tile);
+
+					if(task.adaptive_sampling && thread_tile_converged(&kg, tile, end_sample, task))
+						break;
 				}
 			}
 			else if(system_cpu_support_sse2()) {
@@ -190,16 +227,24 @@ public:
 							break;
 					}
 
-					for(int y = tile.y; y < tile.y + tile.h; y++) {
-						for(int x = tile.x; x < tile.x + tile.w; x++) {
-							kernel_cpu_sse2_path_trace(&kg, render_buffer, rng_state,
-								sample, x, y, tile.offset, tile.stride);
+					if(use_ray_packets) {
+						use_ray_packets = thread_path_trace_packets(&kg, tile, sample, kernel_cpu_sse2_path_trace_packet);
+					}
+					else {
+						for(int y = tile.y; y < tile.y + tile.h; y++) {
+							for(int x = tile.x; x < tile.x + tile.w; x++) {
+								kernel_cpu_sse2_path_trace(&kg, render_buffer, rng_state,
+									sample, x, y, tile.offset, tile.stride);
+							}
 						}
 					}
 
 					tile.sample = sample + 1;
 
 					task.update_progress(tile);
+
+					if(task.adaptive_sampling && thread_tile_converged(&kg, tile, end_sample, task))
+						break;
 				}
 			}
 			else
@@ -211,19 +256,30 @@ public:
 							break;
 					}
 
-					for(int y = tile.y; y < tile.y + tile.h; y++) {
-						for(int x = tile.x; x < tile.x + tile.w; x++) {
-							kernel_cpu_path_trace(&kg, render_buffer, rng_state,
-								sample, x, y, tile.offset, tile.stride);
+					if(use_ray_packets) {
+						use_ray_packets = thread_path_trace_packets(&kg, tile, sample, kernel_cpu_path_trace_packet);
+					}
+					else {
+						for(int y = tile.y; y < tile.y + tile.h; y++) {
+							for(int x = tile.x; x < tile.x + tile.w; x++) {
+								kernel_cpu_path_trace(&kg, render_buffer, rng_state,
+									sample, x, y, tile.offset, tile.stride);
+							}
 						}
 					}
 
 					tile.sample = sample + 1;
 
 					task.update_progress(tile);
+
+					if(task.adaptive_sampling && thread_tile_converged(&kg, tile, end_sample, task))
+						break;
 				}
 			}
 
+			if(task.adaptive_sampling)
+				thread_write_sample_count(&kg, tile);
+
 			task.release_tile(tile);
 
 			if(task_pool.cancelled()) {
@@ -232,11 +288,102 @@ public:
 			}
 		}
 
+		thread_image_cache_free(&kg);
+
+#ifdef __RAY_STATS__
+		stats.rays_add(kg.num_rays[RAY_STATS_CAMERA], kg.num_rays[RAY_STATS_BOUNCE], kg.num_rays[RAY_STATS_SHADOW]);
+#endif
+
 #ifdef WITH_OSL
 		OSLShader::thread_free(&kg);
 #endif
 	}
 
+	/* Adaptive sampling: estimate the error of each pixel from the combined
+	 * and variance passes. The tile is done when the error of its worst pixel
+	 * is below the threshold, remaining samples are reported as finished. */
+	bool thread_tile_converged(KernelGlobals *kg, RenderTile& tile, int end_sample, DeviceTask& task)
+	{
+		if(!(kg->__data.film.pass_flag & PASS_VARIANCE))
+			return false;
+		if(tile.sample < task.adaptive_min_samples || tile.sample >= end_sample)
+			return false;
+
+		float *render_buffer = (float*)tile.buffer;
+		int pass_stride = kg->__data.film.pass_stride;
+		int pass_variance = kg->__data.film.pass_variance;
+		float inv_sample = 1.0f/tile.sample;
+
+		for(int y = tile.y; y < tile.y + tile.h; y++) {
+			for(int x = tile.x; x < tile.x + tile.w; x++) {
+				float *buffer = render_buffer + (tile.offset + x + y*tile.stride)*pass_stride;
+
+				float mean = (buffer[0] + buffer[1] + buffer[2])*(1.0f/3.0f)*inv_sample;
+				float variance = max(buffer[pass_variance]*inv_sample - mean*mean, 0.0f);
+
+				/* standard error of the mean, relative to the square root of
+				 * the pixel intensity so dark pixels are not oversampled */
+				float error = sqrtf(variance*inv_sample)/(sqrtf(max(mean, 0.0f)) + 1e-4f);
+
+				if(error > task.adaptive_threshold)
+					return false;
+			}
+		}
+
+		task.update_progress(tile, end_sample - tile.sample);
+
+		return true;
+	}
+
+	/* debug pass with the number of samples the tile was rendered with */
+	void thread_write_sample_count(KernelGlobals *kg, RenderTile& tile)
+	{
+		if(!(kg->__data.film.pass_flag & PASS_SAMPLE_COUNT))
+			return;
+
+		float *render_buffer = (float*)tile.buffer;
+		int pass_stride = kg->__data.film.pass_stride;
+		int pass_sample_count = kg->__data.film.pass_sample_count;
+
+		for(int y = tile.y; y < tile.y + tile.h; y++) {
+			for(int x = tile.x; x < tile.x + tile.w; x++) {
+				float *buffer = render_buffer + (tile.offset + x + y*tile.stride)*pass_stride;
+				buffer[pass_sample_count] = (float)tile.sample;
+			}
+		}
+	}
+
+	typedef void (*PathTracePacketFunction)(KernelGlobals *kg, float *buffer, unsigned int *rng_state,
+		int sample, int x, int y, int w, int h, int offset, int stride, int *num_nodes, int *num_lanes);
+
+	/* Trace one sample of the tile with camera rays in 2x2 pixel packets.
+	 * Returns false when too few rays per packet stay active during
+	 * traversal, in which case single rays are faster for the rest of the
+	 * tile. */
+	bool thread_path_trace_packets(KernelGlobals *kg, RenderTile& tile, int sample, PathTracePacketFunction path_trace_packet)
+	{
+		float *render_buffer = (float*)tile.buffer;
+		uint *rng_state = (uint*)tile.rng_state;
+		int num_nodes = 0, num_lanes = 0;
+
+		for(int y = tile.y; y < tile.y + tile.h; y += 2) {
+			for(int x = tile.x; x < tile.x + tile.w; x += 2) {
+				int w = min(2, tile.x + tile.w - x);
+				int h = min(2, tile.y + tile.h - y);
+
+				path_trace_packet(kg, render_buffer, rng_state,
+					sample, x, y, w, h, tile.offset, tile.stride, &num_nodes, &num_lanes);
+			}
+		}
+
+		/* no statistics means the kernel could not use packets */
+		if(num_nodes == 0)
+			return false;
+
+		/* average number of active rays per visited node, out of 4 */
+		return num_lanes >= num_nodes*2;
+	}
+
 	void thread_film_convert(DeviceTask& task)
 	{
 		float sample_scale = 1.0f/(task.sample + 1);
@@ -297,6 +444,8 @@ public:
 		OSLShader::thread_init(&kg, &kernel_globals, &osl_globals);
 #endif
 
+		thread_image_cache_init(&kg);
+
 #ifdef WITH_OPTIMIZED_KERNEL
 		if(system_cpu_support_sse3()) {
 			for(int x = task.shader_x; x < task.shader_x + task.shader_w; x++) {
@@ -325,6 +474,8 @@ public:
 			}
 		}
 
+		thread_image_cache_free(&kg);
+
 #ifdef WITH_OSL
 		OSLShader::thread_free(&kg);
 #endif
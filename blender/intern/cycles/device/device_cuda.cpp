@@ -904,16 +904,18 @@ public:
 		}
 	}
 
-	void draw_pixels(device_memory& mem, int y, int w, int h, int dy, int width, int height, bool transparent)
+	void draw_pixels(device_memory& mem, int y, int w, int h, int dy, int width, int height, bool transparent,
+		const int4 *dirty, DeviceDrawTexture *texture)
 	{
 		if(!background) {
 			PixelMem pmem = pixel_mem_map[mem.device_pointer];
+			int4 rect = (dirty)? *dirty: make_int4(0, 0, w, h);
 
 			cuda_push_context();
 
 			/* for multi devices, this assumes the ineffecient method that we allocate
 			 * all pixels on the device even though we only render to a subset */
-			size_t offset = 4*y*w;
+			size_t offset = 4*((size_t)(y + rect.y)*w + rect.x);
 
 			if(mem.data_type == TYPE_HALF)
 				offset *= sizeof(GLhalf);
@@ -922,10 +924,15 @@ public:
 
 			glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, pmem.cuPBO);
 			glBindTexture(GL_TEXTURE_2D, pmem.cuTexId);
-			if(mem.data_type == TYPE_HALF)
-				glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RGBA, GL_HALF_FLOAT, (void*)offset);
-			else
-				glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, (void*)offset);
+			if(rect.z > 0 && rect.w > 0) {
+				/* only copy the changed region from the PBO */
+				glPixelStorei(GL_UNPACK_ROW_LENGTH, w);
+				if(mem.data_type == TYPE_HALF)
+					glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x, rect.y, rect.z, rect.w, GL_RGBA, GL_HALF_FLOAT, (void*)offset);
+				else
+					glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x, rect.y, rect.z, rect.w, GL_RGBA, GL_UNSIGNED_BYTE, (void*)offset);
+				glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+			}
 			glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
 			
 			glEnable(GL_TEXTURE_2D);
@@ -966,7 +973,7 @@ public:
 			return;
 		}
 
-		Device::draw_pixels(mem, y, w, h, dy, width, height, transparent);
+		Device::draw_pixels(mem, y, w, h, dy, width, height, transparent, dirty, texture);
 	}
 
 	void thread_run(DeviceTask *task)
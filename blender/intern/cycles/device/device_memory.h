@@ -256,6 +256,22 @@ private:
 	array<T> data;
 };
 
+/* Draw Texture
+ *
+ * OpenGL texture kept between draws by the code drawing the pixels, so that
+ * only changed pixels are uploaded. It belongs to the context it was drawn
+ * in, and must be freed with that context current. */
+
+class DeviceDrawTexture {
+public:
+	uint texture;
+	int w, h;
+	DataType data_type;
+
+	DeviceDrawTexture() : texture(0), w(0), h(0), data_type(TYPE_UCHAR) {}
+	void free();
+};
+
 CCL_NAMESPACE_END
 
 #endif /* __DEVICE_MEMORY_H__ */
@@ -98,6 +98,21 @@ public:
 		return true;
 	}
 
+	bool set_image_cache(ImageCache *image_cache)
+	{
+		/* only use the cache if all devices can, images are not loaded otherwise */
+		foreach(SubDevice& sub, devices) {
+			if(!sub.device->set_image_cache(image_cache)) {
+				foreach(SubDevice& other, devices)
+					other.device->set_image_cache(NULL);
+
+				return false;
+			}
+		}
+
+		return true;
+	}
+
 	void mem_alloc(device_memory& mem, MemoryType type)
 	{
 		foreach(SubDevice& sub, devices) {
@@ -234,8 +249,13 @@ public:
 		mem.device_pointer = tmp;
 	}
 
-	void draw_pixels(device_memory& rgba, int y, int w, int h, int dy, int width, int height, bool transparent)
+	void draw_pixels(device_memory& rgba, int y, int w, int h, int dy, int width, int height, bool transparent,
+		const int4 *dirty, DeviceDrawTexture *texture)
 	{
+		/* one texture can only be kept for one device drawing all pixels */
+		if(devices.size() != 1)
+			texture = NULL;
+
 		device_ptr tmp = rgba.device_pointer;
 		int i = 0, sub_h = h/devices.size();
 		int sub_height = height/devices.size();
@@ -248,7 +268,17 @@ public:
 			/* adjust math for w/width */
 
 			rgba.device_pointer = sub.ptr_map[tmp];
-			sub.device->draw_pixels(rgba, sy, w, sh, sdy, width, sheight, transparent);
+
+			if(dirty) {
+				/* clip changed region to the rows of this device */
+				int y0 = max(dirty->y - i*sub_h, 0);
+				int y1 = min(dirty->y + dirty->w - i*sub_h, sh);
+				int4 sub_dirty = make_int4(dirty->x, y0, dirty->z, max(y1 - y0, 0));
+
+				sub.device->draw_pixels(rgba, sy, w, sh, sdy, width, sheight, transparent, &sub_dirty, texture);
+			}
+			else
+				sub.device->draw_pixels(rgba, sy, w, sh, sdy, width, sheight, transparent, NULL, texture);
 			i++;
 		}
 
@@ -19,16 +19,238 @@
 #include "device_network.h"
 
 #include "util_foreach.h"
+#include "util_task.h"
+
+#ifdef WITH_NETWORK
+#ifdef WITH_LZO
+#include "minilzo.h"
+#endif
+#ifdef WITH_LZMA
+#include "LzmaLib.h"
+#endif
+#endif
 
 CCL_NAMESPACE_BEGIN
 
 #ifdef WITH_NETWORK
 
+/* Protocol */
+
+/* frames smaller than this are not worth compressing */
+#define NETWORK_COMPRESS_MIN_SIZE 1024
+
+NetworkProtocol network_protocol_from_env()
+{
+	NetworkProtocol protocol;
+	const char *env = getenv("CYCLES_NETWORK_PROTOCOL");
+	string name = (env)? env: "binary";
+
+	protocol.binary = (name != "text");
+
+	if(name == "lzo")
+		protocol.compression = NETWORK_COMPRESSION_LZO;
+	else if(name == "lzma")
+		protocol.compression = NETWORK_COMPRESSION_LZMA;
+
+	return protocol;
+}
+
+bool network_compression_supported(int compression)
+{
+	switch(compression) {
+		case NETWORK_COMPRESSION_NONE:
+			return true;
+#ifdef WITH_LZO
+		case NETWORK_COMPRESSION_LZO:
+			return true;
+#endif
+#ifdef WITH_LZMA
+		case NETWORK_COMPRESSION_LZMA:
+			return true;
+#endif
+		default:
+			return false;
+	}
+}
+
+/* returns compressed size, or 0 if compression failed or didn't help */
+static size_t network_compress(int compression, const void *data, size_t size, vector<char>& out)
+{
+	if(size < NETWORK_COMPRESS_MIN_SIZE)
+		return 0;
+
+#ifdef WITH_LZO
+	if(compression == NETWORK_COMPRESSION_LZO) {
+		static bool lzo_initialized = (lzo_init() == LZO_E_OK);
+		vector<char> wrkmem(LZO1X_1_MEM_COMPRESS);
+		lzo_uint out_len = size + size/16 + 64 + 3;
+
+		if(!lzo_initialized)
+			return 0;
+
+		out.resize(out_len);
+
+		if(lzo1x_1_compress((const lzo_bytep)data, size, (lzo_bytep)&out[0], &out_len, &wrkmem[0]) != LZO_E_OK)
+			return 0;
+
+		return (out_len < size)? out_len: 0;
+	}
+#endif
+#ifdef WITH_LZMA
+	if(compression == NETWORK_COMPRESSION_LZMA) {
+		/* properties are stored in front of the compressed data */
+		size_t props_size = LZMA_PROPS_SIZE;
+		size_t out_len = size;
+
+		out.resize(LZMA_PROPS_SIZE + size);
+
+		if(LzmaCompress((unsigned char*)&out[LZMA_PROPS_SIZE], &out_len, (const unsigned char*)data, size,
+		                (unsigned char*)&out[0], &props_size, 3, 1 << 20, 3, 0, 2, 32, 1) != SZ_OK)
+			return 0;
+
+		out_len += LZMA_PROPS_SIZE;
+
+		return (out_len < size)? out_len: 0;
+	}
+#endif
+
+	(void)data;
+	(void)out;
+
+	return 0;
+}
+
+static bool network_decompress(int compression, const char *in, size_t in_size, void *data, size_t size)
+{
+#ifdef WITH_LZO
+	if(compression == NETWORK_COMPRESSION_LZO) {
+		lzo_uint out_len = size;
+
+		return lzo1x_decompress_safe((const lzo_bytep)in, in_size, (lzo_bytep)data, &out_len, NULL) == LZO_E_OK &&
+		       out_len == size;
+	}
+#endif
+#ifdef WITH_LZMA
+	if(compression == NETWORK_COMPRESSION_LZMA) {
+		size_t out_len = size;
+		size_t src_len = in_size - LZMA_PROPS_SIZE;
+
+		if(in_size < LZMA_PROPS_SIZE)
+			return false;
+
+		return LzmaUncompress((unsigned char*)data, &out_len, (const unsigned char*)in + LZMA_PROPS_SIZE, &src_len,
+		                      (const unsigned char*)in, LZMA_PROPS_SIZE) == SZ_OK && out_len == size;
+	}
+#endif
+
+	(void)in;
+	(void)in_size;
+	(void)data;
+	(void)size;
+
+	return false;
+}
+
+void network_frame_write(tcp::socket& socket, const NetworkProtocol& protocol, const void *data, size_t size)
+{
+	vector<char> compressed;
+	size_t compressed_size = network_compress(protocol.compression, data, size, compressed);
+
+	/* size on the wire and uncompressed size, equal if not compressed */
+	uint64_t header[2];
+	header[0] = (compressed_size)? compressed_size: size;
+	header[1] = size;
+
+	const void *payload = (compressed_size)? (const void*)&compressed[0]: data;
+
+	boost::array<boost::asio::const_buffer, 2> buffers = {{
+		boost::asio::buffer((const void*)header, sizeof(header)),
+		boost::asio::buffer(payload, (size_t)header[0])
+	}};
+
+	boost::system::error_code error;
+	boost::asio::write(socket, buffers, boost::asio::transfer_all(), error);
+
+	if(error.value())
+		cout << "Network send error: " << error.message() << "\n";
+}
+
+static bool network_frame_read_header(tcp::socket& socket, uint64_t header[2])
+{
+	boost::system::error_code error;
+	size_t len = boost::asio::read(socket, boost::asio::buffer(header, sizeof(uint64_t)*2), error);
+
+	if(len != sizeof(uint64_t)*2) {
+		cout << "Network receive error: invalid header size\n";
+		return false;
+	}
+
+	return true;
+}
+
+static bool network_frame_read_data(tcp::socket& socket, const NetworkProtocol& protocol,
+	const uint64_t header[2], void *data)
+{
+	size_t wire_size = (size_t)header[0];
+	size_t size = (size_t)header[1];
+
+	if(wire_size == size) {
+		if(size && boost::asio::read(socket, boost::asio::buffer(data, size)) != size) {
+			cout << "Network receive error: data size doesn't match header\n";
+			return false;
+		}
+
+		return true;
+	}
+
+	vector<char> compressed(wire_size);
+
+	if(boost::asio::read(socket, boost::asio::buffer(compressed)) != wire_size) {
+		cout << "Network receive error: data size doesn't match header\n";
+		return false;
+	}
+
+	if(!network_decompress(protocol.compression, &compressed[0], wire_size, data, size)) {
+		cout << "Network receive error: failed to decompress data\n";
+		return false;
+	}
+
+	return true;
+}
+
+bool network_frame_read(tcp::socket& socket, const NetworkProtocol& protocol, void *data, size_t size)
+{
+	uint64_t header[2];
+
+	if(!network_frame_read_header(socket, header))
+		return false;
+
+	if(header[1] != size) {
+		cout << "Network receive error: buffer size doesn't match expected size\n";
+		return false;
+	}
+
+	return network_frame_read_data(socket, protocol, header, data);
+}
+
+bool network_frame_read(tcp::socket& socket, const NetworkProtocol& protocol, vector<char>& data)
+{
+	uint64_t header[2];
+
+	if(!network_frame_read_header(socket, header))
+		return false;
+
+	data.resize((size_t)header[1]);
+
+	return network_frame_read_data(socket, protocol, header, (data.size())? &data[0]: NULL);
+}
+
 class NetworkDevice : public Device
 {
 public:
 	boost::asio::io_service io_service;
 	tcp::socket socket;
+	NetworkProtocol protocol;
 	device_ptr mem_counter;
 	DeviceTask the_task; /* todo: handle multiple tasks */
 
@@ -53,20 +275,51 @@ public:
 		if(error)
 			throw boost::system::system_error(error);
 
+		/* no latency from small RPCs waiting for more data */
+		socket.set_option(tcp::no_delay(true));
+
 		mem_counter = 0;
+
+		negotiate_protocol();
 	}
 
 	~NetworkDevice()
 	{
-		RPCSend snd(socket, "stop");
+		RPCSend snd(socket, protocol, "stop");
 		snd.write();
 	}
 
+	void negotiate_protocol()
+	{
+		NetworkProtocol requested = network_protocol_from_env();
+
+		if(!requested.binary)
+			return;
+
+		/* handshake is done in text mode, server replies with the compression
+		 * it supports, after which both sides switch to binary */
+		RPCSend snd(socket, protocol, "protocol");
+		snd.add(requested.compression);
+		snd.write();
+
+		RPCReceive rcv(socket, protocol);
+		int compression = NETWORK_COMPRESSION_NONE;
+
+		if(rcv.name == "protocol")
+			rcv.read(compression);
+
+		if(compression != requested.compression || !network_compression_supported(compression))
+			compression = NETWORK_COMPRESSION_NONE;
+
+		protocol.binary = true;
+		protocol.compression = compression;
+	}
+
 	void mem_alloc(device_memory& mem, MemoryType type)
 	{
 		mem.device_pointer = ++mem_counter;
 
-		RPCSend snd(socket, "mem_alloc");
+		RPCSend snd(socket, protocol, "mem_alloc");
 
 		snd.add(mem);
 		snd.add(type);
@@ -75,7 +328,7 @@ public:
 
 	void mem_copy_to(device_memory& mem)
 	{
-		RPCSend snd(socket, "mem_copy_to");
+		RPCSend snd(socket, protocol, "mem_copy_to");
 
 		snd.add(mem);
 		snd.write();
@@ -84,7 +337,7 @@ public:
 
 	void mem_copy_from(device_memory& mem, int y, int w, int h, int elem)
 	{
-		RPCSend snd(socket, "mem_copy_from");
+		RPCSend snd(socket, protocol, "mem_copy_from");
 
 		snd.add(mem);
 		snd.add(y);
@@ -93,13 +346,17 @@ public:
 		snd.add(elem);
 		snd.write();
 
-		RPCReceive rcv(socket);
-		rcv.read_buffer((void*)mem.data_pointer, mem.memory_size());
+		/* only the requested rows are sent back */
+		size_t offset = elem*y*w;
+		size_t size = elem*w*h;
+
+		RPCReceive rcv(socket, protocol);
+		rcv.read_buffer((uint8_t*)mem.data_pointer + offset, size);
 	}
 
 	void mem_zero(device_memory& mem)
 	{
-		RPCSend snd(socket, "mem_zero");
+		RPCSend snd(socket, protocol, "mem_zero");
 
 		snd.add(mem);
 		snd.write();
@@ -108,7 +365,7 @@ public:
 	void mem_free(device_memory& mem)
 	{
 		if(mem.device_pointer) {
-			RPCSend snd(socket, "mem_free");
+			RPCSend snd(socket, protocol, "mem_free");
 
 			snd.add(mem);
 			snd.write();
@@ -119,7 +376,7 @@ public:
 
 	void const_copy_to(const char *name, void *host, size_t size)
 	{
-		RPCSend snd(socket, "const_copy_to");
+		RPCSend snd(socket, protocol, "const_copy_to");
 
 		string name_string(name);
 
@@ -133,7 +390,7 @@ public:
 	{
 		mem.device_pointer = ++mem_counter;
 
-		RPCSend snd(socket, "tex_alloc");
+		RPCSend snd(socket, protocol, "tex_alloc");
 
 		string name_string(name);
 
@@ -148,7 +405,7 @@ public:
 	void tex_free(device_memory& mem)
 	{
 		if(mem.device_pointer) {
-			RPCSend snd(socket, "tex_free");
+			RPCSend snd(socket, protocol, "tex_free");
 
 			snd.add(mem);
 			snd.write();
@@ -161,39 +418,56 @@ public:
 	{
 		the_task = task;
 
-		RPCSend snd(socket, "task_add");
+		RPCSend snd(socket, protocol, "task_add");
 		snd.add(task);
 		snd.write();
 	}
 
+	/* acquire up to count tiles and send them in one reply, so that the
+	 * server has tiles queued while the previous ones are still rendering */
+	void send_tiles(const string& name, int count, list<RenderTile>& the_tiles)
+	{
+		vector<RenderTile> tiles;
+		RenderTile tile;
+
+		/* todo: watch out for recursive calls! */
+		while((int)tiles.size() < count && the_task.acquire_tile(this, tile)) {
+			the_tiles.push_back(tile);
+			tiles.push_back(tile);
+		}
+
+		RPCSend snd(socket, protocol, name);
+		int num_tiles = tiles.size();
+
+		snd.add(num_tiles);
+		foreach(RenderTile& tile, tiles)
+			snd.add(tile);
+		snd.write();
+	}
+
 	void task_wait()
 	{
-		RPCSend snd(socket, "task_wait");
+		RPCSend snd(socket, protocol, "task_wait");
 		snd.write();
 
 		list<RenderTile> the_tiles;
 
 		/* todo: run this threaded for connecting to multiple clients */
 		for(;;) {
-			RPCReceive rcv(socket);
+			RPCReceive rcv(socket, protocol);
 			RenderTile tile;
 
 			if(rcv.name == "acquire_tile") {
-				/* todo: watch out for recursive calls! */
-				if(the_task.acquire_tile(this, tile)) { /* write return as bool */
-					the_tiles.push_back(tile);
+				int count;
+				rcv.read(count);
 
-					RPCSend snd(socket, "acquire_tile");
-					snd.add(tile);
-					snd.write();
-				}
-				else {
-					RPCSend snd(socket, "acquire_tile_none");
-					snd.write();
-				}
+				send_tiles("acquire_tile", count, the_tiles);
 			}
 			else if(rcv.name == "release_tile") {
+				int count;
+
 				rcv.read(tile);
+				rcv.read(count);
 
 				for(list<RenderTile>::iterator it = the_tiles.begin(); it != the_tiles.end(); it++) {
 					if(tile.x == it->x && tile.y == it->y && tile.start_sample == it->start_sample) {
@@ -207,17 +481,18 @@ public:
 
 				the_task.release_tile(tile);
 
-				RPCSend snd(socket, "release_tile");
-				snd.write();
+				send_tiles("release_tile", count, the_tiles);
 			}
 			else if(rcv.name == "task_wait_done")
 				break;
+			else if(rcv.name.empty())
+				break; /* connection error */
 		}
 	}
 
 	void task_cancel()
 	{
-		RPCSend snd(socket, "task_cancel");
+		RPCSend snd(socket, protocol, "task_cancel");
 		snd.write();
 	}
 };
@@ -244,17 +519,19 @@ void device_network_info(vector<DeviceInfo>& devices)
 class DeviceServer {
 public:
 	DeviceServer(Device *device_, tcp::socket& socket_)
-	: device(device_), socket(socket_)
+	: device(device_), socket(socket_), tiles_done(false)
 	{
+		/* keep enough tiles queued to keep all threads busy */
+		prefetch = max(TaskScheduler::num_threads(), 1);
 	}
 
 	void listen()
 	{
 		/* receive remote function calls */
 		for(;;) {
-			RPCReceive rcv(socket);
+			RPCReceive rcv(socket, protocol);
 
-			if(rcv.name == "stop")
+			if(rcv.name == "stop" || rcv.name.empty())
 				break;
 
 			process(rcv);
@@ -266,7 +543,23 @@ protected:
 	{
 		// fprintf(stderr, "receive process %s\n", rcv.name.c_str());
 
-		if(rcv.name == "mem_alloc") {
+		if(rcv.name == "protocol") {
+			int compression;
+
+			rcv.read(compression);
+
+			if(!network_compression_supported(compression))
+				compression = NETWORK_COMPRESSION_NONE;
+
+			/* reply in text mode, then switch */
+			RPCSend snd(socket, protocol, "protocol");
+			snd.add(compression);
+			snd.write();
+
+			protocol.binary = true;
+			protocol.compression = compression;
+		}
+		else if(rcv.name == "mem_alloc") {
 			MemoryType type;
 			network_device_memory mem;
 			device_ptr remote_pointer;
@@ -320,9 +613,12 @@ protected:
 
 			device->mem_copy_from(mem, y, w, h, elem);
 
-			RPCSend snd(socket);
+			size_t offset = elem*y*w;
+			size_t size = elem*w*h;
+
+			RPCSend snd(socket, protocol);
 			snd.write();
-			snd.write_buffer((uint8_t*)mem.data_pointer, mem.memory_size());
+			snd.write_buffer((uint8_t*)mem.data_pointer + offset, size);
 		}
 		else if(rcv.name == "mem_zero") {
 			network_device_memory mem;
@@ -419,12 +715,15 @@ protected:
 			task.update_tile_sample = function_bind(&DeviceServer::task_update_tile_sample, this, _1);
 			task.get_cancel = function_bind(&DeviceServer::task_get_cancel, this);
 
+			tile_queue.clear();
+			tiles_done = false;
+
 			device->task_add(task);
 		}
 		else if(rcv.name == "task_wait") {
 			device->task_wait();
 
-			RPCSend snd(socket, "task_wait_done");
+			RPCSend snd(socket, protocol, "task_wait_done");
 			snd.write();
 		}
 		else if(rcv.name == "task_cancel") {
@@ -432,34 +731,61 @@ protected:
 		}
 	}
 
-	bool task_acquire_tile(Device *device, RenderTile& tile)
+	/* receive reply with tiles for the queue, processing any RPCs that the
+	 * client sends in between */
+	void receive_tiles(const string& name, int count)
 	{
-		thread_scoped_lock acquire_lock(acquire_mutex);
+		while(1) {
+			RPCReceive rcv(socket, protocol);
 
-		bool result = false;
+			if(rcv.name == name) {
+				int num_tiles;
+				rcv.read(num_tiles);
 
-		RPCSend snd(socket, "acquire_tile");
-		snd.write();
+				for(int i = 0; i < num_tiles; i++) {
+					RenderTile tile;
+					rcv.read(tile);
 
-		while(1) {
-			RPCReceive rcv(socket);
+					if(tile.buffer) tile.buffer = ptr_map[tile.buffer];
+					if(tile.rng_state) tile.rng_state = ptr_map[tile.rng_state];
 
-			if(rcv.name == "acquire_tile") {
-				rcv.read(tile);
+					tile_queue.push_back(tile);
+				}
 
-				if(tile.buffer) tile.buffer = ptr_map[tile.buffer];
-				if(tile.rng_state) tile.rng_state = ptr_map[tile.rng_state];
+				if(num_tiles < count)
+					tiles_done = true;
 
-				result = true;
 				break;
 			}
-			else if(rcv.name == "acquire_tile_none")
+			else if(rcv.name.empty()) {
+				/* connection error */
+				tiles_done = true;
 				break;
+			}
 			else
 				process(rcv);
 		}
+	}
+
+	bool task_acquire_tile(Device *device, RenderTile& tile)
+	{
+		thread_scoped_lock acquire_lock(acquire_mutex);
+
+		if(tile_queue.empty() && !tiles_done) {
+			RPCSend snd(socket, protocol, "acquire_tile");
+			snd.add(prefetch);
+			snd.write();
+
+			receive_tiles("acquire_tile", prefetch);
+		}
+
+		if(tile_queue.empty())
+			return false;
 
-		return result;
+		tile = tile_queue.front();
+		tile_queue.pop_front();
+
+		return true;
 	}
 
 	void task_update_progress_sample()
@@ -479,18 +805,15 @@ protected:
 		if(tile.buffer) tile.buffer = ptr_imap[tile.buffer];
 		if(tile.rng_state) tile.rng_state = ptr_imap[tile.rng_state];
 
-		RPCSend snd(socket, "release_tile");
+		/* release reply refills the tile queue, saving a round trip */
+		int count = (tiles_done)? 0: max(prefetch - (int)tile_queue.size(), 0);
+
+		RPCSend snd(socket, protocol, "release_tile");
 		snd.add(tile);
+		snd.add(count);
 		snd.write();
 
-		while(1) {
-			RPCReceive rcv(socket);
-
-			if(rcv.name == "release_tile")
-				break;
-			else
-				process(rcv);
-		}
+		receive_tiles("release_tile", count);
 	}
 
 	bool task_get_cancel()
@@ -501,6 +824,7 @@ protected:
 	/* properties */
 	Device *device;
 	tcp::socket& socket;
+	NetworkProtocol protocol;
 
 	/* mapping of remote to local pointer */
 	map<device_ptr, device_ptr> ptr_map;
@@ -509,6 +833,11 @@ protected:
 
 	thread_mutex acquire_mutex;
 
+	/* tiles acquired from the client ahead of time */
+	list<RenderTile> tile_queue;
+	bool tiles_done;
+	int prefetch;
+
 	/* todo: free memory and device (osl) on network error */
 };
 
@@ -525,6 +854,7 @@ void Device::server_run()
 
 			tcp::socket socket(io_service);
 			acceptor.accept(socket);
+			socket.set_option(tcp::no_delay(true));
 
 			string remote_address = socket.remote_endpoint().address().to_string();
 			printf("Connected to remote client at: %s\n", remote_address.c_str());
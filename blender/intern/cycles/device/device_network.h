@@ -19,6 +19,8 @@
 
 #ifdef WITH_NETWORK
 
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
 #include <boost/archive/text_iarchive.hpp>
 #include <boost/archive/text_oarchive.hpp>
 #include <boost/array.hpp>
@@ -30,6 +32,7 @@
 #include <iostream>
 
 #include "buffers.h"
+#include "device_task.h"
 
 #include "util_foreach.h"
 #include "util_list.h"
@@ -51,6 +54,38 @@ static const int DISCOVER_PORT = 5121;
 static const string DISCOVER_REQUEST_MSG = "REQUEST_RENDER_SERVER_IP";
 static const string DISCOVER_REPLY_MSG = "REPLY_RENDER_SERVER_IP";
 
+/* Protocol
+ *
+ * Connections start with the text archive protocol, after which the client
+ * may switch both sides to a binary protocol with optional compression. In
+ * binary mode, RPC archives and raw buffers are sent as frames with a header
+ * holding the size on the wire and the uncompressed size, so that each frame
+ * is only compressed when that actually makes it smaller. */
+
+enum NetworkCompression {
+	NETWORK_COMPRESSION_NONE = 0,
+	NETWORK_COMPRESSION_LZO = 1,
+	NETWORK_COMPRESSION_LZMA = 2
+};
+
+class NetworkProtocol {
+public:
+	bool binary;
+	int compression;
+
+	NetworkProtocol()
+	: binary(false), compression(NETWORK_COMPRESSION_NONE) {}
+};
+
+/* protocol requested through the CYCLES_NETWORK_PROTOCOL environment
+ * variable: text, binary (default), lzo or lzma */
+NetworkProtocol network_protocol_from_env();
+bool network_compression_supported(int compression);
+
+void network_frame_write(tcp::socket& socket, const NetworkProtocol& protocol, const void *data, size_t size);
+bool network_frame_read(tcp::socket& socket, const NetworkProtocol& protocol, void *data, size_t size);
+bool network_frame_read(tcp::socket& socket, const NetworkProtocol& protocol, vector<char>& data);
+
 /* Serialization of device memory */
 
 class network_device_memory : public device_memory
@@ -62,50 +97,90 @@ public:
 	vector<char> local_data;
 };
 
+/* Serialization shared by send and receive, so both sides always match */
+
+template<typename Archive> void network_serialize(Archive& archive, device_memory& mem)
+{
+	archive & mem.data_type & mem.data_elements & mem.data_size;
+	archive & mem.data_width & mem.data_height & mem.device_pointer;
+}
+
+template<typename Archive> void network_serialize(Archive& archive, DeviceTask& task)
+{
+	int type = (int)task.type;
+
+	archive & type & task.x & task.y & task.w & task.h;
+	archive & task.rgba_byte & task.rgba_half & task.buffer & task.sample & task.num_samples;
+	archive & task.offset & task.stride;
+	archive & task.shader_input & task.shader_output & task.shader_eval_type;
+	archive & task.shader_x & task.shader_w;
+	archive & task.need_finish_queue & task.integrator_branched & task.use_ray_packets;
+	archive & task.adaptive_sampling & task.adaptive_threshold & task.adaptive_min_samples;
+
+	task.type = (DeviceTask::Type)type;
+}
+
+template<typename Archive> void network_serialize(Archive& archive, RenderTile& tile)
+{
+	archive & tile.x & tile.y & tile.w & tile.h;
+	archive & tile.start_sample & tile.num_samples & tile.sample;
+	archive & tile.resolution & tile.offset & tile.stride;
+	archive & tile.buffer & tile.rng_state;
+}
+
 /* Remote procedure call Send */
 
 class RPCSend {
 public:
-	RPCSend(tcp::socket& socket_, const string& name_ = "")
-	: name(name_), socket(socket_), archive(archive_stream), sent(false)
+	RPCSend(tcp::socket& socket_, const NetworkProtocol& protocol_, const string& name_ = "")
+	: name(name_), socket(socket_), protocol(protocol_),
+	  text_archive(NULL), binary_archive(NULL), sent(false)
 	{
-		archive & name_;
+		if(protocol.binary)
+			binary_archive = new boost::archive::binary_oarchive(archive_stream, boost::archive::no_header);
+		else
+			text_archive = new boost::archive::text_oarchive(archive_stream);
+
+		*this & name;
 	}
 
 	~RPCSend()
 	{
 		if(!sent)
 			fprintf(stderr, "Error: RPC %s not sent\n", name.c_str());
+
+		delete text_archive;
+		delete binary_archive;
+	}
+
+	template<typename T> RPCSend& operator&(T& data)
+	{
+		if(binary_archive)
+			*binary_archive & data;
+		else
+			*text_archive & data;
+
+		return *this;
 	}
 
 	void add(const device_memory& mem)
 	{
-		archive & mem.data_type & mem.data_elements & mem.data_size;
-		archive & mem.data_width & mem.data_height & mem.device_pointer;
+		network_serialize(*this, const_cast<device_memory&>(mem));
 	}
 
 	template<typename T> void add(const T& data)
 	{
-		archive & data;
+		*this & const_cast<T&>(data);
 	}
 
 	void add(const DeviceTask& task)
 	{
-		int type = (int)task.type;
-
-		archive & type & task.x & task.y & task.w & task.h;
-		archive & task.rgba_byte & task.rgba_half & task.buffer & task.sample & task.num_samples;
-		archive & task.offset & task.stride;
-		archive & task.shader_input & task.shader_output & task.shader_eval_type;
-		archive & task.shader_x & task.shader_w;
+		network_serialize(*this, const_cast<DeviceTask&>(task));
 	}
 
 	void add(const RenderTile& tile)
 	{
-		archive & tile.x & tile.y & tile.w & tile.h;
-		archive & tile.start_sample & tile.num_samples & tile.sample;
-		archive & tile.offset & tile.stride;
-		archive & tile.buffer & tile.rng_state;
+		network_serialize(*this, const_cast<RenderTile&>(tile));
 	}
 
 	void write()
@@ -115,6 +190,12 @@ public:
 		/* get string from stream */
 		string archive_str = archive_stream.str();
 
+		if(protocol.binary) {
+			network_frame_write(socket, protocol, archive_str.data(), archive_str.size());
+			sent = true;
+			return;
+		}
+
 		/* first send fixed size header with size of following data */
 		ostringstream header_stream;
 		header_stream << setw(8) << hex << archive_str.size();
@@ -140,6 +221,11 @@ public:
 
 	void write_buffer(void *buffer, size_t size)
 	{
+		if(protocol.binary) {
+			network_frame_write(socket, protocol, buffer, size);
+			return;
+		}
+
 		boost::system::error_code error;
 
 		boost::asio::write(socket,
@@ -153,8 +239,11 @@ public:
 protected:
 	string name;
 	tcp::socket& socket;
+	/* copy, the protocol may be switched while this RPC is alive */
+	NetworkProtocol protocol;
 	ostringstream archive_stream;
-	boost::archive::text_oarchive archive;
+	boost::archive::text_oarchive *text_archive;
+	boost::archive::binary_oarchive *binary_archive;
 	bool sent;
 };
 
@@ -162,9 +251,24 @@ protected:
 
 class RPCReceive {
 public:
-	RPCReceive(tcp::socket& socket_)
-	: socket(socket_), archive_stream(NULL), archive(NULL)
+	RPCReceive(tcp::socket& socket_, const NetworkProtocol& protocol_)
+	: socket(socket_), protocol(protocol_), archive_stream(NULL),
+	  text_archive(NULL), binary_archive(NULL)
 	{
+		if(protocol.binary) {
+			vector<char> data;
+
+			if(network_frame_read(socket, protocol, data)) {
+				archive_str = (data.size())? string(&data[0], data.size()): string("");
+				archive_stream = new istringstream(archive_str);
+				binary_archive = new boost::archive::binary_iarchive(*archive_stream, boost::archive::no_header);
+
+				*this & name;
+			}
+
+			return;
+		}
+
 		/* read head with fixed size */
 		vector<char> header(8);
 		size_t len = boost::asio::read(socket, boost::asio::buffer(header));
@@ -183,14 +287,10 @@ public:
 
 				if(len == data_size) {
 					archive_str = (data.size())? string(&data[0], data.size()): string("");
-#if 0
-					istringstream archive_stream(archive_str);
-					boost::archive::text_iarchive archive(archive_stream);
-#endif
 					archive_stream = new istringstream(archive_str);
-					archive = new boost::archive::text_iarchive(*archive_stream);
+					text_archive = new boost::archive::text_iarchive(*archive_stream);
 
-					*archive & name;
+					*this & name;
 				}
 				else
 					cout << "Network receive error: data size doens't match header\n";
@@ -204,25 +304,40 @@ public:
 
 	~RPCReceive()
 	{
-		delete archive;
+		delete text_archive;
+		delete binary_archive;
 		delete archive_stream;
 	}
 
+	template<typename T> RPCReceive& operator&(T& data)
+	{
+		if(binary_archive)
+			*binary_archive & data;
+		else if(text_archive)
+			*text_archive & data;
+
+		return *this;
+	}
+
 	void read(network_device_memory& mem)
 	{
-		*archive & mem.data_type & mem.data_elements & mem.data_size;
-		*archive & mem.data_width & mem.data_height & mem.device_pointer;
+		network_serialize(*this, mem);
 
 		mem.data_pointer = 0;
 	}
 
 	template<typename T> void read(T& data)
 	{
-		*archive & data;
+		*this & data;
 	}
 
 	void read_buffer(void *buffer, size_t size)
 	{
+		if(protocol.binary) {
+			network_frame_read(socket, protocol, buffer, size);
+			return;
+		}
+
 		size_t len = boost::asio::read(socket, boost::asio::buffer(buffer, size));
 
 		if(len != size)
@@ -231,23 +346,12 @@ public:
 
 	void read(DeviceTask& task)
 	{
-		int type;
-
-		*archive & type & task.x & task.y & task.w & task.h;
-		*archive & task.rgba_byte & task.rgba_half & task.buffer & task.sample & task.num_samples;
-		*archive & task.resolution & task.offset & task.stride;
-		*archive & task.shader_input & task.shader_output & task.shader_eval_type;
-		*archive & task.shader_x & task.shader_w;
-
-		task.type = (DeviceTask::Type)type;
+		network_serialize(*this, task);
 	}
 
 	void read(RenderTile& tile)
 	{
-		*archive & tile.x & tile.y & tile.w & tile.h;
-		*archive & tile.start_sample & tile.num_samples & tile.sample;
-		*archive & tile.resolution & tile.offset & tile.stride;
-		*archive & tile.buffer & tile.rng_state & tile.rgba_byte & tile.rgba_half;
+		network_serialize(*this, tile);
 
 		tile.buffers = NULL;
 	}
@@ -256,9 +360,11 @@ public:
 
 protected:
 	tcp::socket& socket;
+	NetworkProtocol protocol;
 	string archive_str;
 	istringstream *archive_stream;
-	boost::archive::text_iarchive *archive;
+	boost::archive::text_iarchive *text_archive;
+	boost::archive::binary_iarchive *binary_archive;
 };
 
 /* Server auto discovery */
@@ -30,7 +30,9 @@ DeviceTask::DeviceTask(Type type_)
 : type(type_), x(0), y(0), w(0), h(0), rgba_byte(0), rgba_half(0), buffer(0),
   sample(0), num_samples(1),
   shader_input(0), shader_output(0),
-  shader_eval_type(0), shader_x(0), shader_w(0)
+  shader_eval_type(0), shader_x(0), shader_w(0),
+  use_ray_packets(false),
+  adaptive_sampling(false), adaptive_threshold(0.0f), adaptive_min_samples(0)
 {
 	last_update_time = time_dt();
 }
@@ -88,13 +90,15 @@ void DeviceTask::split(list<DeviceTask>& tasks, int num)
 	}
 }
 
-void DeviceTask::update_progress(RenderTile &rtile)
+void DeviceTask::update_progress(RenderTile &rtile, int num_samples)
 {
 	if (type != PATH_TRACE)
 		return;
 
-	if(update_progress_sample)
-		update_progress_sample();
+	if(update_progress_sample) {
+		for(int i = 0; i < num_samples; i++)
+			update_progress_sample();
+	}
 
 	if(update_tile_sample) {
 		double current_time = time_dt();
@@ -55,7 +55,7 @@ public:
 	void split(list<DeviceTask>& tasks, int num);
 	void split_max_size(list<DeviceTask>& tasks, int max_size);
 
-	void update_progress(RenderTile &rtile);
+	void update_progress(RenderTile &rtile, int num_samples = 1);
 
 	boost::function<bool(Device *device, RenderTile&)> acquire_tile;
 	boost::function<void(void)> update_progress_sample;
@@ -65,6 +65,11 @@ public:
 
 	bool need_finish_queue;
 	bool integrator_branched;
+	bool use_ray_packets;
+
+	bool adaptive_sampling;
+	float adaptive_threshold;
+	int adaptive_min_samples;
 protected:
 	double last_update_time;
 };
@@ -96,6 +96,13 @@ void kernel_cpu_path_trace(KernelGlobals *kg, float *buffer, unsigned int *rng_s
 		kernel_path_trace(kg, buffer, rng_state, sample, x, y, offset, stride);
 }
 
+/* Path Tracing with camera ray packets */
+
+void kernel_cpu_path_trace_packet(KernelGlobals *kg, float *buffer, unsigned int *rng_state, int sample, int x, int y, int w, int h, int offset, int stride, int *num_nodes, int *num_lanes)
+{
+	kernel_path_trace_block(kg, buffer, rng_state, sample, x, y, w, h, offset, stride, num_nodes, num_lanes);
+}
+
 /* Film */
 
 void kernel_cpu_convert_to_byte(KernelGlobals *kg, uchar4 *rgba, float *buffer, float sample_scale, int x, int y, int offset, int stride)
@@ -112,10 +112,103 @@ __device_inline void bvh_instance_motion_pop(KernelGlobals *kg, int object, cons
 }
 #endif
 
+/* Triangle vertices for compact storage, fetched through the vertex index
+ * since no Woop data is stored */
+__device_inline void bvh_triangle_vertices(KernelGlobals *kg, int triAddr, float3 *v0, float3 *v1, float3 *v2)
+{
+	int prim = kernel_tex_fetch(__prim_index, triAddr);
+	float4 tri_vindex = kernel_tex_fetch(__tri_vindex, prim);
+
+	*v0 = float4_to_float3(kernel_tex_fetch(__tri_verts, __float_as_int(tri_vindex.x)));
+	*v1 = float4_to_float3(kernel_tex_fetch(__tri_verts, __float_as_int(tri_vindex.y)));
+	*v2 = float4_to_float3(kernel_tex_fetch(__tri_verts, __float_as_int(tri_vindex.z)));
+}
+
+/* Moller-Trumbore intersection for compact triangles. Edges are taken
+ * relative to v2 so that u and v match the Woop barycentrics. */
+__device_inline bool bvh_triangle_intersect_compact(KernelGlobals *kg, float3 P, float3 dir,
+	float tmax, int triAddr, float *t, float *u, float *v)
+{
+	float3 v0, v1, v2;
+	bvh_triangle_vertices(kg, triAddr, &v0, &v1, &v2);
+
+	float3 e1 = v0 - v2;
+	float3 e2 = v1 - v2;
+	float3 s1 = cross(dir, e2);
+	float divisor = dot(s1, e1);
+
+	if(divisor == 0.0f)
+		return false;
+
+	float invdivisor = 1.0f/divisor;
+
+	/* compute and check barycentric u */
+	float3 d = P - v2;
+	float uu = dot(d, s1)*invdivisor;
+
+	if(uu < 0.0f || uu > 1.0f)
+		return false;
+
+	/* compute and check barycentric v */
+	float3 s2 = cross(d, e1);
+	float vv = dot(dir, s2)*invdivisor;
+
+	if(vv < 0.0f || uu + vv > 1.0f)
+		return false;
+
+	/* compute and check intersection t-value */
+	float tt = dot(e2, s2)*invdivisor;
+
+	if(!(tt > 0.0f && tt < tmax))
+		return false;
+
+	*t = tt;
+	*u = uu;
+	*v = vv;
+	return true;
+}
+
+/* Distance along D from P to the plane of the triangle, for refining */
+__device_inline float bvh_triangle_plane_distance(KernelGlobals *kg, int triAddr, float3 P, float3 D)
+{
+	if(kernel_data.bvh.use_compact_triangles) {
+		float3 v0, v1, v2;
+		bvh_triangle_vertices(kg, triAddr, &v0, &v1, &v2);
+
+		float3 Ng = cross(v0 - v2, v1 - v2);
+		return dot(v2 - P, Ng)/dot(D, Ng);
+	}
+
+	float4 v00 = kernel_tex_fetch(__tri_woop, triAddr*TRI_NODE_SIZE+0);
+	float Oz = v00.w - P.x*v00.x - P.y*v00.y - P.z*v00.z;
+	float invDz = 1.0f/(D.x*v00.x + D.y*v00.y + D.z*v00.z);
+	return Oz * invDz;
+}
+
 /* Sven Woop's algorithm */
 __device_inline bool bvh_triangle_intersect(KernelGlobals *kg, Intersection *isect,
 	float3 P, float3 idir, uint visibility, int object, int triAddr)
 {
+	if(kernel_data.bvh.use_compact_triangles) {
+		float t, u, v;
+
+		if(!bvh_triangle_intersect_compact(kg, P, 1.0f/idir, isect->t, triAddr, &t, &u, &v))
+			return false;
+
+#ifdef __VISIBILITY_FLAG__
+		if(!(kernel_tex_fetch(__prim_visibility, triAddr) & visibility))
+			return false;
+#endif
+
+		/* record intersection */
+		isect->prim = triAddr;
+		isect->object = object;
+		isect->u = u;
+		isect->v = v;
+		isect->t = t;
+		return true;
+	}
+
 	/* compute and check intersection t-value */
 	float4 v00 = kernel_tex_fetch(__tri_woop, triAddr*TRI_NODE_SIZE+0);
 	float4 v11 = kernel_tex_fetch(__tri_woop, triAddr*TRI_NODE_SIZE+1);
@@ -682,6 +775,119 @@ __device_inline bool bvh_curve_intersect(KernelGlobals *kg, Intersection *isect,
 
 	return false;
 }
+
+/* Curve Leaf
+ *
+ * BVH leaves hold either triangles or curve segments. For line segments, the
+ * bounding sphere test that rejects most segments is done for four segments
+ * at once, and only the segments passing it go through the full test. The
+ * sphere is slightly enlarged so that rounding differences never reject a
+ * segment that bvh_curve_intersect would accept. */
+
+__device_inline bool bvh_curve_intersect_leaf(KernelGlobals *kg, Intersection *isect,
+	float3 P, float3 idir, uint visibility, int object, int primAddr, int primAddr2, uint *lcg_state, float difl, float extmax)
+{
+	bool hit = false;
+
+#ifdef __KERNEL_SSE2__
+	float3 dir = 1.0f/idir;
+
+	const __m128 Px = _mm_set_ps1(P.x), Py = _mm_set_ps1(P.y), Pz = _mm_set_ps1(P.z);
+	const __m128 dirx = _mm_set_ps1(dir.x), diry = _mm_set_ps1(dir.y), dirz = _mm_set_ps1(dir.z);
+	const __m128 half = _mm_set_ps1(0.5f);
+	const __m128 zero = _mm_setzero_ps();
+
+	for(int base = primAddr; base < primAddr2; base += 4) {
+		int num = min(primAddr2 - base, 4);
+		int segment[4];
+		float4 k1[4], k2[4];
+
+		/* fetch keys, padding with the last segment */
+		for(int i = 0; i < 4; i++) {
+			int addr = base + min(i, num - 1);
+			int prim = kernel_tex_fetch(__prim_index, addr);
+			float4 v00 = kernel_tex_fetch(__curves, prim);
+
+			segment[i] = kernel_tex_fetch(__prim_segment, addr);
+
+			int k0 = __float_as_int(v00.x) + segment[i];
+			k1[i] = kernel_tex_fetch(__curve_keys, k0);
+			k2[i] = kernel_tex_fetch(__curve_keys, k0 + 1);
+		}
+
+		__m128 p1x = _mm_setr_ps(k1[0].x, k1[1].x, k1[2].x, k1[3].x);
+		__m128 p1y = _mm_setr_ps(k1[0].y, k1[1].y, k1[2].y, k1[3].y);
+		__m128 p1z = _mm_setr_ps(k1[0].z, k1[1].z, k1[2].z, k1[3].z);
+		__m128 r1 = _mm_setr_ps(k1[0].w, k1[1].w, k1[2].w, k1[3].w);
+		__m128 p2x = _mm_setr_ps(k2[0].x, k2[1].x, k2[2].x, k2[3].x);
+		__m128 p2y = _mm_setr_ps(k2[0].y, k2[1].y, k2[2].y, k2[3].y);
+		__m128 p2z = _mm_setr_ps(k2[0].z, k2[1].z, k2[2].z, k2[3].z);
+		__m128 r2 = _mm_setr_ps(k2[0].w, k2[1].w, k2[2].w, k2[3].w);
+
+		/* minimum width extension */
+		if(difl != 0.0f) {
+			__m128 vdifl = _mm_set_ps1(difl);
+			__m128 vextmax = _mm_set_ps1(extmax);
+
+			__m128 dx = _mm_sub_ps(p1x, Px), dy = _mm_sub_ps(p1y, Py), dz = _mm_sub_ps(p1z, Pz);
+			__m128 d1 = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+			r1 = _mm_max_ps(r1, _mm_min_ps(_mm_mul_ps(d1, vdifl), vextmax));
+
+			dx = _mm_sub_ps(p2x, Px); dy = _mm_sub_ps(p2y, Py); dz = _mm_sub_ps(p2z, Pz);
+			__m128 d2 = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+			r2 = _mm_max_ps(r2, _mm_min_ps(_mm_mul_ps(d2, vdifl), vextmax));
+		}
+
+		/* bounding sphere of the segment */
+		__m128 ex = _mm_sub_ps(p2x, p1x), ey = _mm_sub_ps(p2y, p1y), ez = _mm_sub_ps(p2z, p1z);
+		__m128 l = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey)), _mm_mul_ps(ez, ez)));
+		__m128 sp_r = _mm_mul_ps(_mm_add_ps(_mm_max_ps(r1, r2), _mm_mul_ps(half, l)), _mm_set_ps1(1.001f));
+
+		__m128 sx = _mm_sub_ps(Px, _mm_mul_ps(_mm_add_ps(p1x, p2x), half));
+		__m128 sy = _mm_sub_ps(Py, _mm_mul_ps(_mm_add_ps(p1y, p2y), half));
+		__m128 sz = _mm_sub_ps(Pz, _mm_mul_ps(_mm_add_ps(p1z, p2z), half));
+
+		__m128 sb = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dirx, sx), _mm_mul_ps(diry, sy)), _mm_mul_ps(dirz, sz));
+		sx = _mm_sub_ps(sx, _mm_mul_ps(sb, dirx));
+		sy = _mm_sub_ps(sy, _mm_mul_ps(sb, diry));
+		sz = _mm_sub_ps(sz, _mm_mul_ps(sb, dirz));
+		sb = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dirx, sx), _mm_mul_ps(diry, sy)), _mm_mul_ps(dirz, sz));
+
+		__m128 slen = _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, sx), _mm_mul_ps(sy, sy)), _mm_mul_ps(sz, sz));
+		__m128 sdisc = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(sb, sb), slen), _mm_mul_ps(sp_r, sp_r));
+
+		/* NaN is not rejected, same as the scalar test */
+		int mask = ~_mm_movemask_ps(_mm_cmplt_ps(sdisc, zero)) & ((1 << num) - 1);
+
+		for(int i = 0; mask; i++, mask >>= 1) {
+			if(!(mask & 1))
+				continue;
+
+			if(bvh_curve_intersect(kg, isect, P, idir, visibility, object, base + i, segment[i], lcg_state, difl, extmax)) {
+				/* shadow ray early termination */
+				if(visibility == PATH_RAY_SHADOW_OPAQUE)
+					return true;
+
+				hit = true;
+			}
+		}
+	}
+#else
+	for(; primAddr < primAddr2; primAddr++) {
+		uint segment = kernel_tex_fetch(__prim_segment, primAddr);
+
+		if(bvh_curve_intersect(kg, isect, P, idir, visibility, object, primAddr, segment, lcg_state, difl, extmax)) {
+			/* shadow ray early termination */
+			if(visibility == PATH_RAY_SHADOW_OPAQUE)
+				return true;
+
+			hit = true;
+		}
+	}
+#endif
+
+	return hit;
+}
 #endif
 
 #ifdef __SUBSURFACE__
@@ -692,55 +898,66 @@ __device_inline bool bvh_curve_intersect(KernelGlobals *kg, Intersection *isect,
 __device_inline void bvh_triangle_intersect_subsurface(KernelGlobals *kg, Intersection *isect_array,
 	float3 P, float3 idir, int object, int triAddr, float tmax, uint *num_hits, uint *lcg_state, int max_hits)
 {
-	/* compute and check intersection t-value */
-	float4 v00 = kernel_tex_fetch(__tri_woop, triAddr*TRI_NODE_SIZE+0);
-	float4 v11 = kernel_tex_fetch(__tri_woop, triAddr*TRI_NODE_SIZE+1);
 	float3 dir = 1.0f/idir;
+	float t, u, v;
 
-	float Oz = v00.w - P.x*v00.x - P.y*v00.y - P.z*v00.z;
-	float invDz = 1.0f/(dir.x*v00.x + dir.y*v00.y + dir.z*v00.z);
-	float t = Oz * invDz;
+	if(kernel_data.bvh.use_compact_triangles) {
+		if(!bvh_triangle_intersect_compact(kg, P, dir, tmax, triAddr, &t, &u, &v))
+			return;
+	}
+	else {
+		/* compute and check intersection t-value */
+		float4 v00 = kernel_tex_fetch(__tri_woop, triAddr*TRI_NODE_SIZE+0);
+		float4 v11 = kernel_tex_fetch(__tri_woop, triAddr*TRI_NODE_SIZE+1);
+
+		float Oz = v00.w - P.x*v00.x - P.y*v00.y - P.z*v00.z;
+		float invDz = 1.0f/(dir.x*v00.x + dir.y*v00.y + dir.z*v00.z);
+		t = Oz * invDz;
+
+		if(!(t > 0.0f && t < tmax))
+			return;
 
-	if(t > 0.0f && t < tmax) {
 		/* compute and check barycentric u */
 		float Ox = v11.w + P.x*v11.x + P.y*v11.y + P.z*v11.z;
 		float Dx = dir.x*v11.x + dir.y*v11.y + dir.z*v11.z;
-		float u = Ox + t*Dx;
+		u = Ox + t*Dx;
 
-		if(u >= 0.0f) {
-			/* compute and check barycentric v */
-			float4 v22 = kernel_tex_fetch(__tri_woop, triAddr*TRI_NODE_SIZE+2);
-			float Oy = v22.w + P.x*v22.x + P.y*v22.y + P.z*v22.z;
-			float Dy = dir.x*v22.x + dir.y*v22.y + dir.z*v22.z;
-			float v = Oy + t*Dy;
+		if(!(u >= 0.0f))
+			return;
 
-			if(v >= 0.0f && u + v <= 1.0f) {
-				(*num_hits)++;
+		/* compute and check barycentric v */
+		float4 v22 = kernel_tex_fetch(__tri_woop, triAddr*TRI_NODE_SIZE+2);
+		float Oy = v22.w + P.x*v22.x + P.y*v22.y + P.z*v22.z;
+		float Dy = dir.x*v22.x + dir.y*v22.y + dir.z*v22.z;
+		v = Oy + t*Dy;
 
-				int hit;
+		if(!(v >= 0.0f && u + v <= 1.0f))
+			return;
+	}
 
-				if(*num_hits <= max_hits) {
-					hit = *num_hits - 1;
-				}
-				else {
-					/* reservoir sampling: if we are at the maximum number of
-					 * hits, randomly replace element or skip it */
-					hit = lcg_step_uint(lcg_state) % *num_hits;
+	(*num_hits)++;
 
-					if(hit >= max_hits)
-						return;
-				}
+	int hit;
 
-				/* record intersection */
-				Intersection *isect = &isect_array[hit];
-				isect->prim = triAddr;
-				isect->object = object;
-				isect->u = u;
-				isect->v = v;
-				isect->t = t;
-			}
-		}
+	if(*num_hits <= max_hits) {
+		hit = *num_hits - 1;
 	}
+	else {
+		/* reservoir sampling: if we are at the maximum number of
+		 * hits, randomly replace element or skip it */
+		hit = lcg_step_uint(lcg_state) % *num_hits;
+
+		if(hit >= max_hits)
+			return;
+	}
+
+	/* record intersection */
+	Intersection *isect = &isect_array[hit];
+	isect->prim = triAddr;
+	isect->object = object;
+	isect->u = u;
+	isect->v = v;
+	isect->t = t;
 }
 #endif
 
@@ -821,6 +1038,15 @@ bool scene_intersect(KernelGlobals *kg, const Ray *ray, const uint visibility, I
 bool scene_intersect(KernelGlobals *kg, const Ray *ray, const uint visibility, Intersection *isect)
 #endif
 {
+#ifdef __RAY_STATS__
+	if(visibility & PATH_RAY_SHADOW)
+		kg->num_rays[RAY_STATS_SHADOW]++;
+	else if(visibility & PATH_RAY_CAMERA)
+		kg->num_rays[RAY_STATS_CAMERA]++;
+	else
+		kg->num_rays[RAY_STATS_BOUNCE]++;
+#endif
+
 #ifdef __OBJECT_MOTION__
 	if(kernel_data.bvh.have_motion) {
 #ifdef __HAIR__
@@ -976,10 +1202,7 @@ __device_inline float3 bvh_triangle_refine(KernelGlobals *kg, ShaderData *sd, co
 
 	P = P + D*t;
 
-	float4 v00 = kernel_tex_fetch(__tri_woop, isect->prim*TRI_NODE_SIZE+0);
-	float Oz = v00.w - P.x*v00.x - P.y*v00.y - P.z*v00.z;
-	float invDz = 1.0f/(D.x*v00.x + D.y*v00.y + D.z*v00.z);
-	float rt = Oz * invDz;
+	float rt = bvh_triangle_plane_distance(kg, isect->prim, P, D);
 
 	P = P + D*rt;
 
@@ -1021,10 +1244,7 @@ __device_inline float3 bvh_triangle_refine_subsurface(KernelGlobals *kg, ShaderD
 
 	P = P + D*t;
 
-	float4 v00 = kernel_tex_fetch(__tri_woop, isect->prim*TRI_NODE_SIZE+0);
-	float Oz = v00.w - P.x*v00.x - P.y*v00.y - P.z*v00.z;
-	float invDz = 1.0f/(D.x*v00.x + D.y*v00.y + D.z*v00.z);
-	float rt = Oz * invDz;
+	float rt = bvh_triangle_plane_distance(kg, isect->prim, P, D);
 
 	P = P + D*rt;
 
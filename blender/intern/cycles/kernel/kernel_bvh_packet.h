@@ -0,0 +1,429 @@
+/*
+ * Copyright 2011-2013 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Packet BVH traversal for the CPU kernel.
+ *
+ * Up to four rays traverse the BVH together, one ray per SSE lane. Every node
+ * is fetched once for the whole packet and tested against all active rays,
+ * which pays off for coherent rays like camera rays from neighbouring pixels.
+ * Each stack entry remembers which rays hit the node, so rays that leave the
+ * packet do not cost triangle tests.
+ *
+ * Only triangles and instancing without object motion are supported, callers
+ * must use scene_intersect for scenes with hair or motion blur. */
+
+CCL_NAMESPACE_BEGIN
+
+#define BVH_PACKET_SIZE 4
+#define BVH_PACKET_MASK ((1 << BVH_PACKET_SIZE) - 1)
+
+typedef union PacketFloat {
+	__m128 m128;
+	float v[BVH_PACKET_SIZE];
+} PacketFloat;
+
+/* traversal statistics, to detect when rays are no longer coherent */
+typedef struct PacketStats {
+	int num_nodes;	/* nodes visited by the packet */
+	int num_lanes;	/* active rays summed over visited nodes */
+} PacketStats;
+
+__device_inline int bvh_packet_count(int mask)
+{
+	return (mask & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + ((mask >> 3) & 1);
+}
+
+__device_inline __m128 bvh_packet_select(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+/* transpose ray origins and directions into SSE registers */
+__device_inline void bvh_packet_load(const float3 *P, const float3 *idir, __m128 *Pv, __m128 *idirv, __m128 *dirv)
+{
+	Pv[0] = _mm_setr_ps(P[0].x, P[1].x, P[2].x, P[3].x);
+	Pv[1] = _mm_setr_ps(P[0].y, P[1].y, P[2].y, P[3].y);
+	Pv[2] = _mm_setr_ps(P[0].z, P[1].z, P[2].z, P[3].z);
+
+	idirv[0] = _mm_setr_ps(idir[0].x, idir[1].x, idir[2].x, idir[3].x);
+	idirv[1] = _mm_setr_ps(idir[0].y, idir[1].y, idir[2].y, idir[3].y);
+	idirv[2] = _mm_setr_ps(idir[0].z, idir[1].z, idir[2].z, idir[3].z);
+
+	const __m128 one = _mm_set_ps1(1.0f);
+
+	dirv[0] = _mm_div_ps(one, idirv[0]);
+	dirv[1] = _mm_div_ps(one, idirv[1]);
+	dirv[2] = _mm_div_ps(one, idirv[2]);
+}
+
+/* intersect all rays with one child bounding box, returns hit mask */
+__device_inline int bvh_packet_node_intersect(const __m128 *P, const __m128 *idir, const __m128 tmax,
+	float lox, float hix, float loy, float hiy, float loz, float hiz, __m128 *tnear)
+{
+	const __m128 t0x = _mm_mul_ps(_mm_sub_ps(_mm_set_ps1(lox), P[0]), idir[0]);
+	const __m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_set_ps1(hix), P[0]), idir[0]);
+	const __m128 t0y = _mm_mul_ps(_mm_sub_ps(_mm_set_ps1(loy), P[1]), idir[1]);
+	const __m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_set_ps1(hiy), P[1]), idir[1]);
+	const __m128 t0z = _mm_mul_ps(_mm_sub_ps(_mm_set_ps1(loz), P[2]), idir[2]);
+	const __m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_set_ps1(hiz), P[2]), idir[2]);
+
+	const __m128 tminxy = _mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y));
+	const __m128 tminz = _mm_max_ps(_mm_min_ps(t0z, t1z), _mm_setzero_ps());
+	const __m128 tmaxxy = _mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y));
+	const __m128 tmaxz = _mm_min_ps(_mm_max_ps(t0z, t1z), tmax);
+
+	const __m128 tmin = _mm_max_ps(tminxy, tminz);
+	const __m128 tfar = _mm_min_ps(tmaxxy, tmaxz);
+
+	*tnear = tmin;
+
+	return _mm_movemask_ps(_mm_cmple_ps(tmin, tfar));
+}
+
+/* Woop triangle computed from the vertices, for compact triangle storage.
+ * Same as BVH::pack_triangle, the setup cost is shared by all rays. */
+__device_inline void bvh_packet_triangle_woop(KernelGlobals *kg, int triAddr, float4 *v00, float4 *v11, float4 *v22)
+{
+	float3 v0, v1, v2;
+	bvh_triangle_vertices(kg, triAddr, &v0, &v1, &v2);
+
+	float3 r0 = v0 - v2;
+	float3 r1 = v1 - v2;
+	float3 r2 = cross(r0, r1);
+	float det = dot(r2, r2);
+
+	if(det == 0.0f) {
+		/* degenerate */
+		*v00 = make_float4(0.0f, 0.0f, 0.0f, 0.0f);
+		*v11 = make_float4(0.0f, 0.0f, 0.0f, 0.0f);
+		*v22 = make_float4(0.0f, 0.0f, 0.0f, 0.0f);
+		return;
+	}
+
+	/* rows of the inverse of the matrix with columns r0, r1, r2 */
+	float invdet = 1.0f/det;
+	float3 ix = cross(r1, r2)*invdet;
+	float3 iy = cross(r2, r0)*invdet;
+	float3 iz = r2*invdet;
+
+	*v00 = make_float4(iz.x, iz.y, iz.z, dot(iz, v2));
+	*v11 = make_float4(ix.x, ix.y, ix.z, -dot(ix, v2));
+	*v22 = make_float4(iy.x, iy.y, iy.z, -dot(iy, v2));
+}
+
+/* Sven Woop's algorithm, one triangle against all rays */
+__device_inline int bvh_packet_triangle_intersect(KernelGlobals *kg, const __m128 *P, const __m128 *dir,
+	PacketFloat *t, PacketFloat *u, PacketFloat *v, int mask, uint visibility, int triAddr)
+{
+	float4 v00, v11, v22;
+
+	if(kernel_data.bvh.use_compact_triangles) {
+		bvh_packet_triangle_woop(kg, triAddr, &v00, &v11, &v22);
+	}
+	else {
+		v00 = kernel_tex_fetch(__tri_woop, triAddr*TRI_NODE_SIZE+0);
+		v11 = kernel_tex_fetch(__tri_woop, triAddr*TRI_NODE_SIZE+1);
+		v22 = kernel_tex_fetch(__tri_woop, triAddr*TRI_NODE_SIZE+2);
+	}
+
+	/* compute and check intersection t-value */
+	const __m128 Oz = _mm_sub_ps(_mm_set_ps1(v00.w),
+		_mm_add_ps(_mm_add_ps(_mm_mul_ps(P[0], _mm_set_ps1(v00.x)), _mm_mul_ps(P[1], _mm_set_ps1(v00.y))), _mm_mul_ps(P[2], _mm_set_ps1(v00.z))));
+	const __m128 Dz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dir[0], _mm_set_ps1(v00.x)), _mm_mul_ps(dir[1], _mm_set_ps1(v00.y))), _mm_mul_ps(dir[2], _mm_set_ps1(v00.z)));
+	const __m128 tt = _mm_div_ps(Oz, Dz);
+
+	__m128 valid = _mm_and_ps(_mm_cmpgt_ps(tt, _mm_setzero_ps()), _mm_cmplt_ps(tt, t->m128));
+
+	if(!(_mm_movemask_ps(valid) & mask))
+		return 0;
+
+	/* compute and check barycentric u */
+	const __m128 Ox = _mm_add_ps(_mm_set_ps1(v11.w),
+		_mm_add_ps(_mm_add_ps(_mm_mul_ps(P[0], _mm_set_ps1(v11.x)), _mm_mul_ps(P[1], _mm_set_ps1(v11.y))), _mm_mul_ps(P[2], _mm_set_ps1(v11.z))));
+	const __m128 Dx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dir[0], _mm_set_ps1(v11.x)), _mm_mul_ps(dir[1], _mm_set_ps1(v11.y))), _mm_mul_ps(dir[2], _mm_set_ps1(v11.z)));
+	const __m128 uu = _mm_add_ps(Ox, _mm_mul_ps(tt, Dx));
+
+	/* compute and check barycentric v */
+	const __m128 Oy = _mm_add_ps(_mm_set_ps1(v22.w),
+		_mm_add_ps(_mm_add_ps(_mm_mul_ps(P[0], _mm_set_ps1(v22.x)), _mm_mul_ps(P[1], _mm_set_ps1(v22.y))), _mm_mul_ps(P[2], _mm_set_ps1(v22.z))));
+	const __m128 Dy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dir[0], _mm_set_ps1(v22.x)), _mm_mul_ps(dir[1], _mm_set_ps1(v22.y))), _mm_mul_ps(dir[2], _mm_set_ps1(v22.z)));
+	const __m128 vv = _mm_add_ps(Oy, _mm_mul_ps(tt, Dy));
+
+	valid = _mm_and_ps(valid, _mm_cmpge_ps(uu, _mm_setzero_ps()));
+	valid = _mm_and_ps(valid, _mm_cmpge_ps(vv, _mm_setzero_ps()));
+	valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(uu, vv), _mm_set_ps1(1.0f)));
+
+	int hit = _mm_movemask_ps(valid) & mask;
+
+#ifdef __VISIBILITY_FLAG__
+	/* visibility flag test, same for all rays in the packet */
+	if(hit && !(kernel_tex_fetch(__prim_visibility, triAddr) & visibility))
+		return 0;
+#endif
+
+	if(hit) {
+		/* record intersection */
+		const __m128 hitmask = _mm_castsi128_ps(_mm_setr_epi32(
+			(hit & 1)? ~0: 0, (hit & 2)? ~0: 0, (hit & 4)? ~0: 0, (hit & 8)? ~0: 0));
+
+		t->m128 = bvh_packet_select(hitmask, tt, t->m128);
+		u->m128 = bvh_packet_select(hitmask, uu, u->m128);
+		v->m128 = bvh_packet_select(hitmask, vv, v->m128);
+	}
+
+	return hit;
+}
+
+/* Intersect a packet of rays with the scene. Rays not in ray_mask are
+ * ignored and their intersection is left untouched. Returns the mask of rays
+ * that hit something. */
+__device int bvh_intersect_packet(KernelGlobals *kg, const Ray *ray, Intersection *isect,
+	int ray_mask, const uint visibility, PacketStats *stats)
+{
+	/* traversal stack, with the rays that intersected each node */
+	int traversalStack[BVH_STACK_SIZE];
+	int traversalMask[BVH_STACK_SIZE];
+	traversalStack[0] = ENTRYPOINT_SENTINEL;
+	traversalMask[0] = 0;
+
+	/* traversal variables */
+	int stackPtr = 0;
+	int nodeAddr = kernel_data.bvh.root;
+	int nodeMask = ray_mask;
+	int activeMask = ray_mask;
+	int object = ~0;
+
+	/* ray parameters */
+	float3 P[BVH_PACKET_SIZE], idir[BVH_PACKET_SIZE];
+	PacketFloat t, u, v;
+	int prim[BVH_PACKET_SIZE], hit_object[BVH_PACKET_SIZE];
+
+	for(int i = 0; i < BVH_PACKET_SIZE; i++) {
+		if(ray_mask & (1 << i)) {
+			P[i] = ray[i].P;
+			idir[i] = bvh_inverse_direction(ray[i].D);
+			t.v[i] = ray[i].t;
+		}
+		else {
+			P[i] = make_float3(0.0f, 0.0f, 0.0f);
+			idir[i] = make_float3(1.0f, 1.0f, 1.0f);
+			t.v[i] = 0.0f;
+		}
+
+		prim[i] = ~0;
+		hit_object[i] = ~0;
+	}
+
+	u.m128 = _mm_setzero_ps();
+	v.m128 = _mm_setzero_ps();
+
+	__m128 Pv[3], idirv[3], dirv[3];
+	bvh_packet_load(P, idir, Pv, idirv, dirv);
+
+	/* traversal loop */
+	do {
+		do
+		{
+			/* traverse internal nodes */
+			while(nodeAddr >= 0 && nodeAddr != ENTRYPOINT_SENTINEL)
+			{
+				nodeMask &= activeMask;
+
+				if(nodeMask == 0) {
+					/* no rays left for this node */
+					nodeAddr = traversalStack[stackPtr];
+					nodeMask = traversalMask[stackPtr];
+					--stackPtr;
+					continue;
+				}
+
+				stats->num_nodes++;
+				stats->num_lanes += bvh_packet_count(nodeMask);
+
+				/* fetch node data */
+				float4 node0 = kernel_tex_fetch(__bvh_nodes, nodeAddr*BVH_NODE_SIZE+0);
+				float4 node1 = kernel_tex_fetch(__bvh_nodes, nodeAddr*BVH_NODE_SIZE+1);
+				float4 node2 = kernel_tex_fetch(__bvh_nodes, nodeAddr*BVH_NODE_SIZE+2);
+				float4 cnodes = kernel_tex_fetch(__bvh_nodes, nodeAddr*BVH_NODE_SIZE+3);
+
+				/* intersect rays against child nodes */
+				__m128 c0near, c1near;
+				int c0mask = bvh_packet_node_intersect(Pv, idirv, t.m128,
+					node0.x, node0.z, node1.x, node1.z, node2.x, node2.z, &c0near) & nodeMask;
+				int c1mask = bvh_packet_node_intersect(Pv, idirv, t.m128,
+					node0.y, node0.w, node1.y, node1.w, node2.y, node2.w, &c1near) & nodeMask;
+
+#ifdef __VISIBILITY_FLAG__
+				if(!(__float_as_uint(cnodes.z) & visibility))
+					c0mask = 0;
+				if(!(__float_as_uint(cnodes.w) & visibility))
+					c1mask = 0;
+#endif
+
+				nodeAddr = __float_as_int(cnodes.x);
+				int nodeAddrChild1 = __float_as_int(cnodes.y);
+
+				if(c0mask && c1mask) {
+					/* both children were intersected, visit the one that is
+					 * closest for most rays first and push the other */
+					int both = c0mask & c1mask;
+					int closer1 = _mm_movemask_ps(_mm_cmplt_ps(c1near, c0near)) & both;
+
+					if(bvh_packet_count(closer1)*2 > bvh_packet_count(both)) {
+						int tmp = nodeAddr;
+						nodeAddr = nodeAddrChild1;
+						nodeAddrChild1 = tmp;
+
+						tmp = c0mask;
+						c0mask = c1mask;
+						c1mask = tmp;
+					}
+
+					++stackPtr;
+					traversalStack[stackPtr] = nodeAddrChild1;
+					traversalMask[stackPtr] = c1mask;
+
+					nodeMask = c0mask;
+				}
+				else if(c1mask) {
+					nodeAddr = nodeAddrChild1;
+					nodeMask = c1mask;
+				}
+				else if(c0mask) {
+					nodeMask = c0mask;
+				}
+				else {
+					/* neither child was intersected */
+					nodeAddr = traversalStack[stackPtr];
+					nodeMask = traversalMask[stackPtr];
+					--stackPtr;
+				}
+			}
+
+			/* if node is leaf, fetch triangle list */
+			if(nodeAddr < 0) {
+				float4 leaf = kernel_tex_fetch(__bvh_nodes, (-nodeAddr-1)*BVH_NODE_SIZE+(BVH_NODE_SIZE-1));
+				int primAddr = __float_as_int(leaf.x);
+				int leafMask = nodeMask & activeMask;
+
+#ifdef __INSTANCING__
+				if(primAddr >= 0) {
+#endif
+					int primAddr2 = __float_as_int(leaf.y);
+
+					/* pop */
+					nodeAddr = traversalStack[stackPtr];
+					nodeMask = traversalMask[stackPtr];
+					--stackPtr;
+
+					/* primitive intersection */
+					while(primAddr < primAddr2 && leafMask) {
+						int hit = bvh_packet_triangle_intersect(kg, Pv, dirv, &t, &u, &v, leafMask, visibility, primAddr);
+
+						if(hit) {
+							for(int i = 0; i < BVH_PACKET_SIZE; i++) {
+								if(hit & (1 << i)) {
+									prim[i] = primAddr;
+									hit_object[i] = object;
+								}
+							}
+
+							/* shadow ray early termination */
+							if(visibility == PATH_RAY_SHADOW_OPAQUE) {
+								activeMask &= ~hit;
+								leafMask &= ~hit;
+							}
+						}
+
+						primAddr++;
+					}
+#ifdef __INSTANCING__
+				}
+				else {
+					/* instance push, for all rays so that pop can restore them */
+					object = kernel_tex_fetch(__prim_object, -primAddr-1);
+
+					for(int i = 0; i < BVH_PACKET_SIZE; i++)
+						if(ray_mask & (1 << i))
+							bvh_instance_push(kg, object, &ray[i], &P[i], &idir[i], &t.v[i], ray[i].t);
+
+					bvh_packet_load(P, idir, Pv, idirv, dirv);
+
+					++stackPtr;
+					traversalStack[stackPtr] = ENTRYPOINT_SENTINEL;
+					traversalMask[stackPtr] = 0;
+
+					nodeAddr = kernel_tex_fetch(__object_node, object);
+					nodeMask = leafMask;
+				}
+#endif
+			}
+
+			/* all shadow rays are blocked */
+			if(activeMask == 0)
+				break;
+		} while(nodeAddr != ENTRYPOINT_SENTINEL);
+
+		if(activeMask == 0)
+			break;
+
+#ifdef __INSTANCING__
+		if(stackPtr >= 0) {
+			kernel_assert(object != ~0);
+
+			/* instance pop */
+			for(int i = 0; i < BVH_PACKET_SIZE; i++)
+				if(ray_mask & (1 << i))
+					bvh_instance_pop(kg, object, &ray[i], &P[i], &idir[i], &t.v[i], ray[i].t);
+
+			bvh_packet_load(P, idir, Pv, idirv, dirv);
+
+			object = ~0;
+			nodeAddr = traversalStack[stackPtr];
+			nodeMask = traversalMask[stackPtr];
+			--stackPtr;
+		}
+#endif
+	} while(nodeAddr != ENTRYPOINT_SENTINEL);
+
+	/* write intersections */
+	int hit_mask = 0;
+
+	for(int i = 0; i < BVH_PACKET_SIZE; i++) {
+		if(!(ray_mask & (1 << i)))
+			continue;
+
+		isect[i].t = t.v[i];
+		isect[i].u = u.v[i];
+		isect[i].v = v.v[i];
+		isect[i].prim = prim[i];
+		isect[i].object = hit_object[i];
+
+		if(prim[i] != ~0)
+			hit_mask |= (1 << i);
+	}
+
+	return hit_mask;
+}
+
+/* test if the scene can be traversed with packets */
+__device_inline bool bvh_packet_supported(KernelGlobals *kg)
+{
+	return !(kernel_data.bvh.have_motion || kernel_data.bvh.have_curves);
+}
+
+CCL_NAMESPACE_END
+
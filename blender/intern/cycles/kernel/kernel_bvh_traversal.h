@@ -69,6 +69,11 @@ __device bool BVH_FUNCTION_NAME
 	isect->u = 0.0f;
 	isect->v = 0.0f;
 
+#ifdef __RAY_STATS__
+	isect->num_traversal_steps = 0;
+	isect->num_primitive_tests = 0;
+#endif
+
 #if defined(__KERNEL_SSE2__) && !FEATURE(BVH_HAIR_MINIMUM_WIDTH)
 	const shuffle_swap_t shuf_identity = shuffle_swap_identity();
 	const shuffle_swap_t shuf_swap = shuffle_swap_swap();
@@ -101,6 +106,10 @@ __device bool BVH_FUNCTION_NAME
 				bool traverseChild0, traverseChild1;
 				int nodeAddrChild1;
 
+#ifdef __RAY_STATS__
+				isect->num_traversal_steps++;
+#endif
+
 #if !defined(__KERNEL_SSE2__) || FEATURE(BVH_HAIR_MINIMUM_WIDTH)
 				/* Intersect two child bounding boxes, non-SSE version */
 				float t = isect->t;
@@ -230,6 +239,10 @@ __device bool BVH_FUNCTION_NAME
 					nodeAddr = traversalStack[stackPtr];
 					--stackPtr;
 
+#ifdef __RAY_STATS__
+					isect->num_primitive_tests += primAddr2 - primAddr;
+#endif
+
 					/* primitive intersection */
 					while(primAddr < primAddr2) {
 						bool hit;
@@ -242,8 +255,11 @@ __device bool BVH_FUNCTION_NAME
 							if(kernel_data.curve.curveflags & CURVE_KN_INTERPOLATE) 
 #if FEATURE(BVH_HAIR_MINIMUM_WIDTH)
 								hit = bvh_cardinal_curve_intersect(kg, isect, P, idir, visibility, object, primAddr, segment, lcg_state, difl, extmax);
-							else
-								hit = bvh_curve_intersect(kg, isect, P, idir, visibility, object, primAddr, segment, lcg_state, difl, extmax);
+							else {
+								/* the leaf holds only curve segments, test them all at once */
+								hit = bvh_curve_intersect_leaf(kg, isect, P, idir, visibility, object, primAddr, primAddr2, lcg_state, difl, extmax);
+								primAddr = primAddr2 - 1;
+							}
 #else
 								hit = bvh_cardinal_curve_intersect(kg, isect, P, idir, visibility, object, primAddr, segment);
 							else
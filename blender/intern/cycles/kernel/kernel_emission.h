@@ -172,7 +172,19 @@ __device_noinline float3 indirect_primitive_emission(KernelGlobals *kg, ShaderDa
 #endif
 		/* multiple importance sampling, get triangle light pdf,
 		 * and compute weight with respect to BSDF pdf */
-		float pdf = triangle_light_pdf(kg, sd->Ng, sd->I, t);
+		float pdf = kernel_data.integrator.pdf_triangles;
+
+		if(kernel_data.integrator.use_light_tree) {
+			/* picking probability depends on the previous shading point */
+			int emitter = light_tree_triangle_emitter(kg, sd->object, sd->prim);
+
+			if(emitter == -1)
+				pdf = 0.0f;
+			else
+				pdf = light_tree_pdf(kg, sd->P + sd->I*t, emitter)*kernel_tex_fetch(__light_tree_emitters, emitter).y;
+		}
+
+		pdf = triangle_light_pdf(kg, sd->Ng, sd->I, t, pdf);
 		float mis_weight = power_heuristic(bsdf_pdf, pdf);
 
 		return L*mis_weight;
@@ -186,12 +198,13 @@ __device_noinline float3 indirect_primitive_emission(KernelGlobals *kg, ShaderDa
 __device_noinline bool indirect_lamp_emission(KernelGlobals *kg, Ray *ray, int path_flag, float bsdf_pdf, float randt, float3 *emission, int bounce)
 {
 	LightSample ls;
-	int lamp = lamp_light_eval_sample(kg, randt);
+	float inv_select_pdf;
+	int lamp = lamp_light_eval_sample(kg, randt, ray->P, &inv_select_pdf);
 
 	if(lamp == ~0)
 		return false;
 
-	if(!lamp_light_eval(kg, lamp, ray->P, ray->D, ray->t, &ls))
+	if(!lamp_light_eval(kg, lamp, ray->P, ray->D, ray->t, inv_select_pdf, &ls))
 		return false;
 
 #ifdef __PASSES__
@@ -31,6 +31,9 @@ struct OSLThreadData;
 struct OSLShadingSystem;
 #endif
 
+class ImageCache;
+struct ImageCacheThreadData;
+
 #define MAX_BYTE_IMAGES   512
 #define MAX_FLOAT_IMAGES  5
 
@@ -52,6 +55,15 @@ typedef struct KernelGlobals {
 	OSLThreadData *osl_tdata;
 #endif
 
+	/* paged image textures, NULL if all images are in texture_*_images */
+	ImageCache *image_cache;
+	ImageCacheThreadData *image_cache_tdata;
+
+#ifdef __RAY_STATS__
+	/* rays traced by this thread, per RayStatsType */
+	uint64_t num_rays[RAY_STATS_NUM];
+#endif
+
 } KernelGlobals;
 
 #endif
@@ -36,6 +36,15 @@ typedef struct LightSample {
 
 #ifdef __BACKGROUND_MIS__
 
+__device float background_light_select_pdf(KernelGlobals *kg)
+{
+	/* with the light tree, infinite lights are picked with a fixed probability */
+	if(kernel_data.integrator.use_light_tree)
+		return kernel_data.integrator.light_tree_pdf_background;
+
+	return kernel_data.integrator.pdf_lights;
+}
+
 __device float3 background_light_sample(KernelGlobals *kg, float randu, float randv, float *pdf)
 {
 	/* for the following, the CDF values are actually a pair of floats, with the
@@ -106,7 +115,7 @@ __device float3 background_light_sample(KernelGlobals *kg, float randu, float ra
 	else
 		*pdf = (cdf_u.x * cdf_v.x)/(M_2PI_F * M_PI_F * sin_theta * denom);
 
-	*pdf *= kernel_data.integrator.pdf_lights;
+	*pdf *= background_light_select_pdf(kg);
 
 	/* compute direction */
 	return -equirectangular_to_direction(u, v);
@@ -140,7 +149,7 @@ __device float background_light_pdf(KernelGlobals *kg, float3 direction)
 
 	float pdf = (cdf_u.x * cdf_v.x)/(M_2PI_F * M_PI_F * sin_theta * denom);
 
-	return pdf * kernel_data.integrator.pdf_lights;
+	return pdf * background_light_select_pdf(kg);
 }
 #endif
 
@@ -208,7 +217,7 @@ __device float lamp_light_pdf(KernelGlobals *kg, const float3 Ng, const float3 I
 }
 
 __device void lamp_light_sample(KernelGlobals *kg, int lamp,
-	float randu, float randv, float3 P, LightSample *ls)
+	float randu, float randv, float3 P, float inv_select_pdf, LightSample *ls)
 {
 	float4 data0 = kernel_tex_fetch(__light_data, lamp*LIGHT_SIZE + 0);
 	float4 data1 = kernel_tex_fetch(__light_data, lamp*LIGHT_SIZE + 1);
@@ -237,7 +246,7 @@ __device void lamp_light_sample(KernelGlobals *kg, int lamp,
 
 		float costheta = dot(lightD, D);
 		ls->pdf = invarea/(costheta*costheta*costheta);
-		ls->eval_fac = ls->pdf*kernel_data.integrator.inv_pdf_lights;
+		ls->eval_fac = ls->pdf*inv_select_pdf;
 	}
 #ifdef __BACKGROUND_MIS__
 	else if(type == LIGHT_BACKGROUND) {
@@ -293,12 +302,12 @@ __device void lamp_light_sample(KernelGlobals *kg, int lamp,
 			ls->pdf = invarea;
 		}
 
-		ls->eval_fac *= kernel_data.integrator.inv_pdf_lights;
+		ls->eval_fac *= inv_select_pdf;
 		ls->pdf *= lamp_light_pdf(kg, ls->Ng, -ls->D, ls->t);
 	}
 }
 
-__device bool lamp_light_eval(KernelGlobals *kg, int lamp, float3 P, float3 D, float t, LightSample *ls)
+__device bool lamp_light_eval(KernelGlobals *kg, int lamp, float3 P, float3 D, float t, float inv_select_pdf, LightSample *ls)
 {
 	float4 data0 = kernel_tex_fetch(__light_data, lamp*LIGHT_SIZE + 0);
 	float4 data1 = kernel_tex_fetch(__light_data, lamp*LIGHT_SIZE + 1);
@@ -415,7 +424,7 @@ __device bool lamp_light_eval(KernelGlobals *kg, int lamp, float3 P, float3 D, f
 	/* compute pdf */
 	if(ls->t != FLT_MAX)
 		ls->pdf *= lamp_light_pdf(kg, ls->Ng, -ls->D, ls->t);
-	ls->eval_fac *= kernel_data.integrator.inv_pdf_lights;
+	ls->eval_fac *= inv_select_pdf;
 
 	return true;
 }
@@ -458,9 +467,8 @@ __device void triangle_light_sample(KernelGlobals *kg, int prim, int object,
 }
 
 __device float triangle_light_pdf(KernelGlobals *kg,
-	const float3 Ng, const float3 I, float t)
+	const float3 Ng, const float3 I, float t, float pdf)
 {
-	float pdf = kernel_data.integrator.pdf_triangles;
 	float cos_pi = fabsf(dot(Ng, I));
 
 	if(cos_pi == 0.0f)
@@ -542,12 +550,198 @@ __device int light_distribution_sample(KernelGlobals *kg, float randt)
 	return clamp(first-1, 0, kernel_data.integrator.num_distribution-1);
 }
 
+/* Light Tree */
+
+__device float light_tree_node_importance(KernelGlobals *kg, float3 P, int node)
+{
+	float4 data0 = kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 0);
+	float4 data1 = kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 1);
+
+	float energy = data0.w;
+
+	if(energy == 0.0f)
+		return 0.0f;
+
+	/* distance to the node, clamped to its size so that nodes containing the
+	 * shading point do not get an infinite importance */
+	float3 bmin = make_float3(data0.x, data0.y, data0.z);
+	float3 bmax = make_float3(data1.x, data1.y, data1.z);
+	float3 centroid = 0.5f*(bmin + bmax);
+	float radius2 = 0.25f*len_squared(bmax - bmin);
+	float3 V = P - centroid;
+	float dist2 = len_squared(V);
+
+	float importance = energy/max(max(dist2, radius2), 1e-8f);
+
+	/* orientation, skipped when light is emitted in all directions or when
+	 * the shading point is inside the bounds */
+	float theta_o = data1.w;
+
+	if(theta_o < M_PI_F && dist2 > radius2) {
+		float4 data2 = kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 2);
+		float3 axis = make_float3(data2.x, data2.y, data2.z);
+		float theta_e = data2.w;
+
+		float dist = sqrtf(dist2);
+		float theta = safe_acosf(dot(axis, V/dist));
+		float theta_u = safe_asinf(sqrtf(radius2/dist2));
+		float theta_p = max(theta - theta_o - theta_u, 0.0f);
+
+		if(theta_p > 0.0f && theta_p >= theta_e)
+			return 0.0f;
+
+		importance *= cosf(theta_p);
+	}
+
+	return importance;
+}
+
+__device bool light_tree_left_probability(KernelGlobals *kg, float3 P, int node, int right, float *prob)
+{
+	/* infinite lights are picked with a fixed probability */
+	float4 left_data3 = kernel_tex_fetch(__light_tree_nodes, (node + 1)*LIGHT_TREE_NODE_SIZE + 3);
+	float4 right_data3 = kernel_tex_fetch(__light_tree_nodes, right*LIGHT_TREE_NODE_SIZE + 3);
+
+	if(__float_as_int(left_data3.w) || __float_as_int(right_data3.w)) {
+		*prob = 0.5f;
+		return true;
+	}
+
+	float left_importance = light_tree_node_importance(kg, P, node + 1);
+	float right_importance = light_tree_node_importance(kg, P, right);
+	float total_importance = left_importance + right_importance;
+
+	if(total_importance == 0.0f)
+		return false;
+
+	*prob = left_importance/total_importance;
+	return true;
+}
+
+__device int light_tree_sample(KernelGlobals *kg, float randt, float3 P, float *pdf)
+{
+	/* traverse from the root, picking a child by importance and reusing the
+	 * random number for the next level */
+	int node = 0;
+
+	*pdf = 1.0f;
+
+	while(true) {
+		float4 data3 = kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 3);
+		int num_emitters = __float_as_int(data3.y);
+
+		if(num_emitters) {
+			/* leaf, pick emitter proportional to energy */
+			int first = __float_as_int(data3.x);
+			float leaf_energy = kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 0).w;
+
+			if(leaf_energy == 0.0f)
+				break;
+
+			float target = randt*leaf_energy;
+			float sum = 0.0f;
+
+			for(int i = 0; i < num_emitters; i++) {
+				float energy = kernel_tex_fetch(__light_tree_emitters, first + i).x;
+				sum += energy;
+
+				if(target < sum || i == num_emitters - 1) {
+					*pdf *= energy/leaf_energy;
+					return first + i;
+				}
+			}
+		}
+
+		int right = __float_as_int(data3.x);
+		float prob;
+
+		if(!light_tree_left_probability(kg, P, node, right, &prob))
+			break;
+
+		if(randt < prob) {
+			randt = randt/prob;
+			node = node + 1;
+			*pdf *= prob;
+		}
+		else {
+			randt = (randt - prob)/(1.0f - prob);
+			node = right;
+			*pdf *= 1.0f - prob;
+		}
+
+		randt = min(randt, 1.0f - 1e-7f);
+	}
+
+	*pdf = 0.0f;
+	return -1;
+}
+
+__device float light_tree_pdf(KernelGlobals *kg, float3 P, int emitter)
+{
+	/* walk up from the leaf to the root, multiplying picking probabilities */
+	float4 e = kernel_tex_fetch(__light_tree_emitters, emitter);
+	int node = __float_as_int(e.z);
+	float leaf_energy = kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 0).w;
+
+	if(leaf_energy == 0.0f)
+		return 0.0f;
+
+	float pdf = e.x/leaf_energy;
+
+	while(node != 0) {
+		int parent = __float_as_int(kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 3).z);
+		int right = __float_as_int(kernel_tex_fetch(__light_tree_nodes, parent*LIGHT_TREE_NODE_SIZE + 3).x);
+		float prob;
+
+		if(!light_tree_left_probability(kg, P, parent, right, &prob))
+			return 0.0f;
+
+		pdf *= (node == right)? 1.0f - prob: prob;
+		node = parent;
+	}
+
+	return pdf;
+}
+
+__device int light_tree_triangle_emitter(KernelGlobals *kg, int object, int prim)
+{
+	/* per object offset of its triangle table, and first triangle index */
+	uint offset = kernel_tex_fetch(__light_tree_triangles, object*2 + 0);
+
+	if(offset == 0)
+		return -1;
+
+	uint tri_offset = kernel_tex_fetch(__light_tree_triangles, object*2 + 1);
+
+	return (int)kernel_tex_fetch(__light_tree_triangles, offset + prim - tri_offset);
+}
+
 /* Generic Light */
 
 __device void light_sample(KernelGlobals *kg, float randt, float randu, float randv, float time, float3 P, LightSample *ls)
 {
 	/* sample index */
-	int index = light_distribution_sample(kg, randt);
+	int index;
+	float pdf_triangle = kernel_data.integrator.pdf_triangles;
+	float inv_select_pdf = kernel_data.integrator.inv_pdf_lights;
+
+	if(kernel_data.integrator.use_light_tree) {
+		/* pick by estimated contribution to the shading point */
+		float select_pdf;
+		int emitter = light_tree_sample(kg, randt, P, &select_pdf);
+
+		if(emitter == -1) {
+			ls->pdf = 0.0f;
+			return;
+		}
+
+		float4 e = kernel_tex_fetch(__light_tree_emitters, emitter);
+		index = __float_as_int(e.w);
+		pdf_triangle = select_pdf*e.y;
+		inv_select_pdf = 1.0f/select_pdf;
+	}
+	else
+		index = light_distribution_sample(kg, randt);
 
 	/* fetch light data */
 	float4 l = kernel_tex_fetch(__light_distribution, index);
@@ -568,12 +762,12 @@ __device void light_sample(KernelGlobals *kg, float randt, float randu, float ra
 
 		/* compute incoming direction, distance and pdf */
 		ls->D = normalize_len(ls->P - P, &ls->t);
-		ls->pdf = triangle_light_pdf(kg, ls->Ng, -ls->D, ls->t);
+		ls->pdf = triangle_light_pdf(kg, ls->Ng, -ls->D, ls->t, pdf_triangle);
 		ls->shader |= __float_as_int(l.z) & (~SHADER_MASK);
 	}
 	else {
 		int lamp = -prim-1;
-		lamp_light_sample(kg, lamp, randu, randv, P, ls);
+		lamp_light_sample(kg, lamp, randu, randv, P, inv_select_pdf, ls);
 	}
 }
 
@@ -585,13 +779,28 @@ __device int light_select_num_samples(KernelGlobals *kg, int index)
 
 __device void light_select(KernelGlobals *kg, int index, float randu, float randv, float3 P, LightSample *ls)
 {
-	lamp_light_sample(kg, index, randu, randv, P, ls);
+	lamp_light_sample(kg, index, randu, randv, P, kernel_data.integrator.inv_pdf_lights, ls);
 }
 
-__device int lamp_light_eval_sample(KernelGlobals *kg, float randt)
+__device int lamp_light_eval_sample(KernelGlobals *kg, float randt, float3 P, float *inv_select_pdf)
 {
 	/* sample index */
-	int index = light_distribution_sample(kg, randt);
+	int index;
+
+	if(kernel_data.integrator.use_light_tree) {
+		float select_pdf;
+		int emitter = light_tree_sample(kg, randt, P, &select_pdf);
+
+		if(emitter == -1)
+			return ~0;
+
+		index = __float_as_int(kernel_tex_fetch(__light_tree_emitters, emitter).w);
+		*inv_select_pdf = 1.0f/select_pdf;
+	}
+	else {
+		index = light_distribution_sample(kg, randt);
+		*inv_select_pdf = kernel_data.integrator.inv_pdf_lights;
+	}
 
 	/* fetch light data */
 	float4 l = kernel_tex_fetch(__light_distribution, index);
@@ -164,5 +164,47 @@ __device_inline void kernel_write_light_passes(KernelGlobals *kg, __global float
 #endif
 }
 
+__device_inline void kernel_write_variance_pass(KernelGlobals *kg, __global float *buffer, int sample, float4 L)
+{
+#ifdef __PASSES__
+	/* squared luminance, together with the combined pass this gives the
+	 * per pixel variance used for adaptive sampling */
+	if(kernel_data.film.pass_flag & PASS_VARIANCE) {
+		float f = average(float4_to_float3(L));
+		kernel_write_pass_float(buffer + kernel_data.film.pass_variance, sample, f*f);
+	}
+#endif
+}
+
+#ifdef __RAY_STATS__
+__device_inline void path_ray_stats_init(PathRayStats *stats)
+{
+	stats->num_traversal_steps = 0;
+	stats->num_primitive_tests = 0;
+	stats->num_shader_evaluations = 0;
+	stats->num_bounces = 0;
+}
+
+__device_inline void path_ray_stats_accum_isect(PathRayStats *stats, const Intersection *isect)
+{
+	stats->num_traversal_steps += isect->num_traversal_steps;
+	stats->num_primitive_tests += isect->num_primitive_tests;
+}
+
+__device_inline void kernel_write_ray_stats_passes(KernelGlobals *kg, __global float *buffer, PathRayStats *stats, int sample)
+{
+	int flag = kernel_data.film.pass_flag;
+
+	if(flag & PASS_BVH_TRAVERSAL_STEPS)
+		kernel_write_pass_float(buffer + kernel_data.film.pass_bvh_traversal_steps, sample, (float)stats->num_traversal_steps);
+	if(flag & PASS_PRIMITIVE_TESTS)
+		kernel_write_pass_float(buffer + kernel_data.film.pass_primitive_tests, sample, (float)stats->num_primitive_tests);
+	if(flag & PASS_SHADER_EVALUATIONS)
+		kernel_write_pass_float(buffer + kernel_data.film.pass_shader_evaluations, sample, (float)stats->num_shader_evaluations);
+	if(flag & PASS_RAY_BOUNCES)
+		kernel_write_pass_float(buffer + kernel_data.film.pass_ray_bounces, sample, (float)stats->num_bounces);
+}
+#endif
+
 CCL_NAMESPACE_END
 
@@ -28,6 +28,9 @@
 #include "kernel_projection.h"
 #include "kernel_random.h"
 #include "kernel_bvh.h"
+#ifdef __RAY_PACKETS__
+#include "kernel_bvh_packet.h"
+#endif
 #include "kernel_accumulate.h"
 #include "kernel_camera.h"
 #include "kernel_shader.h"
@@ -457,7 +460,9 @@ __device_inline bool kernel_path_integrate_lighting(KernelGlobals *kg, RNG *rng,
 
 #endif
 
-__device float4 kernel_path_integrate(KernelGlobals *kg, RNG *rng, int sample, Ray ray, __global float *buffer)
+/* camera_isect is the intersection of the camera ray when it was already traced
+ * as part of a packet, NULL otherwise */
+__device float4 kernel_path_integrate(KernelGlobals *kg, RNG *rng, int sample, Ray ray, __global float *buffer, const Intersection *camera_isect)
 {
 	/* initialize */
 	PathRadiance L;
@@ -481,31 +486,49 @@ __device float4 kernel_path_integrate(KernelGlobals *kg, RNG *rng, int sample, R
 
 	path_state_init(&state);
 
+#ifdef __RAY_STATS__
+	PathRayStats ray_stats;
+	path_ray_stats_init(&ray_stats);
+#endif
+
 	/* path iteration */
 	for(;; rng_offset += PRNG_BOUNCE_NUM) {
 		/* intersect scene */
 		Intersection isect;
-		uint visibility = path_state_ray_visibility(kg, &state);
+		bool hit;
+
+		if(camera_isect) {
+			isect = *camera_isect;
+			hit = (isect.prim != ~0);
+			camera_isect = NULL;
+		}
+		else {
+			uint visibility = path_state_ray_visibility(kg, &state);
 
 #ifdef __HAIR__
-		float difl = 0.0f, extmax = 0.0f;
-		uint lcg_state = 0;
+			float difl = 0.0f, extmax = 0.0f;
+			uint lcg_state = 0;
+
+			if(kernel_data.bvh.have_curves) {
+				if((kernel_data.cam.resolution == 1) && (state.flag & PATH_RAY_CAMERA)) {	
+					float3 pixdiff = ray.dD.dx + ray.dD.dy;
+					/*pixdiff = pixdiff - dot(pixdiff, ray.D)*ray.D;*/
+					difl = kernel_data.curve.minimum_width * len(pixdiff) * 0.5f;
+				}
 
-		if(kernel_data.bvh.have_curves) {
-			if((kernel_data.cam.resolution == 1) && (state.flag & PATH_RAY_CAMERA)) {	
-				float3 pixdiff = ray.dD.dx + ray.dD.dy;
-				/*pixdiff = pixdiff - dot(pixdiff, ray.D)*ray.D;*/
-				difl = kernel_data.curve.minimum_width * len(pixdiff) * 0.5f;
+				extmax = kernel_data.curve.maximum_width;
+				lcg_state = lcg_init(*rng + rng_offset + sample*0x51633e2d);
 			}
 
-			extmax = kernel_data.curve.maximum_width;
-			lcg_state = lcg_init(*rng + rng_offset + sample*0x51633e2d);
-		}
-
-		bool hit = scene_intersect(kg, &ray, visibility, &isect, &lcg_state, difl, extmax);
+			hit = scene_intersect(kg, &ray, visibility, &isect, &lcg_state, difl, extmax);
 #else
-		bool hit = scene_intersect(kg, &ray, visibility, &isect);
+			hit = scene_intersect(kg, &ray, visibility, &isect);
+#endif
+
+#ifdef __RAY_STATS__
+			path_ray_stats_accum_isect(&ray_stats, &isect);
 #endif
+		}
 
 #ifdef __LAMP_MIS__
 		if(kernel_data.integrator.use_lamp_mis && !(state.flag & PATH_RAY_CAMERA)) {
@@ -541,6 +564,10 @@ __device float4 kernel_path_integrate(KernelGlobals *kg, RNG *rng, int sample, R
 			}
 
 #ifdef __BACKGROUND__
+#ifdef __RAY_STATS__
+			ray_stats.num_shader_evaluations++;
+#endif
+
 			/* sample background shader */
 			float3 L_background = indirect_background(kg, &ray, state.flag, ray_pdf, state.bounce);
 			path_radiance_accum_background(&L, throughput, L_background, state.bounce);
@@ -555,6 +582,11 @@ __device float4 kernel_path_integrate(KernelGlobals *kg, RNG *rng, int sample, R
 		float rbsdf = path_rng_1D(kg, rng, sample, num_samples, rng_offset + PRNG_BSDF);
 		shader_eval_surface(kg, &sd, rbsdf, state.flag, SHADER_CONTEXT_MAIN);
 
+#ifdef __RAY_STATS__
+		ray_stats.num_shader_evaluations++;
+		ray_stats.num_bounces++;
+#endif
+
 		/* holdout */
 #ifdef __HOLDOUT__
 		if((sd.flag & (SD_HOLDOUT|SD_HOLDOUT_MASK)) && (state.flag & PATH_RAY_CAMERA)) {
@@ -796,6 +828,10 @@ __device float4 kernel_path_integrate(KernelGlobals *kg, RNG *rng, int sample, R
 
 	kernel_write_light_passes(kg, buffer, &L, sample);
 
+#ifdef __RAY_STATS__
+	kernel_write_ray_stats_passes(kg, buffer, &ray_stats, sample);
+#endif
+
 	return make_float4(L_sum.x, L_sum.y, L_sum.z, 1.0f - L_transparent);
 }
 
@@ -972,6 +1008,11 @@ __device float4 kernel_branched_path_integrate(KernelGlobals *kg, RNG *rng, int
 
 	path_state_init(&state);
 
+#ifdef __RAY_STATS__
+	PathRayStats ray_stats;
+	path_ray_stats_init(&ray_stats);
+#endif
+
 	for(;; rng_offset += PRNG_BOUNCE_NUM) {
 		/* intersect scene */
 		Intersection isect;
@@ -992,10 +1033,16 @@ __device float4 kernel_branched_path_integrate(KernelGlobals *kg, RNG *rng, int
 			lcg_state = lcg_init(*rng + rng_offset + sample*0x51633e2d);
 		}
 
-		if(!scene_intersect(kg, &ray, visibility, &isect, &lcg_state, difl, extmax)) {
+		bool hit = scene_intersect(kg, &ray, visibility, &isect, &lcg_state, difl, extmax);
 #else
-		if(!scene_intersect(kg, &ray, visibility, &isect)) {
+		bool hit = scene_intersect(kg, &ray, visibility, &isect);
 #endif
+
+#ifdef __RAY_STATS__
+		path_ray_stats_accum_isect(&ray_stats, &isect);
+#endif
+
+		if(!hit) {
 			/* eval background shader if nothing hit */
 			if(kernel_data.background.transparent) {
 				L_transparent += average(throughput);
@@ -1007,6 +1054,10 @@ __device float4 kernel_branched_path_integrate(KernelGlobals *kg, RNG *rng, int
 			}
 
 #ifdef __BACKGROUND__
+#ifdef __RAY_STATS__
+			ray_stats.num_shader_evaluations++;
+#endif
+
 			/* sample background shader */
 			float3 L_background = indirect_background(kg, &ray, state.flag, ray_pdf, state.bounce);
 			path_radiance_accum_background(&L, throughput, L_background, state.bounce);
@@ -1021,6 +1072,11 @@ __device float4 kernel_branched_path_integrate(KernelGlobals *kg, RNG *rng, int
 		shader_eval_surface(kg, &sd, 0.0f, state.flag, SHADER_CONTEXT_MAIN);
 		shader_merge_closures(kg, &sd);
 
+#ifdef __RAY_STATS__
+		ray_stats.num_shader_evaluations++;
+		ray_stats.num_bounces++;
+#endif
+
 		/* holdout */
 #ifdef __HOLDOUT__
 		if((sd.flag & (SD_HOLDOUT|SD_HOLDOUT_MASK))) {
@@ -1184,6 +1240,10 @@ __device float4 kernel_branched_path_integrate(KernelGlobals *kg, RNG *rng, int
 
 	kernel_write_light_passes(kg, buffer, &L, sample);
 
+#ifdef __RAY_STATS__
+	kernel_write_ray_stats_passes(kg, buffer, &ray_stats, sample);
+#endif
+
 	return make_float4(L_sum.x, L_sum.y, L_sum.z, 1.0f - L_transparent);
 }
 
@@ -1239,16 +1299,78 @@ __device void kernel_path_trace(KernelGlobals *kg,
 	float4 L;
 
 	if (ray.t != 0.0f)
-		L = kernel_path_integrate(kg, &rng, sample, ray, buffer);
+		L = kernel_path_integrate(kg, &rng, sample, ray, buffer, NULL);
 	else
 		L = make_float4(0.0f, 0.0f, 0.0f, 0.0f);
 
 	/* accumulate result in output buffer */
 	kernel_write_pass_float4(buffer, sample, L);
+	kernel_write_variance_pass(kg, buffer, sample, L);
 
 	path_rng_end(kg, rng_state, rng);
 }
 
+#ifdef __RAY_PACKETS__
+/* Trace a block of up to 2x2 pixels, with the camera rays intersected as one
+ * packet. The rest of each path is traced one ray at a time. */
+__device void kernel_path_trace_packet(KernelGlobals *kg,
+	__global float *buffer, __global uint *rng_state,
+	int sample, int x, int y, int w, int h, int offset, int stride, PacketStats *stats)
+{
+	int pass_stride = kernel_data.film.pass_stride;
+
+	RNG rng[BVH_PACKET_SIZE];
+	Ray ray[BVH_PACKET_SIZE];
+	Intersection isect[BVH_PACKET_SIZE];
+	int index[BVH_PACKET_SIZE];
+	int pixel_mask = 0;
+	int ray_mask = 0;
+
+	/* initialize random numbers and rays */
+	for(int i = 0; i < BVH_PACKET_SIZE; i++) {
+		int px = x + (i & 1);
+		int py = y + (i >> 1);
+
+		if(px >= x + w || py >= y + h)
+			continue;
+
+		index[i] = offset + px + py*stride;
+		pixel_mask |= (1 << i);
+
+		kernel_path_trace_setup(kg, rng_state + index[i], sample, px, py, &rng[i], &ray[i]);
+
+		if(ray[i].t != 0.0f)
+			ray_mask |= (1 << i);
+	}
+
+	/* intersect camera rays */
+	PathState state;
+	path_state_init(&state);
+
+	bvh_intersect_packet(kg, ray, isect, ray_mask, path_state_ray_visibility(kg, &state), stats);
+
+	/* integrate */
+	for(int i = 0; i < BVH_PACKET_SIZE; i++) {
+		if(!(pixel_mask & (1 << i)))
+			continue;
+
+		__global float *pixel_buffer = buffer + index[i]*pass_stride;
+		float4 L;
+
+		if(ray_mask & (1 << i))
+			L = kernel_path_integrate(kg, &rng[i], sample, ray[i], pixel_buffer, &isect[i]);
+		else
+			L = make_float4(0.0f, 0.0f, 0.0f, 0.0f);
+
+		/* accumulate result in output buffer */
+		kernel_write_pass_float4(pixel_buffer, sample, L);
+		kernel_write_variance_pass(kg, pixel_buffer, sample, L);
+
+		path_rng_end(kg, rng_state + index[i], rng[i]);
+	}
+}
+#endif
+
 #ifdef __BRANCHED_PATH__
 __device void kernel_branched_path_trace(KernelGlobals *kg,
 	__global float *buffer, __global uint *rng_state,
@@ -1277,10 +1399,49 @@ __device void kernel_branched_path_trace(KernelGlobals *kg,
 
 	/* accumulate result in output buffer */
 	kernel_write_pass_float4(buffer, sample, L);
+	kernel_write_variance_pass(kg, buffer, sample, L);
 
 	path_rng_end(kg, rng_state, rng);
 }
 #endif
 
+#ifdef __KERNEL_CPU__
+/* Trace a block of up to 2x2 pixels, with camera ray packets when supported,
+ * and falling back to single rays otherwise. Packet statistics are added to
+ * num_nodes and num_lanes. */
+__device void kernel_path_trace_block(KernelGlobals *kg,
+	__global float *buffer, __global uint *rng_state,
+	int sample, int x, int y, int w, int h, int offset, int stride, int *num_nodes, int *num_lanes)
+{
+#ifdef __RAY_PACKETS__
+#ifdef __BRANCHED_PATH__
+	if(!kernel_data.integrator.branched && bvh_packet_supported(kg))
+#else
+	if(bvh_packet_supported(kg))
+#endif
+	{
+		PacketStats stats = {0, 0};
+
+		kernel_path_trace_packet(kg, buffer, rng_state, sample, x, y, w, h, offset, stride, &stats);
+
+		*num_nodes += stats.num_nodes;
+		*num_lanes += stats.num_lanes;
+		return;
+	}
+#endif
+
+	for(int py = y; py < y + h; py++) {
+		for(int px = x; px < x + w; px++) {
+#ifdef __BRANCHED_PATH__
+			if(kernel_data.integrator.branched)
+				kernel_branched_path_trace(kg, buffer, rng_state, sample, px, py, offset, stride);
+			else
+#endif
+				kernel_path_trace(kg, buffer, rng_state, sample, px, py, offset, stride);
+		}
+	}
+}
+#endif
+
 CCL_NAMESPACE_END
 
@@ -99,9 +99,7 @@ void shader_setup_from_ray(KernelGlobals *kg, ShaderData *sd,
 	else {
 #endif
 		/* fetch triangle data */
-		float4 Ns = kernel_tex_fetch(__tri_normal, sd->prim);
-		float3 Ng = make_float3(Ns.x, Ns.y, Ns.z);
-		sd->shader = __float_as_int(Ns.w);
+		float3 Ng = triangle_normal_MT(kg, sd->prim, &sd->shader);
 
 #ifdef __HAIR__
 		sd->segment = ~0;
@@ -183,9 +181,7 @@ __device_inline void shader_setup_from_subsurface(KernelGlobals *kg, ShaderData
 	sd->prim = kernel_tex_fetch(__prim_index, isect->prim);
 
 	/* fetch triangle data */
-	float4 Ns = kernel_tex_fetch(__tri_normal, sd->prim);
-	float3 Ng = make_float3(Ns.x, Ns.y, Ns.z);
-	sd->shader = __float_as_int(Ns.w);
+	float3 Ng = triangle_normal_MT(kg, sd->prim, &sd->shader);
 
 #ifdef __HAIR__
 	sd->segment = ~0;
@@ -952,8 +948,7 @@ __device bool shader_transparent_shadow(KernelGlobals *kg, Intersection *isect)
 #ifdef __HAIR__
 	if(kernel_tex_fetch(__prim_segment, isect->prim) == ~0) {
 #endif
-		float4 Ns = kernel_tex_fetch(__tri_normal, prim);
-		shader = __float_as_int(Ns.w);
+		shader = triangle_shader(kg, prim);
 #ifdef __HAIR__
 	}
 	else {
@@ -38,6 +38,8 @@ KERNEL_TEX(float4, texture_float4, __objects_vector)
 /* triangles */
 KERNEL_TEX(float4, texture_float4, __tri_normal)
 KERNEL_TEX(float4, texture_float4, __tri_vnormal)
+KERNEL_TEX(uint, texture_uint, __tri_normal_packed)
+KERNEL_TEX(uint, texture_uint, __tri_vnormal_packed)
 KERNEL_TEX(float4, texture_float4, __tri_vindex)
 KERNEL_TEX(float4, texture_float4, __tri_verts)
 
@@ -55,6 +57,9 @@ KERNEL_TEX(float4, texture_float4, __light_distribution)
 KERNEL_TEX(float4, texture_float4, __light_data)
 KERNEL_TEX(float2, texture_float2, __light_background_marginal_cdf)
 KERNEL_TEX(float2, texture_float2, __light_background_conditional_cdf)
+KERNEL_TEX(float4, texture_float4, __light_tree_nodes)
+KERNEL_TEX(float4, texture_float4, __light_tree_emitters)
+KERNEL_TEX(uint, texture_uint, __light_tree_triangles)
 
 /* particles */
 KERNEL_TEX(float4, texture_float4, __particles)
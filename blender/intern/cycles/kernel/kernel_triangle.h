@@ -43,6 +43,42 @@ __device_inline float3 triangle_sample_MT(KernelGlobals *kg, int tri_index, floa
 	return triangle_point_MT(kg, tri_index, u, v);
 }
 
+/* Decode octahedral normal with 16 bits per component, as packed for
+ * compact triangle storage */
+__device_inline float3 triangle_normal_decode(uint packed)
+{
+	int ix = (int)(packed & 0xffff);
+	int iy = (int)(packed >> 16);
+
+	/* sign extend */
+	if(ix & 0x8000) ix -= 0x10000;
+	if(iy & 0x8000) iy -= 0x10000;
+
+	float x = max(ix*(1.0f/32767.0f), -1.0f);
+	float y = max(iy*(1.0f/32767.0f), -1.0f);
+	float z = 1.0f - fabsf(x) - fabsf(y);
+
+	/* unfold the lower hemisphere */
+	if(z < 0.0f) {
+		float fx = (1.0f - fabsf(y))*signf(x);
+		float fy = (1.0f - fabsf(x))*signf(y);
+		x = fx;
+		y = fy;
+	}
+
+	return normalize(make_float3(x, y, z));
+}
+
+/* Shader of triangle */
+__device_inline int triangle_shader(KernelGlobals *kg, int tri_index)
+{
+	if(kernel_data.bvh.use_compact_triangles)
+		return (int)kernel_tex_fetch(__tri_normal_packed, tri_index*2 + 1);
+
+	float4 Nm = kernel_tex_fetch(__tri_normal, tri_index);
+	return __float_as_int(Nm.w);
+}
+
 /* Normal for Moller-Trumbore triangles */
 __device_inline float3 triangle_normal_MT(KernelGlobals *kg, int tri_index, int *shader)
 {
@@ -57,6 +93,11 @@ __device_inline float3 triangle_normal_MT(KernelGlobals *kg, int tri_index, int
 	/* compute normal */
 	return normalize(cross(v2 - v0, v1 - v0));
 #else
+	if(kernel_data.bvh.use_compact_triangles) {
+		*shader = (int)kernel_tex_fetch(__tri_normal_packed, tri_index*2 + 1);
+		return triangle_normal_decode(kernel_tex_fetch(__tri_normal_packed, tri_index*2 + 0));
+	}
+
 	float4 Nm = kernel_tex_fetch(__tri_normal, tri_index);
 	*shader = __float_as_int(Nm.w);
 	return make_float3(Nm.x, Nm.y, Nm.z);
@@ -79,9 +120,18 @@ __device_inline float3 triangle_smooth_normal(KernelGlobals *kg, int tri_index,
 	/* load triangle vertices */
 	float3 tri_vindex = float4_to_float3(kernel_tex_fetch(__tri_vindex, tri_index));
 
-	float3 n0 = float4_to_float3(kernel_tex_fetch(__tri_vnormal, __float_as_int(tri_vindex.x)));
-	float3 n1 = float4_to_float3(kernel_tex_fetch(__tri_vnormal, __float_as_int(tri_vindex.y)));
-	float3 n2 = float4_to_float3(kernel_tex_fetch(__tri_vnormal, __float_as_int(tri_vindex.z)));
+	float3 n0, n1, n2;
+
+	if(kernel_data.bvh.use_compact_triangles) {
+		n0 = triangle_normal_decode(kernel_tex_fetch(__tri_vnormal_packed, __float_as_int(tri_vindex.x)));
+		n1 = triangle_normal_decode(kernel_tex_fetch(__tri_vnormal_packed, __float_as_int(tri_vindex.y)));
+		n2 = triangle_normal_decode(kernel_tex_fetch(__tri_vnormal_packed, __float_as_int(tri_vindex.z)));
+	}
+	else {
+		n0 = float4_to_float3(kernel_tex_fetch(__tri_vnormal, __float_as_int(tri_vindex.x)));
+		n1 = float4_to_float3(kernel_tex_fetch(__tri_vnormal, __float_as_int(tri_vindex.y)));
+		n2 = float4_to_float3(kernel_tex_fetch(__tri_vnormal, __float_as_int(tri_vindex.z)));
+	}
 
 	return normalize((1.0f - u - v)*n2 + u*n0 + v*n1);
 }
@@ -30,6 +30,7 @@ CCL_NAMESPACE_BEGIN
 #define OBJECT_SIZE 		11
 #define OBJECT_VECTOR_SIZE	6
 #define LIGHT_SIZE			4
+#define LIGHT_TREE_NODE_SIZE	4
 #define FILTER_TABLE_SIZE	256
 #define RAMP_TABLE_SIZE		256
 #define PARTICLE_SIZE 		5
@@ -125,6 +126,17 @@ CCL_NAMESPACE_BEGIN
 #define __INTERSECTION_REFINE__
 #define __CLAMP_SAMPLE__
 
+/* instrumented kernel counting rays and work per path, CPU only */
+#if defined(__KERNEL_CPU__) && defined(WITH_CYCLES_RAY_STATS)
+#define __RAY_STATS__
+#endif
+
+/* packet traversal of coherent rays, SSE only, packets are not
+ * instrumented so ray statistics use single rays */
+#if defined(__KERNEL_CPU__) && defined(__KERNEL_SSE2__) && !defined(__RAY_STATS__)
+#define __RAY_PACKETS__
+#endif
+
 #ifdef __KERNEL_SHADING__
 #define __SVM__
 #define __EMISSION__
@@ -273,7 +285,13 @@ typedef enum PassType {
 	PASS_MIST = 2097152,
 	PASS_SUBSURFACE_DIRECT = 4194304,
 	PASS_SUBSURFACE_INDIRECT = 8388608,
-	PASS_SUBSURFACE_COLOR = 16777216
+	PASS_SUBSURFACE_COLOR = 16777216,
+	PASS_VARIANCE = 33554432,
+	PASS_SAMPLE_COUNT = 67108864,
+	PASS_BVH_TRAVERSAL_STEPS = 134217728,
+	PASS_PRIMITIVE_TESTS = 268435456,
+	PASS_SHADER_EVALUATIONS = 536870912,
+	PASS_RAY_BOUNCES = 1073741824
 } PassType;
 
 #define PASS_ALL (~0)
@@ -410,8 +428,34 @@ typedef struct Intersection {
 	int prim;
 	int object;
 	int segment;
+
+#ifdef __RAY_STATS__
+	/* work done by the traversal, for ray statistics */
+	int num_traversal_steps;
+	int num_primitive_tests;
+#endif
 } Intersection;
 
+/* Ray Statistics */
+
+#ifdef __RAY_STATS__
+typedef enum RayStatsType {
+	RAY_STATS_CAMERA = 0,
+	RAY_STATS_BOUNCE,
+	RAY_STATS_SHADOW,
+
+	RAY_STATS_NUM
+} RayStatsType;
+
+/* work done along a single path, written to the debug passes */
+typedef struct PathRayStats {
+	int num_traversal_steps;
+	int num_primitive_tests;
+	int num_shader_evaluations;
+	int num_bounces;
+} PathRayStats;
+#endif
+
 /* Attributes */
 
 #define ATTR_PRIM_TYPES		2
@@ -698,17 +742,22 @@ typedef struct KernelFilm {
 	int pass_emission;
 	int pass_background;
 	int pass_ao;
-	int pass_pad1;
+	int pass_variance;
 
 	int pass_shadow;
 	float pass_shadow_scale;
 	int filter_table_offset;
-	int pass_pad2;
+	int pass_sample_count;
 
 	int pass_mist;
 	float mist_start;
 	float mist_inv_depth;
 	float mist_falloff;
+
+	int pass_bvh_traversal_steps;
+	int pass_primitive_tests;
+	int pass_shader_evaluations;
+	int pass_ray_bounces;
 } KernelFilm;
 
 typedef struct KernelBackground {
@@ -774,8 +823,12 @@ typedef struct KernelIntegrator {
 	/* sampler */
 	int sampling_pattern;
 
+	/* light tree */
+	int use_light_tree;
+	float light_tree_pdf_background;
+
 	/* padding */
-	int pad;
+	int pad1, pad2, pad3;
 } KernelIntegrator;
 
 typedef struct KernelBVH {
@@ -786,7 +839,9 @@ typedef struct KernelBVH {
 	int have_curves;
 	int have_instancing;
 
-	int pad1, pad2, pad3;
+	/* indexed vertices and packed normals instead of Woop triangles */
+	int use_compact_triangles;
+	int pad1, pad2;
 } KernelBVH;
 
 typedef enum CurveFlag {
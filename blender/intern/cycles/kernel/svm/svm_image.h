@@ -14,6 +14,10 @@
  * limitations under the License
  */
 
+#ifdef __KERNEL_CPU__
+#include "util_image_cache.h"
+#endif
+
 CCL_NAMESPACE_BEGIN
 
 #ifdef __KERNEL_OPENCL__
@@ -48,7 +52,7 @@ __device_inline float svm_image_texture_frac(float x, int *ix)
 	return x - (float)i;
 }
 
-__device float4 svm_image_texture(KernelGlobals *kg, int id, float x, float y, uint srgb, uint use_alpha)
+__device float4 svm_image_texture(KernelGlobals *kg, int id, float x, float y, float width, uint srgb, uint use_alpha)
 {
 	/* first slots are used by float textures, which are not supported here */
 	if(id < TEX_NUM_FLOAT_IMAGES)
@@ -110,12 +114,16 @@ __device float4 svm_image_texture(KernelGlobals *kg, int id, float x, float y, u
 
 #else
 
-__device float4 svm_image_texture(KernelGlobals *kg, int id, float x, float y, uint srgb, uint use_alpha)
+__device float4 svm_image_texture(KernelGlobals *kg, int id, float x, float y, float width, uint srgb, uint use_alpha)
 {
 	float4 r;
 
 #ifdef __KERNEL_CPU__
-	r = kernel_tex_image_interp(id, x, y);
+	/* images paged in by the image cache, others are fully loaded */
+	if(kg->image_cache && kg->image_cache->contains(id))
+		r = kg->image_cache->lookup(kg->image_cache_tdata, id, x, y, width);
+	else
+		r = kernel_tex_image_interp(id, x, y);
 #else
 	/* not particularly proud of this massive switch, what are the
 	 * alternatives?
@@ -257,6 +265,30 @@ __device float4 svm_image_texture(KernelGlobals *kg, int id, float x, float y, u
 
 #endif
 
+/* Filter width in texture space from the UV differentials, used to pick the
+ * mip-map level for cached images on the CPU. Zero means full resolution. */
+
+__device float svm_image_texture_width(KernelGlobals *kg, ShaderData *sd, uint uv_id)
+{
+#if defined(__KERNEL_CPU__) && defined(__RAY_DIFFERENTIALS__)
+	if(uv_id == 0)
+		return 0.0f;
+
+	AttributeElement elem;
+	int offset = find_attribute(kg, sd, uv_id, &elem);
+
+	if(offset == ATTR_STD_NOT_FOUND)
+		return 0.0f;
+
+	float3 dx, dy;
+	primitive_attribute_float3(kg, sd, elem, offset, &dx, &dy);
+
+	return max(max(fabsf(dx.x), fabsf(dx.y)), max(fabsf(dy.x), fabsf(dy.y)));
+#else
+	return 0.0f;
+#endif
+}
+
 __device void svm_node_tex_image(KernelGlobals *kg, ShaderData *sd, float *stack, uint4 node)
 {
 	uint id = node.y;
@@ -266,7 +298,8 @@ __device void svm_node_tex_image(KernelGlobals *kg, ShaderData *sd, float *stack
 
 	float3 co = stack_load_float3(stack, co_offset);
 	uint use_alpha = stack_valid(alpha_offset);
-	float4 f = svm_image_texture(kg, id, co.x, co.y, srgb, use_alpha);
+	float width = svm_image_texture_width(kg, sd, node.w);
+	float4 f = svm_image_texture(kg, id, co.x, co.y, width, srgb, use_alpha);
 
 	if(stack_valid(out_offset))
 		stack_store_float3(stack, out_offset, make_float3(f.x, f.y, f.z));
@@ -350,11 +383,11 @@ __device void svm_node_tex_image_box(KernelGlobals *kg, ShaderData *sd, float *s
 	uint use_alpha = stack_valid(alpha_offset);
 
 	if(weight.x > 0.0f)
-		f += weight.x*svm_image_texture(kg, id, co.y, co.z, srgb, use_alpha);
+		f += weight.x*svm_image_texture(kg, id, co.y, co.z, 0.0f, srgb, use_alpha);
 	if(weight.y > 0.0f)
-		f += weight.y*svm_image_texture(kg, id, co.x, co.z, srgb, use_alpha);
+		f += weight.y*svm_image_texture(kg, id, co.x, co.z, 0.0f, srgb, use_alpha);
 	if(weight.z > 0.0f)
-		f += weight.z*svm_image_texture(kg, id, co.y, co.x, srgb, use_alpha);
+		f += weight.z*svm_image_texture(kg, id, co.y, co.x, 0.0f, srgb, use_alpha);
 
 	if(stack_valid(out_offset))
 		stack_store_float3(stack, out_offset, make_float3(f.x, f.y, f.z));
@@ -382,7 +415,7 @@ __device void svm_node_tex_environment(KernelGlobals *kg, ShaderData *sd, float
 		uv = direction_to_mirrorball(co);
 
 	uint use_alpha = stack_valid(alpha_offset);
-	float4 f = svm_image_texture(kg, id, uv.x, uv.y, srgb, use_alpha);
+	float4 f = svm_image_texture(kg, id, uv.x, uv.y, 0.0f, srgb, use_alpha);
 
 	if(stack_valid(out_offset))
 		stack_store_float3(stack, out_offset, make_float3(f.x, f.y, f.z));
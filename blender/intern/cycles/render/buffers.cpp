@@ -302,6 +302,7 @@ DisplayBuffer::DisplayBuffer(Device *device_, bool linear)
 	device = device_;
 	draw_width = 0;
 	draw_height = 0;
+	dirty = make_int4(0, 0, 0, 0);
 	transparent = true; /* todo: determine from background */
 	half_float = linear;
 }
@@ -329,6 +330,7 @@ void DisplayBuffer::reset(Device *device, BufferParams& params_)
 	draw_height = 0;
 
 	params = params_;
+	dirty = make_int4(0, 0, params.width, params.height);
 
 	/* free existing buffers */
 	device_free();
@@ -348,10 +350,33 @@ void DisplayBuffer::draw_set(int width, int height)
 {
 	assert(width <= params.width && height <= params.height);
 
+	/* with a different resolution all pixels move */
+	if(width != draw_width || height != draw_height)
+		tag_update(0, 0, width, height);
+
 	draw_width = width;
 	draw_height = height;
 }
 
+void DisplayBuffer::tag_update(int x, int y, int w, int h)
+{
+	if(w <= 0 || h <= 0)
+		return;
+
+	if(dirty.z <= 0 || dirty.w <= 0) {
+		dirty = make_int4(x, y, w, h);
+	}
+	else {
+		int x1 = max(dirty.x + dirty.z, x + w);
+		int y1 = max(dirty.y + dirty.w, y + h);
+
+		dirty.x = min(dirty.x, x);
+		dirty.y = min(dirty.y, y);
+		dirty.z = x1 - dirty.x;
+		dirty.w = y1 - dirty.y;
+	}
+}
+
 void DisplayBuffer::draw(Device *device)
 {
 	if(draw_width != 0 && draw_height != 0) {
@@ -359,12 +384,24 @@ void DisplayBuffer::draw(Device *device)
 		glTranslatef(params.full_x, params.full_y, 0.0f);
 		device_memory& rgba = rgba_data();
 
-		device->draw_pixels(rgba, 0, draw_width, draw_height, 0, params.width, params.height, transparent);
+		/* only upload the pixels converted since the last draw */
+		int x0 = max(dirty.x, 0), y0 = max(dirty.y, 0);
+		int x1 = min(dirty.x + dirty.z, draw_width), y1 = min(dirty.y + dirty.w, draw_height);
+		int4 rect = make_int4(x0, y0, max(x1 - x0, 0), max(y1 - y0, 0));
+
+		device->draw_pixels(rgba, 0, draw_width, draw_height, 0, params.width, params.height, transparent, &rect, &texture);
+
+		dirty = make_int4(0, 0, 0, 0);
 
 		glPopMatrix();
 	}
 }
 
+void DisplayBuffer::draw_free()
+{
+	texture.free();
+}
+
 bool DisplayBuffer::draw_ready()
 {
 	return (draw_width != 0 && draw_height != 0);
@@ -98,6 +98,8 @@ public:
 	 * with progressive render we can be using only a subset of the buffer.
 	 * if these are zero, it means nothing can be drawn yet */
 	int draw_width, draw_height;
+	/* region (x, y, w, h) of the pixels changed since the last draw */
+	int4 dirty;
 	/* draw alpha channel? */
 	bool transparent;
 	/* use half float? */
@@ -105,6 +107,8 @@ public:
 	/* byte buffer for converted result */
 	device_vector<uchar4> rgba_byte;
 	device_vector<half4> rgba_half;
+	/* texture kept between draws, see draw_free */
+	DeviceDrawTexture texture;
 
 	DisplayBuffer(Device *device, bool linear = false);
 	~DisplayBuffer();
@@ -113,8 +117,11 @@ public:
 	void write(Device *device, const string& filename);
 
 	void draw_set(int width, int height);
+	void tag_update(int x, int y, int w, int h);
 	void draw(Device *device);
 	bool draw_ready();
+	/* free the texture, with the context it was drawn in current */
+	void draw_free();
 
 	device_memory& rgba_data();
 
@@ -155,6 +155,20 @@ void Pass::add(PassType type, vector<Pass>& passes)
 			pass.components = 4;
 			pass.exposure = false;
 			break;
+		case PASS_VARIANCE:
+			pass.components = 1;
+			break;
+		case PASS_SAMPLE_COUNT:
+			pass.components = 1;
+			pass.filter = false;
+			break;
+		case PASS_BVH_TRAVERSAL_STEPS:
+		case PASS_PRIMITIVE_TESTS:
+		case PASS_SHADER_EVALUATIONS:
+		case PASS_RAY_BOUNCES:
+			/* averaged over samples, only written by kernels with ray statistics */
+			pass.components = 1;
+			break;
 	}
 
 	passes.push_back(pass);
@@ -391,6 +405,24 @@ void Film::device_update(Device *device, DeviceScene *dscene, Scene *scene)
 				kfilm->pass_shadow = kfilm->pass_stride;
 				kfilm->use_light_pass = 1;
 				break;
+			case PASS_VARIANCE:
+				kfilm->pass_variance = kfilm->pass_stride;
+				break;
+			case PASS_SAMPLE_COUNT:
+				kfilm->pass_sample_count = kfilm->pass_stride;
+				break;
+			case PASS_BVH_TRAVERSAL_STEPS:
+				kfilm->pass_bvh_traversal_steps = kfilm->pass_stride;
+				break;
+			case PASS_PRIMITIVE_TESTS:
+				kfilm->pass_primitive_tests = kfilm->pass_stride;
+				break;
+			case PASS_SHADER_EVALUATIONS:
+				kfilm->pass_shader_evaluations = kfilm->pass_stride;
+				break;
+			case PASS_RAY_BOUNCES:
+				kfilm->pass_ray_bounces = kfilm->pass_stride;
+				break;
 			case PASS_NONE:
 				break;
 		}
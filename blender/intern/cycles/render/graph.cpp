@@ -464,6 +464,41 @@ void ShaderGraph::break_cycles(ShaderNode *node, vector<bool>& visited, vector<b
 	on_stack[node->id] = false;
 }
 
+void ShaderGraph::constant_fold(set<ShaderNode*>& done, ShaderNode *node)
+{
+	/* only fold each node once */
+	if(done.find(node) != done.end())
+		return;
+
+	done.insert(node);
+
+	/* fold nodes connected to inputs first */
+	foreach(ShaderInput *in, node->inputs)
+		if(in->link)
+			constant_fold(done, in->link->parent);
+
+	/* then fold self, replacing links by constant values */
+	foreach(ShaderOutput *sock, node->outputs) {
+		float3 optimized_value = make_float3(0.0f, 0.0f, 0.0f);
+
+		if(sock->links.empty() || !node->constant_fold(sock, &optimized_value))
+			continue;
+
+		vector<ShaderInput*> links(sock->links);
+
+		foreach(ShaderInput *in, links) {
+			/* inputs with a default value would get a texture coordinate or
+			 * similar connected when unlinked, and the output node only
+			 * compiles linked inputs, so these must stay linked */
+			if(in->default_value != ShaderInput::NONE || in->parent == output())
+				continue;
+
+			in->value = optimized_value;
+			disconnect(in);
+		}
+	}
+}
+
 void ShaderGraph::clean()
 {
 	/* remove proxy and unnecessary mix nodes */
@@ -479,6 +514,14 @@ void ShaderGraph::clean()
 	/* break cycles */
 	break_cycles(output(), visited, on_stack);
 
+	/* evaluate nodes with only constant inputs, after which the nodes that
+	 * computed them may no longer be needed, so find used nodes again */
+	set<ShaderNode*> done;
+	constant_fold(done, output());
+
+	visited.assign(num_node_ids, false);
+	break_cycles(output(), visited, on_stack);
+
 	/* disconnect unused nodes */
 	foreach(ShaderNode *node, nodes) {
 		if(!visited[node->id]) {
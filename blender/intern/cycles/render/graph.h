@@ -191,6 +191,10 @@ public:
 	virtual bool has_converter_blackbody() { return false; }
 	virtual bool has_bssrdf_bump() { return false; }
 
+	/* if the output can be computed at compile time, set optimized_value to it
+	 * so that linked inputs can use it as a constant instead */
+	virtual bool constant_fold(ShaderOutput *socket, float3 *optimized_value) { return false; }
+
 	vector<ShaderInput*> inputs;
 	vector<ShaderOutput*> outputs;
 
@@ -252,6 +256,7 @@ protected:
 	void copy_nodes(set<ShaderNode*>& nodes, map<ShaderNode*, ShaderNode*>& nnodemap);
 
 	void break_cycles(ShaderNode *node, vector<bool>& visited, vector<bool>& on_stack);
+	void constant_fold(set<ShaderNode*>& done, ShaderNode *node);
 	void clean();
 	void bump_from_displacement();
 	void refine_bump_nodes();
@@ -20,6 +20,7 @@
 
 #include "util_foreach.h"
 #include "util_image.h"
+#include "util_image_cache.h"
 #include "util_path.h"
 #include "util_progress.h"
 
@@ -35,6 +36,9 @@ ImageManager::ImageManager()
 	pack_images = false;
 	osl_texture_system = NULL;
 	animation_frame = 0;
+	image_cache = NULL;
+	cache_size = 0;
+	disk_cache_size = 0;
 
 	tex_num_images = TEX_NUM_IMAGES;
 	tex_num_float_images = TEX_NUM_FLOAT_IMAGES;
@@ -47,6 +51,8 @@ ImageManager::~ImageManager()
 		assert(!images[slot]);
 	for(size_t slot = 0; slot < float_images.size(); slot++)
 		assert(!float_images[slot]);
+
+	delete image_cache;
 }
 
 void ImageManager::set_pack_images(bool pack_images_)
@@ -66,6 +72,35 @@ void ImageManager::set_extended_image_limits(void)
 	tex_image_byte_start = TEX_EXTENDED_IMAGE_BYTE_START;
 }
 
+void ImageManager::set_cache_size(size_t cache_size_)
+{
+	if(cache_size != cache_size_) {
+		cache_size = cache_size_;
+		need_update = true;
+	}
+}
+
+void ImageManager::set_disk_cache_size(size_t disk_cache_size_)
+{
+	disk_cache_size = disk_cache_size_;
+
+	if(image_cache)
+		image_cache->set_disk_cache_size(disk_cache_size);
+}
+
+void ImageManager::get_cache_stats(uint64_t& hits, uint64_t& misses, size_t& memory_used)
+{
+	if(image_cache) {
+		size_t memory_budget;
+		image_cache->get_stats(hits, misses, memory_used, memory_budget);
+	}
+	else {
+		hits = 0;
+		misses = 0;
+		memory_used = 0;
+	}
+}
+
 bool ImageManager::set_animation_frame_update(int frame)
 {
 	if(frame != animation_frame) {
@@ -537,6 +572,50 @@ void ImageManager::device_load_image(Device *device, DeviceScene *dscene, int sl
 	img->need_load = false;
 }
 
+bool ImageManager::device_cache_image(Device *device, DeviceScene *dscene, int slot)
+{
+	Image *img;
+	bool is_float;
+
+	if(slot >= tex_image_byte_start) {
+		img = images[slot - tex_image_byte_start];
+		is_float = false;
+	}
+	else {
+		img = float_images[slot];
+		is_float = true;
+	}
+
+	/* builtin images are not files we can page from */
+	if(!image_cache || img->builtin_data)
+		return false;
+
+	if(!image_cache->add_image(slot, img->filename, is_float))
+		return false;
+
+	/* free fully loaded image from a previous update */
+	if(is_float) {
+		device_vector<float4>& tex_img = dscene->tex_float_image[slot];
+
+		if(tex_img.device_pointer)
+			device->tex_free(tex_img);
+
+		tex_img.clear();
+	}
+	else {
+		device_vector<uchar4>& tex_img = dscene->tex_image[slot - tex_image_byte_start];
+
+		if(tex_img.device_pointer)
+			device->tex_free(tex_img);
+
+		tex_img.clear();
+	}
+
+	img->need_load = false;
+
+	return true;
+}
+
 void ImageManager::device_free_image(Device *device, DeviceScene *dscene, int slot)
 {
 	Image *img;
@@ -552,6 +631,9 @@ void ImageManager::device_free_image(Device *device, DeviceScene *dscene, int sl
 	}
 
 	if(img) {
+		if(image_cache)
+			image_cache->remove_image(slot);
+
 		if(osl_texture_system) {
 #ifdef WITH_OSL
 			ustring filename(images[slot]->filename);
@@ -592,6 +674,20 @@ void ImageManager::device_update(Device *device, DeviceScene *dscene, Progress&
 	if(!need_update)
 		return;
 
+	/* image files are paged in by the kernel when the device supports it */
+	if(cache_size && !pack_images && !osl_texture_system) {
+		if(!image_cache)
+			image_cache = new ImageCache();
+
+		image_cache->set_memory_budget(cache_size);
+		image_cache->set_disk_cache_size(disk_cache_size);
+
+		if(!device->set_image_cache(image_cache)) {
+			delete image_cache;
+			image_cache = NULL;
+		}
+	}
+
 	TaskPool pool;
 
 	for(size_t slot = 0; slot < images.size(); slot++) {
@@ -602,7 +698,7 @@ void ImageManager::device_update(Device *device, DeviceScene *dscene, Progress&
 			device_free_image(device, dscene, slot + tex_image_byte_start);
 		}
 		else if(images[slot]->need_load) {
-			if(!osl_texture_system) 
+			if(!osl_texture_system && !device_cache_image(device, dscene, slot + tex_image_byte_start))
 				pool.push(function_bind(&ImageManager::device_load_image, this, device, dscene, slot + tex_image_byte_start, &progress));
 		}
 	}
@@ -615,7 +711,7 @@ void ImageManager::device_update(Device *device, DeviceScene *dscene, Progress&
 			device_free_image(device, dscene, slot);
 		}
 		else if(float_images[slot]->need_load) {
-			if(!osl_texture_system) 
+			if(!osl_texture_system && !device_cache_image(device, dscene, slot))
 				pool.push(function_bind(&ImageManager::device_load_image, this, device, dscene, slot, &progress));
 		}
 	}
@@ -678,6 +774,12 @@ void ImageManager::device_free(Device *device, DeviceScene *dscene)
 	dscene->tex_image_packed.clear();
 	dscene->tex_image_packed_info.clear();
 
+	if(image_cache) {
+		device->set_image_cache(NULL);
+		delete image_cache;
+		image_cache = NULL;
+	}
+
 	images.clear();
 	float_images.clear();
 }
@@ -42,6 +42,7 @@ CCL_NAMESPACE_BEGIN
 
 class Device;
 class DeviceScene;
+class ImageCache;
 class Progress;
 
 class ImageManager {
@@ -59,8 +60,12 @@ public:
 	void set_osl_texture_system(void *texture_system);
 	void set_pack_images(bool pack_images_);
 	void set_extended_image_limits(void);
+	void set_cache_size(size_t cache_size_);
+	void set_disk_cache_size(size_t disk_cache_size_);
 	bool set_animation_frame_update(int frame);
 
+	void get_cache_stats(uint64_t& hits, uint64_t& misses, size_t& memory_used);
+
 	bool need_update;
 
 	boost::function<void(const string &filename, void *data, bool &is_float, int &width, int &height, int &channels)> builtin_image_info_cb;
@@ -87,10 +92,16 @@ private:
 	void *osl_texture_system;
 	bool pack_images;
 
+	/* paged image textures, only file images on devices that support it */
+	ImageCache *image_cache;
+	size_t cache_size;
+	size_t disk_cache_size;
+
 	bool file_load_image(Image *img, device_vector<uchar4>& tex_img);
 	bool file_load_float_image(Image *img, device_vector<float4>& tex_img);
 
 	void device_load_image(Device *device, DeviceScene *dscene, int slot, Progress *progess);
+	bool device_cache_image(Device *device, DeviceScene *dscene, int slot);
 	void device_free_image(Device *device, DeviceScene *dscene, int slot);
 
 	void device_pack_images(Device *device, DeviceScene *dscene, Progress& progess);
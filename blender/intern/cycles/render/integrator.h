@@ -66,6 +66,8 @@ public:
 
 	SamplingPattern sampling_pattern;
 
+	bool use_light_tree;
+
 	bool need_update;
 
 	Integrator();
@@ -18,7 +18,9 @@
 #include "device.h"
 #include "integrator.h"
 #include "film.h"
+#include "graph.h"
 #include "light.h"
+#include "light_tree.h"
 #include "mesh.h"
 #include "object.h"
 #include "scene.h"
@@ -93,6 +95,32 @@ static void shade_background_pixels(Device *device, DeviceScene *dscene, int res
 	}
 }
 
+static float shader_emission_estimate(Shader *shader)
+{
+	/* rough estimate of emitted power for the light tree, from the emission
+	 * nodes in the graph. linked inputs are assumed to be one */
+	float estimate = 0.0f;
+	bool found = false;
+
+	if(shader->graph) {
+		foreach(ShaderNode *node, shader->graph->nodes) {
+			if(node->name != ustring("emission"))
+				continue;
+
+			ShaderInput *color_in = node->input("Color");
+			ShaderInput *strength_in = node->input("Strength");
+
+			float color = (color_in->link)? 1.0f: average(color_in->value);
+			float strength = (strength_in->link)? 1.0f: strength_in->value.x;
+
+			estimate += max(color*strength, 0.0f);
+			found = true;
+		}
+	}
+
+	return (found)? estimate: 1.0f;
+}
+
 /* Light */
 
 Light::Light()
@@ -135,6 +163,7 @@ LightManager::LightManager()
 {
 	need_update = true;
 	use_light_visibility = false;
+	use_light_tree = false;
 }
 
 LightManager::~LightManager()
@@ -196,6 +225,17 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 	float4 *distribution = dscene->light_distribution.resize(num_distribution + 1);
 	float totarea = 0.0f;
 
+	/* light tree emitters, inverse areas and per object triangle tables */
+	vector<LightTreeEmitter> tree_emitters;
+	vector<float> tree_invarea;
+	vector<uint> tree_triangles;
+
+	if(use_light_tree) {
+		tree_emitters.reserve(num_distribution);
+		tree_invarea.resize(num_distribution, 0.0f);
+		tree_triangles.resize(scene->objects.size()*2, 0);
+	}
+
 	/* triangles */
 	size_t offset = 0;
 	int j = 0;
@@ -243,6 +283,14 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 				use_light_visibility = true;
 			}
 
+			size_t tree_block = tree_triangles.size();
+
+			if(use_light_tree) {
+				tree_triangles[j*2 + 0] = tree_block;
+				tree_triangles[j*2 + 1] = mesh->tri_offset;
+				tree_triangles.resize(tree_block + mesh->triangles.size(), ~0);
+			}
+
 			for(size_t i = 0; i < mesh->triangles.size(); i++) {
 				Shader *shader = scene->shaders[mesh->shader[i]];
 
@@ -264,7 +312,27 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 						p3 = transform_point(&tfm, p3);
 					}
 
-					totarea += triangle_area(p1, p2, p3);
+					float area = triangle_area(p1, p2, p3);
+					totarea += area;
+
+					if(use_light_tree) {
+						/* emission is two sided, so any orientation */
+						LightTreeEmitter emitter;
+
+						emitter.bounds = BoundBox(p1);
+						emitter.bounds.grow(p2);
+						emitter.bounds.grow(p3);
+						emitter.axis = make_float3(0.0f, 0.0f, 1.0f);
+						emitter.theta_o = M_PI_F;
+						emitter.theta_e = M_PI_2_F;
+						emitter.energy = area*shader_emission_estimate(shader);
+						emitter.infinite = false;
+						emitter.index = offset - 1;
+
+						tree_emitters.push_back(emitter);
+						tree_invarea[offset - 1] = (area > 0.0f)? 1.0f/area: 0.0f;
+						tree_triangles[tree_block + i] = offset - 1;
+					}
 				}
 			}
 
@@ -327,6 +395,9 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 			use_lamp_mis = true;
 		if(light->type == LIGHT_BACKGROUND)
 			num_background_lights++;
+
+		if(use_light_tree)
+			tree_emitters.push_back(light_tree_emitter(scene, light, offset));
 	}
 
 	/* normalize cumulative distribution functions */
@@ -376,6 +447,48 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 
 		kintegrator->use_lamp_mis = use_lamp_mis;
 
+		/* light tree */
+		kintegrator->use_light_tree = use_light_tree;
+		kintegrator->light_tree_pdf_background = 0.0f;
+
+		if(use_light_tree) {
+			progress.set_status("Updating Lights", "Building light tree");
+
+			LightTree tree(tree_emitters);
+			vector<uint> tree_index(num_distribution, ~0);
+
+			float4 *nodes = dscene->light_tree_nodes.resize(tree.nodes.size());
+			float4 *emitters = dscene->light_tree_emitters.resize(tree.emitters.size());
+
+			for(size_t i = 0; i < tree.nodes.size(); i++)
+				nodes[i] = tree.nodes[i];
+
+			for(size_t i = 0; i < tree.emitters.size(); i++) {
+				const LightTreeEmitter& emitter = tree.emitters[i];
+
+				emitters[i] = make_float4(emitter.energy, tree_invarea[emitter.index],
+					__int_as_float(tree.emitter_node[i]), __int_as_float(emitter.index));
+				tree_index[emitter.index] = i;
+			}
+
+			/* triangle tables point into the emitters in tree order */
+			uint *triangles = dscene->light_tree_triangles.resize((tree_triangles.size())? tree_triangles.size(): 1);
+			size_t num_header = scene->objects.size()*2;
+
+			triangles[0] = 0;
+
+			for(size_t i = 0; i < tree_triangles.size(); i++) {
+				uint index = tree_triangles[i];
+				triangles[i] = (i < num_header || index == ~0)? index: tree_index[index];
+			}
+
+			kintegrator->light_tree_pdf_background = tree.pdf_infinite;
+
+			device->tex_alloc("__light_tree_nodes", dscene->light_tree_nodes);
+			device->tex_alloc("__light_tree_emitters", dscene->light_tree_emitters);
+			device->tex_alloc("__light_tree_triangles", dscene->light_tree_triangles);
+		}
+
 		/* bit of an ugly hack to compensate for emitting triangles influencing
 		 * amount of samples we get for this pass */
 		kfilm->pass_shadow_scale = 1.0f;
@@ -398,10 +511,61 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 		kintegrator->pdf_lights = 0.0f;
 		kintegrator->inv_pdf_lights = 0.0f;
 		kintegrator->use_lamp_mis = false;
+		kintegrator->use_light_tree = false;
+		kintegrator->light_tree_pdf_background = 0.0f;
 		kfilm->pass_shadow_scale = 1.0f;
 	}
 }
 
+LightTreeEmitter LightManager::light_tree_emitter(Scene *scene, Light *light, int index)
+{
+	LightTreeEmitter emitter;
+
+	emitter.bounds = BoundBox(light->co);
+	emitter.axis = make_float3(0.0f, 0.0f, 1.0f);
+	emitter.theta_o = M_PI_F;
+	emitter.theta_e = M_PI_2_F;
+	emitter.energy = shader_emission_estimate(scene->shaders[light->shader]);
+	emitter.infinite = false;
+	emitter.index = index;
+
+	float3 dir = light->dir;
+
+	if(len(dir) > 0.0f)
+		dir = normalize(dir);
+
+	if(light->type == LIGHT_POINT || light->type == LIGHT_SPOT) {
+		float3 radius = make_float3(light->size, light->size, light->size);
+		emitter.bounds = BoundBox(light->co - radius, light->co + radius);
+
+		if(light->type == LIGHT_SPOT && len(dir) > 0.0f) {
+			emitter.axis = dir;
+			emitter.theta_o = min(light->spot_angle*0.5f, M_PI_F);
+			emitter.theta_e = 0.0f;
+		}
+	}
+	else if(light->type == LIGHT_AREA) {
+		float3 axisu = light->axisu*(light->sizeu*light->size);
+		float3 axisv = light->axisv*(light->sizev*light->size);
+
+		emitter.bounds.grow(light->co + 0.5f*(axisu + axisv));
+		emitter.bounds.grow(light->co + 0.5f*(axisu - axisv));
+		emitter.bounds.grow(light->co - 0.5f*(axisu + axisv));
+		emitter.bounds.grow(light->co - 0.5f*(axisu - axisv));
+
+		if(len(dir) > 0.0f) {
+			emitter.axis = dir;
+			emitter.theta_o = 0.0f;
+		}
+	}
+	else {
+		/* distant and background lights */
+		emitter.infinite = true;
+	}
+
+	return emitter;
+}
+
 void LightManager::device_update_background(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress)
 {
 	KernelIntegrator *kintegrator = &dscene->data.integrator;
@@ -638,12 +802,16 @@ void LightManager::device_update_points(Device *device, DeviceScene *dscene, Sce
 
 void LightManager::device_update(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress)
 {
-	if(!need_update)
+	/* the light tree is only used by the path integrator */
+	bool need_light_tree = (scene->integrator->use_light_tree && scene->integrator->method == Integrator::PATH);
+
+	if(!need_update && need_light_tree == use_light_tree)
 		return;
 
 	device_free(device, dscene);
 
 	use_light_visibility = false;
+	use_light_tree = (scene->integrator->use_light_tree && scene->integrator->method == Integrator::PATH);
 
 	device_update_points(device, dscene, scene);
 	if(progress.get_cancel()) return;
@@ -668,11 +836,17 @@ void LightManager::device_free(Device *device, DeviceScene *dscene)
 	device->tex_free(dscene->light_data);
 	device->tex_free(dscene->light_background_marginal_cdf);
 	device->tex_free(dscene->light_background_conditional_cdf);
+	device->tex_free(dscene->light_tree_nodes);
+	device->tex_free(dscene->light_tree_emitters);
+	device->tex_free(dscene->light_tree_triangles);
 
 	dscene->light_distribution.clear();
 	dscene->light_data.clear();
 	dscene->light_background_marginal_cdf.clear();
 	dscene->light_background_conditional_cdf.clear();
+	dscene->light_tree_nodes.clear();
+	dscene->light_tree_emitters.clear();
+	dscene->light_tree_triangles.clear();
 }
 
 void LightManager::tag_update(Scene *scene)
@@ -28,6 +28,7 @@ class Device;
 class DeviceScene;
 class Progress;
 class Scene;
+struct LightTreeEmitter;
 
 class Light {
 public:
@@ -64,6 +65,7 @@ public:
 class LightManager {
 public:
 	bool use_light_visibility;
+	bool use_light_tree;
 	bool need_update;
 
 	LightManager();
@@ -78,6 +80,8 @@ protected:
 	void device_update_points(Device *device, DeviceScene *dscene, Scene *scene);
 	void device_update_distribution(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress);
 	void device_update_background(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress);
+
+	LightTreeEmitter light_tree_emitter(Scene *scene, Light *light, int index);
 };
 
 CCL_NAMESPACE_END
@@ -0,0 +1,359 @@
+/*
+ * Copyright 2011-2013 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License
+ */
+
+#include "kernel_types.h"
+
+#include "light_tree.h"
+
+#include "util_algorithm.h"
+#include "util_foreach.h"
+#include "util_math.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* number of centroid bins per axis to evaluate splits */
+#define LIGHT_TREE_NUM_BINS 12
+
+/* Orientation Cone */
+
+void LightTree::Cone::grow(const Cone& other)
+{
+	if(other.empty)
+		return;
+
+	if(empty) {
+		*this = other;
+		return;
+	}
+
+	/* union of two cones, from "Importance Sampling of Many Lights with
+	 * Adaptive Tree Splitting", Conty Estevez and Kulla */
+	Cone a = *this;
+	Cone b = other;
+
+	if(b.theta_o > a.theta_o)
+		swap(a, b);
+
+	float theta_d = safe_acosf(dot(a.axis, b.axis));
+
+	axis = a.axis;
+	theta_e = max(a.theta_e, b.theta_e);
+
+	/* b is inside a */
+	if(min(theta_d + b.theta_o, M_PI_F) <= a.theta_o) {
+		theta_o = a.theta_o;
+		return;
+	}
+
+	float new_theta_o = 0.5f*(a.theta_o + theta_d + b.theta_o);
+
+	if(new_theta_o >= M_PI_F) {
+		theta_o = M_PI_F;
+		return;
+	}
+
+	/* rotate the axis of a towards b to cover both */
+	float3 ortho = b.axis - a.axis*dot(a.axis, b.axis);
+	float ortho_len = len(ortho);
+
+	if(ortho_len < 1e-6f) {
+		theta_o = M_PI_F;
+		return;
+	}
+
+	float theta_r = new_theta_o - a.theta_o;
+
+	axis = normalize(a.axis*cosf(theta_r) + ortho*(sinf(theta_r)/ortho_len));
+	theta_o = new_theta_o;
+}
+
+float LightTree::Cone::measure() const
+{
+	if(empty)
+		return 0.0f;
+
+	/* solid angle of emitted directions, weighted by cosine */
+	float theta_w = min(theta_o + theta_e, M_PI_F);
+	float sin_theta_o = sinf(theta_o);
+	float cos_theta_o = cosf(theta_o);
+
+	return M_2PI_F*(1.0f - cos_theta_o) +
+	       M_PI_2_F*(2.0f*theta_w*sin_theta_o - cosf(theta_o - 2.0f*theta_w) -
+	                 2.0f*theta_o*sin_theta_o + cos_theta_o);
+}
+
+LightTree::Cone LightTree::emitter_cone(const LightTreeEmitter& emitter)
+{
+	Cone cone;
+
+	cone.axis = emitter.axis;
+	cone.theta_o = emitter.theta_o;
+	cone.theta_e = emitter.theta_e;
+	cone.empty = false;
+
+	return cone;
+}
+
+/* Build */
+
+LightTree::LightTree(const vector<LightTreeEmitter>& emitters_)
+: pdf_infinite(0.0f)
+{
+	/* lights with a position first, they are ordered by the tree */
+	foreach(const LightTreeEmitter& emitter, emitters_)
+		if(!emitter.infinite)
+			emitters.push_back(emitter);
+
+	int num_local = emitters.size();
+
+	/* infinite lights are picked uniformly */
+	foreach(const LightTreeEmitter& emitter, emitters_) {
+		if(emitter.infinite) {
+			emitters.push_back(emitter);
+			emitters.back().energy = 1.0f;
+		}
+	}
+
+	int num_emitters = emitters.size();
+	int num_infinite = num_emitters - num_local;
+
+	emitter_node.resize(num_emitters);
+
+	if(num_emitters == 0)
+		return;
+
+	if(num_local && num_infinite) {
+		/* root picking local or infinite lights with equal probability */
+		int root = add_node();
+		int left = build(0, num_local, root);
+		int right = add_node();
+
+		BoundBox bounds(make_float3(nodes[left*LIGHT_TREE_NODE_SIZE + 0].x,
+		                            nodes[left*LIGHT_TREE_NODE_SIZE + 0].y,
+		                            nodes[left*LIGHT_TREE_NODE_SIZE + 0].z),
+		                make_float3(nodes[left*LIGHT_TREE_NODE_SIZE + 1].x,
+		                            nodes[left*LIGHT_TREE_NODE_SIZE + 1].y,
+		                            nodes[left*LIGHT_TREE_NODE_SIZE + 1].z));
+		float energy = nodes[left*LIGHT_TREE_NODE_SIZE + 0].w + (float)num_infinite;
+
+		pack_leaf(right, num_local, num_emitters, root, BoundBox::empty, Cone(), (float)num_infinite, true);
+		pack_inner(root, right, -1, bounds, Cone(), energy);
+
+		pdf_infinite = 0.5f/num_infinite;
+	}
+	else if(num_local) {
+		build(0, num_local, -1);
+	}
+	else {
+		pack_leaf(add_node(), 0, num_emitters, -1, BoundBox::empty, Cone(), (float)num_infinite, true);
+		pdf_infinite = 1.0f/num_infinite;
+	}
+}
+
+int LightTree::add_node()
+{
+	int node = nodes.size()/LIGHT_TREE_NODE_SIZE;
+	nodes.resize(nodes.size() + LIGHT_TREE_NODE_SIZE);
+	return node;
+}
+
+struct LightTreeBin {
+	BoundBox bounds;
+	float energy;
+	int num;
+
+	LightTreeBin() : bounds(BoundBox::empty), energy(0.0f), num(0) {}
+};
+
+struct LightTreeBinCompare {
+	float3 origin;
+	float scale;
+	int dim;
+	int split_bin;
+
+	int bin(const LightTreeEmitter& emitter) const
+	{
+		float c = emitter.bounds.center()[dim];
+		return clamp((int)((c - origin[dim])*scale), 0, LIGHT_TREE_NUM_BINS - 1);
+	}
+
+	bool operator()(const LightTreeEmitter& emitter) const
+	{
+		return bin(emitter) < split_bin;
+	}
+};
+
+struct LightTreeCentroidCompare {
+	int dim;
+
+	bool operator()(const LightTreeEmitter& a, const LightTreeEmitter& b) const
+	{
+		return a.bounds.center()[dim] < b.bounds.center()[dim];
+	}
+};
+
+int LightTree::build(int start, int end, int parent)
+{
+	int node = add_node();
+
+	/* bounds, orientation and energy of all emitters */
+	BoundBox bounds = BoundBox::empty;
+	BoundBox centroid_bounds = BoundBox::empty;
+	Cone cone;
+	float energy = 0.0f;
+
+	for(int i = start; i < end; i++) {
+		bounds.grow(emitters[i].bounds);
+		centroid_bounds.grow(emitters[i].bounds.center());
+		cone.grow(emitter_cone(emitters[i]));
+		energy += emitters[i].energy;
+	}
+
+	if(end - start == 1) {
+		pack_leaf(node, start, end, parent, bounds, cone, energy, false);
+		return node;
+	}
+
+	/* find split with lowest surface area orientation heuristic cost, binned
+	 * by centroid. costs are scaled to prefer splitting the longest axis */
+	float3 extent = centroid_bounds.size();
+	float max_extent = max(max(extent.x, extent.y), extent.z);
+	float min_cost = FLT_MAX;
+	LightTreeBinCompare split;
+
+	split.dim = -1;
+	split.split_bin = 0;
+
+	for(int dim = 0; dim < 3; dim++) {
+		if(extent[dim] == 0.0f)
+			continue;
+
+		LightTreeBin bins[LIGHT_TREE_NUM_BINS];
+		Cone bin_cones[LIGHT_TREE_NUM_BINS];
+		LightTreeBinCompare binner;
+
+		binner.origin = centroid_bounds.min;
+		binner.scale = (float)LIGHT_TREE_NUM_BINS/extent[dim];
+		binner.dim = dim;
+
+		for(int i = start; i < end; i++) {
+			int b = binner.bin(emitters[i]);
+
+			bins[b].bounds.grow(emitters[i].bounds);
+			bins[b].energy += emitters[i].energy;
+			bins[b].num++;
+			bin_cones[b].grow(emitter_cone(emitters[i]));
+		}
+
+		/* sweep right to left and determine costs */
+		float right_cost[LIGHT_TREE_NUM_BINS];
+		BoundBox right_bounds = BoundBox::empty;
+		Cone right_cone;
+		float right_energy = 0.0f;
+
+		for(int b = LIGHT_TREE_NUM_BINS - 1; b > 0; b--) {
+			/* growing by empty bounds is not a no-op */
+			if(bins[b].num) {
+				right_bounds.grow(bins[b].bounds);
+				right_cone.grow(bin_cones[b]);
+				right_energy += bins[b].energy;
+			}
+
+			right_cost[b] = right_energy*right_bounds.safe_area()*right_cone.measure();
+		}
+
+		/* sweep left to right and select lowest cost */
+		BoundBox left_bounds = BoundBox::empty;
+		Cone left_cone;
+		float left_energy = 0.0f;
+		int left_num = 0;
+
+		for(int b = 1; b < LIGHT_TREE_NUM_BINS; b++) {
+			if(bins[b - 1].num) {
+				left_bounds.grow(bins[b - 1].bounds);
+				left_cone.grow(bin_cones[b - 1]);
+				left_energy += bins[b - 1].energy;
+				left_num += bins[b - 1].num;
+			}
+
+			if(left_num == 0 || left_num == end - start)
+				continue;
+
+			float left_cost = left_energy*left_bounds.safe_area()*left_cone.measure();
+			float cost = (left_cost + right_cost[b])*(max_extent/extent[dim]);
+
+			if(cost < min_cost) {
+				min_cost = cost;
+				split = binner;
+				split.split_bin = b;
+			}
+		}
+	}
+
+	int mid;
+
+	if(split.dim != -1) {
+		mid = std::partition(emitters.begin() + start, emitters.begin() + end, split) - emitters.begin();
+	}
+	else {
+		/* all centroids in one bin, split in the middle */
+		LightTreeCentroidCompare compare;
+		compare.dim = (extent.x >= extent.y && extent.x >= extent.z)? 0: (extent.y >= extent.z)? 1: 2;
+
+		mid = (start + end)/2;
+		std::nth_element(emitters.begin() + start, emitters.begin() + mid, emitters.begin() + end, compare);
+	}
+
+	build(start, mid, node);
+	int right = build(mid, end, node);
+
+	pack_inner(node, right, parent, bounds, cone, energy);
+
+	return node;
+}
+
+/* Pack */
+
+void LightTree::pack_leaf(int node, int start, int end, int parent, const BoundBox& bounds,
+                          const Cone& cone, float energy, bool infinite)
+{
+	float4 *data = &nodes[node*LIGHT_TREE_NODE_SIZE];
+
+	data[0] = make_float4(bounds.min.x, bounds.min.y, bounds.min.z, energy);
+	data[1] = make_float4(bounds.max.x, bounds.max.y, bounds.max.z, cone.theta_o);
+	data[2] = make_float4(cone.axis.x, cone.axis.y, cone.axis.z, cone.theta_e);
+	data[3] = make_float4(__int_as_float(start), __int_as_float(end - start),
+	                      __int_as_float(parent), __int_as_float(infinite? 1: 0));
+
+	for(int i = start; i < end; i++)
+		emitter_node[i] = node;
+}
+
+void LightTree::pack_inner(int node, int right, int parent, const BoundBox& bounds,
+                           const Cone& cone, float energy)
+{
+	/* left child follows its parent */
+	float4 *data = &nodes[node*LIGHT_TREE_NODE_SIZE];
+
+	data[0] = make_float4(bounds.min.x, bounds.min.y, bounds.min.z, energy);
+	data[1] = make_float4(bounds.max.x, bounds.max.y, bounds.max.z, cone.theta_o);
+	data[2] = make_float4(cone.axis.x, cone.axis.y, cone.axis.z, cone.theta_e);
+	data[3] = make_float4(__int_as_float(right), __int_as_float(0),
+	                      __int_as_float(parent), __int_as_float(0));
+}
+
+CCL_NAMESPACE_END
+
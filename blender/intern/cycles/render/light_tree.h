@@ -0,0 +1,97 @@
+/*
+ * Copyright 2011-2013 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License
+ */
+
+#ifndef __LIGHT_TREE_H__
+#define __LIGHT_TREE_H__
+
+#include "util_boundbox.h"
+#include "util_types.h"
+#include "util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Light Tree Emitter
+ *
+ * Lamp or emissive triangle as seen by the light tree. Emission directions
+ * are bounded by a cone: normals are within theta_o of the axis, and light
+ * is emitted up to theta_e beyond that. */
+
+struct LightTreeEmitter {
+	BoundBox bounds;
+	float3 axis;
+	float theta_o;
+	float theta_e;
+	float energy;
+
+	/* distant and background lights, without a position */
+	bool infinite;
+
+	/* index in the light distribution before reordering */
+	int index;
+};
+
+/* Light Tree
+ *
+ * Bounding volume hierarchy over lights, built with the surface area
+ * orientation heuristic. Each node stores bounds, an orientation cone and
+ * the total energy of its emitters, from which the kernel estimates the
+ * contribution of the node to a shading point and picks lights accordingly.
+ *
+ * Emitters are reordered so that each leaf covers a contiguous range. Lights
+ * without a position go into a separate leaf below the root, which is picked
+ * with a fixed probability. */
+
+class LightTree {
+public:
+	LightTree(const vector<LightTreeEmitter>& emitters);
+
+	/* packed nodes, LIGHT_TREE_NODE_SIZE float4 per node */
+	vector<float4> nodes;
+
+	/* emitters in tree order, and the leaf node containing each of them */
+	vector<LightTreeEmitter> emitters;
+	vector<int> emitter_node;
+
+	/* probability of picking each infinite light, independent of position */
+	float pdf_infinite;
+
+protected:
+	struct Cone {
+		float3 axis;
+		float theta_o;
+		float theta_e;
+		bool empty;
+
+		Cone() : axis(make_float3(0.0f, 0.0f, 1.0f)), theta_o(0.0f), theta_e(0.0f), empty(true) {}
+
+		void grow(const Cone& other);
+		float measure() const;
+	};
+
+	static Cone emitter_cone(const LightTreeEmitter& emitter);
+
+	int add_node();
+	int build(int start, int end, int parent);
+	void pack_leaf(int node, int start, int end, int parent, const BoundBox& bounds,
+	               const Cone& cone, float energy, bool infinite);
+	void pack_inner(int node, int right, int parent, const BoundBox& bounds,
+	                const Cone& cone, float energy);
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __LIGHT_TREE_H__ */
+
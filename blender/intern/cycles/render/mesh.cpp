@@ -31,6 +31,7 @@
 #include "util_foreach.h"
 #include "util_progress.h"
 #include "util_set.h"
+#include "util_time.h"
 
 CCL_NAMESPACE_BEGIN
 
@@ -302,6 +303,78 @@ void Mesh::pack_normals(Scene *scene, float4 *normal, float4 *vnormal)
 	}
 }
 
+/* Octahedral normal encoding with 16 bits per component, decoded in the
+ * kernel by triangle_normal_decode() */
+static uint pack_normal_oct(float3 N)
+{
+	float sum = fabsf(N.x) + fabsf(N.y) + fabsf(N.z);
+
+	if(sum == 0.0f)
+		return 0;
+
+	float x = N.x/sum;
+	float y = N.y/sum;
+
+	/* fold the lower hemisphere over the diagonals */
+	if(N.z < 0.0f) {
+		float fx = (1.0f - fabsf(y))*signf(x);
+		float fy = (1.0f - fabsf(x))*signf(y);
+		x = fx;
+		y = fy;
+	}
+
+	int ix = float_to_int(floorf(clamp(x, -1.0f, 1.0f)*32767.0f + 0.5f));
+	int iy = float_to_int(floorf(clamp(y, -1.0f, 1.0f)*32767.0f + 0.5f));
+
+	return ((uint)ix & 0xffff) | (((uint)iy & 0xffff) << 16);
+}
+
+void Mesh::pack_normals_compact(Scene *scene, uint *normal, uint *vnormal)
+{
+	Attribute *attr_fN = attributes.find(ATTR_STD_FACE_NORMAL);
+	Attribute *attr_vN = attributes.find(ATTR_STD_VERTEX_NORMAL);
+
+	float3 *fN = attr_fN->data_float3();
+	float3 *vN = attr_vN->data_float3();
+	int shader_id = 0;
+	uint last_shader = -1;
+	bool last_smooth = false;
+
+	size_t triangles_size = triangles.size();
+	uint *shader_ptr = (shader.size())? &shader[0]: NULL;
+
+	bool do_transform = transform_applied;
+	Transform ntfm = transform_normal;
+
+	/* face normal and shader id interleaved, two entries per triangle */
+	for(size_t i = 0; i < triangles_size; i++) {
+		float3 fNi = fN[i];
+
+		if(do_transform)
+			fNi = normalize(transform_direction(&ntfm, fNi));
+
+		if(shader_ptr[i] != last_shader || last_smooth != smooth[i]) {
+			last_shader = shader_ptr[i];
+			last_smooth = smooth[i];
+			shader_id = scene->shader_manager->get_shader_id(last_shader, this, last_smooth);
+		}
+
+		normal[i*2 + 0] = pack_normal_oct(fNi);
+		normal[i*2 + 1] = (uint)shader_id;
+	}
+
+	size_t verts_size = verts.size();
+
+	for(size_t i = 0; i < verts_size; i++) {
+		float3 vNi = vN[i];
+
+		if(do_transform)
+			vNi = normalize(transform_direction(&ntfm, vNi));
+
+		vnormal[i] = pack_normal_oct(vNi);
+	}
+}
+
 void Mesh::pack_verts(float4 *tri_verts, float4 *tri_vindex, size_t vert_offset)
 {
 	size_t verts_size = verts.size();
@@ -389,18 +462,27 @@ void Mesh::compute_bvh(SceneParams *params, Progress *progress, int n, int total
 		vector<Object*> objects;
 		objects.push_back(&object);
 
-		if(bvh && !need_update_rebuild) {
+		bool rebuild = (!bvh || need_update_rebuild ||
+		                bvh->params.use_compact_triangles != params->use_compact_triangles);
+
+		if(!rebuild) {
 			progress->set_status(msg, "Refitting BVH");
 			bvh->objects = objects;
 			bvh->refit(*progress);
+
+			/* refitting keeps the topology of the tree, rebuild once quality has
+			 * degraded too much from deformation */
+			rebuild = bvh->refit_need_rebuild();
 		}
-		else {
+
+		if(rebuild) {
 			progress->set_status(msg, "Building BVH");
 
 			BVHParams bparams;
 			bparams.use_cache = params->use_bvh_cache;
 			bparams.use_spatial_split = params->use_bvh_spatial_split;
 			bparams.use_qbvh = params->use_qbvh;
+			bparams.use_compact_triangles = params->use_compact_triangles;
 
 			delete bvh;
 			bvh = BVH::create(bparams, objects);
@@ -774,27 +856,50 @@ void MeshManager::device_update_mesh(Device *device, DeviceScene *dscene, Scene
 		curve_size += mesh->curves.size();
 	}
 
+	bool compact = scene->params.use_compact_triangles;
+	dscene->data.bvh.use_compact_triangles = compact;
+
 	if(tri_size != 0) {
 		/* normals */
 		progress.set_status("Updating Mesh", "Computing normals");
 
-		float4 *normal = dscene->tri_normal.resize(tri_size);
-		float4 *vnormal = dscene->tri_vnormal.resize(vert_size);
 		float4 *tri_verts = dscene->tri_verts.resize(vert_size);
 		float4 *tri_vindex = dscene->tri_vindex.resize(tri_size);
 
-		foreach(Mesh *mesh, scene->meshes) {
-			mesh->pack_normals(scene, &normal[mesh->tri_offset], &vnormal[mesh->vert_offset]);
-			mesh->pack_verts(&tri_verts[mesh->vert_offset], &tri_vindex[mesh->tri_offset], mesh->vert_offset);
+		if(compact) {
+			uint *normal = dscene->tri_normal_packed.resize(tri_size*2);
+			uint *vnormal = dscene->tri_vnormal_packed.resize(vert_size);
 
-			if(progress.get_cancel()) return;
+			foreach(Mesh *mesh, scene->meshes) {
+				mesh->pack_normals_compact(scene, &normal[mesh->tri_offset*2], &vnormal[mesh->vert_offset]);
+				mesh->pack_verts(&tri_verts[mesh->vert_offset], &tri_vindex[mesh->tri_offset], mesh->vert_offset);
+
+				if(progress.get_cancel()) return;
+			}
+		}
+		else {
+			float4 *normal = dscene->tri_normal.resize(tri_size);
+			float4 *vnormal = dscene->tri_vnormal.resize(vert_size);
+
+			foreach(Mesh *mesh, scene->meshes) {
+				mesh->pack_normals(scene, &normal[mesh->tri_offset], &vnormal[mesh->vert_offset]);
+				mesh->pack_verts(&tri_verts[mesh->vert_offset], &tri_vindex[mesh->tri_offset], mesh->vert_offset);
+
+				if(progress.get_cancel()) return;
+			}
 		}
 
 		/* vertex coordinates */
 		progress.set_status("Updating Mesh", "Copying Mesh to device");
 
-		device->tex_alloc("__tri_normal", dscene->tri_normal);
-		device->tex_alloc("__tri_vnormal", dscene->tri_vnormal);
+		if(compact) {
+			device->tex_alloc("__tri_normal_packed", dscene->tri_normal_packed);
+			device->tex_alloc("__tri_vnormal_packed", dscene->tri_vnormal_packed);
+		}
+		else {
+			device->tex_alloc("__tri_normal", dscene->tri_normal);
+			device->tex_alloc("__tri_vnormal", dscene->tri_vnormal);
+		}
 		device->tex_alloc("__tri_verts", dscene->tri_verts);
 		device->tex_alloc("__tri_vindex", dscene->tri_vindex);
 	}
@@ -815,20 +920,47 @@ void MeshManager::device_update_mesh(Device *device, DeviceScene *dscene, Scene
 	}
 }
 
-void MeshManager::device_update_bvh(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress)
+void MeshManager::device_update_bvh(Device *device, DeviceScene *dscene, Scene *scene, bool mesh_updated, Progress& progress)
 {
-	/* bvh build */
-	progress.set_status("Updating Scene BVH", "Building");
+	/* if only object transforms changed, the same mesh BVH's are instanced
+	 * and we can refit the top level BVH instead of building it again */
+	bool refit = (bvh && !mesh_updated &&
+	              bvh->params.use_qbvh == scene->params.use_qbvh &&
+	              bvh->params.use_compact_triangles == scene->params.use_compact_triangles &&
+	              bvh->objects.size() == scene->objects.size());
+
+	for(size_t i = 0; refit && i < scene->objects.size(); i++) {
+		Object *object = scene->objects[i];
+
+		if(bvh->objects[i] != object || bvh_meshes[i] != object->mesh || object->mesh->transform_applied)
+			refit = false;
+	}
 
-	BVHParams bparams;
-	bparams.top_level = true;
-	bparams.use_qbvh = scene->params.use_qbvh;
-	bparams.use_spatial_split = scene->params.use_bvh_spatial_split;
-	bparams.use_cache = scene->params.use_bvh_cache;
+	if(refit) {
+		progress.set_status("Updating Scene BVH", "Refitting");
 
-	delete bvh;
-	bvh = BVH::create(bparams, scene->objects);
-	bvh->build(progress);
+		bvh->objects = scene->objects;
+		bvh->refit(progress);
+	}
+	else {
+		progress.set_status("Updating Scene BVH", "Building");
+
+		BVHParams bparams;
+		bparams.top_level = true;
+		bparams.use_qbvh = scene->params.use_qbvh;
+		bparams.use_spatial_split = scene->params.use_bvh_spatial_split;
+		bparams.use_cache = scene->params.use_bvh_cache;
+		bparams.use_compact_triangles = scene->params.use_compact_triangles;
+
+		delete bvh;
+		bvh = BVH::create(bparams, scene->objects);
+		bvh->build(progress);
+
+		bvh_meshes.clear();
+
+		foreach(Object *object, scene->objects)
+			bvh_meshes.push_back(object->mesh);
+	}
 
 	if(progress.get_cancel()) return;
 
@@ -875,12 +1007,16 @@ void MeshManager::device_update(Device *device, DeviceScene *dscene, Scene *scen
 		return;
 
 	/* update normals */
+	bool mesh_updated = false;
+
 	foreach(Mesh *mesh, scene->meshes) {
 		foreach(uint shader, mesh->used_shaders)
 			if(scene->shaders[shader]->need_update_attributes)
 				mesh->need_update = true;
 
 		if(mesh->need_update) {
+			mesh_updated = true;
+
 			mesh->add_face_normals();
 			mesh->add_vertex_normals();
 
@@ -925,6 +1061,12 @@ void MeshManager::device_update(Device *device, DeviceScene *dscene, Scene *scen
 		if(mesh->need_update && !mesh->transform_applied)
 			num_bvh++;
 
+	if(scene->params.use_bvh_cache) {
+		Cache::global.set_directory(scene->params.bvh_cache_path);
+		Cache::global.set_max_size((size_t)scene->params.bvh_cache_size*1024*1024);
+	}
+
+	double bvh_start_time = time_dt();
 	TaskPool pool;
 
 	foreach(Mesh *mesh, scene->meshes) {
@@ -952,11 +1094,53 @@ void MeshManager::device_update(Device *device, DeviceScene *dscene, Scene *scen
 
 	if(progress.get_cancel()) return;
 
-	device_update_bvh(device, dscene, scene, progress);
+	device_update_bvh(device, dscene, scene, mesh_updated, progress);
+
+	scene->update_times.bvh += time_dt() - bvh_start_time;
 
 	need_update = false;
 }
 
+static void memory_report_array(string& report, size_t& total, const char *name, device_memory& mem)
+{
+	size_t size = mem.memory_size();
+
+	if(size == 0)
+		return;
+
+	report += string_printf("%-24s %10.2f MB\n", name, size/(1024.0*1024.0));
+	total += size;
+}
+
+string MeshManager::memory_report(DeviceScene *dscene)
+{
+	string report;
+	size_t total = 0;
+
+	memory_report_array(report, total, "__bvh_nodes", dscene->bvh_nodes);
+	memory_report_array(report, total, "__object_node", dscene->object_node);
+	memory_report_array(report, total, "__tri_woop", dscene->tri_woop);
+	memory_report_array(report, total, "__prim_segment", dscene->prim_segment);
+	memory_report_array(report, total, "__prim_visibility", dscene->prim_visibility);
+	memory_report_array(report, total, "__prim_index", dscene->prim_index);
+	memory_report_array(report, total, "__prim_object", dscene->prim_object);
+	memory_report_array(report, total, "__tri_normal", dscene->tri_normal);
+	memory_report_array(report, total, "__tri_vnormal", dscene->tri_vnormal);
+	memory_report_array(report, total, "__tri_normal_packed", dscene->tri_normal_packed);
+	memory_report_array(report, total, "__tri_vnormal_packed", dscene->tri_vnormal_packed);
+	memory_report_array(report, total, "__tri_vindex", dscene->tri_vindex);
+	memory_report_array(report, total, "__tri_verts", dscene->tri_verts);
+	memory_report_array(report, total, "__curves", dscene->curves);
+	memory_report_array(report, total, "__curve_keys", dscene->curve_keys);
+	memory_report_array(report, total, "__attributes_map", dscene->attributes_map);
+	memory_report_array(report, total, "__attributes_float", dscene->attributes_float);
+	memory_report_array(report, total, "__attributes_float3", dscene->attributes_float3);
+
+	report += string_printf("%-24s %10.2f MB\n", "total", total/(1024.0*1024.0));
+
+	return report;
+}
+
 void MeshManager::device_free(Device *device, DeviceScene *dscene)
 {
 	device->tex_free(dscene->bvh_nodes);
@@ -968,6 +1152,8 @@ void MeshManager::device_free(Device *device, DeviceScene *dscene)
 	device->tex_free(dscene->prim_object);
 	device->tex_free(dscene->tri_normal);
 	device->tex_free(dscene->tri_vnormal);
+	device->tex_free(dscene->tri_normal_packed);
+	device->tex_free(dscene->tri_vnormal_packed);
 	device->tex_free(dscene->tri_vindex);
 	device->tex_free(dscene->tri_verts);
 	device->tex_free(dscene->curves);
@@ -985,6 +1171,8 @@ void MeshManager::device_free(Device *device, DeviceScene *dscene)
 	dscene->prim_object.clear();
 	dscene->tri_normal.clear();
 	dscene->tri_vnormal.clear();
+	dscene->tri_normal_packed.clear();
+	dscene->tri_vnormal_packed.clear();
 	dscene->tri_vindex.clear();
 	dscene->tri_verts.clear();
 	dscene->curves.clear();
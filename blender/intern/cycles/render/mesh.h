@@ -118,6 +118,7 @@ public:
 	void add_vertex_normals();
 
 	void pack_normals(Scene *scene, float4 *normal, float4 *vnormal);
+	void pack_normals_compact(Scene *scene, uint *normal, uint *vnormal);
 	void pack_verts(float4 *tri_verts, float4 *tri_vindex, size_t vert_offset);
 	void pack_curves(Scene *scene, float4 *curve_key_co, float4 *curve_data, size_t curvekey_offset);
 	void compute_bvh(SceneParams *params, Progress *progress, int n, int total);
@@ -133,6 +134,8 @@ public:
 class MeshManager {
 public:
 	BVH *bvh;
+	/* mesh of each object in the top level BVH, to detect when it can be refit */
+	vector<Mesh*> bvh_meshes;
 
 	bool need_update;
 
@@ -149,9 +152,12 @@ public:
 	void device_update_object(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress);
 	void device_update_mesh(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress);
 	void device_update_attributes(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress);
-	void device_update_bvh(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress);
+	void device_update_bvh(Device *device, DeviceScene *dscene, Scene *scene, bool mesh_updated, Progress& progress);
 	void device_free(Device *device, DeviceScene *dscene);
 
+	/* device memory used by each mesh, BVH and attribute array */
+	string memory_report(DeviceScene *dscene);
+
 	void tag_update(Scene *scene);
 };
 
@@ -20,6 +20,9 @@
 #include "osl.h"
 #include "sky_model.h"
 
+#include "svm_math_util.h"
+
+#include "util_color.h"
 #include "util_foreach.h"
 #include "util_transform.h"
 
@@ -247,13 +250,26 @@ void ImageTextureNode::compile(SVMCompiler& compiler)
 		}
 
 		if(projection == "Flat") {
+			/* UV attribute for the filter width, only when the differentials of
+			 * the vector input are known */
+			int uv_attr = 0;
+			ShaderOutput *vector_link = vector_in->link;
+
+			if(vector_link && vector_link->parent->name == ustring("texture_coordinate") &&
+			   vector_link == vector_link->parent->output("UV") && tex_mapping.skip() &&
+			   !((TextureCoordinateNode*)vector_link->parent)->from_dupli)
+			{
+				uv_attr = compiler.attribute(ATTR_STD_UV);
+			}
+
 			compiler.add_node(NODE_TEX_IMAGE,
 				slot,
 				compiler.encode_uchar4(
 					vector_offset,
 					color_out->stack_offset,
 					alpha_out->stack_offset,
-					srgb));
+					srgb),
+				uv_attr);
 		}
 		else {
 			compiler.add_node(NODE_TEX_IMAGE_BOX,
@@ -1311,6 +1327,39 @@ ConvertNode::ConvertNode(ShaderSocketType from_, ShaderSocketType to_, bool auto
 		assert(0);
 }
 
+bool ConvertNode::constant_fold(ShaderOutput *socket, float3 *optimized_value)
+{
+	ShaderInput *in = inputs[0];
+
+	if(in->link)
+		return false;
+
+	/* same conversions as the SVM, int sockets are left alone */
+	if(from == SHADER_SOCKET_FLOAT && to != SHADER_SOCKET_INT) {
+		float f = in->value.x;
+		*optimized_value = make_float3(f, f, f);
+		return true;
+	}
+	else if(from == SHADER_SOCKET_COLOR && to == SHADER_SOCKET_FLOAT) {
+		*optimized_value = make_float3(linear_rgb_to_gray(in->value), 0.0f, 0.0f);
+		return true;
+	}
+	else if((from == SHADER_SOCKET_VECTOR || from == SHADER_SOCKET_POINT || from == SHADER_SOCKET_NORMAL) &&
+	        to == SHADER_SOCKET_FLOAT) {
+		float3 f = in->value;
+		*optimized_value = make_float3((f.x + f.y + f.z)*(1.0f/3.0f), 0.0f, 0.0f);
+		return true;
+	}
+	else if(from != SHADER_SOCKET_INT && from != SHADER_SOCKET_STRING && to != SHADER_SOCKET_INT &&
+	        to != SHADER_SOCKET_FLOAT && to != SHADER_SOCKET_STRING) {
+		/* between color, vector, point and normal the value is unchanged */
+		*optimized_value = in->value;
+		return true;
+	}
+
+	return false;
+}
+
 void ConvertNode::compile(SVMCompiler& compiler)
 {
 	ShaderInput *in = inputs[0];
@@ -2613,6 +2662,12 @@ ValueNode::ValueNode()
 	add_output("Value", SHADER_SOCKET_FLOAT);
 }
 
+bool ValueNode::constant_fold(ShaderOutput *socket, float3 *optimized_value)
+{
+	*optimized_value = make_float3(value, value, value);
+	return true;
+}
+
 void ValueNode::compile(SVMCompiler& compiler)
 {
 	ShaderOutput *val_out = output("Value");
@@ -2637,6 +2692,12 @@ ColorNode::ColorNode()
 	add_output("Color", SHADER_SOCKET_COLOR);
 }
 
+bool ColorNode::constant_fold(ShaderOutput *socket, float3 *optimized_value)
+{
+	*optimized_value = value;
+	return true;
+}
+
 void ColorNode::compile(SVMCompiler& compiler)
 {
 	ShaderOutput *color_out = output("Color");
@@ -3368,6 +3429,23 @@ static ShaderEnum math_type_init()
 
 ShaderEnum MathNode::type_enum = math_type_init();
 
+bool MathNode::constant_fold(ShaderOutput *socket, float3 *optimized_value)
+{
+	ShaderInput *value1_in = input("Value1");
+	ShaderInput *value2_in = input("Value2");
+
+	if(value1_in->link || value2_in->link)
+		return false;
+
+	float value = svm_math((NodeMath)type_enum[type], value1_in->value.x, value2_in->value.x);
+
+	if(use_clamp)
+		value = svm_math(NODE_MATH_CLAMP, value, 0.0f);
+
+	*optimized_value = make_float3(value, value, value);
+	return true;
+}
+
 void MathNode::compile(SVMCompiler& compiler)
 {
 	ShaderInput *value1_in = input("Value1");
@@ -3423,6 +3501,27 @@ static ShaderEnum vector_math_type_init()
 
 ShaderEnum VectorMathNode::type_enum = vector_math_type_init();
 
+bool VectorMathNode::constant_fold(ShaderOutput *socket, float3 *optimized_value)
+{
+	ShaderInput *vector1_in = input("Vector1");
+	ShaderInput *vector2_in = input("Vector2");
+
+	if(vector1_in->link || vector2_in->link)
+		return false;
+
+	float value;
+	float3 vector;
+
+	svm_vector_math(&value, &vector, (NodeVectorMath)type_enum[type], vector1_in->value, vector2_in->value);
+
+	if(socket == output("Value"))
+		*optimized_value = make_float3(value, value, value);
+	else
+		*optimized_value = vector;
+
+	return true;
+}
+
 void VectorMathNode::compile(SVMCompiler& compiler)
 {
 	ShaderInput *vector1_in = input("Vector1");
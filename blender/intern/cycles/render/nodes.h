@@ -190,6 +190,8 @@ public:
 	ConvertNode(ShaderSocketType from, ShaderSocketType to, bool autoconvert = false);
 	SHADER_NODE_BASE_CLASS(ConvertNode)
 
+	bool constant_fold(ShaderOutput *socket, float3 *optimized_value);
+
 	ShaderSocketType from, to;
 };
 
@@ -379,6 +381,8 @@ class ValueNode : public ShaderNode {
 public:
 	SHADER_NODE_CLASS(ValueNode)
 
+	bool constant_fold(ShaderOutput *socket, float3 *optimized_value);
+
 	float value;
 };
 
@@ -386,6 +390,8 @@ class ColorNode : public ShaderNode {
 public:
 	SHADER_NODE_CLASS(ColorNode)
 
+	bool constant_fold(ShaderOutput *socket, float3 *optimized_value);
+
 	float3 value;
 };
 
@@ -500,6 +506,8 @@ class MathNode : public ShaderNode {
 public:
 	SHADER_NODE_CLASS(MathNode)
 
+	bool constant_fold(ShaderOutput *socket, float3 *optimized_value);
+
 	bool use_clamp;
 
 	ustring type;
@@ -517,6 +525,8 @@ class VectorMathNode : public ShaderNode {
 public:
 	SHADER_NODE_CLASS(VectorMathNode)
 
+	bool constant_fold(ShaderOutput *socket, float3 *optimized_value);
+
 	ustring type;
 	static ShaderEnum type_enum;
 };
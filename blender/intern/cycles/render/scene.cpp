@@ -34,6 +34,7 @@
 
 #include "util_foreach.h"
 #include "util_progress.h"
+#include "util_time.h"
 
 CCL_NAMESPACE_BEGIN
 
@@ -129,6 +130,9 @@ void Scene::device_update(Device *device_, Progress& progress)
 {
 	if(!device)
 		device = device_;
+
+	double start_time = time_dt();
+	double bvh_time = update_times.bvh;
 	
 	/* The order of updates is important, because there's dependencies between
 	 * the different managers, using data computed by previous managers.
@@ -141,6 +145,8 @@ void Scene::device_update(Device *device_, Progress& progress)
 	 */
 	
 	image_manager->set_pack_images(device->info.pack_images);
+	image_manager->set_cache_size((size_t)params.texture_cache_size*1024*1024);
+	image_manager->set_disk_cache_size((size_t)params.texture_cache_disk_size*1024*1024);
 
 	progress.set_status("Updating Background");
 	background->device_update(device, &dscene, this);
@@ -204,6 +210,9 @@ void Scene::device_update(Device *device_, Progress& progress)
 
 	progress.set_status("Updating Device", "Writing constant memory");
 	device->const_copy_to("__data", &dscene.data, sizeof(dscene.data));
+
+	/* time for everything besides BVH building */
+	update_times.device += (time_dt() - start_time) - (update_times.bvh - bvh_time);
 }
 
 Scene::MotionType Scene::need_motion(bool advanced_shading)
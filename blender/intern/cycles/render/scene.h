@@ -68,6 +68,8 @@ public:
 	/* mesh */
 	device_vector<float4> tri_normal;
 	device_vector<float4> tri_vnormal;
+	device_vector<uint> tri_normal_packed;
+	device_vector<uint> tri_vnormal_packed;
 	device_vector<float4> tri_vindex;
 	device_vector<float4> tri_verts;
 
@@ -88,6 +90,9 @@ public:
 	device_vector<float4> light_data;
 	device_vector<float2> light_background_marginal_cdf;
 	device_vector<float2> light_background_conditional_cdf;
+	device_vector<float4> light_tree_nodes;
+	device_vector<float4> light_tree_emitters;
+	device_vector<uint> light_tree_triangles;
 
 	/* particles */
 	device_vector<float4> particles;
@@ -121,15 +126,22 @@ public:
 	enum { OSL, SVM } shadingsystem;
 	enum BVHType { BVH_DYNAMIC, BVH_STATIC } bvh_type;
 	bool use_bvh_cache;
+	string bvh_cache_path; /* empty for the user cache directory */
+	int bvh_cache_size; /* in megabytes, 0 for unlimited */
 	bool use_bvh_spatial_split;
 	bool use_qbvh;
 	bool persistent_data;
+	int texture_cache_size; /* in megabytes, 0 to load images fully */
+	int texture_cache_disk_size; /* in megabytes, 0 for unlimited */
+	bool use_compact_triangles;
 
 	SceneParams()
 	{
 		shadingsystem = SVM;
 		bvh_type = BVH_DYNAMIC;
 		use_bvh_cache = false;
+		bvh_cache_path = "";
+		bvh_cache_size = 4096;
 		use_bvh_spatial_split = false;
 #ifdef __QBVH__
 		use_qbvh = true;
@@ -137,15 +149,48 @@ public:
 		use_qbvh = false;
 #endif
 		persistent_data = false;
+		texture_cache_size = 0;
+		texture_cache_disk_size = 4096;
+		use_compact_triangles = false;
 	}
 
 	bool modified(const SceneParams& params)
 	{ return !(shadingsystem == params.shadingsystem
 		&& bvh_type == params.bvh_type
 		&& use_bvh_cache == params.use_bvh_cache
+		&& bvh_cache_path == params.bvh_cache_path
+		&& bvh_cache_size == params.bvh_cache_size
 		&& use_bvh_spatial_split == params.use_bvh_spatial_split
 		&& use_qbvh == params.use_qbvh
-		&& persistent_data == params.persistent_data); }
+		&& persistent_data == params.persistent_data
+		&& texture_cache_size == params.texture_cache_size
+		&& texture_cache_disk_size == params.texture_cache_disk_size
+		&& use_compact_triangles == params.use_compact_triangles); }
+};
+
+/* Scene Update Times
+ *
+ * Time in seconds spent syncing the scene from the host application,
+ * building BVH's and updating the other device data. Accumulated until
+ * reset, so that multiple updates for one frame are added together. */
+
+class SceneUpdateTimes {
+public:
+	double sync;
+	double bvh;
+	double device;
+
+	SceneUpdateTimes()
+	{
+		reset();
+	}
+
+	void reset()
+	{
+		sync = 0.0;
+		bvh = 0.0;
+		device = 0.0;
+	}
 };
 
 /* Scene */
@@ -188,6 +233,9 @@ public:
 	/* parameters */
 	SceneParams params;
 
+	/* statistics */
+	SceneUpdateTimes update_times;
+
 	/* mutex must be locked manually by callers */
 	thread_mutex mutex;
 
@@ -20,6 +20,7 @@
 #include "buffers.h"
 #include "camera.h"
 #include "device.h"
+#include "image.h"
 #include "integrator.h"
 #include "scene.h"
 #include "session.h"
@@ -105,6 +106,11 @@ Session::~Session()
 	foreach(RenderBuffers *buffers, tile_buffers)
 		delete buffers;
 
+	/* sessions are freed by the code drawing them, with the same context
+	 * current, sessions that were never drawn have no texture to free */
+	if(display)
+		display->draw_free();
+
 	delete buffers;
 	delete display;
 	delete scene;
@@ -445,6 +451,10 @@ void Session::release_tile(RenderTile& rtile)
 {
 	thread_scoped_lock tile_lock(tile_mutex);
 
+	/* remember the region for display conversion */
+	if(!params.background)
+		tile_dirty.push_back(make_int4(rtile.x, rtile.y, rtile.w, rtile.h));
+
 	if(write_render_tile_cb) {
 		if(params.progressive_refine == false) {
 			/* todo: optimize this by making it thread safe and removing lock */
@@ -584,25 +594,34 @@ void Session::run_cpu()
 		update_progressive_refine(true);
 }
 
-void Session::run()
+bool Session::load_kernels()
 {
-	/* load kernels */
-	if(!kernels_loaded) {
-		progress.set_status("Loading render kernels (may take a few minutes the first time)");
+	if(kernels_loaded)
+		return true;
 
-		if(!device->load_kernels(params.experimental)) {
-			string message = device->error_message();
-			if(message == "")
-				message = "Failed loading render kernel, see console for errors";
+	progress.set_status("Loading render kernels (may take a few minutes the first time)");
 
-			progress.set_status("Error", message);
-			progress.set_update();
-			return;
-		}
+	if(!device->load_kernels(params.experimental)) {
+		string message = device->error_message();
+		if(message == "")
+			message = "Failed loading render kernel, see console for errors";
 
-		kernels_loaded = true;
+		progress.set_status("Error", message);
+		progress.set_update();
+		return false;
 	}
 
+	kernels_loaded = true;
+
+	return true;
+}
+
+void Session::run()
+{
+	/* load kernels */
+	if(!load_kernels())
+		return;
+
 	/* session thread loop */
 	progress.set_status("Waiting for render to start");
 
@@ -611,10 +630,17 @@ void Session::run()
 		/* reset number of rendered samples */
 		progress.reset_sample();
 
+		/* rays are reported per run, stats outlive multiple render layers */
+		stats.rays_reset();
+
+		double render_start = time_dt();
+
 		if(device_use_gl)
 			run_gpu();
 		else
 			run_cpu();
+
+		print_ray_stats(time_dt() - render_start - paused_time);
 	}
 
 	/* progress update */
@@ -624,6 +650,22 @@ void Session::run()
 		progress.set_update();
 }
 
+void Session::print_ray_stats(double render_time)
+{
+	uint64_t num_rays = stats.num_camera_rays + stats.num_bounce_rays + stats.num_shadow_rays;
+
+	/* only kernels built with ray statistics count rays */
+	if(num_rays == 0 || render_time <= 0.0)
+		return;
+
+	printf("Ray statistics, %.2fs render time\n", render_time);
+	printf("  %-8s %14s %12s\n", "Type", "Rays", "Rays/sec");
+	printf("  %-8s %14llu %12.0f\n", "Camera", (unsigned long long)stats.num_camera_rays, stats.num_camera_rays/render_time);
+	printf("  %-8s %14llu %12.0f\n", "Bounce", (unsigned long long)stats.num_bounce_rays, stats.num_bounce_rays/render_time);
+	printf("  %-8s %14llu %12.0f\n", "Shadow", (unsigned long long)stats.num_shadow_rays, stats.num_shadow_rays/render_time);
+	printf("  %-8s %14llu %12.0f\n", "Total", (unsigned long long)num_rays, num_rays/render_time);
+}
+
 bool Session::draw(BufferParams& buffer_params)
 {
 	if(device_use_gl)
@@ -644,6 +686,11 @@ void Session::reset_(BufferParams& buffer_params, int samples)
 
 	tile_manager.reset(buffer_params, samples);
 
+	{
+		thread_scoped_lock tile_lock(tile_mutex);
+		tile_dirty.clear();
+	}
+
 	start_time = time_dt();
 	preview_time = 0.0;
 	paused_time = 0.0;
@@ -811,6 +858,13 @@ void Session::update_status_time(bool show_pause, bool show_done)
 	if(preview_time < 0.0) preview_time = 0.0;
 
 	progress.set_tile(tile, tile_time);
+
+	/* image cache statistics */
+	uint64_t cache_hits, cache_misses;
+	size_t cache_memory;
+
+	scene->image_manager->get_cache_stats(cache_hits, cache_misses, cache_memory);
+	progress.set_image_cache_stats(cache_hits, cache_misses, cache_memory);
 }
 
 void Session::update_progress_sample()
@@ -830,6 +884,15 @@ void Session::path_trace()
 	task.update_progress_sample = function_bind(&Session::update_progress_sample, this);
 	task.need_finish_queue = params.progressive_refine;
 	task.integrator_branched = scene->integrator->method == Integrator::BRANCHED_PATH;
+	task.use_ray_packets = params.use_ray_packets;
+
+	/* stopping tiles early only works when each tile is rendered with all its
+	 * samples at once and written out with its own sample count */
+	if(params.adaptive_sampling && params.background && !params.progressive_refine) {
+		task.adaptive_sampling = true;
+		task.adaptive_threshold = params.adaptive_threshold;
+		task.adaptive_min_samples = params.adaptive_min_samples;
+	}
 
 	device->task_add(task);
 }
@@ -850,11 +913,62 @@ void Session::tonemap()
 	tile_manager.state.buffer.get_offset_stride(task.offset, task.stride);
 
 	if(task.w > 0 && task.h > 0) {
-		device->task_add(task);
+		vector<int4> rects;
+
+		{
+			thread_scoped_lock tile_lock(tile_mutex);
+			rects.swap(tile_dirty);
+		}
+
+		/* clip written regions to the buffer, and find their bounds */
+		int4 bounds = make_int4(task.x + task.w, task.y + task.h, task.x, task.y);
+		size_t area = 0, num = 0;
+
+		for(size_t i = 0; i < rects.size(); i++) {
+			int x0 = max(rects[i].x, task.x), y0 = max(rects[i].y, task.y);
+			int x1 = min(rects[i].x + rects[i].z, task.x + task.w);
+			int y1 = min(rects[i].y + rects[i].w, task.y + task.h);
+
+			if(x1 <= x0 || y1 <= y0)
+				continue;
+
+			rects[num++] = make_int4(x0, y0, x1 - x0, y1 - y0);
+			area += (size_t)(x1 - x0)*(y1 - y0);
+
+			bounds = make_int4(min(bounds.x, x0), min(bounds.y, y0), max(bounds.z, x1), max(bounds.w, y1));
+		}
+
+		rects.resize(num);
+
+		if(rects.empty()) {
+			/* nothing tracked, convert everything */
+			rects.push_back(make_int4(task.x, task.y, task.w, task.h));
+		}
+		else if(area*2 >= (size_t)(bounds.z - bounds.x)*(bounds.w - bounds.y)) {
+			/* mostly covered, a single task avoids per region overhead */
+			rects.clear();
+			rects.push_back(make_int4(bounds.x, bounds.y, bounds.z - bounds.x, bounds.w - bounds.y));
+		}
+
+		/* the device splits each region over its threads */
+		foreach(int4& rect, rects) {
+			DeviceTask rtask = task;
+
+			rtask.x = rect.x;
+			rtask.y = rect.y;
+			rtask.w = rect.z;
+			rtask.h = rect.w;
+
+			device->task_add(rtask);
+		}
+
 		device->task_wait();
 
 		/* set display to new size */
 		display->draw_set(task.w, task.h);
+
+		foreach(int4& rect, rects)
+			display->tag_update(rect.x - task.x, rect.y - task.y, rect.z, rect.w);
 	}
 
 	display_outdated = false;
@@ -895,6 +1009,11 @@ void Session::device_free()
 {
 	scene->device_free();
 
+	free_tile_buffers();
+}
+
+void Session::free_tile_buffers()
+{
 	foreach(RenderBuffers *buffers, tile_buffers)
 		delete buffers;
 
@@ -52,6 +52,11 @@ public:
 	TileOrder tile_order;
 	int start_resolution;
 	int threads;
+	bool use_ray_packets;
+
+	bool adaptive_sampling;
+	float adaptive_threshold;
+	int adaptive_min_samples;
 
 	bool display_buffer_linear;
 
@@ -73,6 +78,11 @@ public:
 		tile_size = make_int2(64, 64);
 		start_resolution = INT_MAX;
 		threads = 0;
+		use_ray_packets = false;
+
+		adaptive_sampling = false;
+		adaptive_threshold = 0.01f;
+		adaptive_min_samples = 16;
 
 		display_buffer_linear = false;
 
@@ -96,6 +106,10 @@ public:
 		&& tile_size == params.tile_size
 		&& start_resolution == params.start_resolution
 		&& threads == params.threads
+		&& use_ray_packets == params.use_ray_packets
+		&& adaptive_sampling == params.adaptive_sampling
+		&& adaptive_threshold == params.adaptive_threshold
+		&& adaptive_min_samples == params.adaptive_min_samples
 		&& display_buffer_linear == params.display_buffer_linear
 		&& cancel_timeout == params.cancel_timeout
 		&& reset_timeout == params.reset_timeout
@@ -131,12 +145,15 @@ public:
 	bool draw(BufferParams& params);
 	void wait();
 
+	bool load_kernels();
+
 	bool ready_to_reset();
 	void reset(BufferParams& params, int samples);
 	void set_samples(int samples);
 	void set_pause(bool pause);
 
 	void device_free();
+	void free_tile_buffers();
 protected:
 	struct DelayedReset {
 		thread_mutex mutex;
@@ -168,6 +185,8 @@ protected:
 
 	void update_progress_sample();
 
+	void print_ray_stats(double render_time);
+
 	bool device_use_gl;
 
 	thread *session_thread;
@@ -197,6 +216,10 @@ protected:
 	bool update_progressive_refine(bool cancel);
 
 	vector<RenderBuffers *> tile_buffers;
+
+	/* regions (x, y, w, h) of the render buffers written since the last
+	 * tonemap, protected by tile_mutex */
+	vector<int4> tile_dirty;
 };
 
 CCL_NAMESPACE_END
@@ -28,6 +28,28 @@
 
 CCL_NAMESPACE_BEGIN
 
+/* Compiled Program */
+
+SVMShaderProgram::SVMShaderProgram()
+{
+	surface_offset = 0;
+	surface_bump_offset = 0;
+	volume_offset = 0;
+	displacement_offset = 0;
+
+	graph = NULL;
+	graph_bump = NULL;
+	used = false;
+	background = false;
+	use_multi_closure = false;
+}
+
+bool SVMShaderProgram::compiled_from(Shader *shader, bool background_, bool use_multi_closure_)
+{
+	return graph == shader->graph && graph_bump == shader->graph_bump && used == shader->used &&
+	       background == background_ && use_multi_closure == use_multi_closure_;
+}
+
 /* Shader Manager */
 
 SVMShaderManager::SVMShaderManager()
@@ -40,6 +62,7 @@ SVMShaderManager::~SVMShaderManager()
 
 void SVMShaderManager::reset(Scene *scene)
 {
+	programs.clear();
 }
 
 void SVMShaderManager::device_update(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress)
@@ -53,31 +76,66 @@ void SVMShaderManager::device_update(Device *device, DeviceScene *dscene, Scene
 	/* determine which shaders are in use */
 	device_update_shaders_used(scene);
 
-	/* svm_nodes */
-	vector<int4> svm_nodes;
-	size_t i;
-
-	for(i = 0; i < scene->shaders.size(); i++) {
-		svm_nodes.push_back(make_int4(NODE_SHADER_JUMP, 0, 0, 0));
-		svm_nodes.push_back(make_int4(NODE_SHADER_JUMP, 0, 0, 0));
-	}
-	
+	/* compile shaders that changed, others reuse their program */
+	map<Shader*, SVMShaderProgram> new_programs;
 	bool use_multi_closure = device->info.advanced_shading;
+	size_t i;
 
 	for(i = 0; i < scene->shaders.size(); i++) {
 		Shader *shader = scene->shaders[i];
+		bool background = ((int)i == scene->default_background);
 
 		if(progress.get_cancel()) return;
 
 		assert(shader->graph);
 
+		SVMShaderProgram& program = new_programs[shader];
+		map<Shader*, SVMShaderProgram>::iterator it = programs.find(shader);
+
+		if(!shader->need_update && it != programs.end() &&
+		   it->second.compiled_from(shader, background, use_multi_closure))
+		{
+			program = it->second;
+		}
+		else {
+			SVMCompiler compiler(scene->shader_manager, scene->image_manager,
+				use_multi_closure);
+			compiler.background = background;
+			compiler.compile(shader, program);
+		}
+
 		if(shader->use_mis && shader->has_surface_emission)
 			scene->light_manager->need_update = true;
+	}
 
-		SVMCompiler compiler(scene->shader_manager, scene->image_manager,
-			use_multi_closure);
-		compiler.background = ((int)i == scene->default_background);
-		compiler.compile(shader, svm_nodes, i);
+	/* programs of removed shaders are dropped here */
+	programs.swap(new_programs);
+
+	/* svm_nodes, jump table followed by the programs. only the jump table
+	 * depends on where a program ends up, so relocating is a copy */
+	size_t num_nodes = scene->shaders.size()*2;
+
+	for(i = 0; i < scene->shaders.size(); i++)
+		num_nodes += programs[scene->shaders[i]].nodes.size();
+
+	vector<int4> svm_nodes;
+	svm_nodes.reserve(num_nodes);
+	svm_nodes.resize(scene->shaders.size()*2);
+
+	for(i = 0; i < scene->shaders.size(); i++) {
+		SVMShaderProgram& program = programs[scene->shaders[i]];
+		int offset = svm_nodes.size();
+
+		svm_nodes[i*2 + 0] = make_int4(NODE_SHADER_JUMP,
+			offset + program.surface_offset,
+			offset + program.volume_offset,
+			offset + program.displacement_offset);
+		svm_nodes[i*2 + 1] = make_int4(NODE_SHADER_JUMP,
+			offset + program.surface_bump_offset,
+			offset + program.volume_offset,
+			offset + program.displacement_offset);
+
+		svm_nodes.insert(svm_nodes.end(), program.nodes.begin(), program.nodes.end());
 	}
 
 	dscene->svm_nodes.copy((uint4*)&svm_nodes[0], svm_nodes.size());
@@ -656,7 +714,7 @@ void SVMCompiler::compile_type(Shader *shader, ShaderGraph *graph, ShaderType ty
 	add_node(NODE_END, 0, 0, 0);
 }
 
-void SVMCompiler::compile(Shader *shader, vector<int4>& global_svm_nodes, int index)
+void SVMCompiler::compile(Shader *shader, SVMShaderProgram& program)
 {
 	/* copy graph for shader with bump mapping */
 	ShaderNode *node = shader->graph->output();
@@ -681,29 +739,37 @@ void SVMCompiler::compile(Shader *shader, vector<int4>& global_svm_nodes, int in
 	shader->has_volume = false;
 	shader->has_displacement = false;
 
+	vector<int4>& program_nodes = program.nodes;
+	program_nodes.clear();
+
 	/* generate surface shader */
 	compile_type(shader, shader->graph, SHADER_TYPE_SURFACE);
-	global_svm_nodes[index*2 + 0].y = global_svm_nodes.size();
-	global_svm_nodes[index*2 + 1].y = global_svm_nodes.size();
-	global_svm_nodes.insert(global_svm_nodes.end(), svm_nodes.begin(), svm_nodes.end());
+	program.surface_offset = program_nodes.size();
+	program.surface_bump_offset = program_nodes.size();
+	program_nodes.insert(program_nodes.end(), svm_nodes.begin(), svm_nodes.end());
 
 	if(shader->graph_bump) {
 		compile_type(shader, shader->graph_bump, SHADER_TYPE_SURFACE);
-		global_svm_nodes[index*2 + 1].y = global_svm_nodes.size();
-		global_svm_nodes.insert(global_svm_nodes.end(), svm_nodes.begin(), svm_nodes.end());
+		program.surface_bump_offset = program_nodes.size();
+		program_nodes.insert(program_nodes.end(), svm_nodes.begin(), svm_nodes.end());
 	}
 
 	/* generate volume shader */
 	compile_type(shader, shader->graph, SHADER_TYPE_VOLUME);
-	global_svm_nodes[index*2 + 0].z = global_svm_nodes.size();
-	global_svm_nodes[index*2 + 1].z = global_svm_nodes.size();
-	global_svm_nodes.insert(global_svm_nodes.end(), svm_nodes.begin(), svm_nodes.end());
+	program.volume_offset = program_nodes.size();
+	program_nodes.insert(program_nodes.end(), svm_nodes.begin(), svm_nodes.end());
 
 	/* generate displacement shader */
 	compile_type(shader, shader->graph, SHADER_TYPE_DISPLACEMENT);
-	global_svm_nodes[index*2 + 0].w = global_svm_nodes.size();
-	global_svm_nodes[index*2 + 1].w = global_svm_nodes.size();
-	global_svm_nodes.insert(global_svm_nodes.end(), svm_nodes.begin(), svm_nodes.end());
+	program.displacement_offset = program_nodes.size();
+	program_nodes.insert(program_nodes.end(), svm_nodes.begin(), svm_nodes.end());
+
+	/* remember what the program was compiled from */
+	program.graph = shader->graph;
+	program.graph_bump = shader->graph_bump;
+	program.used = shader->used;
+	program.background = background;
+	program.use_multi_closure = use_multi_closure;
 }
 
 CCL_NAMESPACE_END
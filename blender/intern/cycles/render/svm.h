@@ -21,6 +21,7 @@
 #include "graph.h"
 #include "shader.h"
 
+#include "util_map.h"
 #include "util_set.h"
 #include "util_string.h"
 
@@ -35,6 +36,33 @@ class ShaderInput;
 class ShaderNode;
 class ShaderOutput;
 
+/* Compiled Program
+ *
+ * SVM nodes of a single shader, with the start of each shader type relative
+ * to the beginning of the program. Programs only use relative jumps, so they
+ * can be cached and moved to another location in svm_nodes unchanged. */
+
+class SVMShaderProgram {
+public:
+	SVMShaderProgram();
+
+	bool compiled_from(Shader *shader, bool background, bool use_multi_closure);
+
+	vector<int4> nodes;
+
+	int surface_offset;
+	int surface_bump_offset;
+	int volume_offset;
+	int displacement_offset;
+
+	/* state the program was compiled with */
+	ShaderGraph *graph;
+	ShaderGraph *graph_bump;
+	bool used;
+	bool background;
+	bool use_multi_closure;
+};
+
 /* Shader Manager */
 
 class SVMShaderManager : public ShaderManager {
@@ -46,6 +74,11 @@ public:
 
 	void device_update(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress);
 	void device_free(Device *device, DeviceScene *dscene, Scene *scene);
+
+protected:
+	/* programs of shaders from the previous update, shaders that were not
+	 * tagged for update reuse them instead of being compiled again */
+	map<Shader*, SVMShaderProgram> programs;
 };
 
 /* Graph Compiler */
@@ -54,7 +87,7 @@ class SVMCompiler {
 public:
 	SVMCompiler(ShaderManager *shader_manager, ImageManager *image_manager,
 		bool use_multi_closure_);
-	void compile(Shader *shader, vector<int4>& svm_nodes, int index);
+	void compile(Shader *shader, SVMShaderProgram& program);
 
 	void stack_assign(ShaderOutput *output);
 	void stack_assign(ShaderInput *input);
@@ -24,6 +24,74 @@
 
 CCL_NAMESPACE_BEGIN
 
+/* Dice Metric */
+
+DiceMetric::DiceMetric()
+{
+	camera = NULL;
+	objecttoworld = transform_identity();
+	camera_P = make_float3(0.0f, 0.0f, 0.0f);
+	pixels_per_unit = 1.0f;
+	nearclip = 0.0f;
+	perspective = false;
+}
+
+void DiceMetric::set_camera(Camera *camera_, const Transform& objecttoworld_)
+{
+	camera = camera_;
+	objecttoworld = objecttoworld_;
+
+	if(!camera)
+		return;
+
+	/* ensure matrices are up to date, camera is synced before meshes */
+	camera->update();
+
+	camera_P = transform_get_column(&camera->cameratoworld, 3);
+	nearclip = camera->nearclip;
+
+	if(camera->type == CAMERA_PERSPECTIVE) {
+		/* raster pixel size at distance 1 from the camera */
+		float3 P0 = transform_perspective(&camera->rastertocamera, make_float3(0.0f, 0.0f, 0.0f));
+		float3 P1 = transform_perspective(&camera->rastertocamera, make_float3(1.0f, 0.0f, 0.0f));
+
+		pixels_per_unit = fabsf(P0.z)/len(P1 - P0);
+		perspective = true;
+	}
+	else if(camera->type == CAMERA_ORTHOGRAPHIC) {
+		float3 dx = transform_direction(&camera->rastertocamera, make_float3(1.0f, 0.0f, 0.0f));
+
+		pixels_per_unit = 1.0f/len(dx);
+		perspective = false;
+	}
+	else {
+		/* panorama, assume the full width covers 360 degrees */
+		pixels_per_unit = camera->width/M_2PI_F;
+		perspective = true;
+	}
+}
+
+float3 DiceMetric::eval(Patch *patch, float2 uv)
+{
+	float3 P;
+
+	patch->eval(&P, NULL, NULL, uv.x, uv.y);
+	if(camera)
+		P = transform_point(&objecttoworld, P);
+
+	return P;
+}
+
+float DiceMetric::scale(const float3& P)
+{
+	if(!camera)
+		return 1.0f;
+	if(!perspective)
+		return pixels_per_unit;
+
+	return pixels_per_unit/max(len(P - camera_P), nearclip);
+}
+
 /* EdgeDice Base */
 
 EdgeDice::EdgeDice(Mesh *mesh_, int shader_, bool smooth_, float dicing_rate_)
@@ -35,7 +103,6 @@ EdgeDice::EdgeDice(Mesh *mesh_, int shader_, bool smooth_, float dicing_rate_)
 	dicing_rate = dicing_rate_;
 	shader = shader_;
 	smooth = smooth_;
-	camera = NULL;
 
 	mesh->attributes.add(ATTR_STD_VERTEX_NORMAL);
 }
@@ -132,16 +199,9 @@ float2 QuadDice::map_uv(SubPatch& sub, float u, float v)
 	return interp(d0, d1, u);
 }
 
-float3 QuadDice::eval_projected(SubPatch& sub, float u, float v)
+float3 QuadDice::eval_metric(SubPatch& sub, float u, float v)
 {
-	float2 uv = map_uv(sub, u, v);
-	float3 P;
-
-	sub.patch->eval(&P, NULL, NULL, uv.x, uv.y);
-	if(camera)
-		P = transform_perspective(&camera->worldtoraster, P);
-
-	return P;
+	return metric.eval(sub.patch, map_uv(sub, u, v));
 }
 
 int QuadDice::add_vert(SubPatch& sub, float u, float v)
@@ -213,13 +273,14 @@ float QuadDice::scale_factor(SubPatch& sub, EdgeFactors& ef, int Mu, int Mv)
 
 	for(int i = 0; i < 3; i++)
 		for(int j = 0; j < 3; j++)
-			P[i][j] = eval_projected(sub, i*0.5f, j*0.5f);
+			P[i][j] = eval_metric(sub, i*0.5f, j*0.5f);
 
 	float A1 = quad_area(P[0][0], P[1][0], P[0][1], P[1][1]);
 	float A2 = quad_area(P[1][0], P[2][0], P[1][1], P[2][1]);
 	float A3 = quad_area(P[0][1], P[1][1], P[0][2], P[1][2]);
 	float A4 = quad_area(P[1][1], P[2][1], P[1][2], P[2][2]);
-	float Apatch = max(A1, max(A2, max(A3, A4)))*4.0f;
+	float S_center = metric.scale(P[1][1]);
+	float Apatch = max(A1, max(A2, max(A3, A4)))*4.0f*S_center*S_center;
 
 	/* solve for scaling factor */
 	float Atri = dicing_rate*dicing_rate*0.5f;
@@ -277,15 +338,30 @@ void QuadDice::add_grid(SubPatch& sub, int Mu, int Mv, int offset)
 	}
 }
 
-void QuadDice::dice(SubPatch& sub, EdgeFactors& ef)
+void QuadDice::grid_size(SubPatch& sub, EdgeFactors& ef, int *Mu_, int *Mv_)
 {
 	/* compute inner grid size with scale factor */
 	int Mu = max(ef.tu0, ef.tu1);
 	int Mv = max(ef.tv0, ef.tv1);
 
 	float S = scale_factor(sub, ef, Mu, Mv);
-	Mu = max((int)ceil(S*Mu), 2); // XXX handle 0 & 1?
-	Mv = max((int)ceil(S*Mv), 2); // XXX handle 0 & 1?
+	*Mu_ = max((int)ceil(S*Mu), 2); // XXX handle 0 & 1?
+	*Mv_ = max((int)ceil(S*Mv), 2); // XXX handle 0 & 1?
+}
+
+size_t QuadDice::estimate_triangles(SubPatch& sub, EdgeFactors& ef)
+{
+	int Mu, Mv;
+	grid_size(sub, ef, &Mu, &Mv);
+
+	/* inner grid plus stitching to the edges */
+	return 2*(size_t)(Mu - 2)*(size_t)(Mv - 2) + (ef.tu0 + ef.tu1 + ef.tv0 + ef.tv1) + 2*(Mu + Mv - 4);
+}
+
+void QuadDice::dice(SubPatch& sub, EdgeFactors& ef)
+{
+	int Mu, Mv;
+	grid_size(sub, ef, &Mu, &Mv);
 
 	/* reserve space for new verts */
 	int offset = mesh->verts.size();
@@ -444,6 +520,13 @@ void TriangleDice::add_grid(SubPatch& sub, EdgeFactors& ef, int M)
 	}
 }
 
+size_t TriangleDice::estimate_triangles(SubPatch& sub, EdgeFactors& ef)
+{
+	/* M^2 for uniform edge factors */
+	size_t M = max(ef.tu, max(ef.tv, ef.tw));
+	return M*M;
+}
+
 void TriangleDice::dice(SubPatch& sub, EdgeFactors& ef)
 {
 	/* todo: handle 2 1 1 resolution */
@@ -22,6 +22,7 @@
  * DiagSplit. For more algorithm details, see the DiagSplit paper or the
  * ARB_tessellation_shader OpenGL extension, Section 2.X.2. */
 
+#include "util_transform.h"
 #include "util_types.h"
 #include "util_vector.h"
 
@@ -31,11 +32,42 @@ class Camera;
 class Mesh;
 class Patch;
 
+/* Dice Metric
+ *
+ * Measures lengths for computing tessellation factors. Without a camera these
+ * are object space lengths. With a camera, lengths are in raster pixels at the
+ * distance of the point from the camera, so tessellation adapts to the camera
+ * distance. Unlike a projection this is also well defined for geometry behind
+ * the camera or outside of the view, which still shows up in reflections. */
+
+class DiceMetric {
+public:
+	DiceMetric();
+
+	void set_camera(Camera *camera, const Transform& objecttoworld);
+
+	float3 eval(Patch *patch, float2 uv);
+	float scale(const float3& P);
+
+	float length(const float3& P0, const float3& P1)
+	{
+		return len(P1 - P0)*scale(0.5f*(P0 + P1));
+	}
+
+protected:
+	Camera *camera;
+	Transform objecttoworld;
+	float3 camera_P;
+	float pixels_per_unit;
+	float nearclip;
+	bool perspective;
+};
+
 /* EdgeDice Base */
 
 class EdgeDice {
 public:
-	Camera *camera;
+	DiceMetric metric;
 	Mesh *mesh;
 	float3 *mesh_P;
 	float3 *mesh_N;
@@ -89,7 +121,7 @@ public:
 	QuadDice(Mesh *mesh, int shader, bool smooth, float dicing_rate);
 
 	void reserve(EdgeFactors& ef, int Mu, int Mv);
-	float3 eval_projected(SubPatch& sub, float u, float v);
+	float3 eval_metric(SubPatch& sub, float u, float v);
 
 	float2 map_uv(SubPatch& sub, float u, float v);
 	int add_vert(SubPatch& sub, float u, float v);
@@ -107,7 +139,9 @@ public:
 
 	float quad_area(const float3& a, const float3& b, const float3& c, const float3& d);
 	float scale_factor(SubPatch& sub, EdgeFactors& ef, int Mu, int Mv);
+	void grid_size(SubPatch& sub, EdgeFactors& ef, int *Mu, int *Mv);
 
+	size_t estimate_triangles(SubPatch& sub, EdgeFactors& ef);
 	void dice(SubPatch& sub, EdgeFactors& ef);
 };
 
@@ -148,6 +182,8 @@ public:
 	int add_vert(SubPatch& sub, float2 uv);
 
 	void add_grid(SubPatch& sub, EdgeFactors& ef, int M);
+
+	size_t estimate_triangles(SubPatch& sub, EdgeFactors& ef);
 	void dice(SubPatch& sub, EdgeFactors& ef);
 };
 
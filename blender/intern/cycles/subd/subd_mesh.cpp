@@ -28,6 +28,8 @@
 
 #include <stdio.h>
 
+#include "mesh.h"
+
 #include "subd_build.h"
 #include "subd_edge.h"
 #include "subd_face.h"
@@ -38,6 +40,8 @@
 
 #include "util_debug.h"
 #include "util_foreach.h"
+#include "util_function.h"
+#include "util_task.h"
 
 CCL_NAMESPACE_BEGIN
 
@@ -285,24 +289,164 @@ void SubdMesh::link_boundary_edge(SubdEdge *edge)
 		edge->vert->edge = edge;
 }
 
-void SubdMesh::tessellate(DiagSplit *split, bool linear, Mesh *mesh, int shader, bool smooth)
+/* Tessellation
+ *
+ * Faces are processed in parallel in chunks of fixed size. Each chunk has its
+ * own copy of the DiagSplit and dices into its own mesh, and meshes are merged
+ * in order, so the result does not depend on the number of threads. */
+
+#define SUBD_FACES_PER_TASK 64
+#define SUBD_MAX_LIMIT_ITERATIONS 4
+
+static void tessellate_build_task(SubdMesh *sdmesh, vector<Patch*> *patches, bool linear, int start, int end)
 {
 	SubdBuilder *builder = SubdBuilder::create(linear);
+
+	for(int f = start; f < end; f++)
+		(*patches)[f] = builder->run(sdmesh->faces[f]);
+
+	delete builder;
+}
+
+static void tessellate_split_task(DiagSplit *split, vector<Patch*> *patches, int start, int end, size_t *num_triangles)
+{
+	for(int f = start; f < end; f++)
+		split->split_patch((*patches)[f]);
+
+	*num_triangles = split->estimate_triangles();
+}
+
+static void tessellate_dice_task(DiagSplit *split, Mesh *mesh, int shader, bool smooth)
+{
+	split->dice(mesh, shader, smooth);
+}
+
+static void tessellate_merge(Mesh *mesh, vector<Mesh*>& meshes)
+{
+	size_t num_verts = mesh->verts.size();
+	size_t num_triangles = mesh->triangles.size();
+
+	foreach(Mesh *chunk_mesh, meshes) {
+		num_verts += chunk_mesh->verts.size();
+		num_triangles += chunk_mesh->triangles.size();
+	}
+
+	size_t vert_offset = mesh->verts.size();
+	size_t tri_offset = mesh->triangles.size();
+
+	mesh->attributes.add(ATTR_STD_VERTEX_NORMAL);
+	mesh->reserve(num_verts, num_triangles, mesh->curves.size(), mesh->curve_keys.size());
+
+	float3 *mesh_N = mesh->attributes.add(ATTR_STD_VERTEX_NORMAL)->data_float3();
+
+	foreach(Mesh *chunk_mesh, meshes) {
+		size_t chunk_verts = chunk_mesh->verts.size();
+		size_t chunk_triangles = chunk_mesh->triangles.size();
+
+		if(chunk_verts) {
+			float3 *chunk_N = chunk_mesh->attributes.find(ATTR_STD_VERTEX_NORMAL)->data_float3();
+
+			memcpy(&mesh->verts[vert_offset], &chunk_mesh->verts[0], sizeof(float3)*chunk_verts);
+			memcpy(&mesh_N[vert_offset], chunk_N, sizeof(float3)*chunk_verts);
+		}
+
+		for(size_t i = 0; i < chunk_triangles; i++) {
+			Mesh::Triangle& tri = chunk_mesh->triangles[i];
+
+			mesh->set_triangle(tri_offset + i,
+				tri.v[0] + vert_offset, tri.v[1] + vert_offset, tri.v[2] + vert_offset,
+				chunk_mesh->shader[i], chunk_mesh->smooth[i]);
+		}
+
+		vert_offset += chunk_verts;
+		tri_offset += chunk_triangles;
+	}
+}
+
+void SubdMesh::tessellate(DiagSplit *split, bool linear, Mesh *mesh, int shader, bool smooth)
+{
 	int num_faces = faces.size();
-		        
-	for(int f = 0; f < num_faces; f++) {
-		SubdFace *face = faces[f];
-		Patch *patch = builder->run(face);
+	int num_chunks = (num_faces + SUBD_FACES_PER_TASK - 1)/SUBD_FACES_PER_TASK;
 
-		if(patch->is_triangle())
-			split->split_triangle(mesh, patch, shader, smooth);
-		else
-			split->split_quad(mesh, patch, shader, smooth);
+	split->stats = DiagSplit::Stats();
+	split->stats.num_patches = num_faces;
+	split->stats.dicing_rate = split->dicing_rate;
 
-		delete patch;
+	if(num_faces == 0)
+		return;
+
+	split->update_metric();
+
+	/* build patches */
+	vector<Patch*> patches(num_faces, NULL);
+	TaskPool pool;
+
+	for(int c = 0; c < num_chunks; c++) {
+		int start = c*SUBD_FACES_PER_TASK;
+		int end = min(start + SUBD_FACES_PER_TASK, num_faces);
+
+		pool.push(function_bind(&tessellate_build_task, this, &patches, linear, start, end));
 	}
 
-	delete builder;
+	pool.wait_work();
+
+	/* split patches, if the estimated number of triangles exceeds the limit,
+	 * increase the dicing rate and split again */
+	vector<DiagSplit> splits;
+	vector<size_t> chunk_triangles(num_chunks, 0);
+	float dicing_rate = split->dicing_rate;
+
+	for(int iteration = 0;; iteration++) {
+		splits.clear();
+		splits.resize(num_chunks, *split);
+
+		for(int c = 0; c < num_chunks; c++) {
+			int start = c*SUBD_FACES_PER_TASK;
+			int end = min(start + SUBD_FACES_PER_TASK, num_faces);
+
+			splits[c].dicing_rate = dicing_rate;
+			pool.push(function_bind(&tessellate_split_task, &splits[c], &patches, start, end, &chunk_triangles[c]));
+		}
+
+		pool.wait_work();
+
+		size_t num_triangles = 0;
+		foreach(size_t n, chunk_triangles)
+			num_triangles += n;
+
+		if(split->max_triangles == 0 || num_triangles <= split->max_triangles ||
+		   iteration == SUBD_MAX_LIMIT_ITERATIONS)
+			break;
+
+		/* number of triangles is roughly inverse quadratic in the dicing rate,
+		 * with some margin because edge factors are rounded up */
+		dicing_rate *= sqrtf(num_triangles/(float)split->max_triangles)*1.05f;
+		split->stats.limited = true;
+	}
+
+	split->stats.dicing_rate = dicing_rate;
+
+	for(int c = 0; c < num_chunks; c++)
+		split->stats.num_subpatches += splits[c].subpatches_quad.size() + splits[c].subpatches_triangle.size();
+
+	/* dice */
+	vector<Mesh*> meshes(num_chunks, NULL);
+
+	for(int c = 0; c < num_chunks; c++) {
+		meshes[c] = new Mesh();
+		pool.push(function_bind(&tessellate_dice_task, &splits[c], meshes[c], shader, smooth));
+	}
+
+	pool.wait_work();
+
+	size_t tri_offset = mesh->triangles.size();
+	tessellate_merge(mesh, meshes);
+	split->stats.num_triangles = mesh->triangles.size() - tri_offset;
+
+	foreach(Mesh *chunk_mesh, meshes)
+		delete chunk_mesh;
+	foreach(Patch *patch, patches)
+		delete patch;
 }
 
 CCL_NAMESPACE_END
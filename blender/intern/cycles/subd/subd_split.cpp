@@ -29,12 +29,35 @@ CCL_NAMESPACE_BEGIN
 
 /* DiagSplit */
 
+DiagSplit::Stats::Stats()
+{
+	num_patches = 0;
+	num_subpatches = 0;
+	num_triangles = 0;
+	dicing_rate = 0.0f;
+	limited = false;
+}
+
+string DiagSplit::Stats::full_report(const string& name)
+{
+	string report = string_printf("Subdivision %s: %lu patches, %lu subpatches, %lu triangles, dicing rate %f",
+		name.c_str(), (unsigned long)num_patches, (unsigned long)num_subpatches,
+		(unsigned long)num_triangles, (double)dicing_rate);
+
+	if(limited)
+		report += " (limited by max triangles)";
+
+	return report;
+}
+
 DiagSplit::DiagSplit()
 {
 	test_steps = 3;
 	split_threshold = 1;
 	dicing_rate = 0.1f;
 	camera = NULL;
+	objecttoworld = transform_identity();
+	max_triangles = 0;
 }
 
 void DiagSplit::dispatch(QuadDice::SubPatch& sub, QuadDice::EdgeFactors& ef)
@@ -49,15 +72,9 @@ void DiagSplit::dispatch(TriangleDice::SubPatch& sub, TriangleDice::EdgeFactors&
 	edgefactors_triangle.push_back(ef);
 }
 
-float3 DiagSplit::project(Patch *patch, float2 uv)
+void DiagSplit::update_metric()
 {
-	float3 P;
-
-	patch->eval(&P, NULL, NULL, uv.x, uv.y);
-	if(camera)
-		P = transform_perspective(&camera->worldtoraster, P);
-
-	return P;
+	metric.set_camera(camera, objecttoworld);
 }
 
 int DiagSplit::T(Patch *patch, float2 Pstart, float2 Pend)
@@ -69,10 +86,12 @@ int DiagSplit::T(Patch *patch, float2 Pstart, float2 Pend)
 	for(int i = 0; i < test_steps; i++) {
 		float t = i/(float)(test_steps-1);
 
-		float3 P = project(patch, Pstart + t*(Pend - Pstart));
+		float3 P = metric.eval(patch, Pstart + t*(Pend - Pstart));
 
 		if(i > 0) {
-			float L = len(P - Plast);
+			/* symmetric in the edge direction, so neighboring patches
+			 * agree on the factors of shared edges */
+			float L = metric.length(Plast, P);
 			Lsum += L;
 			Lmax = max(L, Lmax);
 		}
@@ -244,80 +263,143 @@ void DiagSplit::split(QuadDice::SubPatch& sub, QuadDice::EdgeFactors& ef, int de
 		dispatch(sub, ef);
 }
 
-void DiagSplit::split_triangle(Mesh *mesh, Patch *patch, int shader, bool smooth)
+void DiagSplit::split_patch(Patch *patch)
 {
-	TriangleDice::SubPatch sub_split;
-	TriangleDice::EdgeFactors ef_split;
+	if(patch->is_triangle()) {
+		TriangleDice::SubPatch sub_split;
+		TriangleDice::EdgeFactors ef_split;
 
-	sub_split.patch = patch;
-	sub_split.Pu = make_float2(1.0f, 0.0f);
-	sub_split.Pv = make_float2(0.0f, 1.0f);
-	sub_split.Pw = make_float2(0.0f, 0.0f);
+		sub_split.patch = patch;
+		sub_split.Pu = make_float2(1.0f, 0.0f);
+		sub_split.Pv = make_float2(0.0f, 1.0f);
+		sub_split.Pw = make_float2(0.0f, 0.0f);
 
-	ef_split.tu = T(patch, sub_split.Pv, sub_split.Pw);
-	ef_split.tv = T(patch, sub_split.Pw, sub_split.Pu);
-	ef_split.tw = T(patch, sub_split.Pu, sub_split.Pv);
+		ef_split.tu = T(patch, sub_split.Pv, sub_split.Pw);
+		ef_split.tv = T(patch, sub_split.Pw, sub_split.Pu);
+		ef_split.tw = T(patch, sub_split.Pu, sub_split.Pv);
 
-	split(sub_split, ef_split);
+		split(sub_split, ef_split);
+	}
+	else {
+		QuadDice::SubPatch sub_split;
+		QuadDice::EdgeFactors ef_split;
 
-	TriangleDice dice(mesh, shader, smooth, dicing_rate);
-	dice.camera = camera;
+		sub_split.patch = patch;
+		sub_split.P00 = make_float2(0.0f, 0.0f);
+		sub_split.P10 = make_float2(1.0f, 0.0f);
+		sub_split.P01 = make_float2(0.0f, 1.0f);
+		sub_split.P11 = make_float2(1.0f, 1.0f);
 
-	for(size_t i = 0; i < subpatches_triangle.size(); i++) {
-		TriangleDice::SubPatch& sub = subpatches_triangle[i];
-		TriangleDice::EdgeFactors& ef = edgefactors_triangle[i];
+		ef_split.tu0 = T(patch, sub_split.P00, sub_split.P10);
+		ef_split.tu1 = T(patch, sub_split.P01, sub_split.P11);
+		ef_split.tv0 = T(patch, sub_split.P00, sub_split.P01);
+		ef_split.tv1 = T(patch, sub_split.P10, sub_split.P11);
 
-		ef.tu = 4;
-		ef.tv = 4;
-		ef.tw = 4;
+		split(sub_split, ef_split);
+	}
+}
 
-		ef.tu = max(ef.tu, 1);
-		ef.tv = max(ef.tv, 1);
-		ef.tw = max(ef.tw, 1);
+static void clamp_edge_factors(TriangleDice::EdgeFactors& ef)
+{
+	ef.tu = 4;
+	ef.tv = 4;
+	ef.tw = 4;
 
-		dice.dice(sub, ef);
-	}
+	ef.tu = max(ef.tu, 1);
+	ef.tv = max(ef.tv, 1);
+	ef.tw = max(ef.tw, 1);
+}
 
-	subpatches_triangle.clear();
-	edgefactors_triangle.clear();
+static void clamp_edge_factors(QuadDice::EdgeFactors& ef)
+{
+	ef.tu0 = max(ef.tu0, 1);
+	ef.tu1 = max(ef.tu1, 1);
+	ef.tv0 = max(ef.tv0, 1);
+	ef.tv1 = max(ef.tv1, 1);
 }
 
-void DiagSplit::split_quad(Mesh *mesh, Patch *patch, int shader, bool smooth)
+size_t DiagSplit::estimate_triangles()
 {
-	QuadDice::SubPatch sub_split;
-	QuadDice::EdgeFactors ef_split;
+	/* dicers are only used for estimating, mesh is not modified */
+	Mesh mesh;
+	QuadDice quad_dice(&mesh, 0, false, dicing_rate);
+	TriangleDice triangle_dice(&mesh, 0, false, dicing_rate);
+	size_t num_triangles = 0;
 
-	sub_split.patch = patch;
-	sub_split.P00 = make_float2(0.0f, 0.0f);
-	sub_split.P10 = make_float2(1.0f, 0.0f);
-	sub_split.P01 = make_float2(0.0f, 1.0f);
-	sub_split.P11 = make_float2(1.0f, 1.0f);
+	quad_dice.metric = metric;
+	triangle_dice.metric = metric;
 
-	ef_split.tu0 = T(patch, sub_split.P00, sub_split.P10);
-	ef_split.tu1 = T(patch, sub_split.P01, sub_split.P11);
-	ef_split.tv0 = T(patch, sub_split.P00, sub_split.P01);
-	ef_split.tv1 = T(patch, sub_split.P10, sub_split.P11);
+	for(size_t i = 0; i < subpatches_triangle.size(); i++) {
+		TriangleDice::EdgeFactors ef = edgefactors_triangle[i];
+		clamp_edge_factors(ef);
+		num_triangles += triangle_dice.estimate_triangles(subpatches_triangle[i], ef);
+	}
 
-	split(sub_split, ef_split);
+	for(size_t i = 0; i < subpatches_quad.size(); i++) {
+		QuadDice::EdgeFactors ef = edgefactors_quad[i];
+		clamp_edge_factors(ef);
+		num_triangles += quad_dice.estimate_triangles(subpatches_quad[i], ef);
+	}
 
-	QuadDice dice(mesh, shader, smooth, dicing_rate);
-	dice.camera = camera;
+	return num_triangles;
+}
 
-	for(size_t i = 0; i < subpatches_quad.size(); i++) {
-		QuadDice::SubPatch& sub = subpatches_quad[i];
-		QuadDice::EdgeFactors& ef = edgefactors_quad[i];
+void DiagSplit::dice(Mesh *mesh, int shader, bool smooth)
+{
+	if(subpatches_triangle.size()) {
+		TriangleDice dice(mesh, shader, smooth, dicing_rate);
+		dice.metric = metric;
 
-		ef.tu0 = max(ef.tu0, 1);
-		ef.tu1 = max(ef.tu1, 1);
-		ef.tv0 = max(ef.tv0, 1);
-		ef.tv1 = max(ef.tv1, 1);
+		for(size_t i = 0; i < subpatches_triangle.size(); i++) {
+			TriangleDice::SubPatch& sub = subpatches_triangle[i];
+			TriangleDice::EdgeFactors& ef = edgefactors_triangle[i];
 
-		dice.dice(sub, ef);
+			clamp_edge_factors(ef);
+			dice.dice(sub, ef);
+		}
 	}
 
+	if(subpatches_quad.size()) {
+		QuadDice dice(mesh, shader, smooth, dicing_rate);
+		dice.metric = metric;
+
+		for(size_t i = 0; i < subpatches_quad.size(); i++) {
+			QuadDice::SubPatch& sub = subpatches_quad[i];
+			QuadDice::EdgeFactors& ef = edgefactors_quad[i];
+
+			clamp_edge_factors(ef);
+			dice.dice(sub, ef);
+		}
+	}
+
+	clear();
+}
+
+void DiagSplit::clear()
+{
+	subpatches_triangle.clear();
+	edgefactors_triangle.clear();
 	subpatches_quad.clear();
 	edgefactors_quad.clear();
 }
 
+void DiagSplit::split_triangle(Mesh *mesh, Patch *patch, int shader, bool smooth)
+{
+	assert(patch->is_triangle());
+
+	update_metric();
+	split_patch(patch);
+	dice(mesh, shader, smooth);
+}
+
+void DiagSplit::split_quad(Mesh *mesh, Patch *patch, int shader, bool smooth)
+{
+	assert(!patch->is_triangle());
+
+	update_metric();
+	split_patch(patch);
+	dice(mesh, shader, smooth);
+}
+
 CCL_NAMESPACE_END
 
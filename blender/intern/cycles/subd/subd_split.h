@@ -24,6 +24,8 @@
 
 #include "subd_dice.h"
 
+#include "util_string.h"
+#include "util_transform.h"
 #include "util_types.h"
 #include "util_vector.h"
 
@@ -44,11 +46,33 @@ public:
 	int test_steps;
 	int split_threshold;
 	float dicing_rate;
+
+	/* with a camera, dicing rate is in pixels and adapts to camera distance,
+	 * otherwise it is in object space units */
 	Camera *camera;
+	Transform objecttoworld;
+
+	/* maximum number of triangles for SubdMesh::tessellate, the dicing rate is
+	 * increased until the mesh fits, 0 for no limit */
+	size_t max_triangles;
+
+	/* statistics of the last SubdMesh::tessellate */
+	struct Stats {
+		size_t num_patches;
+		size_t num_subpatches;
+		size_t num_triangles;
+		float dicing_rate;
+		bool limited;
+
+		Stats();
+		string full_report(const string& name);
+	};
+
+	Stats stats;
 
 	DiagSplit();
 
-	float3 project(Patch *patch, float2 uv);
+	void update_metric();
 	int T(Patch *patch, float2 Pstart, float2 Pend);
 	void partition_edge(Patch *patch, float2 *P, int *t0, int *t1,
 		float2 Pstart, float2 Pend, int t);
@@ -59,8 +83,17 @@ public:
 	void dispatch(TriangleDice::SubPatch& sub, TriangleDice::EdgeFactors& ef);
 	void split(TriangleDice::SubPatch& sub, TriangleDice::EdgeFactors& ef, int depth=0);
 
+	/* split patch into subpatches with edge factors, for dicing later */
+	void split_patch(Patch *patch);
+	size_t estimate_triangles();
+	void dice(Mesh *mesh, int shader, bool smooth);
+	void clear();
+
 	void split_triangle(Mesh *mesh, Patch *patch, int shader, bool smooth);
 	void split_quad(Mesh *mesh, Patch *patch, int shader, bool smooth);
+
+protected:
+	DiceMetric metric;
 };
 
 CCL_NAMESPACE_END
@@ -15,15 +15,28 @@
  */
 
 #include <stdio.h>
+#include <time.h>
 
+#include "util_algorithm.h"
 #include "util_cache.h"
 #include "util_debug.h"
 #include "util_foreach.h"
+#include "util_hash.h"
 #include "util_map.h"
-#include "util_md5.h"
 #include "util_path.h"
 #include "util_types.h"
 
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN
+#  include <windows.h>
+#  include <process.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
 #include <boost/version.hpp>
 
 #if (BOOST_VERSION < 104400)
@@ -35,87 +48,358 @@
 
 CCL_NAMESPACE_BEGIN
 
+/* File Layout
+ *
+ * Header, followed by offset and size of each buffer, followed by the buffers
+ * themselves. Buffers are aligned so arrays can use the mapped memory as is. */
+
+#define CACHE_FILE_MAGIC "CYCACHE"
+#define CACHE_FILE_ALIGN 64
+
+struct CacheFileHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t num_buffers;
+	uint64_t check_hash;
+	uint64_t file_size;
+};
+
+static inline uint64_t cache_align(uint64_t offset)
+{
+	return (offset + CACHE_FILE_ALIGN - 1) & ~(uint64_t)(CACHE_FILE_ALIGN - 1);
+}
+
+/* CacheMapping */
+
+CacheMapping::CacheMapping()
+{
+	data = NULL;
+	size = 0;
+#ifdef _WIN32
+	file_handle = INVALID_HANDLE_VALUE;
+	map_handle = NULL;
+#endif
+}
+
+CacheMapping::~CacheMapping()
+{
+#ifdef _WIN32
+	if(data)
+		UnmapViewOfFile(data);
+	if(map_handle)
+		CloseHandle(map_handle);
+	if(file_handle != INVALID_HANDLE_VALUE)
+		CloseHandle(file_handle);
+#else
+	if(data)
+		munmap(data, size);
+#endif
+}
+
+CacheMapping *CacheMapping::open(const string& filename)
+{
+	CacheMapping *mapping = new CacheMapping();
+
+	/* private mapping, modifications are copy-on-write and not written back */
+#ifdef _WIN32
+	mapping->file_handle = CreateFileA(filename.c_str(), GENERIC_READ,
+		FILE_SHARE_READ|FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+	if(mapping->file_handle != INVALID_HANDLE_VALUE) {
+		LARGE_INTEGER file_size;
+
+		if(GetFileSizeEx(mapping->file_handle, &file_size) && file_size.QuadPart > 0) {
+			mapping->map_handle = CreateFileMapping(mapping->file_handle, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+
+			if(mapping->map_handle) {
+				mapping->data = (uchar*)MapViewOfFile(mapping->map_handle, FILE_MAP_COPY, 0, 0, 0);
+				mapping->size = (size_t)file_size.QuadPart;
+			}
+		}
+	}
+#else
+	int fd = ::open(filename.c_str(), O_RDONLY);
+
+	if(fd != -1) {
+		struct stat st;
+
+		if(fstat(fd, &st) == 0 && st.st_size > 0) {
+			void *ptr = mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+			if(ptr != MAP_FAILED) {
+				mapping->data = (uchar*)ptr;
+				mapping->size = st.st_size;
+			}
+		}
+
+		close(fd);
+	}
+#endif
+
+	if(!mapping->data) {
+		delete mapping;
+		return NULL;
+	}
+
+	return mapping;
+}
+
 /* CacheData */
 
 CacheData::CacheData(const string& name_)
 {
 	name = name_;
-	f = NULL;
 	have_filename = false;
+	check_hash = 0;
+	mapping = NULL;
+	num_buffers = 0;
+	read_buffer = 0;
 }
 
 CacheData::~CacheData()
 {
-	if(f)
-		fclose(f);
+	delete mapping;
 }
 
 const string& CacheData::get_filename()
 {
 	if(!have_filename) {
-		MD5Hash hash;
+		/* cheap hash for the file name, and a second one with a different
+		 * seed stored in the file to detect collisions */
+		uint64_t hash = 0;
+		check_hash = 1;
+
+		foreach(const CacheBuffer& buffer, buffers) {
+			if(buffer.size) {
+				hash = hash_buffer(buffer.data, buffer.size, hash);
+				check_hash = hash_buffer(buffer.data, buffer.size, check_hash);
+			}
+		}
 
-		foreach(const CacheBuffer& buffer, buffers)
-			if(buffer.size)
-				hash.append((uint8_t*)buffer.data, buffer.size);
-		
-		filename = name + "_" + hash.get_hex();
+		filename = name + "_" + string_printf("%016llx", (unsigned long long)hash);
 		have_filename = true;
 	}
 
 	return filename;
 }
 
+bool CacheData::read_next(uchar *& ptr, size_t& size)
+{
+	if(!mapping || read_buffer >= num_buffers) {
+		fprintf(stderr, "Failed to read buffer from cache.\n");
+		return false;
+	}
+
+	const uint64_t *table = (const uint64_t*)(mapping->data + sizeof(CacheFileHeader));
+	uint64_t offset = table[read_buffer*2 + 0];
+
+	ptr = mapping->data + offset;
+	size = (size_t)table[read_buffer*2 + 1];
+	read_buffer++;
+
+	return true;
+}
+
+bool CacheData::read_value(void *data, size_t size)
+{
+	uchar *ptr;
+	size_t buffer_size;
+
+	if(!read_next(ptr, buffer_size))
+		return false;
+
+	if(buffer_size != size) {
+		fprintf(stderr, "Failed to read value from cache, size mismatch.\n");
+		return false;
+	}
+
+	memcpy(data, ptr, size);
+	return true;
+}
+
 /* Cache */
 
 Cache Cache::global;
 
+Cache::Cache()
+{
+	max_size = 0;
+}
+
+void Cache::set_directory(const string& directory_)
+{
+	directory = directory_;
+}
+
+void Cache::set_max_size(size_t max_size_)
+{
+	max_size = max_size_;
+}
+
 string Cache::data_filename(CacheData& key)
 {
-	return path_user_get(path_join("cache", key.get_filename()));
+	string dir = (directory.empty())? path_user_get("cache"): directory;
+	return path_join(dir, key.get_filename());
 }
 
 void Cache::insert(CacheData& key, CacheData& value)
 {
 	string filename = data_filename(key);
 	path_create_directories(filename);
-	FILE *f = fopen(filename.c_str(), "wb");
+
+	/* write to a temporary file first, so that other processes sharing the
+	 * cache directory never see partially written files */
+#ifdef _WIN32
+	string tmp_filename = string_printf("%s.%d.tmp", filename.c_str(), (int)_getpid());
+#else
+	string tmp_filename = string_printf("%s.%d.tmp", filename.c_str(), (int)getpid());
+#endif
+	FILE *f = fopen(tmp_filename.c_str(), "wb");
 
 	if(!f) {
-		fprintf(stderr, "Failed to open file %s for writing.\n", filename.c_str());
+		fprintf(stderr, "Failed to open file %s for writing.\n", tmp_filename.c_str());
 		return;
 	}
 
-	foreach(CacheBuffer& buffer, value.buffers) {
-		if(!fwrite(&buffer.size, sizeof(buffer.size), 1, f))
-			fprintf(stderr, "Failed to write to file %s.\n", filename.c_str());
-		if(buffer.size)
-			if(!fwrite(buffer.data, buffer.size, 1, f))
-				fprintf(stderr, "Failed to write to file %s.\n", filename.c_str());
+	/* layout */
+	CacheFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CACHE_FILE_MAGIC, sizeof(CACHE_FILE_MAGIC));
+	header.version = CACHE_FILE_VERSION;
+	header.num_buffers = value.buffers.size();
+	header.check_hash = key.check_hash;
+
+	vector<uint64_t> table(value.buffers.size()*2);
+	uint64_t offset = sizeof(header) + sizeof(uint64_t)*table.size();
+
+	for(size_t i = 0; i < value.buffers.size(); i++) {
+		offset = cache_align(offset);
+		table[i*2 + 0] = offset;
+		table[i*2 + 1] = value.buffers[i].size;
+		offset += value.buffers[i].size;
+	}
+
+	header.file_size = offset;
+
+	/* write */
+	bool ok = (fwrite(&header, sizeof(header), 1, f) == 1);
+	if(ok && table.size())
+		ok = (fwrite(&table[0], sizeof(uint64_t)*table.size(), 1, f) == 1);
+
+	uint64_t written = sizeof(header) + sizeof(uint64_t)*table.size();
+	const char padding[CACHE_FILE_ALIGN] = {0};
+
+	for(size_t i = 0; ok && i < value.buffers.size(); i++) {
+		CacheBuffer& buffer = value.buffers[i];
+		size_t pad = table[i*2 + 0] - written;
+
+		if(pad)
+			ok = (fwrite(padding, pad, 1, f) == 1);
+		if(ok && buffer.size)
+			ok = (fwrite(buffer.data, buffer.size, 1, f) == 1);
+
+		written = table[i*2 + 0] + buffer.size;
+	}
+
+	if(fclose(f) != 0)
+		ok = false;
+
+	if(!ok) {
+		fprintf(stderr, "Failed to write to file %s.\n", tmp_filename.c_str());
+		::remove(tmp_filename.c_str());
+		return;
+	}
+
+	/* replace existing file, not atomic on windows */
+	if(::rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+		::remove(filename.c_str());
+
+		if(::rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+			fprintf(stderr, "Failed to rename file %s.\n", tmp_filename.c_str());
+			::remove(tmp_filename.c_str());
+			return;
+		}
+	}
+
+	if(max_size) {
+		string dir = (directory.empty())? path_user_get("cache"): directory;
+
+		thread_scoped_lock lock(mutex);
+		cache_evict_files(dir, key.name + "_", max_size, filename);
 	}
-	
-	fclose(f);
 }
 
 bool Cache::lookup(CacheData& key, CacheData& value)
 {
 	string filename = data_filename(key);
-	FILE *f = fopen(filename.c_str(), "rb");
+	CacheMapping *mapping = CacheMapping::open(filename);
 
-	if(!f)
+	if(!mapping)
 		return false;
-	
+
+	/* validate header and buffer table */
+	const CacheFileHeader *header = (const CacheFileHeader*)mapping->data;
+	bool valid = (mapping->size >= sizeof(CacheFileHeader) &&
+	              memcmp(header->magic, CACHE_FILE_MAGIC, sizeof(CACHE_FILE_MAGIC)) == 0 &&
+	              header->version == CACHE_FILE_VERSION &&
+	              header->check_hash == key.check_hash &&
+	              header->file_size == mapping->size &&
+	              sizeof(CacheFileHeader) + sizeof(uint64_t)*2*(uint64_t)header->num_buffers <= mapping->size);
+
+	if(valid) {
+		const uint64_t *table = (const uint64_t*)(mapping->data + sizeof(CacheFileHeader));
+
+		for(uint i = 0; i < header->num_buffers && valid; i++) {
+			uint64_t offset = table[i*2 + 0];
+			uint64_t size = table[i*2 + 1];
+
+			if(offset % CACHE_FILE_ALIGN || offset > mapping->size || size > mapping->size - offset)
+				valid = false;
+		}
+	}
+
+	if(!valid) {
+		delete mapping;
+		return false;
+	}
+
+	delete value.mapping;
 	value.name = key.name;
-	value.f = f;
+	value.mapping = mapping;
+	value.num_buffers = header->num_buffers;
+	value.read_buffer = 0;
+
+	if(max_size)
+		cache_touch_file(filename);
 
 	return true;
 }
 
-void Cache::clear_except(const string& name, const set<string>& except)
+struct CacheFileInfo {
+	time_t time;
+	uint64_t size;
+	boost::filesystem::path path;
+
+	bool operator<(const CacheFileInfo& other) const
+	{
+		return time < other.time;
+	}
+};
+
+/* Eviction */
+
+void cache_evict_files(const string& dir, const string& prefix,
+	uint64_t max_size, const string& keep_filename)
 {
-	string dir = path_user_get("cache");
+	string keep = path_filename(keep_filename);
+
+	vector<CacheFileInfo> files;
+	uint64_t total_size = 0;
+
+	try {
+		if(!boost::filesystem::exists(dir))
+			return;
 
-	if(boost::filesystem::exists(dir)) {
 		boost::filesystem::directory_iterator it(dir), it_end;
 
 		for(; it != it_end; it++) {
@@ -125,12 +409,49 @@ void Cache::clear_except(const string& name, const set<string>& except)
 			string filename = it->path().filename().string();
 #endif
 
-			if(boost::starts_with(filename, name))
-				if(except.find(filename) == except.end())
-					boost::filesystem::remove(it->path());
+			/* skip files still being written */
+			if(!boost::starts_with(filename, prefix) || boost::ends_with(filename, ".tmp"))
+				continue;
+
+			CacheFileInfo info;
+			info.path = it->path();
+			info.size = boost::filesystem::file_size(info.path);
+			info.time = boost::filesystem::last_write_time(info.path);
+
+			total_size += info.size;
+
+			if(filename != keep)
+				files.push_back(info);
+		}
+
+		sort(files.begin(), files.end());
+
+		foreach(CacheFileInfo& info, files) {
+			if(total_size <= max_size)
+				break;
+
+			/* can fail on windows if another process has the file mapped */
+			try {
+				boost::filesystem::remove(info.path);
+				total_size -= info.size;
+			}
+			catch(const boost::filesystem::filesystem_error&) {
+			}
 		}
 	}
+	catch(const boost::filesystem::filesystem_error& e) {
+		fprintf(stderr, "Cache eviction failed: %s\n", e.what());
+	}
 }
 
-CCL_NAMESPACE_END
+void cache_touch_file(const string& filename)
+{
+	/* the directory may be read-only */
+	try {
+		boost::filesystem::last_write_time(boost::filesystem::path(filename), time(NULL));
+	}
+	catch(const boost::filesystem::filesystem_error&) {
+	}
+}
 
+CCL_NAMESPACE_END
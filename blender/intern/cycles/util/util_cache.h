@@ -20,22 +20,32 @@
 /* Disk Cache based on Hashing
  *
  * To be used to cache expensive computations. The hash key is created from an
- * arbitrary number of bytes, by hashing the bytes using MD5, which then gives
- * the file name containing the data. This data then is read from the file
- * again into the appropriate data structures.
+ * arbitrary number of bytes, by hashing the bytes with a fast 64 bit hash,
+ * which then gives the file name containing the data. A second hash with a
+ * different seed is stored in the file to detect collisions.
+ *
+ * Files are memory mapped on lookup, so that arrays can reference the data
+ * directly without reading and copying it. Pages are shared between processes
+ * reading the same file and copy-on-write if they are modified.
  *
  * This way we do not need to accurately track changes, compare dates and
  * invalidate cache entries, at the cost of exta computation. If everything
  * is stored in a global cache, computations can perhaps even be shared between
- * different scenes where it may be hard to detect duplicate work.
+ * different scenes where it may be hard to detect duplicate work. The cache
+ * directory is bounded in size, least recently used files are removed first.
  */
 
 #include "util_set.h"
 #include "util_string.h"
+#include "util_thread.h"
+#include "util_types.h"
 #include "util_vector.h"
 
 CCL_NAMESPACE_BEGIN
 
+/* increase when changing the file layout or the data stored in it */
+#define CACHE_FILE_VERSION 1
+
 class CacheBuffer {
 public:
 	const void *data;
@@ -45,13 +55,37 @@ public:
 	{ data = data_; size = size_; }
 };
 
+/* Memory mapped cache file */
+
+class CacheMapping {
+public:
+	static CacheMapping *open(const string& filename);
+	~CacheMapping();
+
+	uchar *data;
+	size_t size;
+
+protected:
+	CacheMapping();
+
+#ifdef _WIN32
+	void *file_handle;
+	void *map_handle;
+#endif
+};
+
 class CacheData {
 public:
 	vector<CacheBuffer> buffers;
 	string name;
 	string filename;
 	bool have_filename;
-	FILE *f;
+	uint64_t check_hash;
+
+	/* lookup result, owned by cache data unless taken over */
+	CacheMapping *mapping;
+	size_t num_buffers;
+	size_t read_buffer;
 
 	CacheData(const string& name = "");
 	~CacheData();
@@ -96,70 +130,71 @@ public:
 		buffers.push_back(buffer);
 	}
 
-	template<typename T> void read(array<T>& data)
+	/* arrays reference the mapped file, which must stay alive as long as
+	 * the array is used */
+	template<typename T> bool read(array<T>& data)
 	{
+		uchar *ptr;
 		size_t size;
 
-		if(!fread(&size, sizeof(size), 1, f)) {
-			fprintf(stderr, "Failed to read vector size from cache.\n");
-			return;
-		}
-
-		if(!size)
-			return;
-
-		data.resize(size/sizeof(T));
+		if(!read_next(ptr, size))
+			return false;
 
-		if(!fread(&data[0], size, 1, f)) {
-			fprintf(stderr, "Failed to read vector data from cache (%lu).\n", (unsigned long)size);
-			return;
-		}
+		data.reference((T*)ptr, size/sizeof(T));
+		return true;
 	}
 
-	void read(int& data)
+	bool read(int& data)
 	{
-		size_t size;
-
-		if(!fread(&size, sizeof(size), 1, f))
-			fprintf(stderr, "Failed to read int size from cache.\n");
-		if(!fread(&data, sizeof(data), 1, f))
-			fprintf(stderr, "Failed to read int from cache.\n");
+		return read_value(&data, sizeof(data));
 	}
 
-	void read(float& data)
+	bool read(float& data)
 	{
-		size_t size;
-
-		if(!fread(&size, sizeof(size), 1, f))
-			fprintf(stderr, "Failed to read float size from cache.\n");
-		if(!fread(&data, sizeof(data), 1, f))
-			fprintf(stderr, "Failed to read float from cache.\n");
+		return read_value(&data, sizeof(data));
 	}
 
-	void read(size_t& data)
+	bool read(size_t& data)
 	{
-		size_t size;
-
-		if(!fread(&size, sizeof(size), 1, f))
-			fprintf(stderr, "Failed to read size_t size from cache.\n");
-		if(!fread(&data, sizeof(data), 1, f))
-			fprintf(stderr, "Failed to read size_t from cache.\n");
+		return read_value(&data, sizeof(data));
 	}
+
+protected:
+	bool read_next(uchar *& ptr, size_t& size);
+	bool read_value(void *data, size_t size);
 };
 
 class Cache {
 public:
 	static Cache global;
 
+	Cache();
+
+	/* directory to store files in, defaults to the user cache directory */
+	void set_directory(const string& directory);
+	/* maximum size of all files in the directory in bytes, 0 for unlimited */
+	void set_max_size(size_t max_size);
+
 	void insert(CacheData& key, CacheData& value);
 	bool lookup(CacheData& key, CacheData& value);
 
-	void clear_except(const string& name, const set<string>& except);
-
 protected:
+	string directory;
+	size_t max_size;
+	thread_mutex mutex;
+
 	string data_filename(CacheData& key);
 };
 
+/* remove least recently used files in directory with a name starting with
+ * prefix, until their total size is at most max_size bytes. keep_filename is
+ * counted but never removed */
+void cache_evict_files(const string& directory, const string& prefix,
+	uint64_t max_size, const string& keep_filename);
+
+/* mark file as recently used for eviction */
+void cache_touch_file(const string& filename);
+
 CCL_NAMESPACE_END
 
 #endif /* __UTIL_CACHE_H__ */
@@ -17,6 +17,8 @@
 #ifndef __UTIL_HASH_H__
 #define __UTIL_HASH_H__
 
+#include <string.h>
+
 #include "util_types.h"
 
 CCL_NAMESPACE_BEGIN
@@ -59,6 +61,48 @@ static inline uint hash_string(const char *str)
 	return i;
 }
 
+/* fast non-cryptographic hash for large buffers, processing 8 bytes at a
+ * time, based on MurmurHash64A */
+
+static inline uint64_t hash_buffer(const void *data, size_t size, uint64_t seed = 0)
+{
+	const uint64_t m = 0xc6a4a7935bd1e995ULL;
+	const int r = 47;
+
+	uint64_t h = seed ^ (size * m);
+
+	const uint8_t *ptr = (const uint8_t*)data;
+	const uint8_t *end = ptr + (size & ~(size_t)7);
+
+	for(; ptr != end; ptr += 8) {
+		uint64_t k;
+		memcpy(&k, ptr, sizeof(k));
+
+		k *= m;
+		k ^= k >> r;
+		k *= m;
+
+		h ^= k;
+		h *= m;
+	}
+
+	size_t tail = size & 7;
+
+	if(tail) {
+		uint64_t k = 0;
+		memcpy(&k, ptr, tail);
+
+		h ^= k;
+		h *= m;
+	}
+
+	h ^= h >> r;
+	h *= m;
+	h ^= h >> r;
+
+	return h;
+}
+
 CCL_NAMESPACE_END
 
 #endif /* __UTIL_HASH_H__ */
@@ -0,0 +1,802 @@
+/*
+ * Copyright 2011-2013 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License
+ */
+
+#include <stdio.h>
+
+#include "util_cache.h"
+#include "util_foreach.h"
+#include "util_image.h"
+#include "util_image_cache.h"
+#include "util_math.h"
+#include "util_md5.h"
+#include "util_path.h"
+
+#include "atomic_ops.h"
+
+#ifdef _WIN32
+#  include <process.h>
+#else
+#  include <unistd.h>
+#endif
+
+CCL_NAMESPACE_BEGIN
+
+/* all tiles use blocks of the same size, 64x64 uchar4 or 32x32 float4 */
+#define IMAGE_CACHE_BLOCK_SIZE (64*64*4)
+#define IMAGE_CACHE_MIN_BLOCKS 256
+#define IMAGE_CACHE_BYTE_TILE_SHIFT 6
+#define IMAGE_CACHE_FLOAT_TILE_SHIFT 5
+
+/* number of lookups after which thread statistics are flushed */
+#define IMAGE_CACHE_STATS_FLUSH 4096
+
+#define IMAGE_CACHE_FILE_VERSION 1
+
+struct ImageCacheFileHeader {
+	char magic[4];
+	int version;
+	int width;
+	int height;
+	int is_float;
+	int num_levels;
+};
+
+/* Tiled Mip-map File
+ *
+ * Header followed by all tiles of all levels, starting with the full resolution
+ * level. Tiles on the right and bottom edge are padded by repeating the last
+ * texel, so every tile takes up one block. */
+
+static inline uchar4 image_cache_average(const uchar4& a, const uchar4& b, const uchar4& c, const uchar4& d)
+{
+	return make_uchar4(
+		(a.x + b.x + c.x + d.x + 2) >> 2,
+		(a.y + b.y + c.y + d.y + 2) >> 2,
+		(a.z + b.z + c.z + d.z + 2) >> 2,
+		(a.w + b.w + c.w + d.w + 2) >> 2);
+}
+
+static inline float4 image_cache_average(const float4& a, const float4& b, const float4& c, const float4& d)
+{
+	return make_float4(
+		(a.x + b.x + c.x + d.x)*0.25f,
+		(a.y + b.y + c.y + d.y)*0.25f,
+		(a.z + b.z + c.z + d.z)*0.25f,
+		(a.w + b.w + c.w + d.w)*0.25f);
+}
+
+template<typename T> static bool image_cache_write_level(FILE *f, const vector<T>& pixels,
+	int width, int height, int tile_shift)
+{
+	int tile_size = 1 << tile_shift;
+	int tiles_x = (width + tile_size - 1) >> tile_shift;
+	int tiles_y = (height + tile_size - 1) >> tile_shift;
+	vector<T> tile(tile_size*tile_size);
+
+	for(int ty = 0; ty < tiles_y; ty++) {
+		for(int tx = 0; tx < tiles_x; tx++) {
+			for(int y = 0; y < tile_size; y++) {
+				int py = min((ty << tile_shift) + y, height - 1);
+
+				for(int x = 0; x < tile_size; x++) {
+					int px = min((tx << tile_shift) + x, width - 1);
+					tile[y*tile_size + x] = pixels[py*width + px];
+				}
+			}
+
+			if(!fwrite(&tile[0], sizeof(T)*tile.size(), 1, f))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+template<typename T> static void image_cache_downsample(const vector<T>& pixels, int width, int height,
+	vector<T>& result, int result_width, int result_height)
+{
+	result.resize(result_width*result_height);
+
+	for(int y = 0; y < result_height; y++) {
+		int y0 = min(y*2, height - 1);
+		int y1 = min(y*2 + 1, height - 1);
+
+		for(int x = 0; x < result_width; x++) {
+			int x0 = min(x*2, width - 1);
+			int x1 = min(x*2 + 1, width - 1);
+
+			result[y*result_width + x] = image_cache_average(
+				pixels[y0*width + x0], pixels[y0*width + x1],
+				pixels[y1*width + x0], pixels[y1*width + x1]);
+		}
+	}
+}
+
+template<typename T> static bool image_cache_write_pyramid(FILE *f, vector<T>& pixels,
+	int width, int height, int tile_shift)
+{
+	vector<T> next;
+
+	for(;;) {
+		if(!image_cache_write_level(f, pixels, width, height, tile_shift))
+			return false;
+
+		if(width == 1 && height == 1)
+			break;
+
+		int next_width = max(width >> 1, 1);
+		int next_height = max(height >> 1, 1);
+
+		image_cache_downsample(pixels, width, height, next, next_width, next_height);
+		pixels.swap(next);
+
+		width = next_width;
+		height = next_height;
+	}
+
+	return true;
+}
+
+/* read image with OIIO as 4 channels, flipped vertically like ImageManager */
+
+template<typename S, typename T> static bool image_cache_read_file(const string& filename, TypeDesc format,
+	S alpha, vector<T>& pixels, int& width, int& height)
+{
+	ImageInput *in = ImageInput::create(filename);
+
+	if(!in)
+		return false;
+
+	ImageSpec spec;
+
+	if(!in->open(filename, spec)) {
+		delete in;
+		return false;
+	}
+
+	width = spec.width;
+	height = spec.height;
+	int components = spec.nchannels;
+
+	if(!(components >= 1 && components <= 4) || width <= 0 || height <= 0) {
+		in->close();
+		delete in;
+		return false;
+	}
+
+	pixels.resize(width*height);
+
+	S *data = (S*)&pixels[0];
+	int scanlinesize = width*components*sizeof(S);
+
+	bool ok = in->read_image(format,
+		(uchar*)data + (height-1)*scanlinesize,
+		AutoStride,
+		-scanlinesize,
+		AutoStride);
+
+	in->close();
+	delete in;
+
+	if(!ok)
+		return false;
+
+	if(components == 2) {
+		for(int i = width*height-1; i >= 0; i--) {
+			data[i*4+3] = data[i*2+1];
+			data[i*4+2] = data[i*2+0];
+			data[i*4+1] = data[i*2+0];
+			data[i*4+0] = data[i*2+0];
+		}
+	}
+	else if(components == 3) {
+		for(int i = width*height-1; i >= 0; i--) {
+			data[i*4+3] = alpha;
+			data[i*4+2] = data[i*3+2];
+			data[i*4+1] = data[i*3+1];
+			data[i*4+0] = data[i*3+0];
+		}
+	}
+	else if(components == 1) {
+		for(int i = width*height-1; i >= 0; i--) {
+			data[i*4+3] = alpha;
+			data[i*4+2] = data[i];
+			data[i*4+1] = data[i];
+			data[i*4+0] = data[i];
+		}
+	}
+
+	return true;
+}
+
+/* Tile table entries. Publishing and evicting use the atomic operations, which
+ * are full barriers, so the tile data is written before a lookup can see the
+ * entry and the entry is cleared before the block is reused. Lookups load the
+ * entry with acquire semantics, and load it again after reading the data with
+ * a barrier in between, to detect the block being reused meanwhile. */
+
+static inline void image_cache_tile_set(volatile int *entry, int old, int b)
+{
+	atomic_cas_uint32((uint32_t*)entry, (uint32_t)old, (uint32_t)b);
+}
+
+#if defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7)))
+static inline int image_cache_tile_get(volatile int *entry)
+{
+	return __atomic_load_n(entry, __ATOMIC_ACQUIRE);
+}
+
+static inline int image_cache_tile_recheck(volatile int *entry)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(entry, __ATOMIC_RELAXED);
+}
+#else
+/* adding zero is a full barrier and returns the current value */
+static inline int image_cache_tile_get(volatile int *entry)
+{
+	return (int)atomic_add_uint32((uint32_t*)entry, 0);
+}
+
+static inline int image_cache_tile_recheck(volatile int *entry)
+{
+	return (int)atomic_add_uint32((uint32_t*)entry, 0);
+}
+#endif
+
+static bool image_cache_seek(FILE *f, uint64_t offset)
+{
+#ifdef _WIN32
+	return _fseeki64(f, offset, SEEK_SET) == 0;
+#else
+	return fseeko(f, offset, SEEK_SET) == 0;
+#endif
+}
+
+/* Image Cache */
+
+ImageCache::ImageCache()
+{
+	num_blocks_used = 0;
+	clock_hand = 0;
+	memory_budget = 0;
+	disk_cache_size = 0;
+	lookups = 0;
+	misses = 0;
+
+	set_memory_budget(0);
+}
+
+ImageCache::~ImageCache()
+{
+	clear();
+}
+
+void ImageCache::set_memory_budget(size_t budget)
+{
+	size_t num_blocks = budget/IMAGE_CACHE_BLOCK_SIZE;
+
+	if(num_blocks < IMAGE_CACHE_MIN_BLOCKS)
+		num_blocks = IMAGE_CACHE_MIN_BLOCKS;
+
+	memory_budget = budget;
+
+	if(num_blocks == blocks.size())
+		return;
+
+	/* drop all loaded tiles, they will be paged in again */
+	free_blocks();
+
+	Block empty = {NULL, NULL, 0, 0, false, false};
+	blocks.resize(num_blocks, empty);
+}
+
+void ImageCache::set_disk_cache_size(size_t size)
+{
+	disk_cache_size = size;
+}
+
+void ImageCache::free_blocks()
+{
+	foreach(Image *img, images) {
+		if(!img)
+			continue;
+
+		foreach(Level& level, img->levels)
+			for(int i = 0; i < level.tiles_x*level.tiles_y; i++)
+				level.tiles[i] = -1;
+	}
+
+	for(size_t i = 0; i < num_blocks_used; i++) {
+		delete [] blocks[i].data;
+		blocks[i].data = NULL;
+		blocks[i].image = NULL;
+	}
+
+	num_blocks_used = 0;
+	clock_hand = 0;
+}
+
+bool ImageCache::add_image(int slot, const string& filename, bool is_float)
+{
+	if(slot < 0 || filename == "")
+		return false;
+
+	if(slot >= (int)images.size())
+		images.resize(slot + 1, NULL);
+	else if(images[slot])
+		remove_image(slot);
+
+	/* only need the resolution here, pixels are read on the first miss */
+	ImageInput *in = ImageInput::create(filename);
+
+	if(!in)
+		return false;
+
+	ImageSpec spec;
+
+	if(!in->open(filename, spec)) {
+		delete in;
+		return false;
+	}
+
+	in->close();
+	delete in;
+
+	if(!(spec.nchannels >= 1 && spec.nchannels <= 4) || spec.width <= 0 || spec.height <= 0)
+		return false;
+
+	Image *img = new Image();
+
+	img->filename = filename;
+	img->is_float = is_float;
+	img->tile_shift = (is_float)? IMAGE_CACHE_FLOAT_TILE_SHIFT: IMAGE_CACHE_BYTE_TILE_SHIFT;
+	img->f = NULL;
+	img->failed = false;
+
+	/* mip-map levels down to 1x1 */
+	int width = spec.width;
+	int height = spec.height;
+	int first_tile = 0;
+	int tile_size = 1 << img->tile_shift;
+
+	for(;;) {
+		Level level;
+
+		level.width = width;
+		level.height = height;
+		level.tiles_x = (width + tile_size - 1) >> img->tile_shift;
+		level.tiles_y = (height + tile_size - 1) >> img->tile_shift;
+		level.first_tile = first_tile;
+		level.tiles = new int[level.tiles_x*level.tiles_y];
+
+		for(int i = 0; i < level.tiles_x*level.tiles_y; i++)
+			level.tiles[i] = -1;
+
+		img->levels.push_back(level);
+		first_tile += level.tiles_x*level.tiles_y;
+
+		if(width == 1 && height == 1)
+			break;
+
+		width = max(width >> 1, 1);
+		height = max(height >> 1, 1);
+	}
+
+	/* cache file name from image file name and modification time, so it is
+	 * regenerated when the image changes */
+	MD5Hash md5;
+	uint64_t mtime = path_modified_time(filename);
+	int version = IMAGE_CACHE_FILE_VERSION;
+	int float_flag = is_float;
+
+	md5.append((const uint8_t*)filename.c_str(), filename.size());
+	md5.append((const uint8_t*)&mtime, sizeof(mtime));
+	md5.append((const uint8_t*)&version, sizeof(version));
+	md5.append((const uint8_t*)&float_flag, sizeof(float_flag));
+
+	img->cache_filename = path_user_get(path_join("cache", "texture_" + md5.get_hex()));
+
+	images[slot] = img;
+
+	return true;
+}
+
+void ImageCache::remove_image(int slot)
+{
+	if(!contains(slot))
+		return;
+
+	Image *img = images[slot];
+
+	/* release blocks used by this image */
+	for(size_t i = 0; i < num_blocks_used; i++) {
+		if(blocks[i].image == img) {
+			blocks[i].image = NULL;
+			blocks[i].referenced = false;
+		}
+	}
+
+	foreach(Level& level, img->levels)
+		delete [] level.tiles;
+
+	if(img->f)
+		fclose(img->f);
+
+	delete img;
+	images[slot] = NULL;
+}
+
+void ImageCache::clear()
+{
+	free_blocks();
+
+	for(size_t slot = 0; slot < images.size(); slot++)
+		remove_image(slot);
+
+	images.clear();
+
+	lookups = 0;
+	misses = 0;
+}
+
+/* Cache File */
+
+bool ImageCache::convert_image(Image *img)
+{
+	thread_scoped_lock convert_lock(convert_mutex);
+
+	vector<uchar4> byte_pixels;
+	vector<float4> float_pixels;
+	int width, height;
+	bool ok;
+
+	if(img->is_float)
+		ok = image_cache_read_file(img->filename, TypeDesc::FLOAT, 1.0f, float_pixels, width, height);
+	else
+		ok = image_cache_read_file(img->filename, TypeDesc::UINT8, (uchar)255, byte_pixels, width, height);
+
+	if(!ok || width != img->levels[0].width || height != img->levels[0].height) {
+		fprintf(stderr, "Image cache: failed to read image %s.\n", img->filename.c_str());
+		return false;
+	}
+
+	/* write to temporary file first, so no other render will see a partial file */
+	/* per process name, so that processes converting the same image at the
+	 * same time never rename a partially written file into place */
+#ifdef _WIN32
+	string tmp_filename = string_printf("%s.%d.tmp", img->cache_filename.c_str(), (int)_getpid());
+#else
+	string tmp_filename = string_printf("%s.%d.tmp", img->cache_filename.c_str(), (int)getpid());
+#endif
+	path_create_directories(tmp_filename);
+
+	FILE *f = fopen(tmp_filename.c_str(), "wb");
+
+	if(!f) {
+		fprintf(stderr, "Image cache: failed to open file %s for writing.\n", tmp_filename.c_str());
+		return false;
+	}
+
+	ImageCacheFileHeader header;
+	memcpy(header.magic, "CTEX", 4);
+	header.version = IMAGE_CACHE_FILE_VERSION;
+	header.width = width;
+	header.height = height;
+	header.is_float = img->is_float;
+	header.num_levels = img->levels.size();
+
+	ok = (fwrite(&header, sizeof(header), 1, f) == 1);
+
+	if(ok) {
+		if(img->is_float)
+			ok = image_cache_write_pyramid(f, float_pixels, width, height, img->tile_shift);
+		else
+			ok = image_cache_write_pyramid(f, byte_pixels, width, height, img->tile_shift);
+	}
+
+	fclose(f);
+
+	if(!ok || rename(tmp_filename.c_str(), img->cache_filename.c_str()) != 0) {
+		remove(tmp_filename.c_str());
+
+		/* on windows renaming fails when another process wrote the file first */
+		if(!ok || !path_exists(img->cache_filename)) {
+			fprintf(stderr, "Image cache: failed to write file %s.\n", img->cache_filename.c_str());
+			return false;
+		}
+	}
+
+	/* files of images in use stay open, so removing them is safe except on
+	 * windows, where it fails and they are removed on a later conversion */
+	if(disk_cache_size)
+		cache_evict_files(path_dirname(img->cache_filename), "texture_", disk_cache_size, img->cache_filename);
+
+	return true;
+}
+
+bool ImageCache::open_cache_file(Image *img)
+{
+	if(img->f)
+		return true;
+	if(img->failed)
+		return false;
+
+	for(int attempt = 0; attempt < 2; attempt++) {
+		FILE *f = fopen(img->cache_filename.c_str(), "rb");
+
+		if(f) {
+			ImageCacheFileHeader header;
+
+			if(fread(&header, sizeof(header), 1, f) == 1 &&
+			   memcmp(header.magic, "CTEX", 4) == 0 &&
+			   header.version == IMAGE_CACHE_FILE_VERSION &&
+			   header.width == img->levels[0].width &&
+			   header.height == img->levels[0].height &&
+			   header.is_float == (int)img->is_float &&
+			   header.num_levels == (int)img->levels.size())
+			{
+				img->f = f;
+
+				if(disk_cache_size && attempt == 0)
+					cache_touch_file(img->cache_filename);
+
+				return true;
+			}
+
+			fclose(f);
+		}
+
+		/* missing or outdated, generate it */
+		if(attempt == 0 && !convert_image(img))
+			break;
+	}
+
+	img->failed = true;
+	return false;
+}
+
+/* Tiles */
+
+int ImageCache::alloc_block(Image *img, int level, int tile)
+{
+	thread_scoped_lock blocks_lock(blocks_mutex);
+	size_t b;
+
+	if(num_blocks_used < blocks.size()) {
+		/* pool not full yet */
+		b = num_blocks_used++;
+		blocks[b].data = new uchar[IMAGE_CACHE_BLOCK_SIZE];
+	}
+	else {
+		/* clock algorithm, skip blocks that were used since the last sweep */
+		for(;;) {
+			b = clock_hand;
+			clock_hand = (clock_hand + 1) % blocks.size();
+
+			Block& block = blocks[b];
+
+			if(block.pinned)
+				continue;
+
+			if(block.image && block.referenced) {
+				block.referenced = false;
+				continue;
+			}
+
+			/* evict, lookups check the tile table again after reading */
+			if(block.image)
+				image_cache_tile_set(&block.image->levels[block.level].tiles[block.tile], b, -1);
+
+			break;
+		}
+	}
+
+	Block& block = blocks[b];
+
+	block.image = img;
+	block.level = level;
+	block.tile = tile;
+	block.referenced = true;
+	block.pinned = true;
+
+	return b;
+}
+
+void ImageCache::load_tile(ImageCacheThreadData *tdata, Image *img, int level, int tile)
+{
+	thread_scoped_lock image_lock(img->mutex);
+
+	/* other thread may have loaded it in the meantime */
+	if(img->levels[level].tiles[tile] != -1)
+		return;
+
+	if(tdata)
+		tdata->misses++;
+	else
+		atomic_add_uint64(&misses, 1);
+
+	if(!open_cache_file(img))
+		return;
+
+	int b = alloc_block(img, level, tile);
+	Block& block = blocks[b];
+
+	uint64_t offset = sizeof(ImageCacheFileHeader) +
+		(uint64_t)(img->levels[level].first_tile + tile)*IMAGE_CACHE_BLOCK_SIZE;
+
+	if(!image_cache_seek(img->f, offset) ||
+	   fread(block.data, IMAGE_CACHE_BLOCK_SIZE, 1, img->f) != 1)
+	{
+		fprintf(stderr, "Image cache: failed to read tile from %s.\n", img->cache_filename.c_str());
+		img->failed = true;
+	}
+
+	/* make tile visible to lookups only after the data is read */
+	if(!img->failed)
+		image_cache_tile_set(&img->levels[level].tiles[tile], -1, b);
+
+	block.pinned = false;
+}
+
+float4 ImageCache::fetch(ImageCacheThreadData *tdata, Image *img, int level, int x, int y)
+{
+	Level& lvl = img->levels[level];
+	int mask = (1 << img->tile_shift) - 1;
+	int tile = (y >> img->tile_shift)*lvl.tiles_x + (x >> img->tile_shift);
+	int offset = ((y & mask) << img->tile_shift) + (x & mask);
+
+	if(tdata)
+		tdata->lookups++;
+
+	for(;;) {
+		int b = image_cache_tile_get(&lvl.tiles[tile]);
+
+		if(b == -1) {
+			load_tile(tdata, img, level, tile);
+
+			/* same color as ImageManager uses for missing images */
+			if(img->failed)
+				return make_float4(1.0f, 0.0f, 1.0f, 1.0f);
+
+			continue;
+		}
+
+		Block& block = blocks[b];
+		float4 r;
+
+		block.referenced = true;
+
+		if(img->is_float) {
+			const float *texel = (const float*)block.data + offset*4;
+			r = make_float4(texel[0], texel[1], texel[2], texel[3]);
+		}
+		else {
+			const uchar *texel = block.data + offset*4;
+			float f = 1.0f/255.0f;
+			r = make_float4(texel[0]*f, texel[1]*f, texel[2]*f, texel[3]*f);
+		}
+
+		/* block may have been evicted and reused while reading */
+		if(image_cache_tile_recheck(&lvl.tiles[tile]) == b)
+			return r;
+	}
+}
+
+static inline int image_cache_wrap_periodic(int x, int width)
+{
+	x %= width;
+	if(x < 0)
+		x += width;
+	return x;
+}
+
+float4 ImageCache::interp(ImageCacheThreadData *tdata, Image *img, int level, float x, float y)
+{
+	int width = img->levels[level].width;
+	int height = img->levels[level].height;
+
+	float fx = x*width - 0.5f;
+	float fy = y*height - 0.5f;
+	int ix = float_to_int(fx) - ((fx < 0.0f)? 1: 0);
+	int iy = float_to_int(fy) - ((fy < 0.0f)? 1: 0);
+	float tx = fx - (float)ix;
+	float ty = fy - (float)iy;
+
+	ix = image_cache_wrap_periodic(ix, width);
+	iy = image_cache_wrap_periodic(iy, height);
+
+	int nix = image_cache_wrap_periodic(ix+1, width);
+	int niy = image_cache_wrap_periodic(iy+1, height);
+
+	float4 r = (1.0f - ty)*(1.0f - tx)*fetch(tdata, img, level, ix, iy);
+	r += (1.0f - ty)*tx*fetch(tdata, img, level, nix, iy);
+	r += ty*(1.0f - tx)*fetch(tdata, img, level, ix, niy);
+	r += ty*tx*fetch(tdata, img, level, nix, niy);
+
+	return r;
+}
+
+float4 ImageCache::lookup(ImageCacheThreadData *tdata, int slot, float x, float y, float width)
+{
+	Image *img = images[slot];
+	int num_levels = img->levels.size();
+
+	/* pick levels so one texel covers the filter footprint */
+	float lod = 0.0f;
+
+	if(width > 0.0f) {
+		float texels = width*max(img->levels[0].width, img->levels[0].height);
+
+		if(texels > 1.0f)
+			lod = min(log2f(texels), (float)(num_levels - 1));
+	}
+
+	int level = float_to_int(lod);
+	float t = lod - level;
+
+	float4 r = interp(tdata, img, level, x, y);
+
+	if(t > 0.0f && level + 1 < num_levels)
+		r = (1.0f - t)*r + t*interp(tdata, img, level + 1, x, y);
+
+	if(tdata && tdata->lookups >= IMAGE_CACHE_STATS_FLUSH)
+		stats_flush(tdata);
+
+	return r;
+}
+
+/* Statistics */
+
+ImageCacheThreadData *ImageCache::thread_init()
+{
+	ImageCacheThreadData *tdata = new ImageCacheThreadData();
+
+	tdata->lookups = 0;
+	tdata->misses = 0;
+
+	return tdata;
+}
+
+void ImageCache::thread_free(ImageCacheThreadData *tdata)
+{
+	if(tdata) {
+		stats_flush(tdata);
+		delete tdata;
+	}
+}
+
+void ImageCache::stats_flush(ImageCacheThreadData *tdata)
+{
+	atomic_add_uint64(&lookups, tdata->lookups);
+	atomic_add_uint64(&misses, tdata->misses);
+
+	tdata->lookups = 0;
+	tdata->misses = 0;
+}
+
+void ImageCache::get_stats(uint64_t& hits_, uint64_t& misses_, size_t& memory_used_, size_t& memory_budget_)
+{
+	uint64_t num_lookups = lookups;
+
+	misses_ = misses;
+	hits_ = (num_lookups > misses_)? num_lookups - misses_: 0;
+	memory_used_ = num_blocks_used*IMAGE_CACHE_BLOCK_SIZE;
+	memory_budget_ = blocks.size()*IMAGE_CACHE_BLOCK_SIZE;
+}
+
+CCL_NAMESPACE_END
+
@@ -0,0 +1,144 @@
+/*
+ * Copyright 2011-2013 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License
+ */
+
+#ifndef __UTIL_IMAGE_CACHE_H__
+#define __UTIL_IMAGE_CACHE_H__
+
+/* Image Texture Cache
+ *
+ * Image textures are split into tiles of a mip-map pyramid, which are loaded
+ * only when a texture lookup needs them, so that memory usage is bounded by a
+ * fixed budget rather than by the size of all images in the scene.
+ *
+ * The first time an image is needed, it is converted into a tiled mip-map file
+ * in the user cache directory, from which tiles are then read with random
+ * access. Least recently used files are removed when the files exceed the disk
+ * cache size. Tiles are stored in a pool of equally sized blocks, byte images use
+ * 64x64 and float images 32x32 tiles. When the pool is full, the least recently
+ * used tile is evicted, approximated with the clock algorithm so that texture
+ * lookups do not need to take a lock. Tile table entries are published and
+ * evicted with atomic operations, lookups read them with acquire semantics
+ * and check them again after reading the tile. */
+
+#include "util_string.h"
+#include "util_thread.h"
+#include "util_types.h"
+#include "util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* per thread statistics, flushed to the cache periodically */
+
+struct ImageCacheThreadData {
+	uint64_t lookups;
+	uint64_t misses;
+};
+
+class ImageCache {
+public:
+	ImageCache();
+	~ImageCache();
+
+	/* memory budget in bytes, a budget below a few megabytes is rounded up */
+	void set_memory_budget(size_t budget);
+	/* maximum size in bytes of the tiled files on disk, 0 for unlimited */
+	void set_disk_cache_size(size_t size);
+
+	/* register image for slot, returns false if the file can't be read */
+	bool add_image(int slot, const string& filename, bool is_float);
+	void remove_image(int slot);
+	void clear();
+
+	bool contains(int slot)
+	{
+		return (slot >= 0 && slot < (int)images.size() && images[slot]);
+	}
+
+	/* bilinear lookup with periodic wrapping, width is the filter footprint in
+	 * texture coordinates, which selects the mip-map levels to blend */
+	float4 lookup(ImageCacheThreadData *tdata, int slot, float x, float y, float width);
+
+	ImageCacheThreadData *thread_init();
+	void thread_free(ImageCacheThreadData *tdata);
+
+	void get_stats(uint64_t& hits, uint64_t& misses, size_t& memory_used, size_t& memory_budget);
+
+protected:
+	struct Level {
+		int width, height;
+		int tiles_x, tiles_y;
+		int first_tile;
+		/* block index for each tile, -1 if not loaded, only modified with
+		 * atomic operations while rendering */
+		volatile int *tiles;
+	};
+
+	struct Image {
+		string filename;
+		bool is_float;
+		int tile_shift;
+		size_t texel_size;
+
+		vector<Level> levels;
+
+		string cache_filename;
+		FILE *f;
+		bool failed;
+		thread_mutex mutex;
+	};
+
+	struct Block {
+		uchar *data;
+		Image *image;
+		int level;
+		int tile;
+		volatile bool referenced;
+		volatile bool pinned;
+	};
+
+	vector<Image*> images;
+
+	vector<Block> blocks;
+	size_t num_blocks_used;
+	size_t clock_hand;
+	thread_mutex blocks_mutex;
+
+	/* converting needs a full resolution copy of the image, only do one at a time */
+	thread_mutex convert_mutex;
+
+	size_t memory_budget;
+	size_t disk_cache_size;
+
+	uint64_t lookups;
+	uint64_t misses;
+
+	void free_blocks();
+
+	bool open_cache_file(Image *img);
+	bool convert_image(Image *img);
+
+	int alloc_block(Image *img, int level, int tile);
+	void load_tile(ImageCacheThreadData *tdata, Image *img, int level, int tile);
+	float4 fetch(ImageCacheThreadData *tdata, Image *img, int level, int x, int y);
+	float4 interp(ImageCacheThreadData *tdata, Image *img, int level, float x, float y);
+
+	void stats_flush(ImageCacheThreadData *tdata);
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __UTIL_IMAGE_CACHE_H__ */
+
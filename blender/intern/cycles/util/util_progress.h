@@ -39,6 +39,9 @@ public:
 		start_time = time_dt();
 		total_time = 0.0f;
 		tile_time = 0.0f;
+		image_cache_hits = 0;
+		image_cache_misses = 0;
+		image_cache_memory = 0;
 		status = "Initializing";
 		substatus = "";
 		sync_status = "";
@@ -73,6 +76,9 @@ public:
 		start_time = time_dt();
 		total_time = 0.0f;
 		tile_time = 0.0f;
+		image_cache_hits = 0;
+		image_cache_misses = 0;
+		image_cache_memory = 0;
 		status = "Initializing";
 		substatus = "";
 		sync_status = "";
@@ -154,6 +160,26 @@ public:
 		return sample;
 	}
 
+	/* image texture cache statistics */
+
+	void set_image_cache_stats(uint64_t hits, uint64_t misses, size_t memory)
+	{
+		thread_scoped_lock lock(progress_mutex);
+
+		image_cache_hits = hits;
+		image_cache_misses = misses;
+		image_cache_memory = memory;
+	}
+
+	void get_image_cache_stats(uint64_t& hits, uint64_t& misses, size_t& memory)
+	{
+		thread_scoped_lock lock(progress_mutex);
+
+		hits = image_cache_hits;
+		misses = image_cache_misses;
+		memory = image_cache_memory;
+	}
+
 	/* status messages */
 
 	void set_status(const string& status_, const string& substatus_ = "")
@@ -245,6 +271,10 @@ protected:
 	double total_time;
 	double tile_time;
 
+	uint64_t image_cache_hits;
+	uint64_t image_cache_misses;
+	size_t image_cache_memory;
+
 	string status;
 	string substatus;
 
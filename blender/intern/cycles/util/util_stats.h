@@ -17,11 +17,14 @@
 #ifndef __UTIL_STATS_H__
 #define __UTIL_STATS_H__
 
+#include "util_thread.h"
+#include "util_types.h"
+
 CCL_NAMESPACE_BEGIN
 
 class Stats {
 public:
-	Stats() : mem_used(0), mem_peak(0) {}
+	Stats() : mem_used(0), mem_peak(0), num_camera_rays(0), num_bounce_rays(0), num_shadow_rays(0) {}
 
 	void mem_alloc(size_t size) {
 		mem_used += size;
@@ -33,8 +36,30 @@ public:
 		mem_used -= size;
 	}
 
+	void rays_add(uint64_t camera, uint64_t bounce, uint64_t shadow) {
+		thread_scoped_lock lock(rays_mutex);
+		num_camera_rays += camera;
+		num_bounce_rays += bounce;
+		num_shadow_rays += shadow;
+	}
+
+	void rays_reset() {
+		thread_scoped_lock lock(rays_mutex);
+		num_camera_rays = 0;
+		num_bounce_rays = 0;
+		num_shadow_rays = 0;
+	}
+
 	size_t mem_used;
 	size_t mem_peak;
+
+	/* rays traced, only counted by kernels built with WITH_CYCLES_RAY_STATS */
+	uint64_t num_camera_rays;
+	uint64_t num_bounce_rays;
+	uint64_t num_shadow_rays;
+
+protected:
+	thread_mutex rays_mutex;
 };
 
 CCL_NAMESPACE_END
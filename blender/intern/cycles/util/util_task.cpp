@@ -19,6 +19,8 @@
 #include "util_system.h"
 #include "util_task.h"
 
+#include "atomic_ops.h"
+
 //#define THREADING_DEBUG_ENABLED
 
 #ifdef THREADING_DEBUG_ENABLED
@@ -60,31 +62,16 @@ void TaskPool::push(const TaskRunFunction& run, bool front)
 
 void TaskPool::wait_work()
 {
+	int thread_id = TaskScheduler::thread_id();
 	thread_scoped_lock num_lock(num_mutex);
 
 	while(num != 0) {
 		num_lock.unlock();
 
-		thread_scoped_lock queue_lock(TaskScheduler::queue_mutex);
-
 		/* find task from this pool. if we get a task from another pool,
 		 * we can get into deadlock */
 		TaskScheduler::Entry work_entry;
-		bool found_entry = false;
-		list<TaskScheduler::Entry>::iterator it;
-
-		for(it = TaskScheduler::queue.begin(); it != TaskScheduler::queue.end(); it++) {
-			TaskScheduler::Entry& entry = *it;
-
-			if(entry.pool == this) {
-				work_entry = entry;
-				found_entry = true;
-				TaskScheduler::queue.erase(it);
-				break;
-			}
-		}
-
-		queue_lock.unlock();
+		bool found_entry = TaskScheduler::pop(thread_id, work_entry, this);
 
 		/* if found task, do it, otherwise wait until other tasks are done */
 		if(found_entry) {
@@ -170,9 +157,14 @@ int TaskScheduler::users = 0;
 vector<thread*> TaskScheduler::threads;
 bool TaskScheduler::do_exit = false;
 
-list<TaskScheduler::Entry> TaskScheduler::queue;
-thread_mutex TaskScheduler::queue_mutex;
-thread_condition_variable TaskScheduler::queue_cond;
+vector<TaskScheduler::Queue*> TaskScheduler::queues;
+thread_mutex TaskScheduler::wake_mutex;
+thread_condition_variable TaskScheduler::wake_cond;
+uint32_t TaskScheduler::num_queued = 0;
+uint32_t TaskScheduler::num_sleeping = 0;
+
+/* index of worker threads, other threads read NULL */
+static thread_specific_ptr<int> thread_id_ptr;
 
 void TaskScheduler::init(int num_threads)
 {
@@ -188,6 +180,12 @@ void TaskScheduler::init(int num_threads)
 			num_threads = system_cpu_thread_count();
 		}
 
+		/* queues must exist before any thread starts popping */
+		queues.resize(num_threads + 1);
+
+		for(size_t i = 0; i < queues.size(); i++)
+			queues[i] = new Queue();
+
 		/* launch threads that will be waiting for work */
 		threads.resize(num_threads);
 
@@ -206,8 +204,11 @@ void TaskScheduler::exit()
 
 	if(users == 0) {
 		/* stop all waiting threads */
-		do_exit = true;
-		TaskScheduler::queue_cond.notify_all();
+		{
+			thread_scoped_lock wake_lock(wake_mutex);
+			do_exit = true;
+			wake_cond.notify_all();
+		}
 
 		/* delete threads */
 		foreach(thread *t, threads) {
@@ -216,23 +217,126 @@ void TaskScheduler::exit()
 		}
 
 		threads.clear();
+
+		/* delete queues */
+		foreach(Queue *queue, queues) {
+			assert(queue->entries.empty());
+			delete queue;
+		}
+
+		queues.clear();
 	}
 }
 
-bool TaskScheduler::thread_wait_pop(Entry& entry)
+int TaskScheduler::thread_id()
 {
-	thread_scoped_lock queue_lock(queue_mutex);
+	if(queues.empty())
+		return -1;
 
-	while(queue.empty() && !do_exit)
-		queue_cond.wait(queue_lock);
+	int *id = thread_id_ptr.get();
 
-	if(queue.empty()) {
-		assert(do_exit);
+	return (id)? *id: -1;
+}
+
+bool TaskScheduler::queue_pop(Queue *queue, Entry& entry, TaskPool *pool, bool front)
+{
+	thread_scoped_lock queue_lock(queue->mutex);
+	list<Entry>& entries = queue->entries;
+
+	if(entries.empty())
 		return false;
+
+	if(pool == NULL) {
+		/* any task will do */
+		if(front) {
+			entry = entries.front();
+			entries.pop_front();
+		}
+		else {
+			entry = entries.back();
+			entries.pop_back();
+		}
+	}
+	else if(front) {
+		/* first task from the given pool */
+		list<Entry>::iterator it;
+
+		for(it = entries.begin(); it != entries.end(); it++)
+			if(it->pool == pool)
+				break;
+
+		if(it == entries.end())
+			return false;
+
+		entry = *it;
+		entries.erase(it);
+	}
+	else {
+		/* last task from the given pool */
+		list<Entry>::reverse_iterator it;
+
+		for(it = entries.rbegin(); it != entries.rend(); it++)
+			if(it->pool == pool)
+				break;
+
+		if(it == entries.rend())
+			return false;
+
+		entry = *it;
+		entries.erase(--it.base());
+	}
+
+	queue_lock.unlock();
+
+	atomic_sub_uint32(&num_queued, 1);
+
+	return true;
+}
+
+bool TaskScheduler::pop(int thread_id, Entry& entry, TaskPool *pool)
+{
+	int num_workers = threads.size();
+
+	/* newest task from our own queue, best for cache coherence */
+	if(thread_id != -1 && queue_pop(queues[thread_id], entry, pool, true))
+		return true;
+
+	/* tasks pushed from outside the scheduler, in push order */
+	if(queue_pop(queues[num_workers], entry, pool, true))
+		return true;
+
+	/* steal oldest task from other workers, starting at our neighbour so
+	 * that thieves spread over the victims */
+	for(int i = 1; i <= num_workers; i++) {
+		int victim = (thread_id + i) % num_workers;
+
+		if(victim == thread_id)
+			continue;
+
+		if(queue_pop(queues[victim], entry, pool, false))
+			return true;
+	}
+
+	return false;
+}
+
+bool TaskScheduler::thread_wait_pop(int thread_id, Entry& entry)
+{
+	while(!pop(thread_id, entry, NULL)) {
+		thread_scoped_lock wake_lock(wake_mutex);
+
+		/* pushing threads only take the wake mutex when someone sleeps,
+		 * num_sleeping must be visible before checking num_queued */
+		atomic_add_uint32(&num_sleeping, 1);
+
+		while(atomic_add_uint32(&num_queued, 0) == 0 && !do_exit)
+			wake_cond.wait(wake_lock);
+
+		atomic_sub_uint32(&num_sleeping, 1);
+
+		if(do_exit && atomic_add_uint32(&num_queued, 0) == 0)
+			return false;
 	}
-	
-	entry = queue.front();
-	queue.pop_front();
 
 	return true;
 }
@@ -241,10 +345,13 @@ void TaskScheduler::thread_run(int thread_id)
 {
 	Entry entry;
 
+	/* valid for as long as the thread runs */
+	thread_id_ptr.reset(&thread_id);
+
 	/* todo: test affinity/denormal mask */
 
 	/* keep popping off tasks */
-	while(thread_wait_pop(entry)) {
+	while(thread_wait_pop(thread_id, entry)) {
 		/* run task */
 		entry.task->run();
 
@@ -260,39 +367,60 @@ void TaskScheduler::push(Entry& entry, bool front)
 {
 	entry.pool->num_increase();
 
-	/* add entry to queue */
-	TaskScheduler::queue_mutex.lock();
-	if(front)
-		TaskScheduler::queue.push_front(entry);
-	else
-		TaskScheduler::queue.push_back(entry);
+	/* count before queueing, so num_queued never lags behind the queues */
+	atomic_add_uint32(&num_queued, 1);
 
-	TaskScheduler::queue_cond.notify_one();
-	TaskScheduler::queue_mutex.unlock();
+	int id = thread_id();
+
+	if(id != -1) {
+		/* worker threads push to their own queue, the front is always the
+		 * next task to run so there is no need to honor the front flag */
+		Queue *queue = queues[id];
+
+		thread_scoped_lock queue_lock(queue->mutex);
+		queue->entries.push_front(entry);
+	}
+	else {
+		Queue *queue = queues[threads.size()];
+
+		thread_scoped_lock queue_lock(queue->mutex);
+		if(front)
+			queue->entries.push_front(entry);
+		else
+			queue->entries.push_back(entry);
+	}
+
+	/* wake up a sleeping thread */
+	if(atomic_add_uint32(&num_sleeping, 0) != 0) {
+		thread_scoped_lock wake_lock(wake_mutex);
+		wake_cond.notify_one();
+	}
 }
 
 void TaskScheduler::clear(TaskPool *pool)
 {
-	thread_scoped_lock queue_lock(TaskScheduler::queue_mutex);
-
-	/* erase all tasks from this pool from the queue */
-	list<Entry>::iterator it = queue.begin();
 	int done = 0;
 
-	while(it != queue.end()) {
-		Entry& entry = *it;
+	/* erase all tasks from this pool from the queues */
+	foreach(Queue *queue, queues) {
+		thread_scoped_lock queue_lock(queue->mutex);
+		list<Entry>::iterator it = queue->entries.begin();
 
-		if(entry.pool == pool) {
-			done++;
-			delete entry.task;
+		while(it != queue->entries.end()) {
+			Entry& entry = *it;
 
-			it = queue.erase(it);
+			if(entry.pool == pool) {
+				done++;
+				delete entry.task;
+
+				it = queue->entries.erase(it);
+			}
+			else
+				it++;
 		}
-		else
-			it++;
 	}
 
-	queue_lock.unlock();
+	atomic_sub_uint32(&num_queued, done);
 
 	/* notify done */
 	pool->num_decrease(done);
@@ -19,6 +19,7 @@
 
 #include "util_list.h"
 #include "util_thread.h"
+#include "util_types.h"
 #include "util_vector.h"
 
 CCL_NAMESPACE_BEGIN
@@ -48,7 +49,8 @@ public:
  *
  * Pool of tasks that will be executed by the central TaskScheduler.For each
  * pool, we can wait for all tasks to be done, or cancel them before they are
- * done.
+ * done. While waiting, the calling thread helps executing tasks from the pool,
+ * so pools may be nested inside tasks of other pools.
  *
  * The run callback that actually executes the task may be created like this:
  * function_bind(&MyClass::task_execute, this, _1, _2) */
@@ -83,8 +85,14 @@ protected:
 
 /* Task Scheduler
  * 
- * Central scheduler that holds running threads ready to execute tasks. A singe
- * queue holds the task from all pools. */
+ * Central scheduler that holds running threads ready to execute tasks.
+ *
+ * Every worker thread owns a double ended queue. Tasks pushed from a worker
+ * thread go to the front of its own queue and are popped from there again, so
+ * recursively spawned tasks stay on the thread that created them. Idle workers
+ * steal from the back of other queues, taking the oldest and usually largest
+ * tasks. Tasks pushed from threads outside the scheduler go to a shared queue
+ * which keeps push order. */
 
 class TaskScheduler
 {
@@ -106,18 +114,31 @@ protected:
 		TaskPool *pool;
 	};
 
+	struct Queue {
+		list<Entry> entries;
+		thread_mutex mutex;
+	};
+
 	static thread_mutex mutex;
 	static int users;
 	static vector<thread*> threads;
 	static bool do_exit;
 
-	static list<Entry> queue;
-	static thread_mutex queue_mutex;
-	static thread_condition_variable queue_cond;
+	/* one queue per worker thread, the last one is shared by other threads */
+	static vector<Queue*> queues;
+
+	/* idle threads wait here until new tasks are queued */
+	static thread_mutex wake_mutex;
+	static thread_condition_variable wake_cond;
+	static uint32_t num_queued;
+	static uint32_t num_sleeping;
 
 	static void thread_run(int thread_id);
-	static bool thread_wait_pop(Entry& entry);
+	static bool thread_wait_pop(int thread_id, Entry& entry);
+	static int thread_id();
 
+	static bool queue_pop(Queue *queue, Entry& entry, TaskPool *pool, bool front);
+	static bool pop(int thread_id, Entry& entry, TaskPool *pool);
 	static void push(Entry& entry, bool front);
 	static void clear(TaskPool *pool);
 };
@@ -68,6 +68,36 @@ protected:
 	bool joined;
 };
 
+/* pointer with a value per thread, pthread based like the thread class.
+ * values are not freed when threads exit */
+
+template<typename T>
+class thread_specific_ptr {
+public:
+	thread_specific_ptr()
+	{
+		pthread_key_create(&key, NULL);
+	}
+
+	~thread_specific_ptr()
+	{
+		pthread_key_delete(key);
+	}
+
+	T *get() const
+	{
+		return (T*)pthread_getspecific(key);
+	}
+
+	void reset(T *value)
+	{
+		pthread_setspecific(key, value);
+	}
+
+protected:
+	pthread_key_t key;
+};
+
 CCL_NAMESPACE_END
 
 #endif /* __UTIL_THREAD_H__ */
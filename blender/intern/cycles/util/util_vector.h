@@ -55,7 +55,9 @@ static inline void free_aligned(void *ptr)
  *   this was actually showing up in profiles quite significantly. it
  *   also does not run any constructors/destructors
  * - if this is used, we are not tempted to use inefficient operations
- * - aligned allocation for SSE data types */
+ * - aligned allocation for SSE data types
+ * - can reference externally owned memory, like a memory mapped file, which
+ *   is then copied on resize and never freed */
 
 template<typename T, size_t alignment = 16>
 class array
@@ -65,6 +67,7 @@ public:
 	{
 		data = NULL;
 		datasize = 0;
+		referenced = false;
 	}
 
 	array(size_t newsize)
@@ -77,6 +80,8 @@ public:
 			data = (T*)malloc_aligned(sizeof(T)*newsize, alignment);
 			datasize = newsize;
 		}
+
+		referenced = false;
 	}
 
 	array(const array& from)
@@ -96,6 +101,8 @@ public:
 			datasize = from.datasize;
 		}
 
+		referenced = false;
+
 		return *this;
 	}
 
@@ -112,12 +119,26 @@ public:
 			memcpy(data, &from[0], datasize*sizeof(T));
 		}
 
+		referenced = false;
+
 		return *this;
 	}
 
 	~array()
 	{
-		free_aligned(data);
+		if(!referenced)
+			free_aligned(data);
+	}
+
+	void reference(T *ptr, size_t newsize)
+	{
+		clear();
+
+		if(newsize) {
+			data = ptr;
+			datasize = newsize;
+			referenced = true;
+		}
 	}
 
 	void resize(size_t newsize)
@@ -128,18 +149,22 @@ public:
 		else if(newsize != datasize) {
 			T *newdata = (T*)malloc_aligned(sizeof(T)*newsize, alignment);
 			memcpy(newdata, data, ((datasize < newsize)? datasize: newsize)*sizeof(T));
-			free_aligned(data);
+			if(!referenced)
+				free_aligned(data);
 
 			data = newdata;
 			datasize = newsize;
+			referenced = false;
 		}
 	}
 
 	void clear()
 	{
-		free_aligned(data);
+		if(!referenced)
+			free_aligned(data);
 		data = NULL;
 		datasize = 0;
+		referenced = false;
 	}
 
 	size_t size() const
@@ -155,6 +180,7 @@ public:
 protected:
 	T *data;
 	size_t datasize;
+	bool referenced;
 };
 
 CCL_NAMESPACE_END
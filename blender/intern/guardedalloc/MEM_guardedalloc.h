@@ -44,6 +44,12 @@
  * linked list, so they remain reachable at all times. There is no
  * back-up in case the linked-list related data is lost.
  *
+ * Alternatively a lock-free allocator can be selected at startup with
+ * #MEM_use_lockfree_allocator. It only keeps the size of each block and
+ * per-thread statistics, without padding or a global list, so threads can
+ * allocate without serializing on a lock. Debug builds still track blocks
+ * to report leaks.
+ *
  * \subsection memissues Known issues with MEM
  *
  * There are currently no known issues with MEM. Note that there is a
@@ -75,7 +81,7 @@ extern "C" {
 	/** Returns the length of the allocated memory segment pointed at
 	 * by vmemh. If the pointer was not previously allocated by this
 	 * module, the result is undefined.*/
-	size_t MEM_allocN_len(const void *vmemh)
+	extern size_t (*MEM_allocN_len)(const void *vmemh)
 #if MEM_GNU_ATTRIBUTES
 	__attribute__((warn_unused_result))
 #endif
@@ -84,21 +90,20 @@ extern "C" {
 	/**
 	 * Release memory previously allocatred by this module. 
 	 */
-	void MEM_freeN(void *vmemh);
+	extern void (*MEM_freeN)(void *vmemh);
 
 #if 0  /* UNUSED */
 	/**
 	 * Return zero if memory is not in allocated list
 	 */
-	short MEM_testN(void *vmemh);
+	extern short (*MEM_testN)(void *vmemh);
 #endif
 
 	/**
 	 * Duplicates a block of memory, and returns a pointer to the
 	 * newly allocated block.  */
-	void *MEM_dupallocN(const void *vmemh)
+	extern void *(*MEM_dupallocN)(const void *vmemh)
 #if MEM_GNU_ATTRIBUTES
-	__attribute__((malloc))
 	__attribute__((warn_unused_result))
 #endif
 	;
@@ -108,9 +113,8 @@ extern "C" {
 	 * allocated block, the old one is freed. this is not as optimized
 	 * as a system realloc but just makes a new allocation and copies
 	 * over from existing memory. */
-	void *MEM_reallocN_id(void *vmemh, size_t len, const char *str)
+	extern void *(*MEM_reallocN_id)(void *vmemh, size_t len, const char *str)
 #if MEM_GNU_ATTRIBUTES
-	__attribute__((malloc))
 	__attribute__((warn_unused_result))
 	__attribute__((alloc_size(2)))
 #endif
@@ -119,9 +123,8 @@ extern "C" {
 	/**
 	 * A variant of realloc which zeros new bytes
 	 */
-	void *MEM_recallocN_id(void *vmemh, size_t len, const char *str)
+	extern void *(*MEM_recallocN_id)(void *vmemh, size_t len, const char *str)
 #if MEM_GNU_ATTRIBUTES
-	__attribute__((malloc))
 	__attribute__((warn_unused_result))
 	__attribute__((alloc_size(2)))
 #endif
@@ -134,9 +137,8 @@ extern "C" {
 	 * Allocate a block of memory of size len, with tag name str. The
 	 * memory is cleared. The name must be static, because only a
 	 * pointer to it is stored ! */
-	void *MEM_callocN(size_t len, const char *str)
+	extern void *(*MEM_callocN)(size_t len, const char *str)
 #if MEM_GNU_ATTRIBUTES
-	__attribute__((malloc))
 	__attribute__((warn_unused_result))
 	__attribute__((nonnull(2)))
 	__attribute__((alloc_size(1)))
@@ -147,9 +149,8 @@ extern "C" {
 	 * Allocate a block of memory of size len, with tag name str. The
 	 * name must be a static, because only a pointer to it is stored !
 	 * */
-	void *MEM_mallocN(size_t len, const char *str)
+	extern void *(*MEM_mallocN)(size_t len, const char *str)
 #if MEM_GNU_ATTRIBUTES
-	__attribute__((malloc))
 	__attribute__((warn_unused_result))
 	__attribute__((nonnull(2)))
 	__attribute__((alloc_size(1)))
@@ -160,9 +161,8 @@ extern "C" {
 	 * Same as callocN, clears memory and uses mmap (disk cached) if supported.
 	 * Can be free'd with MEM_freeN as usual.
 	 * */
-	void *MEM_mapallocN(size_t len, const char *str)
+	extern void *(*MEM_mapallocN)(size_t len, const char *str)
 #if MEM_GNU_ATTRIBUTES
-	__attribute__((malloc))
 	__attribute__((warn_unused_result))
 	__attribute__((nonnull(2)))
 	__attribute__((alloc_size(1)))
@@ -171,49 +171,49 @@ extern "C" {
 
 	/** Print a list of the names and sizes of all allocated memory
 	 * blocks. as a python dict for easy investigation */ 
-	void MEM_printmemlist_pydict(void);
+	extern void (*MEM_printmemlist_pydict)(void);
 
 	/** Print a list of the names and sizes of all allocated memory
 	 * blocks. */ 
-	void MEM_printmemlist(void);
+	extern void (*MEM_printmemlist)(void);
 
 	/** calls the function on all allocated memory blocks. */
-	void MEM_callbackmemlist(void (*func)(void *));
+	extern void (*MEM_callbackmemlist)(void (*func)(void *));
 
 	/** Print statistics about memory usage */
-	void MEM_printmemlist_stats(void);
+	extern void (*MEM_printmemlist_stats)(void);
 	
 	/** Set the callback function for error output. */
-	void MEM_set_error_callback(void (*func)(const char *));
+	extern void (*MEM_set_error_callback)(void (*func)(const char *));
 
 	/**
 	 * Are the start/end block markers still correct ?
 	 *
 	 * @retval 0 for correct memory, 1 for corrupted memory. */
-	bool MEM_check_memory_integrity(void);
+	extern bool (*MEM_check_memory_integrity)(void);
 
 	/** Set thread locking functions for safe memory allocation from multiple
 	 * threads, pass NULL pointers to disable thread locking again. */
-	void MEM_set_lock_callback(void (*lock)(void), void (*unlock)(void));
+	extern void (*MEM_set_lock_callback)(void (*lock)(void), void (*unlock)(void));
 	
 	/** Attempt to enforce OSX (or other OS's) to have malloc and stack nonzero */
-	void MEM_set_memory_debug(void);
+	extern void (*MEM_set_memory_debug)(void);
 
 	/**
 	 * Memory usage stats
 	 * - MEM_get_memory_in_use is all memory
 	 * - MEM_get_mapped_memory_in_use is a subset of all memory */
-	uintptr_t MEM_get_memory_in_use(void);
+	extern uintptr_t (*MEM_get_memory_in_use)(void);
 	/** Get mapped memory usage. */
-	uintptr_t MEM_get_mapped_memory_in_use(void);
+	extern uintptr_t (*MEM_get_mapped_memory_in_use)(void);
 	/** Get amount of memory blocks in use. */
-	unsigned int MEM_get_memory_blocks_in_use(void);
+	extern unsigned int (*MEM_get_memory_blocks_in_use)(void);
 
 	/** Reset the peak memory statistic to zero. */
-	void MEM_reset_peak_memory(void);
+	extern void (*MEM_reset_peak_memory)(void);
 
 	/** Get the peak memory usage in bytes, including mmap allocations. */
-	size_t MEM_get_peak_memory(void)
+	extern size_t (*MEM_get_peak_memory)(void)
 #if MEM_GNU_ATTRIBUTES
 	__attribute__((warn_unused_result))
 #endif
@@ -222,9 +222,16 @@ extern "C" {
 #define MEM_SAFE_FREE(v) if (v) { MEM_freeN(v); v = NULL; } (void)0
 
 #ifndef NDEBUG
-const char *MEM_name_ptr(void *vmemh);
+extern const char *(*MEM_name_ptr)(void *vmemh);
 #endif
 
+/** Switch to the lock-free allocator. Must be called before anything was
+ * allocated, blocks can't be freed by another allocator than the one that
+ * allocated them. Error and lock callbacks must be set after switching.
+ *
+ * @retval false when blocks were already allocated and the switch failed. */
+bool MEM_use_lockfree_allocator(void);
+
 #ifdef __cplusplus
 /* alloc funcs for C++ only */
 #define MEM_CXX_CLASS_ALLOC_FUNCS(_id)                                        \
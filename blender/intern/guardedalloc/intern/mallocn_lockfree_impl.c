@@ -0,0 +1,596 @@
+/*
+ * ***** BEGIN GPL LICENSE BLOCK *****
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * The Original Code is Copyright (C) 2013 by Blender Foundation.
+ * All rights reserved.
+ *
+ * The Original Code is: all of this file.
+ *
+ * Contributor(s): none yet.
+ *
+ * ***** END GPL LICENSE BLOCK *****
+ */
+
+/** \file guardedalloc/intern/mallocn_lockfree_impl.c
+ *  \ingroup MEM
+ *
+ * Memory allocation which keeps track of allocated memory counters
+ * without locking, for fast allocation from many threads.
+ *
+ * There is no global list of blocks, each block only stores its length.
+ * Statistics are kept in a number of counter stripes, each thread updates
+ * its own stripe with atomic operations that are normally uncontended, and
+ * totals are the sum over all stripes.
+ *
+ * In debug builds blocks are additionally linked into a list per stripe,
+ * so that unfreed blocks can still be reported.
+ */
+
+#include <stdlib.h>
+#include <string.h> /* memcpy */
+#include <stdarg.h>
+#include <stddef.h> /* offsetof */
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "MEM_guardedalloc.h"
+
+/* to ensure strict conversions */
+#include "../../source/blender/blenlib/BLI_strict_flags.h"
+
+#include "atomic_ops.h"
+#include "mallocn_intern.h"
+
+/* number of counter stripes, threads beyond this share stripes */
+#define MEM_NUM_STRIPES 64
+#define MEM_CACHE_LINE_SIZE 64
+
+/* peak memory is sampled rather than computed on every allocation,
+ * after this many allocations from a stripe or for large blocks */
+#define MEM_PEAK_SAMPLE_RATE 256
+#define MEM_PEAK_SAMPLE_LEN (1024 * 1024)
+
+typedef struct MemHead {
+#ifndef NDEBUG
+	struct MemHead *next, *prev;
+	const char *name;
+	unsigned int stripe;
+	int pad;
+#endif
+	/* length with MEMHEAD_MMAP_FLAG in the lowest bit */
+	size_t len;
+} MemHead;
+
+#define MEMHEAD_MMAP_FLAG ((size_t)1)
+#define MEMHEAD_FROM_PTR(ptr) (((MemHead *) ptr) - 1)
+#define PTR_FROM_MEMHEAD(memhead) (memhead + 1)
+#define MEMHEAD_IS_MMAP(memhead) ((memhead)->len & MEMHEAD_MMAP_FLAG)
+#define MEMHEAD_LEN(memhead) ((memhead)->len & ~((size_t)(MEMHEAD_MMAP_FLAG)))
+
+/* names are only stored in debug builds */
+#ifndef NDEBUG
+#  define MEMHEAD_NAME(memhead, str) ((memhead)->name)
+#else
+#  define MEMHEAD_NAME(memhead, str) (str)
+#endif
+
+/* counters of one stripe, padded to avoid false sharing between threads */
+typedef struct MemCounters {
+	size_t mem_in_use;
+	size_t mmap_in_use;
+	unsigned int totblock;
+	unsigned int num_alloc;
+#ifndef NDEBUG
+	unsigned int lock;
+	MemHead *first, *last;
+#endif
+} MemCounters;
+
+typedef union MemStripe {
+	MemCounters counters;
+	char pad[MEM_CACHE_LINE_SIZE];
+} MemStripe;
+
+static MemStripe stripes[MEM_NUM_STRIPES];
+static unsigned int stripe_next = 0;
+static size_t peak_mem = 0;
+
+static void (*error_callback)(const char *) = NULL;
+
+static bool malloc_debug_memset = false;
+
+#if defined(WIN32)
+/* our windows mmap implementation is not thread safe */
+static unsigned int mmap_lock = 0;
+#endif
+
+#if defined(_MSC_VER)
+#  define MEM_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__) && !defined(__APPLE__)
+#  define MEM_THREAD_LOCAL __thread
+#endif
+
+#ifdef malloc
+#undef malloc
+#endif
+
+#ifdef calloc
+#undef calloc
+#endif
+
+#ifdef free
+#undef free
+#endif
+
+/* --------------------------------------------------------------------- */
+/* implementation                                                        */
+/* --------------------------------------------------------------------- */
+
+#ifdef __GNUC__
+__attribute__ ((format(printf, 1, 2)))
+#endif
+static void print_error(const char *str, ...)
+{
+	char buf[512];
+	va_list ap;
+
+	va_start(ap, str);
+	vsnprintf(buf, sizeof(buf), str, ap);
+	va_end(ap);
+	buf[sizeof(buf) - 1] = '\0';
+
+	if (error_callback) error_callback(buf);
+}
+
+#if defined(WIN32) || !defined(NDEBUG)
+static void spin_lock(unsigned int *lock)
+{
+	while (atomic_cas_u(lock, 0, 1) != 0) {
+		/* pass */
+	}
+}
+
+static void spin_unlock(unsigned int *lock)
+{
+	atomic_cas_u(lock, 1, 0);
+}
+#endif
+
+static unsigned int mem_stripe_index(void)
+{
+#ifdef MEM_THREAD_LOCAL
+	/* stripe assigned round robin on first use, zero means unassigned */
+	static MEM_THREAD_LOCAL unsigned int thread_stripe = 0;
+
+	if (thread_stripe == 0)
+		thread_stripe = (atomic_add_u(&stripe_next, 1) % MEM_NUM_STRIPES) + 1;
+
+	return thread_stripe - 1;
+#else
+	/* no thread local storage, every thread has its own stack so hash
+	 * its address instead. correctness does not depend on the stripe */
+	int local;
+	uintptr_t addr = ((uintptr_t)&local) >> 16;
+
+	(void)stripe_next;
+
+	return (unsigned int)((addr * 2654435761u) >> 8) % MEM_NUM_STRIPES;
+#endif
+}
+
+static size_t mem_sum_counters(size_t offset)
+{
+	size_t sum = 0;
+	int i;
+
+	/* blocks may be freed from another stripe than they were allocated
+	 * from, so individual stripes wrap around but the sum does not */
+	for (i = 0; i < MEM_NUM_STRIPES; i++)
+		sum += *(volatile size_t *)((char *)&stripes[i].counters + offset);
+
+	/* while other threads are allocating, the sum may briefly be negative */
+	return (sum > ((size_t)-1) / 2) ? 0 : sum;
+}
+
+static void mem_update_peak(void)
+{
+	size_t mem_in_use = MEM_lockfree_get_memory_in_use();
+	size_t peak = peak_mem;
+
+	while (mem_in_use > peak) {
+		size_t prev = atomic_cas_z(&peak_mem, peak, mem_in_use);
+
+		if (prev == peak)
+			break;
+
+		peak = prev;
+	}
+}
+
+static void mem_add_block(MemHead *memh, size_t len, const char *str, bool mmap)
+{
+	unsigned int index = mem_stripe_index();
+	MemCounters *counters = &stripes[index].counters;
+
+	memh->len = len | (mmap ? MEMHEAD_MMAP_FLAG : 0);
+
+	atomic_add_u(&counters->totblock, 1);
+	atomic_add_z(&counters->mem_in_use, len);
+	if (mmap)
+		atomic_add_z(&counters->mmap_in_use, len);
+
+#ifndef NDEBUG
+	memh->name = str;
+	memh->stripe = index;
+	memh->next = NULL;
+
+	spin_lock(&counters->lock);
+	memh->prev = counters->last;
+	if (counters->last) counters->last->next = memh;
+	else counters->first = memh;
+	counters->last = memh;
+	spin_unlock(&counters->lock);
+#else
+	(void)str;
+#endif
+
+	/* only read and written by threads using this stripe, a lost update
+	 * just shifts the next sample */
+	if (len >= MEM_PEAK_SAMPLE_LEN || (++counters->num_alloc % MEM_PEAK_SAMPLE_RATE) == 0)
+		mem_update_peak();
+}
+
+static void mem_remove_block(MemHead *memh)
+{
+	MemCounters *counters = &stripes[mem_stripe_index()].counters;
+	size_t len = MEMHEAD_LEN(memh);
+
+	atomic_sub_u(&counters->totblock, 1);
+	atomic_sub_z(&counters->mem_in_use, len);
+	if (MEMHEAD_IS_MMAP(memh))
+		atomic_sub_z(&counters->mmap_in_use, len);
+
+#ifndef NDEBUG
+	{
+		/* the list is owned by the stripe the block was allocated from */
+		MemCounters *owner = &stripes[memh->stripe].counters;
+
+		spin_lock(&owner->lock);
+		if (memh->next) memh->next->prev = memh->prev;
+		else owner->last = memh->prev;
+		if (memh->prev) memh->prev->next = memh->next;
+		else owner->first = memh->next;
+		spin_unlock(&owner->lock);
+	}
+#endif
+}
+
+size_t MEM_lockfree_allocN_len(const void *vmemh)
+{
+	if (vmemh) {
+		return MEMHEAD_LEN(MEMHEAD_FROM_PTR(vmemh));
+	}
+	else {
+		return 0;
+	}
+}
+
+void MEM_lockfree_freeN(void *vmemh)
+{
+	MemHead *memh;
+	size_t len;
+
+	if (vmemh == NULL) {
+		print_error("Memoryblock free: attempt to free NULL pointer\n");
+#ifdef WITH_ASSERT_ABORT
+		abort();
+#endif
+		return;
+	}
+
+	memh = MEMHEAD_FROM_PTR(vmemh);
+	len = MEMHEAD_LEN(memh);
+
+	mem_remove_block(memh);
+
+	if (MEMHEAD_IS_MMAP(memh)) {
+#if defined(WIN32)
+		spin_lock(&mmap_lock);
+#endif
+		if (munmap(memh, len + sizeof(MemHead)))
+			printf("Couldn't unmap memory\n");
+#if defined(WIN32)
+		spin_unlock(&mmap_lock);
+#endif
+	}
+	else {
+		if (malloc_debug_memset && len)
+			memset(memh + 1, 255, len);
+		free(memh);
+	}
+}
+
+void *MEM_lockfree_dupallocN(const void *vmemh)
+{
+	void *newp = NULL;
+
+	if (vmemh) {
+		const MemHead *memh = MEMHEAD_FROM_PTR(vmemh);
+		const size_t prev_size = MEM_lockfree_allocN_len(vmemh);
+
+		if (MEMHEAD_IS_MMAP(memh))
+			newp = MEM_lockfree_mapallocN(prev_size, "dupli_mapalloc");
+		else
+			newp = MEM_lockfree_mallocN(prev_size, "dupli_alloc");
+
+		if (newp == NULL) return NULL;
+
+		memcpy(newp, vmemh, prev_size);
+	}
+
+	return newp;
+}
+
+void *MEM_lockfree_reallocN_id(void *vmemh, size_t len, const char *str)
+{
+	void *newp = NULL;
+
+	if (vmemh) {
+		size_t old_len = MEM_lockfree_allocN_len(vmemh);
+
+		newp = MEM_lockfree_mallocN(len, MEMHEAD_NAME(MEMHEAD_FROM_PTR(vmemh), str));
+		if (newp) {
+			if (len < old_len) {
+				/* shrink */
+				memcpy(newp, vmemh, len);
+			}
+			else {
+				/* grow (or remain same size) */
+				memcpy(newp, vmemh, old_len);
+			}
+		}
+
+		MEM_lockfree_freeN(vmemh);
+	}
+	else {
+		newp = MEM_lockfree_mallocN(len, str);
+	}
+
+	return newp;
+}
+
+void *MEM_lockfree_recallocN_id(void *vmemh, size_t len, const char *str)
+{
+	void *newp = NULL;
+
+	if (vmemh) {
+		size_t old_len = MEM_lockfree_allocN_len(vmemh);
+
+		newp = MEM_lockfree_mallocN(len, MEMHEAD_NAME(MEMHEAD_FROM_PTR(vmemh), str));
+		if (newp) {
+			if (len < old_len) {
+				/* shrink */
+				memcpy(newp, vmemh, len);
+			}
+			else {
+				memcpy(newp, vmemh, old_len);
+
+				if (len > old_len) {
+					/* grow */
+					/* zero new bytes */
+					memset(((char *)newp) + old_len, 0, len - old_len);
+				}
+			}
+		}
+
+		MEM_lockfree_freeN(vmemh);
+	}
+	else {
+		newp = MEM_lockfree_callocN(len, str);
+	}
+
+	return newp;
+}
+
+void *MEM_lockfree_callocN(size_t len, const char *str)
+{
+	MemHead *memh;
+
+	len = SIZET_ALIGN_4(len);
+
+	memh = (MemHead *)calloc(1, len + sizeof(MemHead));
+
+	if (memh) {
+		mem_add_block(memh, len, str, false);
+		return PTR_FROM_MEMHEAD(memh);
+	}
+	print_error("Calloc returns null: len=" SIZET_FORMAT " in %s, total %u\n",
+	            SIZET_ARG(len), str, (unsigned int) MEM_lockfree_get_memory_in_use());
+	return NULL;
+}
+
+void *MEM_lockfree_mallocN(size_t len, const char *str)
+{
+	MemHead *memh;
+
+	len = SIZET_ALIGN_4(len);
+
+	memh = (MemHead *)malloc(len + sizeof(MemHead));
+
+	if (memh) {
+		mem_add_block(memh, len, str, false);
+		if (malloc_debug_memset && len)
+			memset(memh + 1, 255, len);
+		return PTR_FROM_MEMHEAD(memh);
+	}
+	print_error("Malloc returns null: len=" SIZET_FORMAT " in %s, total %u\n",
+	            SIZET_ARG(len), str, (unsigned int) MEM_lockfree_get_memory_in_use());
+	return NULL;
+}
+
+/* note; mmap returns zero'd memory */
+void *MEM_lockfree_mapallocN(size_t len, const char *str)
+{
+	MemHead *memh;
+
+	len = SIZET_ALIGN_4(len);
+
+#if defined(WIN32)
+	spin_lock(&mmap_lock);
+#endif
+	memh = mmap(NULL, len + sizeof(MemHead),
+	            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
+#if defined(WIN32)
+	spin_unlock(&mmap_lock);
+#endif
+
+	if (memh != (MemHead *)-1) {
+		mem_add_block(memh, len, str, true);
+		return PTR_FROM_MEMHEAD(memh);
+	}
+	else {
+		print_error("Mapalloc returns null, fallback to regular malloc: "
+		            "len=" SIZET_FORMAT " in %s, total %u\n",
+		            SIZET_ARG(len), str, (unsigned int) MEM_lockfree_get_mapped_memory_in_use());
+		return MEM_lockfree_callocN(len, str);
+	}
+}
+
+void MEM_lockfree_printmemlist_pydict(void)
+{
+	/* not supported, use the guarded allocator for detailed lists */
+}
+
+void MEM_lockfree_printmemlist(void)
+{
+#ifndef NDEBUG
+	int i;
+
+	/* only meant to be called when no other threads are allocating */
+	for (i = 0; i < MEM_NUM_STRIPES; i++) {
+		MemHead *memh;
+
+		for (memh = stripes[i].counters.first; memh; memh = memh->next) {
+			print_error("%s len: " SIZET_FORMAT " %p\n",
+			            memh->name, SIZET_ARG(MEMHEAD_LEN(memh)), (void *)(memh + 1));
+		}
+	}
+#endif
+}
+
+void MEM_lockfree_callbackmemlist(void (*func)(void *))
+{
+#ifndef NDEBUG
+	int i;
+
+	for (i = 0; i < MEM_NUM_STRIPES; i++) {
+		MemHead *memh = stripes[i].counters.first;
+
+		while (memh) {
+			MemHead *next = memh->next;
+			func(memh + 1);
+			memh = next;
+		}
+	}
+#else
+	(void)func;
+#endif
+}
+
+void MEM_lockfree_printmemlist_stats(void)
+{
+	printf("\ntotal memory len: %.3f MB\n",
+	       (double)MEM_lockfree_get_memory_in_use() / (double)(1024 * 1024));
+	printf("peak memory len: %.3f MB\n",
+	       (double)MEM_lockfree_get_peak_memory() / (double)(1024 * 1024));
+	printf("\nFor more detailed per-block statistics run Blender with the "
+	       "guarded allocator.\n");
+
+#ifdef HAVE_MALLOC_H /* GLIBC only */
+	printf("System Statistics:\n");
+	malloc_stats();
+#endif
+}
+
+void MEM_lockfree_set_error_callback(void (*func)(const char *))
+{
+	error_callback = func;
+}
+
+bool MEM_lockfree_check_memory_integrity(void)
+{
+	/* no guard tags to check */
+	return false;
+}
+
+void MEM_lockfree_set_lock_callback(void (*lock)(void), void (*unlock)(void))
+{
+	/* not needed, allocation is thread safe */
+	(void)lock;
+	(void)unlock;
+}
+
+void MEM_lockfree_set_memory_debug(void)
+{
+	malloc_debug_memset = true;
+}
+
+uintptr_t MEM_lockfree_get_memory_in_use(void)
+{
+	return mem_sum_counters(offsetof(MemCounters, mem_in_use));
+}
+
+uintptr_t MEM_lockfree_get_mapped_memory_in_use(void)
+{
+	return mem_sum_counters(offsetof(MemCounters, mmap_in_use));
+}
+
+unsigned int MEM_lockfree_get_memory_blocks_in_use(void)
+{
+	unsigned int totblock = 0;
+	int i;
+
+	for (i = 0; i < MEM_NUM_STRIPES; i++)
+		totblock += *(volatile unsigned int *)&stripes[i].counters.totblock;
+
+	return (totblock > ((unsigned int)-1) / 2) ? 0 : totblock;
+}
+
+void MEM_lockfree_reset_peak_memory(void)
+{
+	peak_mem = MEM_lockfree_get_memory_in_use();
+}
+
+size_t MEM_lockfree_get_peak_memory(void)
+{
+	/* peak is sampled, include the current usage in case it was missed */
+	mem_update_peak();
+
+	return peak_mem;
+}
+
+#ifndef NDEBUG
+const char *MEM_lockfree_name_ptr(void *vmemh)
+{
+	if (vmemh) {
+		return MEMHEAD_FROM_PTR(vmemh)->name;
+	}
+	else {
+		return "MEM_name_ptr(NULL)";
+	}
+}
+#endif  /* NDEBUG */
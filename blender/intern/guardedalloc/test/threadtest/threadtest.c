@@ -0,0 +1,230 @@
+/**
+ * ***** BEGIN GPL LICENSE BLOCK *****
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * The Original Code is Copyright (C) 2013 by Blender Foundation.
+ * All rights reserved.
+ *
+ * The Original Code is: all of this file.
+ *
+ * Contributor(s): none yet.
+ *
+ * ***** END GPL LICENSE BLOCK *****
+ */
+
+/**
+ * Multi-threaded allocation benchmark, comparing the guarded allocator
+ * serialized by a lock callback (as BLI_begin_threaded_malloc does) with
+ * the lock-free allocator.
+ *
+ * Each thread keeps a window of live blocks of random size and replaces
+ * them in random order, half of the blocks are handed over to be freed by
+ * the next thread to include cross thread frees. At the end the memory
+ * statistics are checked to be back to zero.
+ */
+
+/* To compile run:
+ * gcc -O2 -DWITH_GUARDEDALLOC -I../../ -I../../../atomic/ threadtest.c ../../intern/mallocn*.c -lpthread -o threadtest
+ *
+ * Usage:
+ * threadtest [num_threads] [num_iterations] [guarded|lockfree]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "MEM_guardedalloc.h"
+
+/* live blocks per thread */
+#define WINDOW_SIZE 256
+/* blocks handed over to the next thread */
+#define HANDOVER_SIZE 64
+#define MAX_BLOCK_SIZE 512
+
+typedef struct ThreadData {
+	int index;
+	int num_iterations;
+	unsigned int seed;
+
+	/* blocks allocated by the previous thread, freed by this one */
+	void *handover[HANDOVER_SIZE];
+	pthread_mutex_t handover_mutex;
+	int num_handover;
+} ThreadData;
+
+static ThreadData *threads_data;
+static int num_threads;
+
+static pthread_mutex_t malloc_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void lock_malloc_thread(void)
+{
+	pthread_mutex_lock(&malloc_mutex);
+}
+
+static void unlock_malloc_thread(void)
+{
+	pthread_mutex_unlock(&malloc_mutex);
+}
+
+static void mem_error_cb(const char *errorStr)
+{
+	fprintf(stderr, "%s", errorStr);
+	fflush(stderr);
+}
+
+static double time_dt(void)
+{
+	struct timeval now;
+	gettimeofday(&now, NULL);
+
+	return now.tv_sec + now.tv_usec * 1e-6;
+}
+
+static unsigned int random_next(unsigned int *seed)
+{
+	*seed = *seed * 1103515245u + 12345u;
+	return (*seed >> 16) & 0x7fff;
+}
+
+static void handover_free(ThreadData *data)
+{
+	int i;
+
+	pthread_mutex_lock(&data->handover_mutex);
+	for (i = 0; i < data->num_handover; i++)
+		MEM_freeN(data->handover[i]);
+	data->num_handover = 0;
+	pthread_mutex_unlock(&data->handover_mutex);
+}
+
+static void *thread_run(void *arg)
+{
+	ThreadData *data = arg;
+	ThreadData *next = &threads_data[(data->index + 1) % num_threads];
+	void *window[WINDOW_SIZE] = {NULL};
+	int i;
+
+	for (i = 0; i < data->num_iterations; i++) {
+		int slot = random_next(&data->seed) % WINDOW_SIZE;
+		size_t size = 1 + random_next(&data->seed) % MAX_BLOCK_SIZE;
+
+		if (window[slot]) {
+			/* every other block is freed by the next thread */
+			if ((i & 1) && next->num_handover < HANDOVER_SIZE) {
+				pthread_mutex_lock(&next->handover_mutex);
+				if (next->num_handover < HANDOVER_SIZE) {
+					next->handover[next->num_handover++] = window[slot];
+					window[slot] = NULL;
+				}
+				pthread_mutex_unlock(&next->handover_mutex);
+			}
+
+			if (window[slot])
+				MEM_freeN(window[slot]);
+		}
+
+		window[slot] = (i & 2) ? MEM_callocN(size, "threadtest calloc") :
+		                         MEM_mallocN(size, "threadtest malloc");
+		memset(window[slot], i & 0xff, size);
+
+		if ((i % 1024) == 0)
+			handover_free(data);
+	}
+
+	for (i = 0; i < WINDOW_SIZE; i++)
+		if (window[i])
+			MEM_freeN(window[i]);
+
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t *threads;
+	int num_iterations = 1000000;
+	int lockfree = 0, i;
+	double time_start, time_total;
+	int error_status = 0;
+
+	num_threads = 4;
+
+	if (argc > 1) num_threads = atoi(argv[1]);
+	if (argc > 2) num_iterations = atoi(argv[2]);
+	if (argc > 3) lockfree = (strcmp(argv[3], "lockfree") == 0);
+
+	if (num_threads < 1 || num_iterations < 1) {
+		fprintf(stderr, "Usage: %s [num_threads] [num_iterations] [guarded|lockfree]\n", argv[0]);
+		return 1;
+	}
+
+	/* must happen before anything is allocated */
+	if (lockfree && !MEM_use_lockfree_allocator()) {
+		fprintf(stderr, "Failed to switch to the lock-free allocator\n");
+		return 1;
+	}
+
+	MEM_set_error_callback(mem_error_cb);
+	MEM_set_lock_callback(lock_malloc_thread, unlock_malloc_thread);
+
+	threads = malloc(sizeof(pthread_t) * num_threads);
+	threads_data = calloc(num_threads, sizeof(ThreadData));
+
+	for (i = 0; i < num_threads; i++) {
+		threads_data[i].index = i;
+		threads_data[i].num_iterations = num_iterations;
+		threads_data[i].seed = 1 + i;
+		pthread_mutex_init(&threads_data[i].handover_mutex, NULL);
+	}
+
+	time_start = time_dt();
+
+	for (i = 0; i < num_threads; i++)
+		pthread_create(&threads[i], NULL, thread_run, &threads_data[i]);
+	for (i = 0; i < num_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	for (i = 0; i < num_threads; i++)
+		handover_free(&threads_data[i]);
+
+	time_total = time_dt() - time_start;
+
+	MEM_set_lock_callback(NULL, NULL);
+
+	printf("%s allocator, %d threads: %.3f seconds, %.2f million allocations per second\n",
+	       lockfree ? "lock-free" : "guarded", num_threads, time_total,
+	       ((double)num_threads * num_iterations) / time_total * 1e-6);
+	printf("peak memory: %.3f MB\n", (double)MEM_get_peak_memory() / (1024.0 * 1024.0));
+
+	/* everything should have been freed */
+	if (MEM_get_memory_blocks_in_use() != 0 || MEM_get_memory_in_use() != 0) {
+		fprintf(stderr, "Not freed memory blocks: %u (%lu bytes)\n",
+		        MEM_get_memory_blocks_in_use(), (unsigned long)MEM_get_memory_in_use());
+		MEM_printmemlist();
+		error_status = 1;
+	}
+
+	for (i = 0; i < num_threads; i++)
+		pthread_mutex_destroy(&threads_data[i].handover_mutex);
+
+	free(threads);
+	free(threads_data);
+
+	return error_status;
+}
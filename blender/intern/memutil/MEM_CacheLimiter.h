@@ -55,12 +55,22 @@
  *     h->unref();
  *
  *     leave image in cache.
+ *
+ * The size of every element is measured when it is inserted or touched,
+ * so the total size is known without walking the cache. Elements are
+ * spread over a number of shards, each with its own lock, LRU queue and
+ * priority heap, so that multiple threads can insert and touch elements
+ * without serializing on a single lock.
  */
 
 #include <list>
-#include <queue>
 #include <vector>
+#include <pthread.h>
 #include "MEM_Allocator.h"
+#include "atomic/atomic_ops.h"
+
+/* number of independently locked parts of a cache */
+#define MEM_CACHE_LIMITER_NUM_SHARDS 8
 
 template<class T>
 class MEM_CacheLimiter;
@@ -78,15 +88,20 @@ public:
 	explicit MEM_CacheLimiterHandle(T * data_,MEM_CacheLimiter<T> *parent_) :
 		data(data_),
 		refcount(0),
-		parent(parent_)
+		parent(parent_),
+		shard(0),
+		size(0),
+		priority(0),
+		stamp(0),
+		heap_index(-1)
 	{ }
 
 	void ref() {
-		refcount++;
+		parent->ref(this, 1);
 	}
 
 	void unref() {
-		refcount--;
+		parent->ref(this, -1);
 	}
 
 	T *get() {
@@ -106,13 +121,7 @@ public:
 	}
 
 	bool destroy_if_possible() {
-		if (can_destroy()) {
-			delete data;
-			data = NULL;
-			unmanage();
-			return true;
-		}
-		return false;
+		return parent->destroy_if_possible(this);
 	}
 
 	void unmanage() {
@@ -130,6 +139,16 @@ private:
 	int refcount;
 	typename std::list<MEM_CacheLimiterHandle<T> *, MEM_Allocator<MEM_CacheLimiterHandle<T> *> >::iterator me;
 	MEM_CacheLimiter<T> * parent;
+
+	/* shard this element lives in, and its size when last measured */
+	int shard;
+	size_t size;
+
+	/* destruction priority when last computed and insert or touch time,
+	 * lower values are destroyed first */
+	int priority;
+	unsigned int stamp;
+	int heap_index;
 };
 
 template<class T>
@@ -139,38 +158,101 @@ public:
 	typedef int    (*MEM_CacheLimiter_ItemPriority_Func) (void *item, int default_priority);
 
 	MEM_CacheLimiter(MEM_CacheLimiter_DataSize_Func getDataSize_)
-		: getDataSize(getDataSize_) {
+		: getDataSize(getDataSize_), getItemPriority(NULL), total_size(0), stamp(0) {
+		for (int i = 0; i < MEM_CACHE_LIMITER_NUM_SHARDS; i++) {
+			pthread_mutex_init(&shards[i].mutex, NULL);
+			shards[i].size = 0;
+			shards[i].heap_modified = 0;
+		}
 	}
 
 	~MEM_CacheLimiter() {
-		for (iterator it = queue.begin(); it != queue.end(); it++) {
-			delete *it;
+		for (int i = 0; i < MEM_CACHE_LIMITER_NUM_SHARDS; i++) {
+			MEM_CacheQueue& queue = shards[i].queue;
+
+			for (iterator it = queue.begin(); it != queue.end(); it++) {
+				delete *it;
+			}
+
+			pthread_mutex_destroy(&shards[i].mutex);
 		}
 	}
 
-	MEM_CacheLimiterHandle<T> *insert(T * elem) {
-		queue.push_back(new MEM_CacheLimiterHandle<T>(elem, this));
-		iterator it = queue.end();
-		--it;
-		queue.back()->me = it;
-		return queue.back();
+	MEM_CacheLimiterHandle<T> *insert(T * elem, int refcount = 0) {
+		MEM_CacheElementPtr handle = new MEM_CacheLimiterHandle<T>(elem, this);
+		int index = shard_index(elem);
+		Shard& shard = shards[index];
+
+		/* measure outside of the lock */
+		handle->shard = index;
+		handle->refcount = refcount;
+		handle->size = (getDataSize) ? getDataSize(elem->get_data()) : 0;
+
+		pthread_mutex_lock(&shard.mutex);
+
+		shard.queue.push_back(handle);
+		handle->me = shard.queue.end();
+		--handle->me;
+
+		add_size(shard, handle->size);
+
+		handle->stamp = atomic_add_u(&stamp, 1);
+		if (getItemPriority) {
+			handle->priority = item_priority(handle);
+			heap_push(shard, handle);
+			shard.heap_modified++;
+		}
+
+		pthread_mutex_unlock(&shard.mutex);
+
+		return handle;
 	}
 
 	void unmanage(MEM_CacheLimiterHandle<T> *handle) {
-		queue.erase(handle->me);
+		Shard& shard = shards[handle->shard];
+
+		pthread_mutex_lock(&shard.mutex);
+		remove(shard, handle);
+		pthread_mutex_unlock(&shard.mutex);
+
 		delete handle;
 	}
 
+	bool destroy_if_possible(MEM_CacheLimiterHandle<T> *handle) {
+		Shard& shard = shards[handle->shard];
+		bool destroyed = false;
+
+		pthread_mutex_lock(&shard.mutex);
+		if (handle->can_destroy()) {
+			destroy(shard, handle);
+			destroyed = true;
+		}
+		pthread_mutex_unlock(&shard.mutex);
+
+		if (destroyed)
+			delete handle;
+
+		return destroyed;
+	}
+
+	void ref(MEM_CacheLimiterHandle<T> *handle, int count) {
+		Shard& shard = shards[handle->shard];
+
+		pthread_mutex_lock(&shard.mutex);
+		handle->refcount += count;
+		pthread_mutex_unlock(&shard.mutex);
+	}
+
 	size_t get_memory_in_use() {
 		if (getDataSize)
-			return total_size();
+			return total_size;
 		else
 			return MEM_get_memory_in_use();
 	}
 
 	void enforce_limits() {
 		size_t max = MEM_CacheLimiter_get_maximum();
-		size_t mem_in_use, cur_size;
+		size_t mem_in_use;
 
 		if (max == 0) {
 			return;
@@ -178,40 +260,84 @@ public:
 
 		mem_in_use = get_memory_in_use();
 
-		if (mem_in_use <= max) {
-			return;
-		}
-
-		while (!queue.empty() && mem_in_use > max) {
-			MEM_CacheElementPtr elem = get_least_priority_destroyable_element();
+		while (mem_in_use > max) {
+			/* pick the shard with the lowest priority destroyable element,
+			 * other threads may change shards in the meantime, in which case
+			 * we still destroy the lowest priority element of that shard */
+			int best_shard = -1;
+			int best_priority = 0;
+			unsigned int best_age = 0;
+
+			for (int i = 0; i < MEM_CACHE_LIMITER_NUM_SHARDS; i++) {
+				Shard& shard = shards[i];
+
+				pthread_mutex_lock(&shard.mutex);
+				MEM_CacheElementPtr elem = get_least_priority_destroyable_element(shard);
+
+				if (elem) {
+					unsigned int age = stamp - elem->stamp;
+					int priority = (getItemPriority) ? elem->priority : 0;
+
+					if (best_shard == -1 || priority < best_priority ||
+					    (priority == best_priority && age > best_age))
+					{
+						best_shard = i;
+						best_priority = priority;
+						best_age = age;
+					}
+				}
+				pthread_mutex_unlock(&shard.mutex);
+			}
 
-			if (!elem)
+			if (best_shard == -1)
 				break;
 
-			if (getDataSize) {
-				cur_size = getDataSize(elem->get()->get_data());
-			}
-			else {
-				cur_size = mem_in_use;
-			}
+			Shard& shard = shards[best_shard];
+			MEM_CacheElementPtr elem;
 
-			if (elem->destroy_if_possible()) {
-				if (getDataSize) {
-					mem_in_use -= cur_size;
-				}
-				else {
-					mem_in_use -= cur_size - MEM_get_memory_in_use();
-				}
-			}
+			pthread_mutex_lock(&shard.mutex);
+			elem = get_least_priority_destroyable_element(shard);
+			if (elem)
+				destroy(shard, elem);
+			pthread_mutex_unlock(&shard.mutex);
+
+			if (elem)
+				delete elem;
+
+			mem_in_use = get_memory_in_use();
 		}
 	}
 
+	/* the handle itself must stay valid, callers make sure it is not
+	 * destroyed by enforce_limits from another thread meanwhile */
 	void touch(MEM_CacheLimiterHandle<T> * handle) {
-		queue.push_back(handle);
-		queue.erase(handle->me);
-		iterator it = queue.end();
-		--it;
-		handle->me = it;
+		Shard& shard = shards[handle->shard];
+		size_t size;
+
+		pthread_mutex_lock(&shard.mutex);
+
+		if (!handle->data) {
+			pthread_mutex_unlock(&shard.mutex);
+			return;
+		}
+
+		/* measure under the lock, the element may be destroyed otherwise */
+		size = (getDataSize) ? getDataSize(handle->data->get_data()) : 0;
+
+		shard.queue.splice(shard.queue.end(), shard.queue, handle->me);
+
+		/* size may have changed since insertion, for example by adding mipmaps */
+		sub_size(shard, handle->size);
+		handle->size = size;
+		add_size(shard, handle->size);
+
+		handle->stamp = atomic_add_u(&stamp, 1);
+		if (getItemPriority) {
+			handle->priority = item_priority(handle);
+			heap_update(shard, handle);
+		}
+
+		pthread_mutex_unlock(&shard.mutex);
 	}
 
 	void set_item_priority_func(MEM_CacheLimiter_ItemPriority_Func item_priority_func) {
@@ -221,52 +347,202 @@ public:
 private:
 	typedef MEM_CacheLimiterHandle<T> *MEM_CacheElementPtr;
 	typedef std::list<MEM_CacheElementPtr, MEM_Allocator<MEM_CacheElementPtr> > MEM_CacheQueue;
+	typedef std::vector<MEM_CacheElementPtr, MEM_Allocator<MEM_CacheElementPtr> > MEM_CacheHeap;
 	typedef typename MEM_CacheQueue::iterator iterator;
 
-	size_t total_size() {
-		size_t size = 0;
-		for (iterator it = queue.begin(); it != queue.end(); it++) {
-			size+= getDataSize((*it)->get()->get_data());
-		}
-		return size;
+	struct Shard {
+		pthread_mutex_t mutex;
+
+		/* least recently used element first */
+		MEM_CacheQueue queue;
+
+		/* binary min heap on priority, only used with an item priority
+		 * function. priorities depend on the state of the cache user and
+		 * change over time, they are recomputed after enough modifications */
+		MEM_CacheHeap heap;
+		size_t heap_modified;
+
+		size_t size;
+	};
+
+	int shard_index(T *elem) {
+		/* distribute by address, elements from the same cache are usually
+		 * allocated close together so mix the bits */
+		size_t h = (size_t)elem;
+		h ^= h >> 16;
+		h *= 0x45d9f3b;
+		h ^= h >> 16;
+		return (int)(h % MEM_CACHE_LIMITER_NUM_SHARDS);
+	}
+
+	void add_size(Shard& shard, size_t size) {
+		shard.size += size;
+		atomic_add_z(&total_size, size);
+	}
+
+	void sub_size(Shard& shard, size_t size) {
+		shard.size -= size;
+		atomic_sub_z(&total_size, size);
+	}
+
+	int item_priority(MEM_CacheElementPtr elem) {
+		/* by default 0 means highest priority element, older elements
+		 * have lower priority. casting to int is questionable, but unlikely
+		 * to cause problems */
+		int priority = -(int)(stamp - elem->stamp);
+		return getItemPriority(elem->get()->get_data(), priority);
+	}
+
+	/* remove from shard without deleting the handle, lock must be held */
+	void remove(Shard& shard, MEM_CacheElementPtr elem) {
+		shard.queue.erase(elem->me);
+		sub_size(shard, elem->size);
+
+		if (elem->heap_index != -1)
+			heap_remove(shard, elem);
+	}
+
+	void destroy(Shard& shard, MEM_CacheElementPtr elem) {
+		delete elem->data;
+		elem->data = NULL;
+		remove(shard, elem);
 	}
 
-	MEM_CacheElementPtr get_least_priority_destroyable_element(void) {
-		if (queue.empty())
+	MEM_CacheElementPtr get_least_priority_destroyable_element(Shard& shard) {
+		if (shard.queue.empty())
 			return NULL;
 
-		if (!getItemPriority)
-			return *queue.begin();
+		if (!getItemPriority) {
+			for (iterator it = shard.queue.begin(); it != shard.queue.end(); it++) {
+				if ((*it)->can_destroy())
+					return *it;
+			}
 
-		MEM_CacheElementPtr best_match_elem = NULL;
-		int best_match_priority = 0;
-		iterator it;
-		int i;
+			return NULL;
+		}
 
-		for (it = queue.begin(), i = 0; it != queue.end(); it++, i++) {
-			MEM_CacheElementPtr elem = *it;
+		if (shard.heap_modified > shard.heap.size() / 4)
+			heap_refresh(shard);
 
-			if (!elem->can_destroy())
-				continue;
+		/* elements in use are temporarily taken off the heap */
+		MEM_CacheElementPtr best_match_elem = NULL;
+		MEM_CacheHeap in_use;
 
-			/* by default 0 means highest priority element */
-			/* casting a size type to int is questionable,
-			   but unlikely to cause problems */
-			int priority = -((int)(queue.size()) - i - 1);
-			priority = getItemPriority(elem->get()->get_data(), priority);
+		while (!shard.heap.empty()) {
+			MEM_CacheElementPtr elem = shard.heap[0];
 
-			if (priority < best_match_priority || best_match_elem == NULL) {
-				best_match_priority = priority;
+			if (elem->can_destroy()) {
 				best_match_elem = elem;
+				break;
 			}
+
+			heap_remove(shard, elem);
+			in_use.push_back(elem);
 		}
 
+		for (size_t i = 0; i < in_use.size(); i++)
+			heap_push(shard, in_use[i]);
+
 		return best_match_elem;
 	}
 
-	MEM_CacheQueue queue;
+	/* Priority heap */
+
+	static bool heap_less(MEM_CacheElementPtr a, MEM_CacheElementPtr b) {
+		if (a->priority != b->priority)
+			return a->priority < b->priority;
+
+		/* older element first for equal priority */
+		return (int)(a->stamp - b->stamp) < 0;
+	}
+
+	void heap_set(Shard& shard, int index, MEM_CacheElementPtr elem) {
+		shard.heap[index] = elem;
+		elem->heap_index = index;
+	}
+
+	void heap_sift_up(Shard& shard, int index) {
+		MEM_CacheElementPtr elem = shard.heap[index];
+
+		while (index > 0) {
+			int parent_index = (index - 1) / 2;
+
+			if (!heap_less(elem, shard.heap[parent_index]))
+				break;
+
+			heap_set(shard, index, shard.heap[parent_index]);
+			index = parent_index;
+		}
+
+		heap_set(shard, index, elem);
+	}
+
+	void heap_sift_down(Shard& shard, int index) {
+		MEM_CacheElementPtr elem = shard.heap[index];
+		int size = (int)shard.heap.size();
+
+		while (true) {
+			int child = 2 * index + 1;
+
+			if (child >= size)
+				break;
+			if (child + 1 < size && heap_less(shard.heap[child + 1], shard.heap[child]))
+				child++;
+			if (!heap_less(shard.heap[child], elem))
+				break;
+
+			heap_set(shard, index, shard.heap[child]);
+			index = child;
+		}
+
+		heap_set(shard, index, elem);
+	}
+
+	void heap_push(Shard& shard, MEM_CacheElementPtr elem) {
+		shard.heap.push_back(elem);
+		heap_sift_up(shard, (int)shard.heap.size() - 1);
+	}
+
+	void heap_remove(Shard& shard, MEM_CacheElementPtr elem) {
+		int index = elem->heap_index;
+		MEM_CacheElementPtr last = shard.heap.back();
+
+		shard.heap.pop_back();
+		elem->heap_index = -1;
+
+		if (last != elem) {
+			heap_set(shard, index, last);
+			heap_sift_up(shard, index);
+			heap_sift_down(shard, last->heap_index);
+		}
+	}
+
+	void heap_update(Shard& shard, MEM_CacheElementPtr elem) {
+		heap_sift_up(shard, elem->heap_index);
+		heap_sift_down(shard, elem->heap_index);
+		shard.heap_modified++;
+	}
+
+	void heap_refresh(Shard& shard) {
+		int size = (int)shard.heap.size();
+
+		for (int i = 0; i < size; i++)
+			shard.heap[i]->priority = item_priority(shard.heap[i]);
+
+		for (int i = size / 2 - 1; i >= 0; i--)
+			heap_sift_down(shard, i);
+
+		shard.heap_modified = 0;
+	}
+
+	Shard shards[MEM_CACHE_LIMITER_NUM_SHARDS];
 	MEM_CacheLimiter_DataSize_Func getDataSize;
 	MEM_CacheLimiter_ItemPriority_Func getItemPriority;
+
+	/* sum of element sizes over all shards */
+	size_t total_size;
+	/* incremented on every insert and touch, to order elements by age */
+	unsigned int stamp;
 };
 
 #endif // __MEM_CACHELIMITER_H__
@@ -56,6 +56,9 @@ size_t MEM_CacheLimiter_get_maximum(void);
  * Create new MEM_CacheLimiter object
  * managed objects are destructed with the data_destructor
  *
+ * Objects may be inserted, touched and unmanaged from multiple threads,
+ * the data_destructor is called from whichever thread enforces limits.
+ *
  * @param data_destructor
  * @return A new MEM_CacheLimter object
  */
@@ -82,6 +85,17 @@ void delete_MEM_CacheLimiter(MEM_CacheLimiterC *This);
 
 MEM_CacheLimiterHandleC *MEM_CacheLimiter_insert(MEM_CacheLimiterC *This, void *data);
 
+/**
+ * Manage object with its reference counter already incremented, so that
+ * limits enforced from other threads can't destruct it before the caller
+ * is done with it and calls MEM_CacheLimiter_unref
+ *
+ * @param This "This" pointer, data data object to manage
+ * @return CacheLimiterHandle to ref, unref, touch the managed object
+ */
+
+MEM_CacheLimiterHandleC *MEM_CacheLimiter_insert_ref(MEM_CacheLimiterC *This, void *data);
+
 /**
  * Free objects until memory constraints are satisfied
  *
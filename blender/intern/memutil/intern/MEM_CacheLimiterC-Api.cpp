@@ -56,10 +56,11 @@ class MEM_CacheLimiterCClass {
 public:
 	MEM_CacheLimiterCClass(MEM_CacheLimiter_Destruct_Func data_destructor_, MEM_CacheLimiter_DataSize_Func data_size)
 		: data_destructor(data_destructor_), cache(data_size) {
+		pthread_mutex_init(&cclass_list_mutex, NULL);
 	}
 	~MEM_CacheLimiterCClass();
 
-	handle_t * insert(void *data);
+	handle_t * insert(void *data, int refcount);
 
 	void destruct(void *data, list_t::iterator it);
 
@@ -71,7 +72,9 @@ private:
 
 	MEM_CacheLimiter<MEM_CacheLimiterHandleCClass> cache;
 
+	/* cache shards are locked separately, so the list needs its own lock */
 	list_t cclass_list;
+	pthread_mutex_t cclass_list_mutex;
 };
 
 class MEM_CacheLimiterHandleCClass {
@@ -101,20 +104,27 @@ private:
 	list_t::iterator it;
 };
 
-handle_t *MEM_CacheLimiterCClass::insert(void *data)
+handle_t *MEM_CacheLimiterCClass::insert(void *data, int refcount)
 {
-	cclass_list.push_back(new MEM_CacheLimiterHandleCClass(data, this));
+	MEM_CacheLimiterHandleCClass *cclass_handle = new MEM_CacheLimiterHandleCClass(data, this);
+
+	pthread_mutex_lock(&cclass_list_mutex);
+	cclass_list.push_back(cclass_handle);
 	list_t::iterator it = cclass_list.end();
 	--it;
-	cclass_list.back()->set_iter(it);
+	cclass_handle->set_iter(it);
+	pthread_mutex_unlock(&cclass_list_mutex);
 
-	return cache.insert(cclass_list.back());
+	return cache.insert(cclass_handle, refcount);
 }
 
 void MEM_CacheLimiterCClass::destruct(void *data, list_t::iterator it)
 {
 	data_destructor(data);
+
+	pthread_mutex_lock(&cclass_list_mutex);
 	cclass_list.erase(it);
+	pthread_mutex_unlock(&cclass_list_mutex);
 }
 
 MEM_CacheLimiterHandleCClass::~MEM_CacheLimiterHandleCClass()
@@ -132,6 +142,8 @@ MEM_CacheLimiterCClass::~MEM_CacheLimiterCClass()
 
 		delete *it;
 	}
+
+	pthread_mutex_destroy(&cclass_list_mutex);
 }
 
 // ----------------------------------------------------------------------
@@ -159,7 +171,12 @@ void delete_MEM_CacheLimiter(MEM_CacheLimiterC *This)
 
 MEM_CacheLimiterHandleC *MEM_CacheLimiter_insert(MEM_CacheLimiterC *This, void *data)
 {
-	return (MEM_CacheLimiterHandleC *) cast(This)->insert(data);
+	return (MEM_CacheLimiterHandleC *) cast(This)->insert(data, 0);
+}
+
+MEM_CacheLimiterHandleC *MEM_CacheLimiter_insert_ref(MEM_CacheLimiterC *This, void *data)
+{
+	return (MEM_CacheLimiterHandleC *) cast(This)->insert(data, 1);
 }
 
 void MEM_CacheLimiter_enforce_limits(MEM_CacheLimiterC *This)
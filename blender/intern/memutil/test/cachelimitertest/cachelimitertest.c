@@ -0,0 +1,255 @@
+/**
+ * ***** BEGIN GPL LICENSE BLOCK *****
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * The Original Code is Copyright (C) 2013 by Blender Foundation.
+ * All rights reserved.
+ *
+ * The Original Code is: all of this file.
+ *
+ * Contributor(s): none yet.
+ *
+ * ***** END GPL LICENSE BLOCK *****
+ */
+
+/**
+ * Cache limiter stress test, inserting entries of random size from multiple
+ * threads the same way the movie cache does, with an item priority function
+ * set so eviction goes through the priority heap.
+ *
+ * Every thread keeps a few of its latest entries referenced and touches
+ * them, like a player holding frames while prefetching. Size accounting of
+ * the limiter is checked against the sizes of entries which were not
+ * destroyed yet, and to be within the limit once no entries are referenced.
+ */
+
+/* To compile run:
+ * g++ -O2 -c -I../../ -I../../../ ../../intern/MEM_CacheLimiterC-Api.cpp
+ * gcc -O2 -DWITH_GUARDEDALLOC -I../../ -I../../../ -I../../../guardedalloc/ -I../../../atomic/ cachelimitertest.c MEM_CacheLimiterC-Api.o ../../../guardedalloc/intern/mallocn*.c -lstdc++ -lpthread -o cachelimitertest
+ *
+ * Usage:
+ * cachelimitertest [num_threads] [num_entries]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "MEM_guardedalloc.h"
+#include "MEM_CacheLimiterC-Api.h"
+#include "atomic/atomic_ops.h"
+
+/* entries kept referenced by each thread */
+#define NUM_REFERENCED 8
+#define MAX_ENTRY_SIZE (64 * 1024)
+#define CACHE_LIMIT (64 * 1024 * 1024)
+
+typedef struct CacheEntry {
+	size_t size;
+	int frame;
+	MEM_CacheLimiterHandleC *handle;
+} CacheEntry;
+
+typedef struct ThreadData {
+	int index;
+	int num_entries;
+	unsigned int seed;
+} ThreadData;
+
+static MEM_CacheLimiterC *limiter;
+
+static pthread_mutex_t malloc_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* bytes and entries which were inserted and not destroyed yet */
+static size_t live_size = 0;
+static size_t live_entries = 0;
+
+static double time_dt(void)
+{
+	struct timeval now;
+	gettimeofday(&now, NULL);
+
+	return now.tv_sec + now.tv_usec * 1e-6;
+}
+
+static void lock_malloc_thread(void)
+{
+	pthread_mutex_lock(&malloc_mutex);
+}
+
+static void unlock_malloc_thread(void)
+{
+	pthread_mutex_unlock(&malloc_mutex);
+}
+
+static unsigned int random_next(unsigned int *seed)
+{
+	*seed = *seed * 1103515245u + 12345u;
+	return (*seed >> 16) & 0x7fff;
+}
+
+static void entry_destructor(void *data)
+{
+	CacheEntry *entry = data;
+
+	atomic_sub_z(&live_size, entry->size);
+	atomic_sub_z(&live_entries, 1);
+
+	MEM_freeN(entry);
+}
+
+static size_t entry_size(void *data)
+{
+	CacheEntry *entry = data;
+
+	return entry->size;
+}
+
+static int entry_priority(void *data, int default_priority)
+{
+	CacheEntry *entry = data;
+
+	/* keep even frames a bit longer, similar to frames close to the current one */
+	return default_priority + ((entry->frame & 1) ? 0 : 16);
+}
+
+static void *thread_run(void *arg)
+{
+	ThreadData *data = arg;
+	CacheEntry *referenced[NUM_REFERENCED] = {NULL};
+	int i, j;
+
+	for (i = 0; i < data->num_entries; i++) {
+		CacheEntry *entry = MEM_mallocN(sizeof(CacheEntry), "cachelimitertest entry");
+		int slot = i % NUM_REFERENCED;
+
+		entry->size = 1 + random_next(&data->seed) * 2 % MAX_ENTRY_SIZE;
+		entry->frame = i;
+
+		atomic_add_z(&live_size, entry->size);
+		atomic_add_z(&live_entries, 1);
+
+		/* insert referenced, so it can't be destroyed by another thread
+		 * before we got the handle */
+		entry->handle = MEM_CacheLimiter_insert_ref(limiter, entry);
+		MEM_CacheLimiter_enforce_limits(limiter);
+
+		if (referenced[slot])
+			MEM_CacheLimiter_unref(referenced[slot]->handle);
+		referenced[slot] = entry;
+
+		/* touch entries still referenced, as a cache hit would */
+		for (j = 0; j < NUM_REFERENCED; j++)
+			if (referenced[j] && (random_next(&data->seed) & 3) == 0)
+				MEM_CacheLimiter_touch(referenced[j]->handle);
+	}
+
+	for (j = 0; j < NUM_REFERENCED; j++)
+		if (referenced[j])
+			MEM_CacheLimiter_unref(referenced[j]->handle);
+
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t *threads;
+	ThreadData *threads_data;
+	int num_threads = 4, num_entries = 100000, i;
+	double time_start, time_total;
+	size_t mem_in_use;
+	int error_status = 0;
+
+	if (argc > 1) num_threads = atoi(argv[1]);
+	if (argc > 2) num_entries = atoi(argv[2]);
+
+	if (num_threads < 1 || num_entries < 1) {
+		fprintf(stderr, "Usage: %s [num_threads] [num_entries]\n", argv[0]);
+		return 1;
+	}
+
+	/* as BLI_begin_threaded_malloc does */
+	MEM_set_lock_callback(lock_malloc_thread, unlock_malloc_thread);
+
+	MEM_CacheLimiter_set_maximum(CACHE_LIMIT);
+
+	limiter = new_MEM_CacheLimiter(entry_destructor, entry_size);
+	MEM_CacheLimiter_ItemPriority_Func_set(limiter, entry_priority);
+
+	threads = malloc(sizeof(pthread_t) * num_threads);
+	threads_data = calloc(num_threads, sizeof(ThreadData));
+
+	for (i = 0; i < num_threads; i++) {
+		threads_data[i].index = i;
+		/* total number of entries is split between threads */
+		threads_data[i].num_entries = num_entries / num_threads + (i < num_entries % num_threads);
+		threads_data[i].seed = 1 + i;
+	}
+
+	time_start = time_dt();
+
+	for (i = 0; i < num_threads; i++)
+		pthread_create(&threads[i], NULL, thread_run, &threads_data[i]);
+	for (i = 0; i < num_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	time_total = time_dt() - time_start;
+
+	printf("%d threads, %d entries: %.3f seconds, %.0f inserts per second\n",
+	       num_threads, num_entries, time_total, num_entries / time_total);
+
+	/* nothing referenced anymore, so the limit must be satisfiable */
+	MEM_CacheLimiter_enforce_limits(limiter);
+	mem_in_use = MEM_CacheLimiter_get_memory_in_use(limiter);
+
+	printf("cache memory in use: %.3f MB in %lu entries, limit %.3f MB\n",
+	       (double)mem_in_use / (1024.0 * 1024.0), (unsigned long)live_entries,
+	       (double)CACHE_LIMIT / (1024.0 * 1024.0));
+
+	if (mem_in_use != live_size) {
+		fprintf(stderr, "Accounted size %lu does not match size of cached entries %lu\n",
+		        (unsigned long)mem_in_use, (unsigned long)live_size);
+		error_status = 1;
+	}
+
+	if (mem_in_use > CACHE_LIMIT) {
+		fprintf(stderr, "Cache memory exceeds the limit\n");
+		error_status = 1;
+	}
+
+	/* everything should be destroyed with the smallest limit, zero means unlimited */
+	MEM_CacheLimiter_set_maximum(1);
+	MEM_CacheLimiter_enforce_limits(limiter);
+
+	if (live_entries != 0 || MEM_CacheLimiter_get_memory_in_use(limiter) != 0) {
+		fprintf(stderr, "Not destroyed entries: %lu\n", (unsigned long)live_entries);
+		error_status = 1;
+	}
+
+	delete_MEM_CacheLimiter(limiter);
+
+	if (MEM_get_memory_blocks_in_use() != 0) {
+		fprintf(stderr, "Not freed memory blocks: %u\n", MEM_get_memory_blocks_in_use());
+		MEM_printmemlist();
+		error_status = 1;
+	}
+
+	free(threads);
+	free(threads_data);
+
+	return error_status;
+}
@@ -122,6 +122,7 @@ void BLI_spin_end(SpinLock *spin);
 #define THREAD_LOCK_WRITE   2
 
 typedef pthread_rwlock_t ThreadRWMutex;
+#define BLI_RWLOCK_INITIALIZER  PTHREAD_RWLOCK_INITIALIZER
 
 void BLI_rw_mutex_init(ThreadRWMutex *mutex);
 void BLI_rw_mutex_end(ThreadRWMutex *mutex);
@@ -86,11 +86,11 @@ extern "C" {
  * All NodeOperation has a setting for their render-priority, but only for output NodeOperation these have effect.
  * In ExecutionSystem.execute all priorities are checked. For every priority the ExecutionGroup's are check if the
  * priority do match.
- * When match the ExecutionGroup will be executed (this happens in serial)
+ * When match the ExecutionGroup's will be added to a TaskGraph, and all of them are executed at the same time.
  *
  * @see ExecutionSystem.execute control of the Render priority
  * @see NodeOperation.getRenderPriority receive the render priority
- * @see ExecutionGroup.execute the main loop to execute a whole ExecutionGroup
+ * @see ExecutionSystem.executeGroups execute all ExecutionGroup's of a priority
  *
  * @section order Chunk order
  *
@@ -103,20 +103,20 @@ extern "C" {
  *  - [@ref OrderOfChunks.COM_TO_TOP_DOWN]: Start calculation from the bottom to the top of the image
  *  - [@ref OrderOfChunks.COM_TO_RULE_OF_THIRDS]: Experimental order based on 9 hot-spots in the image
  *
- * When the chunk-order is determined, the first few chunks will be checked if they can be scheduled.
+ * When the chunk-order is determined, the chunks are added to the TaskGraph in that order.
  * Chunks can have three states:
  *  - [@ref ChunkExecutionState.COM_ES_NOT_SCHEDULED]: Chunk is not yet scheduled, or dependencies are not met
  *  - [@ref ChunkExecutionState.COM_ES_SCHEDULED]: All dependencies are met, chunk is scheduled, but not finished
  *  - [@ref ChunkExecutionState.COM_ES_EXECUTED]: Chunk is finished
  *
- * @see ExecutionGroup.execute
+ * @see ExecutionGroup.addTasks
  * @see ViewerOperation.getChunkOrder
  * @see OrderOfChunks
  *
  * @section interest Area of interest
  * An ExecutionGroup can have dependencies to other ExecutionGroup's. Data passing from one ExecutionGroup to another
  * one are stored in 'chunks'.
- * If not all input chunks are available the chunk execution will not be scheduled.
+ * A chunk is not scheduled before all input chunks it needs are executed.
  * <pre>
  * +-------------------------------------+              +--------------------------------------+
  * | ExecutionGroup A                    |              | ExecutionGroup B                     |
@@ -140,12 +140,10 @@ extern "C" {
  * </pre>
  *
  * In the above example ExecutionGroup B has an outputoperation (ViewerOperation) and is being executed.
- * The first chunk is evaluated [@ref ExecutionGroup.scheduleChunkWhenPossible],
- * but not all input chunks are available. The relevant ExecutionGroup (that can calculate the missing chunks;
- * ExecutionGroup A) is asked to calculate the area ExecutionGroup B is missing.
- * [@ref ExecutionGroup.scheduleAreaWhenPossible]
- * ExecutionGroup B checks what chunks the area spans, and tries to schedule these chunks.
- * If all input data is available these chunks are scheduled [@ref ExecutionGroup.scheduleChunk]
+ * A ChunkTask is added for the first chunk [@ref ExecutionGroup.addChunkTask].
+ * The relevant ExecutionGroup (that can calculate the input chunks; ExecutionGroup A) is asked to add
+ * the area ExecutionGroup B needs [@ref ExecutionGroup.addAreaTasks].
+ * ExecutionGroup A checks what chunks the area spans, and adds the tasks of these chunks as dependencies.
  *
  * <pre>
  *
@@ -154,35 +152,33 @@ extern "C" {
  * +-------------------------+        | (B)            |                           | (A)            |
  *            O                       +----------------+                           +----------------+
  *            O                                |                                            |
- *            O       ExecutionGroup.execute   |                                            |
+ *            O       ExecutionGroup.addTasks  |                                            |
  *            O------------------------------->O                                            |
  *            .                                O                                            |
  *            .                                O-------\                                    |
- *            .                                .       | ExecutionGroup.scheduleChunkWhenPossible
+ *            .                                .       | ExecutionGroup.addChunkTask        |
  *            .                                .  O----/ (*)                                |
  *            .                                .  O                                         |
  *            .                                .  O                                         |
- *            .                                .  O  ExecutionGroup.scheduleAreaWhenPossible|
+ *            .                                .  O  ExecutionGroup.addAreaTasks            |
  *            .                                .  O---------------------------------------->O
- *            .                                .  .                                         O----------\ ExecutionGroup.scheduleChunkWhenPossible
+ *            .                                .  .                                         O----------\ ExecutionGroup.addChunkTask
  *            .                                .  .                                         .          | (*)
  *            .                                .  .                                         .  O-------/
  *            .                                .  .                                         .  O
- *            .                                .  .                                         .  O
- *            .                                .  .                                         .  O-------\ ExecutionGroup.scheduleChunk
- *            .                                .  .                                         .  .       |
- *            .                                .  .                                         .  .  O----/
- *            .                                .  .                                         .  O<=O
  *            .                                .  .                                         O<=O
- *            .                                .  .                                         O
  *            .                                .  O<========================================O
  *            .                                .  O                                         |
  *            .                                O<=O                                         |
- *            .                                O                                            |
- *            .                                O                                            |
+ *            O<===============================O                                            |
+ *            O                                |                                            |
+ *            O  TaskGraph.execute             |                                            |
  * </pre>
  *
- * This happens until all chunks of (ExecutionGroup B) are finished executing or the user break's the process.
+ * This happens for all chunks of (ExecutionGroup B). When the TaskGraph is executed the chunks without
+ * dependencies are scheduled [@ref ExecutionGroup.scheduleChunk]. Every other chunk is scheduled by the
+ * device thread that finishes the last chunk it depends on [@ref TaskGraph.taskFinished], until all chunks
+ * are finished executing or the user break's the process.
  *
  * NodeOperation like the ScaleOperation can influence the area of interest by reimplementing the
  * [@ref NodeOperation.determineAreaOfInterest] method
@@ -206,11 +202,11 @@ extern "C" {
  *
  * </pre>
  *
- * @see ExecutionGroup.execute Execute a complete ExecutionGroup. Halts until finished or breaked by user
- * @see ExecutionGroup.scheduleChunkWhenPossible Tries to schedule a single chunk,
- * checks if all input data is available. Can trigger dependant chunks to be calculated
- * @see ExecutionGroup.scheduleAreaWhenPossible Tries to schedule an area. This can be multiple chunks
- * (is called from [@ref ExecutionGroup.scheduleChunkWhenPossible])
+ * @see ExecutionGroup.addTasks Add all chunks of an output ExecutionGroup to a TaskGraph
+ * @see ExecutionGroup.addChunkTask Add a single chunk, with the input chunks it depends on
+ * @see ExecutionGroup.addAreaTasks Add the chunks of an area. This can be multiple chunks
+ * (is called from [@ref ExecutionGroup.addChunkTask])
+ * @see TaskGraph.execute Execute the chunks of a TaskGraph. Halts until finished or breaked by user
  * @see ExecutionGroup.scheduleChunk Schedule a chunk on the WorkScheduler
  * @see NodeOperation.determineDependingAreaOfInterest Influence the area of interest of a chunk.
  * @see WriteBufferOperation NodeOperation to write to a MemoryProxy/MemoryBuffer
@@ -318,6 +314,27 @@ extern "C" {
 void COM_execute(RenderData *rd, bNodeTree *editingtree, int rendering,
                  const ColorManagedViewSettings *viewSettings, const ColorManagedDisplaySettings *displaySettings);
 
+/**
+ * @brief Execute a node tree a number of times and print timing statistics to stdout.
+ * Used by the --compositor-benchmark command line option.
+ *
+ * Every iteration is a complete editing (not rendering) execution, the BufferCache is cleared
+ * before every iteration so all chunks are calculated again.
+ * Afterwards the number of calculated chunks per second, and the busy and idle time of every
+ * device are printed.
+ *
+ * @param rd [struct RenderData]
+ *   Render data for this composite, this won't always belong to a scene.
+ *
+ * @param editingtree [struct bNodeTree]
+ *   The node tree to benchmark, the progress and break callbacks of the tree are not used.
+ *
+ * @param iterations
+ *   number of times the node tree is executed
+ */
+void COM_benchmark(RenderData *rd, bNodeTree *editingtree, int iterations,
+                   const ColorManagedViewSettings *viewSettings, const ColorManagedDisplaySettings *displaySettings);
+
 /**
  * @brief Deinitialize the compositor caches and allocated memory.
  * Use COM_clearCaches to only free the caches.
@@ -36,6 +36,18 @@ typedef enum DataType {
 	COM_DT_COLOR   = 4
 } DataType;
 
+/**
+ * @brief how the channels of a MemoryBuffer are stored
+ * @see MemoryBuffer
+ * @ingroup Memory
+ */
+typedef enum MemoryBufferFormat {
+	/** @brief a float per channel, the number of channels depends on the DataType */
+	COM_MB_FLOAT      = 0,
+	/** @brief a half float per channel, only used for COM_DT_COLOR */
+	COM_MB_HALF_FLOAT = 1
+} MemoryBufferFormat;
+
 /**
  * @brief Possible quality settings
  * @see CompositorContext.quality
@@ -109,4 +121,13 @@ typedef enum OrderOfChunks {
 
 #define COM_BLUR_BOKEH_PIXELS 512
 
+// maximum number of bytes the BufferCache keeps between executions
+#define COM_BUFFER_CACHE_SIZE ((size_t)1024 * 1024 * 1024)
+
+// milliseconds between checks for a user break while a TaskGraph is executing
+#define COM_TASK_GRAPH_BREAK_INTERVAL 100
+
+// number of rows calculated at a time by buffer execution, between checks for a user break
+#define COM_BUFFER_EXECUTION_ROWS 16
+
 #endif  /* __COM_DEFINES_H__ */
@@ -0,0 +1,372 @@
+/*
+ * Copyright 2013, Blender Foundation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * Contributor: 
+ *		Jeroen Bakker 
+ *		Monique Dewanchand
+ */
+
+#include <string.h>
+#include <vector>
+
+#include "COM_BufferCache.h"
+#include "COM_MemoryBuffer.h"
+#include "COM_defines.h"
+
+#include "MEM_guardedalloc.h"
+
+extern "C" {
+#include "DNA_camera_types.h"
+#include "DNA_color_types.h"
+#include "DNA_genfile.h"
+#include "DNA_image_types.h"
+#include "DNA_node_types.h"
+#include "DNA_object_types.h"
+#include "DNA_scene_types.h"
+#include "DNA_sdna_types.h"
+#include "BKE_global.h"
+#include "BKE_image.h"
+#include "BKE_node.h"
+#include "IMB_imbuf_types.h"
+#include "RE_pipeline.h"
+}
+
+using namespace std;
+
+typedef struct BufferCacheEntry {
+	uint64_t key;
+	MemoryBuffer *buffer;
+	size_t size;
+	unsigned int lastUsage;
+} BufferCacheEntry;
+
+static vector<BufferCacheEntry> s_entries;
+static size_t s_cacheSize = 0;
+static unsigned int s_usage = 0;
+static SDNA *s_sdna = NULL;
+
+uint64_t BufferCache::hash(uint64_t key, const void *data, size_t size)
+{
+	/* FNV-1a */
+	const unsigned char *bytes = (const unsigned char *)data;
+	for (size_t i = 0; i < size; i++) {
+		key ^= bytes[i];
+		key *= 1099511628211ULL;
+	}
+	return key;
+}
+
+static uint64_t hash_pixels(uint64_t key, const void *data, size_t size)
+{
+	/* same as BufferCache.hash, a word at a time as images can be large */
+	const uint64_t *words = (const uint64_t *)data;
+	size_t numberOfWords = size / sizeof(uint64_t);
+	for (size_t i = 0; i < numberOfWords; i++) {
+		key ^= words[i];
+		key *= 1099511628211ULL;
+	}
+	return BufferCache::hash(key, words + numberOfWords, size - numberOfWords * sizeof(uint64_t));
+}
+
+static bool hash_image(uint64_t &key, Image *image, ImageUser *iuser)
+{
+	/* viewer and render result images are replaced while compositing and rendering */
+	if (image->type == IMA_TYPE_R_RESULT || image->type == IMA_TYPE_COMPOSITE) {
+		return false;
+	}
+
+	/* byte images are converted to linear float when read, with these settings, while the
+	 * stored pixels stay the same when they change */
+	const char *colorspace = image->colorspace_settings.name;
+	short alphaFlag = image->flag & IMA_IGNORE_ALPHA;
+	key = BufferCache::hash(key, colorspace, strlen(colorspace));
+	key = BufferCache::hash(key, &image->alpha_mode, sizeof(image->alpha_mode));
+	key = BufferCache::hash(key, &alphaFlag, sizeof(alphaFlag));
+
+	/* painting and scripts edit the pixels in place, without any change to the image or the
+	 * buffer pointers, so the pixels that are read are part of the key */
+	ImBuf *ibuf = BKE_image_acquire_ibuf(image, iuser, NULL);
+	if (ibuf) {
+		key = BufferCache::hash(key, &ibuf->x, sizeof(ibuf->x));
+		key = BufferCache::hash(key, &ibuf->y, sizeof(ibuf->y));
+		key = BufferCache::hash(key, &ibuf->channels, sizeof(ibuf->channels));
+		if (ibuf->rect_float) {
+			key = hash_pixels(key, ibuf->rect_float, sizeof(float) * ibuf->channels * ibuf->x * ibuf->y);
+		}
+		else if (ibuf->rect) {
+			key = hash_pixels(key, ibuf->rect, sizeof(unsigned int) * ibuf->x * ibuf->y);
+		}
+		if (ibuf->zbuf_float) {
+			key = hash_pixels(key, ibuf->zbuf_float, sizeof(float) * ibuf->x * ibuf->y);
+		}
+	}
+	BKE_image_release_ibuf(image, ibuf, NULL);
+
+	/* multilayer images are read from their render result */
+	if (image->rr) {
+		for (RenderLayer *rl = (RenderLayer *)image->rr->layers.first; rl; rl = rl->next) {
+			if (rl->rectf) {
+				key = hash_pixels(key, rl->rectf, sizeof(float) * 4 * rl->rectx * rl->recty);
+			}
+			for (RenderPass *rpass = (RenderPass *)rl->passes.first; rpass; rpass = rpass->next) {
+				if (rpass->rect) {
+					key = hash_pixels(key, rpass->rect, sizeof(float) * rpass->channels * rpass->rectx * rpass->recty);
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+static uint64_t hash_dna_struct(uint64_t key, SDNA *sdna, int structNumber, const char *data)
+{
+	/* hash member by member, pointers differ per copy of the tree and padding has no meaning */
+	const short *sp = sdna->structs[structNumber];
+	int numberOfMembers = sp[1];
+
+	sp += 2;
+	for (int a = 0; a < numberOfMembers; a++, sp += 2) {
+		const char *name = sdna->names[sp[1]];
+		int nameLength = strlen(name);
+		int arraySize = (name[nameLength - 1] == ']') ? DNA_elem_array_size(name, nameLength) : 1;
+
+		if (name[0] == '*' || (name[0] == '(' && name[1] == '*')) {
+			data += sdna->pointerlen * arraySize;
+			continue;
+		}
+
+		int size = sdna->typelens[sp[0]];
+		int memberStructNumber = DNA_struct_find_nr(sdna, sdna->types[sp[0]]);
+
+		if (memberStructNumber != -1) {
+			for (int i = 0; i < arraySize; i++) {
+				key = hash_dna_struct(key, sdna, memberStructNumber, data + i * size);
+			}
+		}
+		else if (strncmp(name, "pad", 3) != 0 && strncmp(name, "_pad", 4) != 0) {
+			key = BufferCache::hash(key, data, size * arraySize);
+		}
+		data += size * arraySize;
+	}
+	return key;
+}
+
+static uint64_t hash_curvemapping(uint64_t key, const CurveMapping *cumap)
+{
+	/* the storage itself holds pointers to the points, which differ per copy of the tree */
+	key = BufferCache::hash(key, &cumap->flag, sizeof(cumap->flag));
+	key = BufferCache::hash(key, &cumap->preset, sizeof(cumap->preset));
+	key = BufferCache::hash(key, &cumap->clipr, sizeof(cumap->clipr));
+	key = BufferCache::hash(key, cumap->black, sizeof(cumap->black));
+	key = BufferCache::hash(key, cumap->white, sizeof(cumap->white));
+	for (int a = 0; a < CM_TOT; a++) {
+		const CurveMap *cuma = &cumap->cm[a];
+		key = BufferCache::hash(key, &cuma->totpoint, sizeof(cuma->totpoint));
+		key = BufferCache::hash(key, &cuma->flag, sizeof(cuma->flag));
+		key = BufferCache::hash(key, cuma->ext_in, sizeof(cuma->ext_in));
+		key = BufferCache::hash(key, cuma->ext_out, sizeof(cuma->ext_out));
+		if (cuma->curve) {
+			key = BufferCache::hash(key, cuma->curve, sizeof(CurveMapPoint) * cuma->totpoint);
+		}
+	}
+	return key;
+}
+
+uint64_t BufferCache::hashNode(bNode *node)
+{
+	uint64_t key = 14695981039346656037ULL;
+
+	if (node == NULL) {
+		return key;
+	}
+
+	switch (node->type) {
+		/* these read data blocks that can be edited without the node tree being touched */
+		case CMP_NODE_TEXTURE:
+		case CMP_NODE_MOVIECLIP:
+		case CMP_NODE_STABILIZE2D:
+		case CMP_NODE_MOVIEDISTORTION:
+		case CMP_NODE_MASK:
+		case CMP_NODE_KEYINGSCREEN:
+		case CMP_NODE_TRACKPOS:
+		case CMP_NODE_PLANETRACKDEFORM:
+			return COM_BUFFER_CACHE_NO_KEY;
+		case CMP_NODE_DEFOCUS:
+			/* without a scene the camera of the scene being composited is used */
+			if (node->id == NULL) {
+				return COM_BUFFER_CACHE_NO_KEY;
+			}
+			break;
+	}
+
+	key = hash(key, &node->type, sizeof(node->type));
+	key = hash(key, &node->custom1, sizeof(node->custom1));
+	key = hash(key, &node->custom2, sizeof(node->custom2));
+	key = hash(key, &node->custom3, sizeof(node->custom3));
+	key = hash(key, &node->custom4, sizeof(node->custom4));
+	key = hash(key, &node->id, sizeof(node->id));
+
+	if (node->id) {
+		switch (GS(node->id->name)) {
+			case ID_IM:
+			{
+				ImageUser *iuser = (node->type == CMP_NODE_IMAGE) ? (ImageUser *)node->storage : NULL;
+				if (!hash_image(key, (Image *)node->id, iuser)) {
+					return COM_BUFFER_CACHE_NO_KEY;
+				}
+				break;
+			}
+			case ID_SCE:
+			{
+				Scene *scene = (Scene *)node->id;
+				if (node->type == CMP_NODE_R_LAYERS) {
+					/* the render result is replaced by every render */
+					Render *re = RE_GetRender(scene->id.name);
+					if (G.is_rendering) {
+						return COM_BUFFER_CACHE_NO_KEY;
+					}
+					if (re) {
+						RenderStats *stats = RE_GetStats(re);
+						key = hash(key, &stats->starttime, sizeof(stats->starttime));
+						key = hash(key, &stats->lastframetime, sizeof(stats->lastframetime));
+					}
+				}
+				/* defocus reads the lens of the active camera */
+				if (scene->camera && scene->camera->type == OB_CAMERA) {
+					Camera *camera = (Camera *)scene->camera->data;
+					key = hash(key, &camera->type, offsetof(Camera, ipo) - offsetof(Camera, type));
+					key = hash(key, &camera->sensor_fit, sizeof(camera->sensor_fit));
+					key = hash(key, scene->camera->obmat, sizeof(scene->camera->obmat));
+					if (camera->dof_ob) {
+						key = hash(key, camera->dof_ob->obmat, sizeof(camera->dof_ob->obmat));
+					}
+				}
+				break;
+			}
+		}
+	}
+
+	if (node->storage) {
+		const char *storageName = node->typeinfo->storagename;
+		if (strcmp(storageName, "CurveMapping") == 0) {
+			key = hash_curvemapping(key, (CurveMapping *)node->storage);
+		}
+		else {
+			/* the values of the storage are described by DNA */
+			int structNumber = -1;
+			if (storageName[0]) {
+				if (s_sdna == NULL) {
+					s_sdna = DNA_sdna_from_data(DNAstr, DNAlen, false);
+				}
+				structNumber = DNA_struct_find_nr(s_sdna, storageName);
+			}
+			if (structNumber == -1) {
+				return COM_BUFFER_CACHE_NO_KEY;
+			}
+			key = hash_dna_struct(key, s_sdna, structNumber, (const char *)node->storage);
+		}
+	}
+
+	for (bNodeSocket *sock = (bNodeSocket *)node->inputs.first; sock; sock = sock->next) {
+		if (sock->default_value) {
+			key = hash(key, sock->default_value, MEM_allocN_len(sock->default_value));
+		}
+	}
+
+	return (key == COM_BUFFER_CACHE_NO_KEY) ? 1 : key;
+}
+
+static void buffer_cache_remove(unsigned int index)
+{
+	BufferCacheEntry &entry = s_entries[index];
+	s_cacheSize -= entry.size;
+	s_entries.erase(s_entries.begin() + index);
+}
+
+MemoryBuffer *BufferCache::acquire(uint64_t key, unsigned int width, unsigned int height)
+{
+	for (unsigned int index = 0; index < s_entries.size(); index++) {
+		BufferCacheEntry &entry = s_entries[index];
+		if (entry.key == key &&
+		    entry.buffer->getWidth() == (int)width &&
+		    entry.buffer->getHeight() == (int)height)
+		{
+			MemoryBuffer *buffer = entry.buffer;
+			buffer_cache_remove(index);
+			return buffer;
+		}
+	}
+	return NULL;
+}
+
+void BufferCache::release(uint64_t key, MemoryBuffer *buffer)
+{
+	BufferCacheEntry entry;
+	unsigned int index;
+
+	entry.key = key;
+	entry.buffer = buffer;
+	entry.size = buffer->getMemorySize();
+	entry.lastUsage = ++s_usage;
+
+	if (entry.size > COM_BUFFER_CACHE_SIZE) {
+		delete buffer;
+		return;
+	}
+
+	for (index = 0; index < s_entries.size(); index++) {
+		if (s_entries[index].key == key) {
+			delete s_entries[index].buffer;
+			buffer_cache_remove(index);
+			break;
+		}
+	}
+
+	/* free least recently used buffers */
+	while (s_cacheSize + entry.size > COM_BUFFER_CACHE_SIZE) {
+		unsigned int oldest = 0;
+		for (index = 1; index < s_entries.size(); index++) {
+			if (s_entries[index].lastUsage < s_entries[oldest].lastUsage) {
+				oldest = index;
+			}
+		}
+		delete s_entries[oldest].buffer;
+		buffer_cache_remove(oldest);
+	}
+
+	s_entries.push_back(entry);
+	s_cacheSize += entry.size;
+}
+
+void BufferCache::clear()
+{
+	while (s_entries.size() > 0) {
+		delete s_entries.back().buffer;
+		s_entries.pop_back();
+	}
+	s_cacheSize = 0;
+}
+
+void BufferCache::deinitialize()
+{
+	clear();
+	if (s_sdna) {
+		DNA_sdna_free(s_sdna);
+		s_sdna = NULL;
+	}
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2013, Blender Foundation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * Contributor: 
+ *		Jeroen Bakker 
+ *		Monique Dewanchand
+ */
+
+#ifndef _COM_BufferCache_h
+#define _COM_BufferCache_h
+
+#include <stddef.h>
+#include "BLI_sys_types.h"
+
+struct bNode;
+class MemoryBuffer;
+
+/**
+ * @brief key of a buffer that must not be cached
+ * @ingroup Memory
+ */
+#define COM_BUFFER_CACHE_NO_KEY 0
+
+/**
+ * @brief keeps the buffers of WriteBufferOperation's between executions of the compositor.
+ *
+ * Buffers are identified by a key that is a hash of everything upstream of the
+ * WriteBufferOperation: the settings of the nodes, the unconnected input values,
+ * the pixels of the images read, the resolutions and the frame. When a node is edited only the keys downstream of it
+ * change, so the other buffers can be reused instead of being calculated again.
+ *
+ * The cache is only used from the thread executing the compositor, which holds the
+ * compositor mutex.
+ * @see ExecutionSystem.determineBufferCacheKeys
+ * @ingroup Memory
+ */
+class BufferCache {
+public:
+	/**
+	 * @brief add data to a key
+	 */
+	static uint64_t hash(uint64_t key, const void *data, size_t size);
+
+	/**
+	 * @brief hash the settings of a node
+	 * @note the result does not depend on the copy of the node tree being executed
+	 * @return COM_BUFFER_CACHE_NO_KEY when the output of the node can change without the node changing
+	 */
+	static uint64_t hashNode(struct bNode *node);
+
+	/**
+	 * @brief take a buffer out of the cache
+	 * @return the buffer, the caller becomes the owner, or NULL when not cached
+	 */
+	static MemoryBuffer *acquire(uint64_t key, unsigned int width, unsigned int height);
+
+	/**
+	 * @brief store a completely calculated buffer in the cache
+	 * @note the cache becomes the owner of the buffer, least recently used buffers
+	 * are freed to stay within COM_BUFFER_CACHE_SIZE
+	 */
+	static void release(uint64_t key, MemoryBuffer *buffer);
+
+	/**
+	 * @brief free all cached buffers
+	 */
+	static void clear();
+
+	/**
+	 * @brief free all cached buffers and the data used for hashing nodes
+	 */
+	static void deinitialize();
+};
+
+#endif
@@ -31,8 +31,20 @@
  * work are packaged as a WorkPackage instance.
  */
 class Device {
+private:
+	/**
+	 * @brief number of WorkPackages executed since the last resetStatistics
+	 */
+	unsigned int m_numberOfExecutedWorkPackages;
+
+	/**
+	 * @brief time spent executing WorkPackages since the last resetStatistics, in seconds
+	 */
+	double m_executionTime;
 
 public:
+	Device() { resetStatistics(); }
+
 	/**
 	 * @brief Declaration of the virtual destructor 
 	 * @note resolve warning gcc 4.7
@@ -55,6 +67,24 @@ public:
 	 */
 	virtual void execute(WorkPackage *work) = 0;
 
+	/**
+	 * @brief count an executed WorkPackage
+	 * @note only called from the thread of this device
+	 * @param executionTime the time it took to execute, in seconds
+	 */
+	void addExecutedWorkPackage(double executionTime) {
+		this->m_numberOfExecutedWorkPackages++;
+		this->m_executionTime += executionTime;
+	}
+
+	void resetStatistics() {
+		this->m_numberOfExecutedWorkPackages = 0;
+		this->m_executionTime = 0.0;
+	}
+
+	unsigned int getNumberOfExecutedWorkPackages() const { return this->m_numberOfExecutedWorkPackages; }
+	double getExecutionTime() const { return this->m_executionTime; }
+
 #ifdef WITH_CXX_GUARDEDALLOC
 	MEM_CXX_CLASS_ALLOC_FUNCS("COM:Device")
 #endif
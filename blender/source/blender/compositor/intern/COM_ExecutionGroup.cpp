@@ -34,6 +34,7 @@
 #include "COM_WriteBufferOperation.h"
 #include "COM_ReadBufferOperation.h"
 #include "COM_WorkScheduler.h"
+#include "COM_TaskGraph.h"
 #include "COM_ViewerOperation.h"
 #include "COM_ChunkOrder.h"
 #include "COM_ExecutionSystemHelper.h"
@@ -52,6 +53,7 @@ ExecutionGroup::ExecutionGroup()
 	this->m_isOutput = false;
 	this->m_complex = false;
 	this->m_chunkExecutionStates = NULL;
+	this->m_chunkTasks = NULL;
 	this->m_bTree = NULL;
 	this->m_height = 0;
 	this->m_width = 0;
@@ -62,6 +64,8 @@ ExecutionGroup::ExecutionGroup()
 	this->m_initialized = false;
 	this->m_openCL = false;
 	this->m_singleThreaded = false;
+	this->m_bufferExecution = false;
+	this->m_inputBuffersReleased = false;
 	this->m_chunksFinished = 0;
 	BLI_rcti_init(&this->m_viewerBorder, 0, 0, 0, 0);
 	this->m_executionStartTime = 0;
@@ -156,20 +160,33 @@ void ExecutionGroup::initExecution()
 	if (this->m_chunkExecutionStates != NULL) {
 		MEM_freeN(this->m_chunkExecutionStates);
 	}
+	if (this->m_chunkTasks != NULL) {
+		MEM_freeN(this->m_chunkTasks);
+	}
 	unsigned int index;
 	determineNumberOfChunks();
 
+	/* the buffer of the output operation was taken from the BufferCache, nothing to calculate */
+	NodeOperation *output = this->getOutputNodeOperation();
+	const bool cached = output->isWriteBufferOperation() && ((WriteBufferOperation *)output)->isCached();
+
 	this->m_chunkExecutionStates = NULL;
+	this->m_chunkTasks = NULL;
 	if (this->m_numberOfChunks != 0) {
 		this->m_chunkExecutionStates = (ChunkExecutionState *)MEM_mallocN(sizeof(ChunkExecutionState) * this->m_numberOfChunks, __func__);
 		for (index = 0; index < this->m_numberOfChunks; index++) {
-			this->m_chunkExecutionStates[index] = COM_ES_NOT_SCHEDULED;
+			this->m_chunkExecutionStates[index] = cached ? COM_ES_EXECUTED : COM_ES_NOT_SCHEDULED;
 		}
+		this->m_chunkTasks = (ChunkTask **)MEM_callocN(sizeof(ChunkTask *) * this->m_numberOfChunks, __func__);
 	}
 
 
 	unsigned int maxNumber = 0;
 
+	/* only groups writing to a buffer can skip the per pixel calls, the output
+	 * operation itself is the one collecting the region */
+	this->m_bufferExecution = !this->m_complex && output->isWriteBufferOperation();
+
 	for (index = 0; index < this->m_operations.size(); index++) {
 		NodeOperation *operation = this->m_operations[index];
 		if (operation->isReadBufferOperation()) {
@@ -177,10 +194,59 @@ void ExecutionGroup::initExecution()
 			this->m_cachedReadOperations.push_back(readOperation);
 			maxNumber = max(maxNumber, readOperation->getOffset());
 		}
+		if (index != 0 && !operation->isBufferExecution()) {
+			this->m_bufferExecution = false;
+		}
 	}
 	maxNumber++;
 	this->m_cachedMaxReadBufferOffset = maxNumber;
 
+	/* the buffers read by this group are kept until releaseInputBuffers */
+	vector<MemoryProxy *> memoryProxies;
+	this->determineDependingMemoryProxies(&memoryProxies);
+	for (index = 0; index < memoryProxies.size(); index++) {
+		MemoryProxy *memoryProxy = memoryProxies[index];
+		if (find(memoryProxies.begin(), memoryProxies.begin() + index, memoryProxy) == memoryProxies.begin() + index) {
+			memoryProxy->addConsumer();
+		}
+	}
+	this->m_inputBuffersReleased = false;
+
+}
+
+bool ExecutionGroup::isComplete() const
+{
+	if (this->m_chunkExecutionStates == NULL) {
+		return false;
+	}
+	for (unsigned int index = 0; index < this->m_numberOfChunks; index++) {
+		if (this->m_chunkExecutionStates[index] != COM_ES_EXECUTED) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void ExecutionGroup::releaseInputBuffers()
+{
+	vector<MemoryProxy *> memoryProxies;
+	unsigned int index;
+
+	if (this->m_inputBuffersReleased) {
+		return;
+	}
+	this->m_inputBuffersReleased = true;
+
+	this->determineDependingMemoryProxies(&memoryProxies);
+	for (index = 0; index < memoryProxies.size(); index++) {
+		MemoryProxy *memoryProxy = memoryProxies[index];
+		if (find(memoryProxies.begin(), memoryProxies.begin() + index, memoryProxy) != memoryProxies.begin() + index) {
+			continue;
+		}
+		if (memoryProxy->removeConsumer()) {
+			memoryProxy->getWriteBufferOperation()->releaseMemoryBuffer();
+		}
+	}
 }
 
 void ExecutionGroup::deinitExecution()
@@ -189,6 +255,10 @@ void ExecutionGroup::deinitExecution()
 		MEM_freeN(this->m_chunkExecutionStates);
 		this->m_chunkExecutionStates = NULL;
 	}
+	if (this->m_chunkTasks != NULL) {
+		MEM_freeN(this->m_chunkTasks);
+		this->m_chunkTasks = NULL;
+	}
 	this->m_numberOfChunks = 0;
 	this->m_numberOfXChunks = 0;
 	this->m_numberOfYChunks = 0;
@@ -224,13 +294,13 @@ void ExecutionGroup::determineNumberOfChunks()
 /**
  * this method is called for the top execution groups. containing the compositor node or the preview node or the viewer node)
  */
-void ExecutionGroup::execute(ExecutionSystem *graph)
+bool ExecutionGroup::addTasks(ExecutionSystem *graph, TaskGraph *taskGraph)
 {
 	CompositorContext &context = graph->getContext();
 	const bNodeTree *bTree = context.getbNodeTree();
-	if (this->m_width == 0 || this->m_height == 0) {return; } /// @note: break out... no pixels to calculate.
-	if (bTree->test_break && bTree->test_break(bTree->tbh)) {return; } /// @note: early break out for blur and preview nodes
-	if (this->m_numberOfChunks == 0) {return; } /// @note: early break out
+	if (this->m_width == 0 || this->m_height == 0) {return false; } /// @note: break out... no pixels to calculate.
+	if (bTree->test_break && bTree->test_break(bTree->tbh)) {return false; } /// @note: early break out for blur and preview nodes
+	if (this->m_numberOfChunks == 0) {return false; } /// @note: early break out
 	unsigned int chunkNumber;
 
 	this->m_executionStartTime = PIL_check_seconds_timer();
@@ -347,50 +417,16 @@ void ExecutionGroup::execute(ExecutionSystem *graph)
 	DebugInfo::execution_group_started(this);
 	DebugInfo::graphviz(graph);
 
-	bool breaked = false;
-	bool finished = false;
-	unsigned int startIndex = 0;
-	const int maxNumberEvaluated = BLI_system_thread_count() * 2;
-
-	while (!finished && !breaked) {
-		bool startEvaluated = false;
-		finished = true;
-		int numberEvaluated = 0;
-
-		for (index = startIndex; index < this->m_numberOfChunks && numberEvaluated < maxNumberEvaluated; index++) {
-			chunkNumber = chunkOrder[index];
-			int yChunk = chunkNumber / this->m_numberOfXChunks;
-			int xChunk = chunkNumber - (yChunk * this->m_numberOfXChunks);
-			const ChunkExecutionState state = this->m_chunkExecutionStates[chunkNumber];
-			if (state == COM_ES_NOT_SCHEDULED) {
-				scheduleChunkWhenPossible(graph, xChunk, yChunk);
-				finished = false;
-				startEvaluated = true;
-				numberEvaluated++;
-
-				if (bTree->update_draw)
-					bTree->update_draw(bTree->udh);
-			}
-			else if (state == COM_ES_SCHEDULED) {
-				finished = false;
-				startEvaluated = true;
-				numberEvaluated++;
-			}
-			else if (state == COM_ES_EXECUTED && !startEvaluated) {
-				startIndex = index + 1;
-			}
-		}
-
-		WorkScheduler::finish();
-
-		if (bTree->test_break && bTree->test_break(bTree->tbh)) {
-			breaked = true;
-		}
+	/* tasks without dependencies are scheduled in the order they are added */
+	for (index = 0; index < this->m_numberOfChunks; index++) {
+		chunkNumber = chunkOrder[index];
+		int yChunk = chunkNumber / this->m_numberOfXChunks;
+		int xChunk = chunkNumber - (yChunk * this->m_numberOfXChunks);
+		addChunkTask(taskGraph, xChunk, yChunk);
 	}
-	DebugInfo::execution_group_finished(this);
-	DebugInfo::graphviz(graph);
 
 	MEM_freeN(chunkOrder);
+	return true;
 }
 
 MemoryBuffer **ExecutionGroup::getInputBuffersOpenCL(int chunkNumber)
@@ -440,6 +476,9 @@ void ExecutionGroup::printBackgroundStats(void)
 
 	fprintf(stdout, "Mem:%.2fM (%.2fM, Peak %.2fM) ",
 	        megs_used_memory, mmap_used_memory, megs_peak_memory);
+	fprintf(stdout, "| Buffers %.2fM (Peak %.2fM) ",
+	        MemoryProxy::getBufferMemory() / (1024.0 * 1024.0),
+	        MemoryProxy::getPeakBufferMemory() / (1024.0 * 1024.0));
 
 	BLI_timestr(execution_time, timestr, sizeof(timestr));
 	printf("| Elapsed %s ", timestr);
@@ -477,6 +516,12 @@ void ExecutionGroup::finalizeChunkExecution(int chunkNumber, MemoryBuffer **memo
 		if (G.background)
 			printBackgroundStats();
 	}
+
+	/* last, once the task is finished the compositor can continue without this ExecutionGroup */
+	ChunkTask *task = this->m_chunkTasks[chunkNumber];
+	if (task) {
+		task->getTaskGraph()->taskFinished(task);
+	}
 }
 
 inline void ExecutionGroup::determineChunkRect(rcti *rect, const unsigned int xChunk, const unsigned int yChunk) const
@@ -516,10 +561,16 @@ MemoryBuffer *ExecutionGroup::allocateOutputBuffer(int chunkNumber, rcti *rect)
 }
 
 
-bool ExecutionGroup::scheduleAreaWhenPossible(ExecutionSystem *graph, rcti *area)
+void ExecutionGroup::addAreaTasks(TaskGraph *taskGraph, rcti *area, ChunkTask *dependent)
 {
+	ChunkTask *dependency;
+
 	if (this->m_singleThreaded) {
-		return scheduleChunkWhenPossible(graph, 0, 0);
+		dependency = addChunkTask(taskGraph, 0, 0);
+		if (dependency) {
+			taskGraph->addDependency(dependent, dependency);
+		}
+		return;
 	}
 	// find all chunks inside the rect
 	// determine minxchunk, minychunk, maxxchunk, maxychunk where x and y are chunknumbers
@@ -538,16 +589,14 @@ bool ExecutionGroup::scheduleAreaWhenPossible(ExecutionSystem *graph, rcti *area
 	maxxchunk = min_ii(maxxchunk, (int)m_numberOfXChunks);
 	maxychunk = min_ii(maxychunk, (int)m_numberOfYChunks);
 
-	bool result = true;
 	for (indexx = minxchunk; indexx < maxxchunk; indexx++) {
 		for (indexy = minychunk; indexy < maxychunk; indexy++) {
-			if (!scheduleChunkWhenPossible(graph, indexx, indexy)) {
-				result = false;
+			dependency = addChunkTask(taskGraph, indexx, indexy);
+			if (dependency) {
+				taskGraph->addDependency(dependent, dependency);
 			}
 		}
 	}
-
-	return result;
 }
 
 bool ExecutionGroup::scheduleChunk(unsigned int chunkNumber)
@@ -560,33 +609,35 @@ bool ExecutionGroup::scheduleChunk(unsigned int chunkNumber)
 	return false;
 }
 
-bool ExecutionGroup::scheduleChunkWhenPossible(ExecutionSystem *graph, int xChunk, int yChunk)
+ChunkTask *ExecutionGroup::addChunkTask(TaskGraph *taskGraph, int xChunk, int yChunk)
 {
 	if (xChunk < 0 || xChunk >= (int)this->m_numberOfXChunks) {
-		return true;
+		return NULL;
 	}
 	if (yChunk < 0 || yChunk >= (int)this->m_numberOfYChunks) {
-		return true;
+		return NULL;
 	}
 	int chunkNumber = yChunk * this->m_numberOfXChunks + xChunk;
 	// chunk is already executed
 	if (this->m_chunkExecutionStates[chunkNumber] == COM_ES_EXECUTED) {
-		return true;
+		return NULL;
 	}
 
-	// chunk is scheduled, but not executed
-	if (this->m_chunkExecutionStates[chunkNumber] == COM_ES_SCHEDULED) {
-		return false;
+	// chunk is already part of the graph
+	if (this->m_chunkTasks[chunkNumber]) {
+		return this->m_chunkTasks[chunkNumber];
 	}
 
-	// chunk is nor executed nor scheduled.
+	// chunk is nor executed nor in the graph.
+	ChunkTask *task = taskGraph->addTask(this, chunkNumber);
+	this->m_chunkTasks[chunkNumber] = task;
+
 	vector<MemoryProxy *> memoryProxies;
 	this->determineDependingMemoryProxies(&memoryProxies);
 
 	rcti rect;
 	determineChunkRect(&rect, xChunk, yChunk);
 	unsigned int index;
-	bool canBeExecuted = true;
 	rcti area;
 
 	for (index = 0; index < this->m_cachedReadOperations.size(); index++) {
@@ -597,20 +648,14 @@ bool ExecutionGroup::scheduleChunkWhenPossible(ExecutionSystem *graph, int xChun
 		ExecutionGroup *group = memoryProxy->getExecutor();
 
 		if (group != NULL) {
-			if (!group->scheduleAreaWhenPossible(graph, &area)) {
-				canBeExecuted = false;
-			}
+			group->addAreaTasks(taskGraph, &area, task);
 		}
 		else {
 			throw "ERROR";
 		}
 	}
 
-	if (canBeExecuted) {
-		scheduleChunk(chunkNumber);
-	}
-
-	return false;
+	return task;
 }
 
 void ExecutionGroup::determineDependingAreaOfInterest(rcti *input, ReadBufferOperation *readOperation, rcti *output)
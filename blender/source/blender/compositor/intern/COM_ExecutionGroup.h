@@ -54,6 +54,8 @@ typedef enum ChunkExecutionState {
 class MemoryProxy;
 class ReadBufferOperation;
 class Device;
+class ChunkTask;
+class TaskGraph;
 
 /**
  * @brief Class ExecutionGroup is a group of NodeOperations that are executed as one.
@@ -120,6 +122,18 @@ private:
 	 * @brief Is this Execution group SingleThreaded
 	 */
 	bool m_singleThreaded;
+
+	/**
+	 * @brief can all operations of this ExecutionGroup calculate a whole chunk in a single call
+	 * @see NodeOperation.executeBuffer
+	 */
+	bool m_bufferExecution;
+
+	/**
+	 * @brief this ExecutionGroup is done reading the buffers of the MemoryProxy's it depends on
+	 * @see releaseInputBuffers
+	 */
+	bool m_inputBuffersReleased;
 	
 	/**
 	 * @brief what is the maximum number field of all ReadBufferOperation in this ExecutionGroup.
@@ -150,6 +164,11 @@ private:
 	 *   - COM_ES_EXECUTED: executed
 	 */
 	ChunkExecutionState *m_chunkExecutionStates;
+
+	/**
+	 * @brief the ChunkTask of every chunk in the TaskGraph being executed, NULL for chunks not in the graph
+	 */
+	ChunkTask **m_chunkTasks;
 	
 	/**
 	 * @brief indicator when this ExecutionGroup has valid NodeOperations in its vector for Execution
@@ -203,34 +222,22 @@ private:
 	void determineNumberOfChunks();
 	
 	/**
-	 * @brief try to schedule a specific chunk.
-	 * @note scheduling succeeds when all input requirements are met and the chunks hasn't been scheduled yet.
-	 * @param graph
+	 * @brief add the task of a specific chunk to a TaskGraph, together with the tasks of the input chunks it needs.
+	 * @param taskGraph
 	 * @param xChunk
 	 * @param yChunk
-	 * @return [true:false]
-	 * true: package(s) are scheduled
-	 * false: scheduling is deferred (depending workpackages are scheduled)
+	 * @return the task of the chunk, NULL when the chunk does not exist or is already executed
 	 */
-	bool scheduleChunkWhenPossible(ExecutionSystem *graph, int xChunk, int yChunk);
+	ChunkTask *addChunkTask(TaskGraph *taskGraph, int xChunk, int yChunk);
 
 	/**
-	 * @brief try to schedule a specific area.
-	 * @note Check if a certain area is available, when not available this are will be checked.
+	 * @brief add the tasks of the chunks overlapping a specific area to a TaskGraph.
 	 * @note This method is called from other ExecutionGroup's.
-	 * @param graph
-	 * @param rect
-	 * @return [true:false]
-	 * true: package(s) are scheduled
-	 * false: scheduling is deferred (depending workpackages are scheduled)
-	 */
-	bool scheduleAreaWhenPossible(ExecutionSystem *graph, rcti *rect);
-
-	/**
-	 * @brief add a chunk to the WorkScheduler.
-	 * @param chunknumber
+	 * @param taskGraph
+	 * @param rect the area needed by dependent
+	 * @param dependent the task of the other ExecutionGroup reading the area
 	 */
-	bool scheduleChunk(unsigned int chunkNumber);
+	void addAreaTasks(TaskGraph *taskGraph, rcti *rect, ChunkTask *dependent);
 	
 	/**
 	 * @brief determine the area of interest of a certain input area
@@ -303,6 +310,17 @@ public:
 	 * @brief does this ExecutionGroup contains a complex NodeOperation
 	 */
 	const bool isComplex() const;
+
+	/**
+	 * @brief are chunks of this ExecutionGroup calculated a whole region at a time
+	 * @note only valid after initExecution
+	 */
+	const bool isBufferExecution() const { return this->m_bufferExecution; }
+
+	/**
+	 * @brief have all chunks of this ExecutionGroup been calculated
+	 */
+	bool isComplete() const;
 	
 	
 	/**
@@ -367,20 +385,37 @@ public:
 	
 	
 	/**
-	 * @brief schedule an ExecutionGroup
-	 * @note this method will return when all chunks have been calculated, or the execution has breaked (by user)
+	 * @brief add the chunks of an output ExecutionGroup to a TaskGraph
+	 * @note the chunks will be calculated when the TaskGraph is executed
 	 *
 	 * first the order of the chunks will be determined. This is determined by finding the ViewerOperation and get the relevant information from it.
 	 *   - ChunkOrdering
 	 *   - CenterX
 	 *   - CenterY
 	 *
-	 * After determining the order of the chunks the chunks will be scheduled
+	 * After determining the order of the chunks the tasks of the chunks and the input chunks they depend on are added.
 	 *
 	 * @see ViewerOperation
 	 * @param system
+	 * @param taskGraph
+	 * @return [true:false]
+	 * true: tasks are added
+	 * false: there is nothing to calculate, or the execution has breaked (by user)
+	 */
+	bool addTasks(ExecutionSystem *system, TaskGraph *taskGraph);
+
+	/**
+	 * @brief add a chunk to the WorkScheduler.
+	 * @note called by the TaskGraph when all chunks it depends on are executed
+	 * @param chunknumber
 	 */
-	void execute(ExecutionSystem *system);
+	bool scheduleChunk(unsigned int chunkNumber);
+
+	/**
+	 * @brief set the ChunkTask of a chunk
+	 * @see TaskGraph
+	 */
+	void setChunkTask(unsigned int chunkNumber, ChunkTask *task) { this->m_chunkTasks[chunkNumber] = task; }
 	
 	/**
 	 * @brief this method determines the MemoryProxy's where this execution group depends on.
@@ -389,6 +424,18 @@ public:
 	 * @param memoryProxies result
 	 */
 	void determineDependingMemoryProxies(vector<MemoryProxy *> *memoryProxies);
+
+	/**
+	 * @brief tell the MemoryProxy's this ExecutionGroup depends on that it is done reading them.
+	 * Buffers no other ExecutionGroup has to read are freed right away instead of at deinitExecution.
+	 * @note must be called from the thread executing the compositor when the ExecutionGroup is complete
+	 */
+	void releaseInputBuffers();
+
+	/**
+	 * @brief has releaseInputBuffers been called during this execution
+	 */
+	bool isInputBuffersReleased() const { return this->m_inputBuffersReleased; }
 	
 	/**
 	 * @brief Determine the rect (minx, maxx, miny, maxy) of a chunk.
@@ -20,6 +20,9 @@
  *		Monique Dewanchand
  */
 
+#include <string.h>
+#include <typeinfo>
+
 #include "COM_ExecutionSystem.h"
 
 #include "PIL_time.h"
@@ -33,12 +36,17 @@ extern "C" {
 #include "COM_ExecutionGroup.h"
 #include "COM_NodeBase.h"
 #include "COM_WorkScheduler.h"
+#include "COM_TaskGraph.h"
 #include "COM_ReadBufferOperation.h"
 #include "COM_GroupNode.h"
 #include "COM_WriteBufferOperation.h"
 #include "COM_ReadBufferOperation.h"
 #include "COM_ExecutionSystemHelper.h"
 #include "COM_Debug.h"
+#include "COM_BufferCache.h"
+#include "COM_SetValueOperation.h"
+#include "COM_SetColorOperation.h"
+#include "COM_SetVectorOperation.h"
 
 #include "BKE_global.h"
 
@@ -144,6 +152,9 @@ void ExecutionSystem::execute()
 	}
 	unsigned int index;
 
+	determineBufferFormats();
+	determineBufferCacheKeys();
+
 	for (index = 0; index < this->m_operations.size(); index++) {
 		NodeOperation *operation = this->m_operations[index];
 		operation->setbNodeTree(this->m_context.getbNodeTree());
@@ -161,6 +172,9 @@ void ExecutionSystem::execute()
 		executionGroup->setChunksize(this->m_context.getChunksize());
 		executionGroup->initExecution();
 	}
+	MemoryProxy::resetPeakBufferMemory();
+	/* groups taken from the BufferCache don't need their inputs */
+	releaseInputBuffers();
 
 	WorkScheduler::start(this->m_context);
 
@@ -183,18 +197,198 @@ void ExecutionSystem::execute()
 	}
 }
 
+void ExecutionSystem::releaseInputBuffers()
+{
+	unsigned int index;
+	for (index = 0; index < this->m_groups.size(); index++) {
+		ExecutionGroup *executionGroup = this->m_groups[index];
+		if (!executionGroup->isInputBuffersReleased() && executionGroup->isComplete()) {
+			executionGroup->releaseInputBuffers();
+		}
+	}
+}
+
 void ExecutionSystem::executeGroups(CompositorPriority priority)
 {
 	unsigned int index;
 	vector<ExecutionGroup *> executionGroups;
+	vector<ExecutionGroup *> startedGroups;
 	this->findOutputExecutionGroup(&executionGroups, priority);
 
+	/* the output groups of a priority are calculated together, chunks of one group
+	 * don't have to wait for the other groups to finish */
+	TaskGraph *taskGraph = new TaskGraph();
 	for (index = 0; index < executionGroups.size(); index++) {
 		ExecutionGroup *group = executionGroups[index];
-		group->execute(this);
+		if (group->addTasks(this, taskGraph)) {
+			startedGroups.push_back(group);
+		}
+	}
+
+	taskGraph->execute(this);
+	delete taskGraph;
+
+	for (index = 0; index < startedGroups.size(); index++) {
+		ExecutionGroup *group = startedGroups[index];
+		DebugInfo::execution_group_finished(group);
+		DebugInfo::graphviz(this);
 	}
 }
 
+void ExecutionSystem::determineBufferFormats()
+{
+	map<MemoryProxy *, bool> complexReaders;
+	unsigned int index;
+	/* half floats are precise enough for previews */
+	const bool useHalfFloat = !this->m_context.isRendering() &&
+	                          (this->m_context.getQuality() == COM_QUALITY_LOW || this->m_context.isFastCalculation());
+
+	for (index = 0; index < this->m_operations.size(); index++) {
+		NodeOperation *operation = this->m_operations[index];
+		if (operation->isWriteBufferOperation()) {
+			WriteBufferOperation *writeOperation = (WriteBufferOperation *)operation;
+			InputSocket *inputSocket = writeOperation->getInputSocket(0);
+			DataType datatype = COM_DT_COLOR;
+			if (inputSocket->isConnected()) {
+				datatype = inputSocket->getConnection()->getFromSocket()->getDataType();
+			}
+			writeOperation->getMemoryProxy()->setDataType(datatype);
+			writeOperation->getMemoryProxy()->setFormat(COM_MB_FLOAT);
+		}
+	}
+
+	/* complex operations access the floats of their input buffers directly */
+	for (index = 0; index < this->m_operations.size(); index++) {
+		NodeOperation *operation = this->m_operations[index];
+		if (!operation->isReadBufferOperation()) {
+			continue;
+		}
+		MemoryProxy *memoryProxy = ((ReadBufferOperation *)operation)->getMemoryProxy();
+		OutputSocket *outputSocket = operation->getOutputSocket();
+		for (unsigned int connectionIndex = 0; connectionIndex < outputSocket->getNumberOfConnections(); connectionIndex++) {
+			SocketConnection *connection = outputSocket->getConnection(connectionIndex);
+			NodeOperation *reader = (NodeOperation *)connection->getToNode();
+			if (!reader->isComplex()) {
+				continue;
+			}
+			complexReaders[memoryProxy] = true;
+			for (unsigned int inputIndex = 0; inputIndex < reader->getNumberOfInputSockets(); inputIndex++) {
+				if (reader->getInputSocket(inputIndex) == connection->getToSocket() &&
+				    !reader->canReadPackedBuffer(inputIndex))
+				{
+					memoryProxy->setDataType(COM_DT_COLOR);
+				}
+			}
+		}
+	}
+
+	if (useHalfFloat) {
+		for (index = 0; index < this->m_operations.size(); index++) {
+			NodeOperation *operation = this->m_operations[index];
+			if (operation->isWriteBufferOperation()) {
+				MemoryProxy *memoryProxy = ((WriteBufferOperation *)operation)->getMemoryProxy();
+				if (memoryProxy->getDataType() == COM_DT_COLOR && !complexReaders[memoryProxy]) {
+					memoryProxy->setFormat(COM_MB_HALF_FLOAT);
+				}
+			}
+		}
+	}
+}
+
+void ExecutionSystem::determineBufferCacheKeys()
+{
+	map<NodeOperation *, uint64_t> keys;
+	unsigned int index;
+
+	if (this->m_context.isRendering()) {
+		/* the render result has just been replaced, nothing cached can be reused */
+		BufferCache::clear();
+		return;
+	}
+
+	const int framenumber = this->m_context.getFramenumber();
+	const CompositorQuality quality = this->m_context.getQuality();
+	const bool fastcalculation = this->m_context.isFastCalculation();
+	uint64_t contextKey = BufferCache::hashNode(NULL);
+	contextKey = BufferCache::hash(contextKey, &framenumber, sizeof(framenumber));
+	contextKey = BufferCache::hash(contextKey, &quality, sizeof(quality));
+	contextKey = BufferCache::hash(contextKey, &fastcalculation, sizeof(fastcalculation));
+
+	for (index = 0; index < this->m_operations.size(); index++) {
+		NodeOperation *operation = this->m_operations[index];
+		if (operation->isWriteBufferOperation()) {
+			WriteBufferOperation *writeOperation = (WriteBufferOperation *)operation;
+			MemoryProxy *memoryProxy = writeOperation->getMemoryProxy();
+			uint64_t key = determineBufferCacheKey(writeOperation, contextKey, keys);
+			if (key != COM_BUFFER_CACHE_NO_KEY) {
+				/* a cached buffer must be stored the same way */
+				const DataType datatype = memoryProxy->getDataType();
+				const MemoryBufferFormat format = memoryProxy->getFormat();
+				key = BufferCache::hash(key, &datatype, sizeof(datatype));
+				key = BufferCache::hash(key, &format, sizeof(format));
+			}
+			writeOperation->setCacheKey(key);
+		}
+	}
+}
+
+uint64_t ExecutionSystem::determineBufferCacheKey(NodeOperation *operation, uint64_t contextKey, map<NodeOperation *, uint64_t> &keys)
+{
+	map<NodeOperation *, uint64_t>::iterator found = keys.find(operation);
+	if (found != keys.end()) {
+		return found->second;
+	}
+	/* guard against cycles */
+	keys[operation] = COM_BUFFER_CACHE_NO_KEY;
+
+	uint64_t key = contextKey;
+
+	if (operation->isReadBufferOperation()) {
+		ReadBufferOperation *readOperation = (ReadBufferOperation *)operation;
+		key = determineBufferCacheKey(readOperation->getMemoryProxy()->getWriteBufferOperation(), contextKey, keys);
+		keys[operation] = key;
+		return key;
+	}
+
+	/* operations added by conversions are defined by their type, resolution and inputs */
+	map<NodeOperation *, uint64_t>::iterator seed = this->m_bufferCacheSeeds.find(operation);
+	if (seed != this->m_bufferCacheSeeds.end()) {
+		if (seed->second == COM_BUFFER_CACHE_NO_KEY) {
+			return COM_BUFFER_CACHE_NO_KEY;
+		}
+		key = BufferCache::hash(key, &seed->second, sizeof(seed->second));
+	}
+
+	const char *type = typeid(*operation).name();
+	const unsigned int resolution[2] = {operation->getWidth(), operation->getHeight()};
+	key = BufferCache::hash(key, type, strlen(type));
+	key = BufferCache::hash(key, resolution, sizeof(resolution));
+
+	if (operation->isSetOperation()) {
+		float value[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+		operation->read(value, 0, 0, COM_PS_NEAREST);
+		key = BufferCache::hash(key, value, sizeof(value));
+	}
+
+	for (unsigned int index = 0; index < operation->getNumberOfInputSockets(); index++) {
+		InputSocket *inputSocket = operation->getInputSocket(index);
+		uint64_t inputKey = COM_BUFFER_CACHE_NO_KEY;
+		if (inputSocket->isConnected()) {
+			inputKey = determineBufferCacheKey((NodeOperation *)inputSocket->getConnection()->getFromNode(), contextKey, keys);
+			if (inputKey == COM_BUFFER_CACHE_NO_KEY) {
+				return COM_BUFFER_CACHE_NO_KEY;
+			}
+		}
+		key = BufferCache::hash(key, &inputKey, sizeof(inputKey));
+	}
+
+	if (key == COM_BUFFER_CACHE_NO_KEY) {
+		key = 1;
+	}
+	keys[operation] = key;
+	return key;
+}
+
 void ExecutionSystem::addOperation(NodeOperation *operation)
 {
 	ExecutionSystemHelper::addOperation(this->m_operations, operation);
@@ -287,9 +481,21 @@ void ExecutionSystem::convertToOperations()
 
 	for (index = 0; index < this->m_nodes.size(); index++) {
 		Node *node = (Node *)this->m_nodes[index];
+		unsigned int firstOperation = this->m_operations.size();
 		DebugInfo::node_to_operations(node);
 		node->convertToOperations(this, &this->m_context);
 
+		/* operations of one node are told apart by the order they were added in */
+		const uint64_t nodeKey = BufferCache::hashNode(node->getbNode());
+		for (unsigned int operationIndex = firstOperation; operationIndex < this->m_operations.size(); operationIndex++) {
+			uint64_t seed = COM_BUFFER_CACHE_NO_KEY;
+			if (nodeKey != COM_BUFFER_CACHE_NO_KEY) {
+				const unsigned int ordinal = operationIndex - firstOperation;
+				seed = BufferCache::hash(nodeKey, &ordinal, sizeof(ordinal));
+			}
+			this->m_bufferCacheSeeds[this->m_operations[operationIndex]] = seed;
+		}
+
 		debug_check_node_connections(node);
 	}
 
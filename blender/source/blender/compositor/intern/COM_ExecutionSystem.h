@@ -27,6 +27,8 @@ class ExecutionGroup;
 
 #include "DNA_color_types.h"
 #include "DNA_node_types.h"
+#include "BLI_sys_types.h"
+#include <map>
 #include <vector>
 #include "COM_Node.h"
 #include "COM_SocketConnection.h"
@@ -141,6 +143,12 @@ private:
 	 */
 	vector<SocketConnection *> m_connections;
 
+	/**
+	 * @brief hash of the settings of the node an operation was created for
+	 * @see BufferCache.hashNode
+	 */
+	map<NodeOperation *, uint64_t> m_bufferCacheSeeds;
+
 private: //methods
 	/**
 	 * @brief add ReadBufferOperation and WriteBufferOperation around an operation
@@ -239,6 +247,12 @@ public:
 	 */
 	vector<NodeOperation *>& getOperations() { return this->m_operations; }
 
+	/**
+	 * @brief free the buffers that complete ExecutionGroup's were the last to read
+	 * @see ExecutionGroup.releaseInputBuffers
+	 */
+	void releaseInputBuffers();
+
 private:
 
 	/**
@@ -247,8 +261,27 @@ private:
 	 */
 	void determineActualSocketDataTypes(vector<NodeBase *> &nodes);
 	
+	/**
+	 * @brief execute all output ExecutionGroup's of a priority in a single TaskGraph
+	 * @note this method will return when all chunks have been calculated, or the execution has breaked (by user)
+	 */
 	void executeGroups(CompositorPriority priority);
 
+	/**
+	 * @brief determine how every MemoryProxy stores its buffer.
+	 * Values and vectors are stored with fewer channels and colors as half floats in low quality,
+	 * unless a complex operation reading the buffer needs all channels as floats.
+	 * @see NodeOperation.canReadPackedBuffer
+	 */
+	void determineBufferFormats();
+
+	/**
+	 * @brief give every WriteBufferOperation the key of its buffer in the BufferCache
+	 * @see BufferCache
+	 */
+	void determineBufferCacheKeys();
+	uint64_t determineBufferCacheKey(NodeOperation *operation, uint64_t contextKey, map<NodeOperation *, uint64_t> &keys);
+
 #ifdef WITH_CXX_GUARDEDALLOC
 	MEM_CXX_CLASS_ALLOC_FUNCS("COM:ExecutionSystem")
 #endif
@@ -24,11 +24,123 @@
 #include "MEM_guardedalloc.h"
 //#include "BKE_global.h"
 
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
+typedef union FloatBits {
+	float f;
+	unsigned int u;
+} FloatBits;
+
+/* IEEE half float conversion, rounds to nearest even */
+static unsigned short float_to_half(float value)
+{
+	FloatBits f;
+	unsigned int sign;
+	unsigned short result;
+
+	f.f = value;
+	sign = f.u & 0x80000000u;
+	f.u ^= sign;
+
+	if (f.u >= ((127 + 16) << 23)) {
+		/* too large for a half float, inf or nan */
+		result = (f.u > (255u << 23)) ? 0x7e00 : 0x7c00;
+	}
+	else if (f.u < (113 << 23)) {
+		/* denormal or zero, let the float addition do the rounding */
+		FloatBits magic;
+		magic.u = ((127 - 15) + (23 - 10) + 1) << 23;
+		f.f += magic.f;
+		result = f.u - magic.u;
+	}
+	else {
+		const unsigned int mantissa_odd = (f.u >> 13) & 1;
+		f.u += ((unsigned int)(15 - 127) << 23) + 0xfff;
+		f.u += mantissa_odd;
+		result = f.u >> 13;
+	}
+	return result | (sign >> 16);
+}
+
+static float half_to_float(unsigned short value)
+{
+	const unsigned int shifted_exponent = 0x7c00 << 13;
+	FloatBits f;
+	unsigned int exponent;
+
+	f.u = (value & 0x7fff) << 13;
+	exponent = shifted_exponent & f.u;
+	f.u += (127 - 15) << 23;
+
+	if (exponent == shifted_exponent) {
+		/* inf or nan */
+		f.u += (128 - 16) << 23;
+	}
+	else if (exponent == 0) {
+		/* denormal or zero */
+		FloatBits magic;
+		magic.u = 113 << 23;
+		f.u += 1 << 23;
+		f.f -= magic.f;
+	}
+	f.u |= (value & 0x8000) << 16;
+	return f.f;
+}
+
+#ifdef __SSE2__
+/* converts 4 half floats at once, gives the same results as half_to_float */
+static __m128 half_to_float4(const unsigned short *value)
+{
+	const __m128i half = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)value), _mm_setzero_si128());
+	const __m128i exponent_mantissa = _mm_and_si128(half, _mm_set1_epi32(0x7fff));
+	const __m128i sign = _mm_slli_epi32(_mm_xor_si128(half, exponent_mantissa), 16);
+	/* scaling by 2^112 moves the exponent to the float range and normalizes denormals */
+	const __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(exponent_mantissa, 13)),
+	                                 _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23)));
+	const __m128i was_infnan = _mm_cmpgt_epi32(exponent_mantissa, _mm_set1_epi32(0x7bff));
+	const __m128 infnan_exponent = _mm_and_ps(_mm_castsi128_ps(was_infnan), _mm_castsi128_ps(_mm_set1_epi32(255 << 23)));
+	return _mm_or_ps(scaled, _mm_or_ps(_mm_castsi128_ps(sign), infnan_exponent));
+}
+#endif
+
+static void half_to_float_v4(float result[4], const unsigned short value[4])
+{
+#ifdef __SSE2__
+	_mm_storeu_ps(result, half_to_float4(value));
+#else
+	result[0] = half_to_float(value[0]);
+	result[1] = half_to_float(value[1]);
+	result[2] = half_to_float(value[2]);
+	result[3] = half_to_float(value[3]);
+#endif
+}
+
+static unsigned int memory_buffer_channels(DataType datatype)
+{
+	switch (datatype) {
+		case COM_DT_VALUE:
+			return 1;
+		case COM_DT_VECTOR:
+			return 3;
+		case COM_DT_COLOR:
+		default:
+			return COM_NUMBER_OF_CHANNELS;
+	}
+}
+
 unsigned int MemoryBuffer::determineBufferSize()
 {
 	return getWidth() * getHeight();
 }
 
+size_t MemoryBuffer::getMemorySize()
+{
+	const size_t channelSize = (this->m_format == COM_MB_HALF_FLOAT) ? sizeof(unsigned short) : sizeof(float);
+	return channelSize * determineBufferSize() * this->m_numberOfChannels;
+}
+
 int MemoryBuffer::getWidth() const
 {
 	return this->m_rect.xmax - this->m_rect.xmin;
@@ -38,14 +150,34 @@ int MemoryBuffer::getHeight() const
 	return this->m_rect.ymax - this->m_rect.ymin;
 }
 
+void MemoryBuffer::allocate(DataType datatype, MemoryBufferFormat format)
+{
+	BLI_assert(format == COM_MB_FLOAT || datatype == COM_DT_COLOR);
+	this->m_datatype = datatype;
+	this->m_format = format;
+	this->m_numberOfChannels = memory_buffer_channels(datatype);
+	this->m_buffer = NULL;
+	this->m_halfBuffer = NULL;
+	if (format == COM_MB_HALF_FLOAT) {
+		this->m_halfBuffer = (unsigned short *)MEM_mallocN(getMemorySize(), "COM_MemoryBuffer");
+	}
+	else {
+		this->m_buffer = (float *)MEM_mallocN(getMemorySize(), "COM_MemoryBuffer");
+	}
+}
+
 MemoryBuffer::MemoryBuffer(MemoryProxy *memoryProxy, unsigned int chunkNumber, rcti *rect)
 {
 	BLI_rcti_init(&this->m_rect, rect->xmin, rect->xmax, rect->ymin, rect->ymax);
 	this->m_memoryProxy = memoryProxy;
 	this->m_chunkNumber = chunkNumber;
-	this->m_buffer = (float *)MEM_mallocN(sizeof(float) * determineBufferSize() * COM_NUMBER_OF_CHANNELS, "COM_MemoryBuffer");
+	if (memoryProxy) {
+		this->allocate(memoryProxy->getDataType(), memoryProxy->getFormat());
+	}
+	else {
+		this->allocate(COM_DT_COLOR, COM_MB_FLOAT);
+	}
 	this->m_state = COM_MB_ALLOCATED;
-	this->m_datatype = COM_DT_COLOR;
 	this->m_chunkWidth = this->m_rect.xmax - this->m_rect.xmin;
 }
 
@@ -54,20 +186,19 @@ MemoryBuffer::MemoryBuffer(MemoryProxy *memoryProxy, rcti *rect)
 	BLI_rcti_init(&this->m_rect, rect->xmin, rect->xmax, rect->ymin, rect->ymax);
 	this->m_memoryProxy = memoryProxy;
 	this->m_chunkNumber = -1;
-	this->m_buffer = (float *)MEM_mallocN(sizeof(float) * determineBufferSize() * COM_NUMBER_OF_CHANNELS, "COM_MemoryBuffer");
+	this->allocate(COM_DT_COLOR, COM_MB_FLOAT);
 	this->m_state = COM_MB_TEMPORARILY;
-	this->m_datatype = COM_DT_COLOR;
 	this->m_chunkWidth = this->m_rect.xmax - this->m_rect.xmin;
 }
 MemoryBuffer *MemoryBuffer::duplicate()
 {
 	MemoryBuffer *result = new MemoryBuffer(this->m_memoryProxy, &this->m_rect);
-	memcpy(result->m_buffer, this->m_buffer, this->determineBufferSize() * COM_NUMBER_OF_CHANNELS * sizeof(float));
+	result->copyContentFrom(this);
 	return result;
 }
 void MemoryBuffer::clear()
 {
-	memset(this->m_buffer, 0, this->determineBufferSize() * COM_NUMBER_OF_CHANNELS * sizeof(float));
+	memset(this->m_format == COM_MB_HALF_FLOAT ? (void *)this->m_halfBuffer : (void *)this->m_buffer, 0, getMemorySize());
 }
 
 float *MemoryBuffer::convertToValueBuffer()
@@ -77,11 +208,19 @@ float *MemoryBuffer::convertToValueBuffer()
 
 	float *result = (float *)MEM_mallocN(sizeof(float) * size, __func__);
 
-	const float *fp_src = this->m_buffer;
-	float       *fp_dst = result;
+	float *fp_dst = result;
 
-	for (i = 0; i < size; i++, fp_dst++, fp_src += COM_NUMBER_OF_CHANNELS) {
-		*fp_dst = *fp_src;
+	if (this->m_format == COM_MB_HALF_FLOAT) {
+		const unsigned short *hp_src = this->m_halfBuffer;
+		for (i = 0; i < size; i++, fp_dst++, hp_src += this->m_numberOfChannels) {
+			*fp_dst = half_to_float(*hp_src);
+		}
+	}
+	else {
+		const float *fp_src = this->m_buffer;
+		for (i = 0; i < size; i++, fp_dst++, fp_src += this->m_numberOfChannels) {
+			*fp_dst = *fp_src;
+		}
 	}
 
 	return result;
@@ -89,16 +228,17 @@ float *MemoryBuffer::convertToValueBuffer()
 
 float MemoryBuffer::getMaximumValue()
 {
-	float result = this->m_buffer[0];
 	const unsigned int size = this->determineBufferSize();
 	unsigned int i;
+	float color[4];
 
-	const float *fp_src = this->m_buffer;
+	readElem(color, 0);
+	float result = color[0];
 
-	for (i = 0; i < size; i++, fp_src += COM_NUMBER_OF_CHANNELS) {
-		float value = *fp_src;
-		if (value > result) {
-			result = value;
+	for (i = 0; i < size; i++) {
+		readElem(color, i);
+		if (color[0] > result) {
+			result = color[0];
 		}
 	}
 
@@ -131,6 +271,96 @@ MemoryBuffer::~MemoryBuffer()
 		MEM_freeN(this->m_buffer);
 		this->m_buffer = NULL;
 	}
+	if (this->m_halfBuffer) {
+		MEM_freeN(this->m_halfBuffer);
+		this->m_halfBuffer = NULL;
+	}
+}
+
+void MemoryBuffer::readPackedElem(float result[4], int offset)
+{
+	if (this->m_format == COM_MB_HALF_FLOAT) {
+		half_to_float_v4(result, &this->m_halfBuffer[offset * COM_NUMBER_OF_CHANNELS]);
+	}
+	else {
+		const float *elem = &this->m_buffer[offset * this->m_numberOfChannels];
+		switch (this->m_numberOfChannels) {
+			case 1:
+				result[0] = elem[0];
+				result[1] = 0.0f;
+				result[2] = 0.0f;
+				result[3] = 0.0f;
+				break;
+			case 3:
+				copy_v3_v3(result, elem);
+				result[3] = 0.0f;
+				break;
+			default:
+				copy_v4_v4(result, elem);
+				break;
+		}
+	}
+}
+
+void MemoryBuffer::writeElem(int offset, const float color[4])
+{
+	if (this->m_format == COM_MB_HALF_FLOAT) {
+		unsigned short *elem = &this->m_halfBuffer[offset * COM_NUMBER_OF_CHANNELS];
+		elem[0] = float_to_half(color[0]);
+		elem[1] = float_to_half(color[1]);
+		elem[2] = float_to_half(color[2]);
+		elem[3] = float_to_half(color[3]);
+	}
+	else {
+		float *elem = &this->m_buffer[offset * this->m_numberOfChannels];
+		switch (this->m_numberOfChannels) {
+			case 1:
+				elem[0] = color[0];
+				break;
+			case 3:
+				copy_v3_v3(elem, color);
+				break;
+			default:
+				copy_v4_v4(elem, color);
+				break;
+		}
+	}
+}
+
+void MemoryBuffer::readRow(float *output, int x, int y, int width)
+{
+	const int offset = this->m_chunkWidth * (y - this->m_rect.ymin) + x - this->m_rect.xmin;
+	int i;
+
+	if (!this->isPacked()) {
+		memcpy(output, &this->m_buffer[offset * COM_NUMBER_OF_CHANNELS], sizeof(float) * width * COM_NUMBER_OF_CHANNELS);
+	}
+	else if (this->m_format == COM_MB_HALF_FLOAT) {
+		const unsigned short *input = &this->m_halfBuffer[offset * COM_NUMBER_OF_CHANNELS];
+		for (i = 0; i < width; i++, output += COM_NUMBER_OF_CHANNELS, input += COM_NUMBER_OF_CHANNELS) {
+			half_to_float_v4(output, input);
+		}
+	}
+	else {
+		for (i = 0; i < width; i++, output += COM_NUMBER_OF_CHANNELS) {
+			readPackedElem(output, offset + i);
+		}
+	}
+}
+
+void MemoryBuffer::writeRow(int x, int y, int width, const float *input)
+{
+	const int offset = this->m_chunkWidth * (y - this->m_rect.ymin) + x - this->m_rect.xmin;
+	int i;
+
+	if (!this->isPacked()) {
+		memcpy(&this->m_buffer[offset * COM_NUMBER_OF_CHANNELS], input, sizeof(float) * width * COM_NUMBER_OF_CHANNELS);
+	}
+	else {
+		for (i = 0; i < width; i++, input += COM_NUMBER_OF_CHANNELS) {
+			writeElem(offset + i, input);
+		}
+	}
 }
 
 void MemoryBuffer::copyContentFrom(MemoryBuffer *otherBuffer)
@@ -147,11 +377,30 @@ void MemoryBuffer::copyContentFrom(MemoryBuffer *otherBuffer)
 	int offset;
 	int otherOffset;
 
+	if (maxX <= minX) {
+		return;
+	}
+
+	if (this->m_format == otherBuffer->m_format && this->m_numberOfChannels == otherBuffer->m_numberOfChannels) {
+		const bool half = (this->m_format == COM_MB_HALF_FLOAT);
+		const size_t elemSize = (half ? sizeof(unsigned short) : sizeof(float)) * this->m_numberOfChannels;
+		char *data = half ? (char *)this->m_halfBuffer : (char *)this->m_buffer;
+		const char *otherData = half ? (const char *)otherBuffer->m_halfBuffer : (const char *)otherBuffer->m_buffer;
 
-	for (otherY = minY; otherY < maxY; otherY++) {
-		otherOffset = ((otherY - otherBuffer->m_rect.ymin) * otherBuffer->m_chunkWidth + minX - otherBuffer->m_rect.xmin) * COM_NUMBER_OF_CHANNELS;
-		offset = ((otherY - this->m_rect.ymin) * this->m_chunkWidth + minX - this->m_rect.xmin) * COM_NUMBER_OF_CHANNELS;
-		memcpy(&this->m_buffer[offset], &otherBuffer->m_buffer[otherOffset], (maxX - minX) * COM_NUMBER_OF_CHANNELS * sizeof(float));
+		for (otherY = minY; otherY < maxY; otherY++) {
+			otherOffset = (otherY - otherBuffer->m_rect.ymin) * otherBuffer->m_chunkWidth + minX - otherBuffer->m_rect.xmin;
+			offset = (otherY - this->m_rect.ymin) * this->m_chunkWidth + minX - this->m_rect.xmin;
+			memcpy(&data[offset * elemSize], &otherData[otherOffset * elemSize], (maxX - minX) * elemSize);
+		}
+	}
+	else {
+		/* convert through a row of full colors */
+		float *row = (float *)MEM_mallocN(sizeof(float) * (maxX - minX) * COM_NUMBER_OF_CHANNELS, __func__);
+		for (otherY = minY; otherY < maxY; otherY++) {
+			otherBuffer->readRow(row, minX, otherY, maxX - minX);
+			this->writeRow(minX, otherY, maxX - minX, row);
+		}
+		MEM_freeN(row);
 	}
 }
 
@@ -160,8 +409,29 @@ void MemoryBuffer::writePixel(int x, int y, const float color[4])
 	if (x >= this->m_rect.xmin && x < this->m_rect.xmax &&
 	    y >= this->m_rect.ymin && y < this->m_rect.ymax)
 	{
-		const int offset = (this->m_chunkWidth * (y - this->m_rect.ymin) + x - this->m_rect.xmin) * COM_NUMBER_OF_CHANNELS;
-		copy_v4_v4(&this->m_buffer[offset], color);
+		const int offset = this->m_chunkWidth * (y - this->m_rect.ymin) + x - this->m_rect.xmin;
+		writeElem(offset, color);
+	}
+}
+
+void MemoryBuffer::fill(const rcti *rect, const float value[4])
+{
+	int x, y;
+	if (this->isPacked()) {
+		for (y = rect->ymin; y < rect->ymax; y++) {
+			const int offset = this->m_chunkWidth * (y - this->m_rect.ymin) - this->m_rect.xmin;
+			for (x = rect->xmin; x < rect->xmax; x++) {
+				writeElem(offset + x, value);
+			}
+		}
+		return;
+	}
+	for (y = rect->ymin; y < rect->ymax; y++) {
+		float *buffer = getElem(rect->xmin, y);
+		for (x = rect->xmin; x < rect->xmax; x++) {
+			copy_v4_v4(buffer, value);
+			buffer += COM_NUMBER_OF_CHANNELS;
+		}
 	}
 }
 
@@ -170,8 +440,11 @@ void MemoryBuffer::addPixel(int x, int y, const float color[4])
 	if (x >= this->m_rect.xmin && x < this->m_rect.xmax &&
 	    y >= this->m_rect.ymin && y < this->m_rect.ymax)
 	{
-		const int offset = (this->m_chunkWidth * (y - this->m_rect.ymin) + x - this->m_rect.xmin) * COM_NUMBER_OF_CHANNELS;
-		add_v4_v4(&this->m_buffer[offset], color);
+		const int offset = this->m_chunkWidth * (y - this->m_rect.ymin) + x - this->m_rect.xmin;
+		float result[4];
+		readElem(result, offset);
+		add_v4_v4(result, color);
+		writeElem(offset, result);
 	}
 }
 
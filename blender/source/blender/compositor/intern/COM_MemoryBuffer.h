@@ -91,14 +91,30 @@ private:
 	 */
 	MemoryBufferState m_state;
 	
+	/**
+	 * @brief number of channels stored per pixel
+	 */
+	unsigned int m_numberOfChannels;
+
+	/**
+	 * @brief how the channels are stored
+	 */
+	MemoryBufferFormat m_format;
+
 	/**
 	 * @brief the actual float buffer/data
 	 */
 	float *m_buffer;
 
+	/**
+	 * @brief the data when stored as COM_MB_HALF_FLOAT
+	 */
+	unsigned short *m_halfBuffer;
+
 public:
 	/**
 	 * @brief construct new MemoryBuffer for a chunk
+	 * @note the datatype and format of the memoryProxy are used
 	 */
 	MemoryBuffer(MemoryProxy *memoryProxy, unsigned int chunkNumber, rcti *rect);
 	
@@ -120,8 +136,54 @@ public:
 	/**
 	 * @brief get the data of this MemoryBuffer
 	 * @note buffer should already be available in memory
+	 * @note there are getNumberOfChannels floats per pixel, half float buffers can only be accessed by read
+	 */
+	float *getBuffer()
+	{
+		BLI_assert(this->m_format == COM_MB_FLOAT);
+		return this->m_buffer;
+	}
+
+	/**
+	 * @brief get the number of channels stored per pixel
 	 */
-	float *getBuffer() { return this->m_buffer; }
+	unsigned int getNumberOfChannels() const { return this->m_numberOfChannels; }
+
+	/**
+	 * @brief get how the channels are stored
+	 */
+	MemoryBufferFormat getFormat() const { return this->m_format; }
+
+	/**
+	 * @brief are pixels stored differently than COM_NUMBER_OF_CHANNELS floats
+	 */
+	inline const bool isPacked() const
+	{
+		return this->m_numberOfChannels != COM_NUMBER_OF_CHANNELS || this->m_format != COM_MB_FLOAT;
+	}
+
+	/**
+	 * @brief get the data of the pixel at (x, y) in image space
+	 * @note no bounds checking is done, rows are continuous for the width of this buffer
+	 * @note only for buffers that are not packed
+	 */
+	inline float *getElem(int x, int y)
+	{
+		BLI_assert(!this->isPacked());
+		return &this->m_buffer[(this->m_chunkWidth * (y - this->m_rect.ymin) + x - this->m_rect.xmin) * COM_NUMBER_OF_CHANNELS];
+	}
+
+	/**
+	 * @brief read width pixels starting at (x, y) in image space, converted to COM_NUMBER_OF_CHANNELS floats
+	 * @note no bounds checking is done
+	 */
+	void readRow(float *output, int x, int y, int width);
+
+	/**
+	 * @brief write width pixels of COM_NUMBER_OF_CHANNELS floats starting at (x, y) in image space
+	 * @note no bounds checking is done
+	 */
+	void writeRow(int x, int y, int width, const float *input);
 	
 	/**
 	 * @brief after execution the state will be set to available by calling this method
@@ -175,8 +237,7 @@ public:
 		}
 		else {
 			wrap_pixel(x, y, extend_x, extend_y);
-			const int offset = (this->m_chunkWidth * y + x) * COM_NUMBER_OF_CHANNELS;
-			copy_v4_v4(result, &this->m_buffer[offset]);
+			readElem(result, this->m_chunkWidth * y + x);
 		}
 	}
 
@@ -185,10 +246,10 @@ public:
 	                        MemoryBufferExtend extend_y = COM_MB_CLIP)
 	{
 		wrap_pixel(x, y, extend_x, extend_y);
-		const int offset = (this->m_chunkWidth * y + x) * COM_NUMBER_OF_CHANNELS;
+		const int offset = this->m_chunkWidth * y + x;
 
 		BLI_assert(offset >= 0);
-		BLI_assert(offset < this->determineBufferSize() * COM_NUMBER_OF_CHANNELS);
+		BLI_assert(offset < this->determineBufferSize());
 		BLI_assert(!(extend_x == COM_MB_CLIP && (x < m_rect.xmin || x >= m_rect.xmax)) &&
 		           !(extend_y == COM_MB_CLIP && (y < m_rect.ymin || y >= m_rect.ymax)));
 
@@ -198,10 +259,16 @@ public:
 		           (int)(this->determineBufferSize() * COM_NUMBER_OF_CHANNELS));
 #endif
 
-		copy_v4_v4(result, &this->m_buffer[offset]);
+		readElem(result, offset);
 	}
 	
 	void writePixel(int x, int y, const float color[4]);
+
+	/**
+	 * @brief set all pixels of rect to the same value
+	 * @note rect must be inside this MemoryBuffer
+	 */
+	void fill(const rcti *rect, const float value[4]);
 	void addPixel(int x, int y, const float color[4]);
 	inline void readBilinear(float result[4], float x, float y,
 	                         MemoryBufferExtend extend_x = COM_MB_CLIP,
@@ -276,6 +343,11 @@ public:
 	 */
 	int getHeight() const;
 	
+	/**
+	 * @brief get the number of bytes allocated for the pixels of this MemoryBuffer
+	 */
+	size_t getMemorySize();
+	
 	/**
 	 * @brief clear the buffer. Make all pixels black transparent.
 	 */
@@ -289,6 +361,30 @@ public:
 private:
 	unsigned int determineBufferSize();
 
+	/**
+	 * @brief allocate the buffer for the datatype and format
+	 */
+	void allocate(DataType datatype, MemoryBufferFormat format);
+
+	/**
+	 * @brief read the pixel at offset (in pixels) from the start of the buffer
+	 */
+	inline void readElem(float result[4], int offset)
+	{
+		if (this->isPacked()) {
+			readPackedElem(result, offset);
+		}
+		else {
+			copy_v4_v4(result, &this->m_buffer[offset * COM_NUMBER_OF_CHANNELS]);
+		}
+	}
+	void readPackedElem(float result[4], int offset);
+
+	/**
+	 * @brief write the pixel at offset (in pixels) from the start of the buffer
+	 */
+	void writeElem(int offset, const float color[4]);
+
 #ifdef WITH_CXX_GUARDEDALLOC
 	MEM_CXX_CLASS_ALLOC_FUNCS("COM:MemoryBuffer")
 #endif
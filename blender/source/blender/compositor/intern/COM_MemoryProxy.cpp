@@ -22,11 +22,26 @@
 
 #include "COM_MemoryProxy.h"
 
+/* buffers are only allocated and freed by the thread executing the compositor */
+static size_t s_bufferMemory = 0;
+static size_t s_peakBufferMemory = 0;
+
+static void memory_proxy_add_memory(MemoryBuffer *buffer)
+{
+	s_bufferMemory += buffer->getMemorySize();
+	if (s_bufferMemory > s_peakBufferMemory) {
+		s_peakBufferMemory = s_bufferMemory;
+	}
+}
 
 MemoryProxy::MemoryProxy()
 {
 	this->m_writeBufferOperation = NULL;
 	this->m_executor = NULL;
+	this->m_buffer = NULL;
+	this->m_numberOfConsumers = 0;
+	this->m_datatype = COM_DT_COLOR;
+	this->m_format = COM_MB_FLOAT;
 }
 
 void MemoryProxy::allocate(unsigned int width, unsigned int height)
@@ -38,13 +53,54 @@ void MemoryProxy::allocate(unsigned int width, unsigned int height)
 	result.ymax = height;
 
 	this->m_buffer = new MemoryBuffer(this, 1, &result);
+	memory_proxy_add_memory(this->m_buffer);
+}
+
+void MemoryProxy::setBuffer(MemoryBuffer *buffer)
+{
+	this->m_buffer = buffer;
+	memory_proxy_add_memory(this->m_buffer);
 }
 
 void MemoryProxy::free()
 {
 	if (this->m_buffer) {
+		s_bufferMemory -= this->m_buffer->getMemorySize();
 		delete this->m_buffer;
 		this->m_buffer = NULL;
 	}
 }
 
+MemoryBuffer *MemoryProxy::detachBuffer()
+{
+	MemoryBuffer *buffer = this->m_buffer;
+	if (buffer) {
+		s_bufferMemory -= buffer->getMemorySize();
+	}
+	this->m_buffer = NULL;
+	return buffer;
+}
+
+bool MemoryProxy::removeConsumer()
+{
+	if (this->m_numberOfConsumers == 0) {
+		return false;
+	}
+	this->m_numberOfConsumers--;
+	return this->m_numberOfConsumers == 0;
+}
+
+size_t MemoryProxy::getBufferMemory()
+{
+	return s_bufferMemory;
+}
+
+size_t MemoryProxy::getPeakBufferMemory()
+{
+	return s_peakBufferMemory;
+}
+
+void MemoryProxy::resetPeakBufferMemory()
+{
+	s_peakBufferMemory = s_bufferMemory;
+}
@@ -50,7 +50,12 @@ private:
 	/**
 	 * @brief datatype of this MemoryProxy
 	 */
-	/* DataType m_datatype; */ /* UNUSED */
+	DataType m_datatype;
+
+	/**
+	 * @brief how the channels of the buffer are stored
+	 */
+	MemoryBufferFormat m_format;
 	
 	/**
 	 * @brief channel information of this buffer
@@ -62,6 +67,11 @@ private:
 	 */
 	MemoryBuffer *m_buffer;
 
+	/**
+	 * @brief number of ExecutionGroup's that still have to read the buffer
+	 */
+	unsigned int m_numberOfConsumers;
+
 public:
 	MemoryProxy();
 	
@@ -88,6 +98,18 @@ public:
 	 */
 	WriteBufferOperation *getWriteBufferOperation() { return this->m_writeBufferOperation; }
 
+	/**
+	 * @brief set the datatype of the buffer, determines the number of channels that are stored
+	 */
+	void setDataType(DataType datatype) { this->m_datatype = datatype; }
+	DataType getDataType() const { return this->m_datatype; }
+
+	/**
+	 * @brief set how the channels of the buffer are stored
+	 */
+	void setFormat(MemoryBufferFormat format) { this->m_format = format; }
+	MemoryBufferFormat getFormat() const { return this->m_format; }
+
 	/**
 	 * @brief allocate memory of size width x height
 	 */
@@ -103,6 +125,47 @@ public:
 	 */
 	inline MemoryBuffer *getBuffer() { return this->m_buffer; }
 
+	/**
+	 * @brief use a buffer calculated by an earlier execution, the MemoryProxy becomes the owner
+	 */
+	void setBuffer(MemoryBuffer *buffer);
+
+	/**
+	 * @brief detach the buffer from the MemoryProxy, the caller becomes the owner
+	 */
+	MemoryBuffer *detachBuffer();
+
+	/**
+	 * @brief forget all ExecutionGroup's reading the buffer
+	 */
+	void resetConsumers() { this->m_numberOfConsumers = 0; }
+
+	/**
+	 * @brief an ExecutionGroup will read the buffer
+	 */
+	void addConsumer() { this->m_numberOfConsumers++; }
+
+	/**
+	 * @brief an ExecutionGroup is done reading the buffer
+	 * @return true when no ExecutionGroup has to read the buffer anymore
+	 */
+	bool removeConsumer();
+
+	/**
+	 * @brief get the number of bytes of all buffers allocated by MemoryProxy's
+	 */
+	static size_t getBufferMemory();
+
+	/**
+	 * @brief get the highest number of bytes allocated by MemoryProxy's since resetPeakBufferMemory
+	 */
+	static size_t getPeakBufferMemory();
+
+	/**
+	 * @brief start measuring the peak memory usage
+	 */
+	static void resetPeakBufferMemory();
+
 #ifdef WITH_CXX_GUARDEDALLOC
 	MEM_CXX_CLASS_ALLOC_FUNCS("COM:MemoryProxy")
 #endif
@@ -36,6 +36,7 @@ NodeOperation::NodeOperation() : NodeBase()
 	this->m_height = 0;
 	this->m_isResolutionSet = false;
 	this->m_openCL = false;
+	this->m_bufferExecution = false;
 	this->m_btree = NULL;
 }
 
@@ -107,6 +108,30 @@ NodeOperation *NodeOperation::getInputOperation(unsigned int inputSocketIndex)
 	return this->getInputSocket(inputSocketIndex)->getOperation();
 }
 
+MemoryBuffer *NodeOperation::createInputBuffer(unsigned int inputSocketIndex, rcti *rect)
+{
+	MemoryBuffer *buffer = new MemoryBuffer(NULL, rect);
+	this->getInputOperation(inputSocketIndex)->readBuffer(buffer, rect);
+	return buffer;
+}
+
+void NodeOperation::readBuffer(MemoryBuffer *output, rcti *rect)
+{
+	if (this->isBufferExecution()) {
+		executeBuffer(output, rect);
+	}
+	else {
+		int x, y;
+		for (y = rect->ymin; y < rect->ymax; y++) {
+			float *buffer = output->getElem(rect->xmin, y);
+			for (x = rect->xmin; x < rect->xmax; x++) {
+				this->read(buffer, x, y, COM_PS_NEAREST);
+				buffer += COM_NUMBER_OF_CHANNELS;
+			}
+		}
+	}
+}
+
 void NodeOperation::getConnectedInputSockets(vector<InputSocket *> *sockets)
 {
 	vector<InputSocket *> &inputsockets = this->getInputSockets();
@@ -65,6 +65,12 @@ private:
 	 */
 	bool m_openCL;
 
+	/**
+	 * @brief can this operation calculate a whole region in a single call.
+	 * @see NodeOperation.executeBuffer
+	 */
+	bool m_bufferExecution;
+
 	/**
 	 * @brief mutex reference for very special node initializations
 	 * @note only use when you really know what you are doing.
@@ -140,6 +146,25 @@ public:
 	 */
 	virtual void executeRegion(rcti *rect, unsigned int chunkNumber) {}
 
+	/**
+	 * @brief calculate all pixels of a region in a single call
+	 * @note only called when isBufferExecution() is true, inputs are fetched with createInputBuffer
+	 * @ingroup execution
+	 * @param output the buffer to write to, must contain rect
+	 * @param rect the region to calculate in image space
+	 */
+	virtual void executeBuffer(MemoryBuffer *output, rcti *rect) {}
+
+	/**
+	 * @brief write the result of this operation for a region into output
+	 *
+	 * Uses executeBuffer when this operation supports it, otherwise the region is
+	 * calculated pixel by pixel.
+	 * @param output the buffer to write to, must contain rect
+	 * @param rect the region to calculate in image space
+	 */
+	void readBuffer(MemoryBuffer *output, rcti *rect);
+
 	/**
 	 * @brief when a chunk is executed by an OpenCLDevice, this method is called
 	 * @ingroup execution
@@ -200,6 +225,19 @@ public:
 	 */
 	const bool isComplex() const { return this->m_complex; }
 
+	/**
+	 * @brief can this operation calculate a whole region in one call
+	 * @see ExecutionGroup.isBufferExecution
+	 */
+	const bool isBufferExecution() const { return this->m_bufferExecution; }
+
+	/**
+	 * @brief can this complex operation access the MemoryBuffer of an input when it is stored
+	 * with fewer channels than COM_NUMBER_OF_CHANNELS
+	 * @see MemoryBuffer.getNumberOfChannels
+	 */
+	virtual bool canReadPackedBuffer(unsigned int inputSocketIndex) const { return false; }
+
 	virtual bool isSetOperation() const { return false; }
 
 	/**
@@ -266,6 +304,12 @@ protected:
 	SocketReader *getInputSocketReader(unsigned int inputSocketindex);
 	NodeOperation *getInputOperation(unsigned int inputSocketindex);
 
+	/**
+	 * @brief calculate an input of this operation for a region into a new temporarily MemoryBuffer
+	 * @note the caller is responsible for deleting the buffer
+	 */
+	MemoryBuffer *createInputBuffer(unsigned int inputSocketIndex, rcti *rect);
+
 	void deinitMutex();
 	void initMutex();
 	void lockMutex();
@@ -285,6 +329,11 @@ protected:
 	 */
 	void setOpenCL(bool openCL) { this->m_openCL = openCL; }
 
+	/**
+	 * @brief set if this NodeOperation implements executeBuffer
+	 */
+	void setBufferExecution(bool bufferExecution) { this->m_bufferExecution = bufferExecution; }
+
 #ifdef WITH_CXX_GUARDEDALLOC
 	MEM_CXX_CLASS_ALLOC_FUNCS("COM:NodeOperation")
 #endif
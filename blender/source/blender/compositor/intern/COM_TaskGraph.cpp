@@ -0,0 +1,166 @@
+/*
+ * Copyright 2013, Blender Foundation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * Contributor: 
+ *		Jeroen Bakker 
+ *		Monique Dewanchand
+ */
+
+#include "COM_TaskGraph.h"
+#include "COM_ExecutionGroup.h"
+#include "COM_ExecutionSystem.h"
+#include "COM_defines.h"
+
+extern "C" {
+#include "DNA_node_types.h"
+}
+
+ChunkTask::ChunkTask(TaskGraph *taskGraph, ExecutionGroup *group, unsigned int chunkNumber)
+{
+	this->m_taskGraph = taskGraph;
+	this->m_executionGroup = group;
+	this->m_chunkNumber = chunkNumber;
+	this->m_numberOfUnfinishedDependencies = 0;
+}
+
+TaskGraph::TaskGraph()
+{
+	BLI_mutex_init(&this->m_mutex);
+	this->m_finishedTasks = BLI_thread_queue_init();
+	this->m_numberOfScheduledTasks = 0;
+	this->m_numberOfFinishedTasks = 0;
+	this->m_breaked = false;
+}
+
+TaskGraph::~TaskGraph()
+{
+	unsigned int index;
+	for (index = 0; index < this->m_tasks.size(); index++) {
+		ChunkTask *task = this->m_tasks[index];
+		task->getExecutionGroup()->setChunkTask(task->getChunkNumber(), NULL);
+		delete task;
+	}
+	this->m_tasks.clear();
+	BLI_thread_queue_free(this->m_finishedTasks);
+	BLI_mutex_end(&this->m_mutex);
+}
+
+ChunkTask *TaskGraph::addTask(ExecutionGroup *group, unsigned int chunkNumber)
+{
+	ChunkTask *task = new ChunkTask(this, group, chunkNumber);
+	this->m_tasks.push_back(task);
+	return task;
+}
+
+void TaskGraph::addDependency(ChunkTask *task, ChunkTask *dependency)
+{
+	/* a chunk read through multiple ReadBufferOperation's is counted for each of them,
+	 * and taskFinished will decrease the counter as many times */
+	dependency->m_dependents.push_back(task);
+	task->m_numberOfUnfinishedDependencies++;
+}
+
+void TaskGraph::scheduleTask(ChunkTask *task)
+{
+	task->getExecutionGroup()->scheduleChunk(task->getChunkNumber());
+}
+
+bool TaskGraph::isFinished()
+{
+	bool finished;
+	BLI_mutex_lock(&this->m_mutex);
+	if (this->m_breaked) {
+		finished = this->m_numberOfFinishedTasks == this->m_numberOfScheduledTasks;
+	}
+	else {
+		finished = this->m_numberOfFinishedTasks == this->m_tasks.size();
+	}
+	BLI_mutex_unlock(&this->m_mutex);
+	return finished;
+}
+
+void TaskGraph::execute(ExecutionSystem *system)
+{
+	const bNodeTree *bTree = system->getContext().getbNodeTree();
+	vector<ChunkTask *> readyTasks;
+	unsigned int index;
+
+	if (this->m_tasks.empty()) {
+		return;
+	}
+
+	/* collect all tasks first, the counters change as soon as the first task is scheduled */
+	for (index = 0; index < this->m_tasks.size(); index++) {
+		ChunkTask *task = this->m_tasks[index];
+		if (task->m_numberOfUnfinishedDependencies == 0) {
+			readyTasks.push_back(task);
+		}
+	}
+
+	BLI_mutex_lock(&this->m_mutex);
+	this->m_numberOfScheduledTasks += readyTasks.size();
+	BLI_mutex_unlock(&this->m_mutex);
+
+	for (index = 0; index < readyTasks.size(); index++) {
+		scheduleTask(readyTasks[index]);
+	}
+
+	while (!isFinished()) {
+		if (BLI_thread_queue_pop_timeout(this->m_finishedTasks, COM_TASK_GRAPH_BREAK_INTERVAL)) {
+			while (BLI_thread_queue_size(this->m_finishedTasks) > 0) {
+				BLI_thread_queue_pop(this->m_finishedTasks);
+			}
+
+			system->releaseInputBuffers();
+
+			if (bTree->update_draw)
+				bTree->update_draw(bTree->udh);
+		}
+
+		if (bTree->test_break && bTree->test_break(bTree->tbh)) {
+			BLI_mutex_lock(&this->m_mutex);
+			this->m_breaked = true;
+			BLI_mutex_unlock(&this->m_mutex);
+		}
+	}
+
+	system->releaseInputBuffers();
+}
+
+void TaskGraph::taskFinished(ChunkTask *task)
+{
+	vector<ChunkTask *> readyTasks;
+	unsigned int index;
+
+	BLI_mutex_lock(&this->m_mutex);
+	for (index = 0; index < task->m_dependents.size(); index++) {
+		ChunkTask *dependent = task->m_dependents[index];
+		dependent->m_numberOfUnfinishedDependencies--;
+		if (dependent->m_numberOfUnfinishedDependencies == 0 && !this->m_breaked) {
+			readyTasks.push_back(dependent);
+		}
+	}
+	this->m_numberOfScheduledTasks += readyTasks.size();
+	this->m_numberOfFinishedTasks++;
+	/* pushed while locked, once the last task is counted execute returns and the graph is freed */
+	BLI_thread_queue_push(this->m_finishedTasks, task);
+	BLI_mutex_unlock(&this->m_mutex);
+
+	for (index = 0; index < readyTasks.size(); index++) {
+		scheduleTask(readyTasks[index]);
+	}
+}
@@ -0,0 +1,185 @@
+/*
+ * Copyright 2013, Blender Foundation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * Contributor: 
+ *		Jeroen Bakker 
+ *		Monique Dewanchand
+ */
+
+class ChunkTask;
+class TaskGraph;
+
+#ifndef _COM_TaskGraph_h
+#define _COM_TaskGraph_h
+
+#include <vector>
+
+#include "MEM_guardedalloc.h"
+
+extern "C" {
+	#include "BLI_threads.h"
+}
+
+using namespace std;
+
+class ExecutionGroup;
+class ExecutionSystem;
+
+/**
+ * @brief a chunk of an ExecutionGroup that has to be calculated, together with the chunks depending on it
+ * @see TaskGraph
+ * @ingroup Execution
+ */
+class ChunkTask {
+private:
+	/**
+	 * @brief the graph this task is part of
+	 */
+	TaskGraph *m_taskGraph;
+
+	/**
+	 * @brief executionGroup the chunk belongs to
+	 */
+	ExecutionGroup *m_executionGroup;
+
+	/**
+	 * @brief number of the chunk in the executionGroup
+	 */
+	unsigned int m_chunkNumber;
+
+	/**
+	 * @brief number of tasks that must be finished before this task can be scheduled
+	 * @note protected by the mutex of the TaskGraph once the graph is executing
+	 */
+	unsigned int m_numberOfUnfinishedDependencies;
+
+	/**
+	 * @brief the tasks reading the result of this task
+	 */
+	vector<ChunkTask *> m_dependents;
+
+public:
+	ChunkTask(TaskGraph *taskGraph, ExecutionGroup *group, unsigned int chunkNumber);
+
+	TaskGraph *getTaskGraph() const { return this->m_taskGraph; }
+	ExecutionGroup *getExecutionGroup() const { return this->m_executionGroup; }
+	unsigned int getChunkNumber() const { return this->m_chunkNumber; }
+
+#ifdef WITH_CXX_GUARDEDALLOC
+	MEM_CXX_CLASS_ALLOC_FUNCS("COM:ChunkTask")
+#endif
+
+	friend class TaskGraph;
+};
+
+/**
+ * @brief the chunks needed to calculate a set of output ExecutionGroup's, with their dependencies.
+ *
+ * Every chunk that has to be calculated is a ChunkTask. A task depends on the chunks of the
+ * ExecutionGroup's it reads, as determined by ExecutionGroup.determineDependingAreaOfInterest.
+ * Tasks without dependencies are handed to the WorkScheduler when the graph is executed,
+ * the other tasks are handed over by the device thread finishing their last dependency.
+ * This way independent branches of the node tree and chunks of different ExecutionGroup's
+ * are calculated at the same time, without the thread executing the compositor polling the chunks.
+ *
+ * The graph is built by ExecutionGroup.addTasks from the thread executing the compositor,
+ * before it is executed.
+ * @see ExecutionSystem.executeGroups
+ * @ingroup Execution
+ */
+class TaskGraph {
+private:
+	/**
+	 * @brief all tasks, in the order they were added
+	 */
+	vector<ChunkTask *> m_tasks;
+
+	/**
+	 * @brief protects the counters of the graph and its tasks during execution
+	 */
+	ThreadMutex m_mutex;
+
+	/**
+	 * @brief every finished task is pushed here to wake up the thread executing the compositor
+	 */
+	ThreadQueue *m_finishedTasks;
+
+	/**
+	 * @brief number of tasks that have been handed to the WorkScheduler
+	 */
+	unsigned int m_numberOfScheduledTasks;
+
+	/**
+	 * @brief number of tasks that have been calculated
+	 */
+	unsigned int m_numberOfFinishedTasks;
+
+	/**
+	 * @brief the user has breaked the execution, tasks that are not yet scheduled will not be
+	 */
+	bool m_breaked;
+
+	/**
+	 * @brief hand a task to the WorkScheduler
+	 * @note m_numberOfScheduledTasks must already count the task
+	 */
+	void scheduleTask(ChunkTask *task);
+
+	/**
+	 * @brief are all tasks that will be calculated finished
+	 */
+	bool isFinished();
+
+public:
+	TaskGraph();
+	~TaskGraph();
+
+	/**
+	 * @brief add a task for a chunk of an ExecutionGroup
+	 * @note the caller has to make sure a chunk is only added once
+	 */
+	ChunkTask *addTask(ExecutionGroup *group, unsigned int chunkNumber);
+
+	/**
+	 * @brief task can only be scheduled after dependency is finished
+	 */
+	void addDependency(ChunkTask *task, ChunkTask *dependency);
+
+	/**
+	 * @brief get the number of tasks in this graph
+	 */
+	unsigned int getNumberOfTasks() const { return this->m_tasks.size(); }
+
+	/**
+	 * @brief calculate all tasks of the graph
+	 * @note this method will return when all tasks have been calculated, or the execution has breaked (by user).
+	 * In the mean time the buffers that are no longer needed are released and the editor is redrawn.
+	 */
+	void execute(ExecutionSystem *system);
+
+	/**
+	 * @brief a device has calculated the chunk of a task, schedule the tasks waiting for it
+	 * @note called from the device threads
+	 */
+	void taskFinished(ChunkTask *task);
+
+#ifdef WITH_CXX_GUARDEDALLOC
+	MEM_CXX_CLASS_ALLOC_FUNCS("COM:TaskGraph")
+#endif
+};
+
+#endif
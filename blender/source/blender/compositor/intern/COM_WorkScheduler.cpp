@@ -52,6 +52,11 @@
 /// @brief list of all CPUDevices. for every hardware thread an instance of CPUDevice is created
 static vector<CPUDevice *> g_cpudevices;
 
+/// @brief time the WorkScheduler was last started
+static double g_startTime = 0.0;
+/// @brief total time the WorkScheduler has been running since the last resetStatistics
+static double g_activeTime = 0.0;
+
 #if COM_CURRENT_THREADING_MODEL == COM_TM_QUEUE
 /// @brief list of all thread for every CPUDevice in cpudevices a thread exists
 static ListBase g_cputhreads;
@@ -148,7 +153,9 @@ void *WorkScheduler::thread_execute_cpu(void *data)
 	
 	while ((work = (WorkPackage *)BLI_thread_queue_pop(g_cpuqueue))) {
 		HIGHLIGHT(work);
+		double startTime = PIL_check_seconds_timer();
 		device->execute(work);
+		device->addExecutedWorkPackage(PIL_check_seconds_timer() - startTime);
 		delete work;
 	}
 	
@@ -162,7 +169,9 @@ void *WorkScheduler::thread_execute_gpu(void *data)
 	
 	while ((work = (WorkPackage *)BLI_thread_queue_pop(g_gpuqueue))) {
 		HIGHLIGHT(work);
+		double startTime = PIL_check_seconds_timer();
 		device->execute(work);
+		device->addExecutedWorkPackage(PIL_check_seconds_timer() - startTime);
 		delete work;
 	}
 	
@@ -195,6 +204,7 @@ void WorkScheduler::schedule(ExecutionGroup *group, int chunkNumber)
 
 void WorkScheduler::start(CompositorContext &context)
 {
+	g_startTime = PIL_check_seconds_timer();
 #if COM_CURRENT_THREADING_MODEL == COM_TM_QUEUE
 	unsigned int index;
 	g_cpuqueue = BLI_thread_queue_init();
@@ -251,6 +261,58 @@ void WorkScheduler::stop()
 	}
 #endif
 #endif
+	g_activeTime += PIL_check_seconds_timer() - g_startTime;
+}
+
+void WorkScheduler::resetStatistics()
+{
+	unsigned int index;
+	g_activeTime = 0.0;
+	for (index = 0; index < g_cpudevices.size(); index++) {
+		g_cpudevices[index]->resetStatistics();
+	}
+#if COM_CURRENT_THREADING_MODEL == COM_TM_QUEUE && defined(COM_OPENCL_ENABLED)
+	for (index = 0; index < g_gpudevices.size(); index++) {
+		g_gpudevices[index]->resetStatistics();
+	}
+#endif
+}
+
+static void printDeviceStatistics(const char *type, unsigned int index, Device *device)
+{
+	double idleTime = g_activeTime - device->getExecutionTime();
+	if (idleTime < 0.0) {
+		idleTime = 0.0;
+	}
+	printf("%s %u: %u chunks | Busy %.3fs | Idle %.3fs (%.1f%%)\n", type, index + 1,
+	       device->getNumberOfExecutedWorkPackages(), device->getExecutionTime(),
+	       idleTime, g_activeTime > 0.0 ? 100.0 * idleTime / g_activeTime : 0.0);
+}
+
+void WorkScheduler::printStatistics()
+{
+	unsigned int index;
+	unsigned int numberOfWorkPackages = 0;
+
+#if COM_CURRENT_THREADING_MODEL == COM_TM_QUEUE
+	for (index = 0; index < g_cpudevices.size(); index++) {
+		printDeviceStatistics("CPU", index, g_cpudevices[index]);
+		numberOfWorkPackages += g_cpudevices[index]->getNumberOfExecutedWorkPackages();
+	}
+#ifdef COM_OPENCL_ENABLED
+	for (index = 0; index < g_gpudevices.size(); index++) {
+		printDeviceStatistics("GPU", index, g_gpudevices[index]);
+		numberOfWorkPackages += g_gpudevices[index]->getNumberOfExecutedWorkPackages();
+	}
+#endif
+#else
+	(void)index;
+	printf("Device statistics are not available without threading\n");
+#endif
+
+	printf("Total: %u chunks in %.3fs, %.1f chunks/s\n", numberOfWorkPackages, g_activeTime,
+	       g_activeTime > 0.0 ? numberOfWorkPackages / g_activeTime : 0.0);
+	fflush(stdout);
 }
 
 bool WorkScheduler::hasGPUDevices()
@@ -60,7 +60,8 @@ public:
 	 * An execution group schedules a chunk in the WorkScheduler
 	 * when ExecutionGroup.isOpenCL is set the work will be handled by a OpenCLDevice
 	 * otherwide the work is scheduled for an CPUDevice
-	 * @see ExecutionGroup.execute
+	 * @note can be called from the device threads, when a finished chunk makes other chunks ready
+	 * @see ExecutionGroup.scheduleChunk
 	 * @param group the execution group
 	 * @param chunkNumber the number of the chunk in the group to be executed
 	 */
@@ -113,6 +114,19 @@ public:
 	 */
 	static bool hasGPUDevices();
 
+	/**
+	 * @brief reset the number of executed chunks and the busy time of all devices
+	 * @note must not be called while the WorkScheduler is started
+	 */
+	static void resetStatistics();
+
+	/**
+	 * @brief print the number of executed chunks, the busy and the idle time of every device to stdout
+	 * @note the idle time of a device is the time the WorkScheduler was started, but the device was not executing
+	 * @see resetStatistics
+	 */
+	static void printStatistics();
+
 #ifdef WITH_CXX_GUARDEDALLOC
 	MEM_CXX_CLASS_ALLOC_FUNCS("COM:WorkScheduler")
 #endif
@@ -20,6 +20,7 @@
  *		Monique Dewanchand
  */
 
+#include <stdio.h>
 
 extern "C" {
 #include "BKE_node.h"
@@ -27,12 +28,14 @@ extern "C" {
 }
 #include "BKE_main.h"
 #include "BKE_global.h"
+#include "PIL_time.h"
 
 #include "COM_compositor.h"
 #include "COM_ExecutionSystem.h"
 #include "COM_WorkScheduler.h"
 #include "OCL_opencl.h"
 #include "COM_MovieDistortionOperation.h"
+#include "COM_BufferCache.h"
 
 static ThreadMutex s_compositorMutex;
 static char is_compositorMutex_init = FALSE;
@@ -40,11 +43,10 @@ static char is_compositorMutex_init = FALSE;
 static void intern_freeCompositorCaches()
 {
 	deintializeDistortionCache();
+	BufferCache::clear();
 }
 
-void COM_execute(RenderData *rd, bNodeTree *editingtree, int rendering,
-                 const ColorManagedViewSettings *viewSettings,
-                 const ColorManagedDisplaySettings *displaySettings)
+static void intern_initializeMutex()
 {
 	/* initialize mutex, TODO this mutex init is actually not thread safe and
 	 * should be done somewhere as part of blender startup, all the other
@@ -53,6 +55,13 @@ void COM_execute(RenderData *rd, bNodeTree *editingtree, int rendering,
 		BLI_mutex_init(&s_compositorMutex);
 		is_compositorMutex_init = TRUE;
 	}
+}
+
+void COM_execute(RenderData *rd, bNodeTree *editingtree, int rendering,
+                 const ColorManagedViewSettings *viewSettings,
+                 const ColorManagedDisplaySettings *displaySettings)
+{
+	intern_initializeMutex();
 
 	BLI_mutex_lock(&s_compositorMutex);
 
@@ -100,6 +109,72 @@ void COM_execute(RenderData *rd, bNodeTree *editingtree, int rendering,
 	BLI_mutex_unlock(&s_compositorMutex);
 }
 
+static void benchmark_progress(void *UNUSED(prh), float UNUSED(progress))
+{
+}
+
+static int benchmark_test_break(void *UNUSED(tbh))
+{
+	return FALSE;
+}
+
+void COM_benchmark(RenderData *rd, bNodeTree *editingtree, int iterations,
+                   const ColorManagedViewSettings *viewSettings,
+                   const ColorManagedDisplaySettings *displaySettings)
+{
+	void (*progress)(void *, float) = editingtree->progress;
+	void (*stats_draw)(void *, char *) = editingtree->stats_draw;
+	int (*test_break)(void *) = editingtree->test_break;
+	void (*update_draw)(void *) = editingtree->update_draw;
+	double totalTime = 0.0;
+	int iteration;
+
+	intern_initializeMutex();
+
+	BLI_mutex_lock(&s_compositorMutex);
+
+	/* there is no job or render to report to */
+	editingtree->progress = benchmark_progress;
+	editingtree->stats_draw = NULL;
+	editingtree->test_break = benchmark_test_break;
+	editingtree->update_draw = NULL;
+
+	float aspect = rd->xsch > 0 ? (float)rd->ysch / (float)rd->xsch : 1.0f;
+	BKE_node_preview_init_tree(editingtree, COM_PREVIEW_SIZE, (int)(COM_PREVIEW_SIZE * aspect), FALSE);
+
+	bool use_opencl = (editingtree->flag & NTREE_COM_OPENCL) != 0;
+	WorkScheduler::initialize(use_opencl);
+	WorkScheduler::resetStatistics();
+
+	for (iteration = 0; iteration < iterations; iteration++) {
+		/* calculate all chunks every iteration */
+		BufferCache::clear();
+
+		double startTime = PIL_check_seconds_timer();
+		ExecutionSystem *system = new ExecutionSystem(rd, editingtree, false, false,
+		                                              viewSettings, displaySettings);
+		system->execute();
+		delete system;
+		double executionTime = PIL_check_seconds_timer() - startTime;
+
+		totalTime += executionTime;
+		printf("Compositor benchmark: iteration %d/%d, %.3fs\n", iteration + 1, iterations, executionTime);
+	}
+
+	if (iterations > 0) {
+		printf("Compositor benchmark: %d iterations, %.3fs per iteration\n", iterations, totalTime / iterations);
+	}
+	WorkScheduler::printStatistics();
+	BufferCache::clear();
+
+	editingtree->progress = progress;
+	editingtree->stats_draw = stats_draw;
+	editingtree->test_break = test_break;
+	editingtree->update_draw = update_draw;
+
+	BLI_mutex_unlock(&s_compositorMutex);
+}
+
 static void UNUSED_FUNCTION(COM_freeCaches)()
 {
 	if (is_compositorMutex_init) {
@@ -114,6 +189,7 @@ void COM_deinitialize()
 	if (is_compositorMutex_init) {
 		BLI_mutex_lock(&s_compositorMutex);
 		intern_freeCompositorCaches();
+		BufferCache::deinitialize();
 		WorkScheduler::deinitialize();
 		is_compositorMutex_init = FALSE;
 		BLI_mutex_unlock(&s_compositorMutex);
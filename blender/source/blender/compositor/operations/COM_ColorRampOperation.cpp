@@ -37,6 +37,7 @@ ColorRampOperation::ColorRampOperation() : NodeOperation()
 
 	this->m_inputProgram = NULL;
 	this->m_colorBand = NULL;
+	this->setBufferExecution(true);
 }
 void ColorRampOperation::initExecution()
 {
@@ -51,6 +52,20 @@ void ColorRampOperation::executePixel(float output[4], float x, float y, PixelSa
 	do_colorband(this->m_colorBand, values[0], output);
 }
 
+void ColorRampOperation::executeBuffer(MemoryBuffer *output, rcti *rect)
+{
+	int x, y;
+
+	/* the value is read into the output, do_colorband takes it by value before writing */
+	this->getInputOperation(0)->readBuffer(output, rect);
+	for (y = rect->ymin; y < rect->ymax; y++) {
+		float *row = output->getElem(rect->xmin, y);
+		for (x = rect->xmin; x < rect->xmax; x++, row += COM_NUMBER_OF_CHANNELS) {
+			do_colorband(this->m_colorBand, row[0], row);
+		}
+	}
+}
+
 void ColorRampOperation::deinitExecution()
 {
 	this->m_inputProgram = NULL;
@@ -39,6 +39,11 @@ public:
 	 * the inner loop of this program
 	 */
 	void executePixel(float output[4], float x, float y, PixelSampler sampler);
+
+	/**
+	 * the whole region at once
+	 */
+	void executeBuffer(MemoryBuffer *output, rcti *rect);
 	
 	/**
 	 * Initialize the execution
@@ -45,6 +45,7 @@ ConvertValueToColorOperation::ConvertValueToColorOperation() : ConvertBaseOperat
 {
 	this->addInputSocket(COM_DT_VALUE);
 	this->addOutputSocket(COM_DT_COLOR);
+	this->setBufferExecution(true);
 }
 
 void ConvertValueToColorOperation::executePixel(float output[4], float x, float y, PixelSampler sampler)
@@ -55,6 +56,20 @@ void ConvertValueToColorOperation::executePixel(float output[4], float x, float
 	output[3] = 1.0f;
 }
 
+void ConvertValueToColorOperation::executeBuffer(MemoryBuffer *output, rcti *rect)
+{
+	int x, y;
+
+	this->getInputOperation(0)->readBuffer(output, rect);
+	for (y = rect->ymin; y < rect->ymax; y++) {
+		float *row = output->getElem(rect->xmin, y);
+		for (x = rect->xmin; x < rect->xmax; x++, row += COM_NUMBER_OF_CHANNELS) {
+			row[1] = row[2] = row[0];
+			row[3] = 1.0f;
+		}
+	}
+}
+
 
 /* ******** Color to Value ******** */
 
@@ -62,6 +77,7 @@ ConvertColorToValueOperation::ConvertColorToValueOperation() : ConvertBaseOperat
 {
 	this->addInputSocket(COM_DT_COLOR);
 	this->addOutputSocket(COM_DT_VALUE);
+	this->setBufferExecution(true);
 }
 
 void ConvertColorToValueOperation::executePixel(float output[4], float x, float y, PixelSampler sampler)
@@ -71,6 +87,19 @@ void ConvertColorToValueOperation::executePixel(float output[4], float x, float
 	output[0] = (inputColor[0] + inputColor[1] + inputColor[2]) / 3.0f;
 }
 
+void ConvertColorToValueOperation::executeBuffer(MemoryBuffer *output, rcti *rect)
+{
+	int x, y;
+
+	this->getInputOperation(0)->readBuffer(output, rect);
+	for (y = rect->ymin; y < rect->ymax; y++) {
+		float *row = output->getElem(rect->xmin, y);
+		for (x = rect->xmin; x < rect->xmax; x++, row += COM_NUMBER_OF_CHANNELS) {
+			row[0] = (row[0] + row[1] + row[2]) / 3.0f;
+		}
+	}
+}
+
 
 /* ******** Color to BW ******** */
 
@@ -78,6 +107,7 @@ ConvertColorToBWOperation::ConvertColorToBWOperation() : ConvertBaseOperation()
 {
 	this->addInputSocket(COM_DT_COLOR);
 	this->addOutputSocket(COM_DT_VALUE);
+	this->setBufferExecution(true);
 }
 
 void ConvertColorToBWOperation::executePixel(float output[4], float x, float y, PixelSampler sampler)
@@ -87,6 +117,19 @@ void ConvertColorToBWOperation::executePixel(float output[4], float x, float y,
 	output[0] = rgb_to_bw(inputColor);
 }
 
+void ConvertColorToBWOperation::executeBuffer(MemoryBuffer *output, rcti *rect)
+{
+	int x, y;
+
+	this->getInputOperation(0)->readBuffer(output, rect);
+	for (y = rect->ymin; y < rect->ymax; y++) {
+		float *row = output->getElem(rect->xmin, y);
+		for (x = rect->xmin; x < rect->xmax; x++, row += COM_NUMBER_OF_CHANNELS) {
+			row[0] = rgb_to_bw(row);
+		}
+	}
+}
+
 
 /* ******** Color to Vector ******** */
 
@@ -94,6 +137,7 @@ ConvertColorToVectorOperation::ConvertColorToVectorOperation() : ConvertBaseOper
 {
 	this->addInputSocket(COM_DT_COLOR);
 	this->addOutputSocket(COM_DT_VECTOR);
+	this->setBufferExecution(true);
 }
 
 void ConvertColorToVectorOperation::executePixel(float output[4], float x, float y, PixelSampler sampler)
@@ -101,6 +145,11 @@ void ConvertColorToVectorOperation::executePixel(float output[4], float x, float
 	this->m_inputOperation->read(output, x, y, sampler);
 }
 
+void ConvertColorToVectorOperation::executeBuffer(MemoryBuffer *output, rcti *rect)
+{
+	this->getInputOperation(0)->readBuffer(output, rect);
+}
+
 
 /* ******** Value to Vector ******** */
 
@@ -108,6 +157,7 @@ ConvertValueToVectorOperation::ConvertValueToVectorOperation() : ConvertBaseOper
 {
 	this->addInputSocket(COM_DT_VALUE);
 	this->addOutputSocket(COM_DT_VECTOR);
+	this->setBufferExecution(true);
 }
 
 void ConvertValueToVectorOperation::executePixel(float output[4], float x, float y, PixelSampler sampler)
@@ -120,6 +170,20 @@ void ConvertValueToVectorOperation::executePixel(float output[4], float x, float
 	output[3] = 0.0f;
 }
 
+void ConvertValueToVectorOperation::executeBuffer(MemoryBuffer *output, rcti *rect)
+{
+	int x, y;
+
+	this->getInputOperation(0)->readBuffer(output, rect);
+	for (y = rect->ymin; y < rect->ymax; y++) {
+		float *row = output->getElem(rect->xmin, y);
+		for (x = rect->xmin; x < rect->xmax; x++, row += COM_NUMBER_OF_CHANNELS) {
+			row[1] = row[2] = row[0];
+			row[3] = 0.0f;
+		}
+	}
+}
+
 
 /* ******** Vector to Color ******** */
 
@@ -127,6 +191,7 @@ ConvertVectorToColorOperation::ConvertVectorToColorOperation() : ConvertBaseOper
 {
 	this->addInputSocket(COM_DT_VECTOR);
 	this->addOutputSocket(COM_DT_COLOR);
+	this->setBufferExecution(true);
 }
 
 void ConvertVectorToColorOperation::executePixel(float output[4], float x, float y, PixelSampler sampler)
@@ -135,6 +200,19 @@ void ConvertVectorToColorOperation::executePixel(float output[4], float x, float
 	output[3] = 1.0f;
 }
 
+void ConvertVectorToColorOperation::executeBuffer(MemoryBuffer *output, rcti *rect)
+{
+	int x, y;
+
+	this->getInputOperation(0)->readBuffer(output, rect);
+	for (y = rect->ymin; y < rect->ymax; y++) {
+		float *row = output->getElem(rect->xmin, y);
+		for (x = rect->xmin; x < rect->xmax; x++, row += COM_NUMBER_OF_CHANNELS) {
+			row[3] = 1.0f;
+		}
+	}
+}
+
 
 /* ******** Vector to Value ******** */
 
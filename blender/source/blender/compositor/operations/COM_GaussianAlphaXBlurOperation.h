@@ -53,6 +53,7 @@ public:
 	void deinitExecution();
 	
 	void *initializeTileData(rcti *rect);
+	bool canReadPackedBuffer(unsigned int inputSocketIndex) const { return inputSocketIndex == 0; }
 	bool determineDependingAreaOfInterest(rcti *input, ReadBufferOperation *readOperation, rcti *output);
 
 	/**
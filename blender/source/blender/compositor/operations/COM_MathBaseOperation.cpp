@@ -65,6 +65,29 @@ void MathBaseOperation::determineResolution(unsigned int resolution[2], unsigned
 	NodeOperation::determineResolution(resolution, preferredResolution);
 }
 
+void MathBaseOperation::executeBuffer(MemoryBuffer *output, rcti *rect)
+{
+	const int width = BLI_rcti_size_x(rect);
+	MemoryBuffer *inputValue2 = this->createInputBuffer(1, rect);
+	int y;
+
+	/* the first value is read into the output and calculated in place */
+	this->getInputOperation(0)->readBuffer(output, rect);
+
+	for (y = rect->ymin; y < rect->ymax; y++) {
+		float *row = output->getElem(rect->xmin, y);
+		mathRow(row, inputValue2->getElem(rect->xmin, y), width);
+
+		if (this->m_useClamp) {
+			for (int x = 0; x < width; x++, row += COM_NUMBER_OF_CHANNELS) {
+				CLAMP(row[0], 0.0f, 1.0f);
+			}
+		}
+	}
+
+	delete inputValue2;
+}
+
 void MathBaseOperation::clampIfNeeded(float *color)
 {
 	if (this->m_useClamp) {
@@ -85,6 +108,13 @@ void MathAddOperation::executePixel(float output[4], float x, float y, PixelSamp
 	clampIfNeeded(output);
 }
 
+void MathAddOperation::mathRow(float *output, const float *value2, int width)
+{
+	for (int x = 0; x < width; x++, output += COM_NUMBER_OF_CHANNELS, value2 += COM_NUMBER_OF_CHANNELS) {
+		output[0] = output[0] + value2[0];
+	}
+}
+
 void MathSubtractOperation::executePixel(float output[4], float x, float y, PixelSampler sampler)
 {
 	float inputValue1[4];
@@ -98,6 +128,13 @@ void MathSubtractOperation::executePixel(float output[4], float x, float y, Pixe
 	clampIfNeeded(output);
 }
 
+void MathSubtractOperation::mathRow(float *output, const float *value2, int width)
+{
+	for (int x = 0; x < width; x++, output += COM_NUMBER_OF_CHANNELS, value2 += COM_NUMBER_OF_CHANNELS) {
+		output[0] = output[0] - value2[0];
+	}
+}
+
 void MathMultiplyOperation::executePixel(float output[4], float x, float y, PixelSampler sampler)
 {
 	float inputValue1[4];
@@ -111,6 +148,13 @@ void MathMultiplyOperation::executePixel(float output[4], float x, float y, Pixe
 	clampIfNeeded(output);
 }
 
+void MathMultiplyOperation::mathRow(float *output, const float *value2, int width)
+{
+	for (int x = 0; x < width; x++, output += COM_NUMBER_OF_CHANNELS, value2 += COM_NUMBER_OF_CHANNELS) {
+		output[0] = output[0] * value2[0];
+	}
+}
+
 void MathDivideOperation::executePixel(float output[4], float x, float y, PixelSampler sampler)
 {
 	float inputValue1[4];
@@ -127,6 +171,13 @@ void MathDivideOperation::executePixel(float output[4], float x, float y, PixelS
 	clampIfNeeded(output);
 }
 
+void MathDivideOperation::mathRow(float *output, const float *value2, int width)
+{
+	for (int x = 0; x < width; x++, output += COM_NUMBER_OF_CHANNELS, value2 += COM_NUMBER_OF_CHANNELS) {
+		output[0] = (value2[0] == 0) ? 0.0f : output[0] / value2[0];
+	}
+}
+
 void MathSineOperation::executePixel(float output[4], float x, float y, PixelSampler sampler)
 {
 	float inputValue1[4];
@@ -265,6 +316,13 @@ void MathMinimumOperation::executePixel(float output[4], float x, float y, Pixel
 	clampIfNeeded(output);
 }
 
+void MathMinimumOperation::mathRow(float *output, const float *value2, int width)
+{
+	for (int x = 0; x < width; x++, output += COM_NUMBER_OF_CHANNELS, value2 += COM_NUMBER_OF_CHANNELS) {
+		output[0] = min(output[0], value2[0]);
+	}
+}
+
 void MathMaximumOperation::executePixel(float output[4], float x, float y, PixelSampler sampler)
 {
 	float inputValue1[4];
@@ -278,6 +336,13 @@ void MathMaximumOperation::executePixel(float output[4], float x, float y, Pixel
 	clampIfNeeded(output);
 }
 
+void MathMaximumOperation::mathRow(float *output, const float *value2, int width)
+{
+	for (int x = 0; x < width; x++, output += COM_NUMBER_OF_CHANNELS, value2 += COM_NUMBER_OF_CHANNELS) {
+		output[0] = max(output[0], value2[0]);
+	}
+}
+
 void MathRoundOperation::executePixel(float output[4], float x, float y, PixelSampler sampler)
 {
 	float inputValue1[4];
@@ -304,6 +369,13 @@ void MathLessThanOperation::executePixel(float output[4], float x, float y, Pixe
 	clampIfNeeded(output);
 }
 
+void MathLessThanOperation::mathRow(float *output, const float *value2, int width)
+{
+	for (int x = 0; x < width; x++, output += COM_NUMBER_OF_CHANNELS, value2 += COM_NUMBER_OF_CHANNELS) {
+		output[0] = output[0] < value2[0] ? 1.0f : 0.0f;
+	}
+}
+
 void MathGreaterThanOperation::executePixel(float output[4], float x, float y, PixelSampler sampler)
 {
 	float inputValue1[4];
@@ -317,6 +389,13 @@ void MathGreaterThanOperation::executePixel(float output[4], float x, float y, P
 	clampIfNeeded(output);
 }
 
+void MathGreaterThanOperation::mathRow(float *output, const float *value2, int width)
+{
+	for (int x = 0; x < width; x++, output += COM_NUMBER_OF_CHANNELS, value2 += COM_NUMBER_OF_CHANNELS) {
+		output[0] = output[0] > value2[0] ? 1.0f : 0.0f;
+	}
+}
+
 void MathModuloOperation::executePixel(float output[4], float x, float y, PixelSampler sampler)
 {
 	float inputValue1[4];
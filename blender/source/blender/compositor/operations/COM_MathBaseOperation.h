@@ -46,11 +46,22 @@ protected:
 	MathBaseOperation();
 
 	void clampIfNeeded(float color[4]);
+
+	/**
+	 * calculate a row of values for executeBuffer
+	 * @param output holds the first value when called and receives the result
+	 */
+	virtual void mathRow(float *output, const float *value2, int width) {}
 public:
 	/**
 	 * the inner loop of this program
 	 */
 	void executePixel(float output[4], float x, float y, PixelSampler sampler) = 0;
+
+	/**
+	 * calculate a whole region, only used by operations that implement mathRow
+	 */
+	void executeBuffer(MemoryBuffer *output, rcti *rect);
 	
 	/**
 	 * Initialize the execution
@@ -71,23 +82,31 @@ public:
 };
 
 class MathAddOperation : public MathBaseOperation {
+protected:
+	void mathRow(float *output, const float *value2, int width);
 public:
-	MathAddOperation() : MathBaseOperation() {}
+	MathAddOperation() : MathBaseOperation() { this->setBufferExecution(true); }
 	void executePixel(float output[4], float x, float y, PixelSampler sampler);
 };
 class MathSubtractOperation : public MathBaseOperation {
+protected:
+	void mathRow(float *output, const float *value2, int width);
 public:
-	MathSubtractOperation() : MathBaseOperation() {}
+	MathSubtractOperation() : MathBaseOperation() { this->setBufferExecution(true); }
 	void executePixel(float output[4], float x, float y, PixelSampler sampler);
 };
 class MathMultiplyOperation : public MathBaseOperation {
+protected:
+	void mathRow(float *output, const float *value2, int width);
 public:
-	MathMultiplyOperation() : MathBaseOperation() {}
+	MathMultiplyOperation() : MathBaseOperation() { this->setBufferExecution(true); }
 	void executePixel(float output[4], float x, float y, PixelSampler sampler);
 };
 class MathDivideOperation : public MathBaseOperation {
+protected:
+	void mathRow(float *output, const float *value2, int width);
 public:
-	MathDivideOperation() : MathBaseOperation() {}
+	MathDivideOperation() : MathBaseOperation() { this->setBufferExecution(true); }
 	void executePixel(float output[4], float x, float y, PixelSampler sampler);
 };
 class MathSineOperation : public MathBaseOperation {
@@ -132,13 +151,17 @@ public:
 	void executePixel(float output[4], float x, float y, PixelSampler sampler);
 };
 class MathMinimumOperation : public MathBaseOperation {
+protected:
+	void mathRow(float *output, const float *value2, int width);
 public:
-	MathMinimumOperation() : MathBaseOperation() {}
+	MathMinimumOperation() : MathBaseOperation() { this->setBufferExecution(true); }
 	void executePixel(float output[4], float x, float y, PixelSampler sampler);
 };
 class MathMaximumOperation : public MathBaseOperation {
+protected:
+	void mathRow(float *output, const float *value2, int width);
 public:
-	MathMaximumOperation() : MathBaseOperation() {}
+	MathMaximumOperation() : MathBaseOperation() { this->setBufferExecution(true); }
 	void executePixel(float output[4], float x, float y, PixelSampler sampler);
 };
 class MathRoundOperation : public MathBaseOperation {
@@ -147,13 +170,17 @@ public:
 	void executePixel(float output[4], float x, float y, PixelSampler sampler);
 };
 class MathLessThanOperation : public MathBaseOperation {
+protected:
+	void mathRow(float *output, const float *value2, int width);
 public:
-	MathLessThanOperation() : MathBaseOperation() {}
+	MathLessThanOperation() : MathBaseOperation() { this->setBufferExecution(true); }
 	void executePixel(float output[4], float x, float y, PixelSampler sampler);
 };
 class MathGreaterThanOperation : public MathBaseOperation {
+protected:
+	void mathRow(float *output, const float *value2, int width);
 public:
-	MathGreaterThanOperation() : MathBaseOperation() {}
+	MathGreaterThanOperation() : MathBaseOperation() { this->setBufferExecution(true); }
 	void executePixel(float output[4], float x, float y, PixelSampler sampler);
 };
 
@@ -26,6 +26,18 @@ extern "C" {
 	#include "BLI_math.h"
 }
 
+#ifdef __SSE__
+#  include <xmmintrin.h>
+
+/* store the mixed rgb while keeping the alpha of the first color */
+static inline void mix_store_rgb(float *output, const __m128 result)
+{
+	const float alpha = output[3];
+	_mm_storeu_ps(output, result);
+	output[3] = alpha;
+}
+#endif
+
 /* ******** Mix Base Operation ******** */
 
 MixBaseOperation::MixBaseOperation() : NodeOperation()
@@ -69,6 +81,52 @@ void MixBaseOperation::executePixel(float output[4], float x, float y, PixelSamp
 	output[3] = inputColor1[3];
 }
 
+void MixBaseOperation::executeBuffer(MemoryBuffer *output, rcti *rect)
+{
+	const int width = BLI_rcti_size_x(rect);
+	MemoryBuffer *inputValue = this->createInputBuffer(0, rect);
+	MemoryBuffer *inputColor2 = this->createInputBuffer(2, rect);
+	int y;
+
+	/* the first color is read into the output and mixed in place */
+	this->getInputOperation(1)->readBuffer(output, rect);
+
+	for (y = rect->ymin; y < rect->ymax; y++) {
+		float *row = output->getElem(rect->xmin, y);
+		mixRow(row, inputValue->getElem(rect->xmin, y), inputColor2->getElem(rect->xmin, y), width);
+
+		if (this->m_useClamp) {
+			for (int x = 0; x < width; x++, row += COM_NUMBER_OF_CHANNELS) {
+#ifdef __SSE__
+				_mm_storeu_ps(row, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(row), _mm_setzero_ps()), _mm_set1_ps(1.0f)));
+#else
+				clampIfNeeded(row);
+#endif
+			}
+		}
+	}
+
+	delete inputValue;
+	delete inputColor2;
+}
+
+void MixBaseOperation::mixRow(float *output, const float *value, const float *color2, int width)
+{
+	for (int x = 0; x < width; x++, output += COM_NUMBER_OF_CHANNELS, value += COM_NUMBER_OF_CHANNELS, color2 += COM_NUMBER_OF_CHANNELS) {
+		const float fac = mixFactor(value, color2);
+#ifdef __SSE__
+		const __m128 v = _mm_set1_ps(fac);
+		const __m128 vm = _mm_set1_ps(1.0f - fac);
+		mix_store_rgb(output, _mm_add_ps(_mm_mul_ps(vm, _mm_loadu_ps(output)), _mm_mul_ps(v, _mm_loadu_ps(color2))));
+#else
+		const float facm = 1.0f - fac;
+		output[0] = facm * output[0] + fac * color2[0];
+		output[1] = facm * output[1] + fac * color2[1];
+		output[2] = facm * output[2] + fac * color2[2];
+#endif
+	}
+}
+
 void MixBaseOperation::determineResolution(unsigned int resolution[2], unsigned int preferredResolution[2])
 {
 	InputSocket *socket;
@@ -104,7 +162,7 @@ void MixBaseOperation::deinitExecution()
 
 MixAddOperation::MixAddOperation() : MixBaseOperation()
 {
-	/* pass */
+	this->setBufferExecution(true);
 }
 
 void MixAddOperation::executePixel(float output[4], float x, float y, PixelSampler sampler)
@@ -129,11 +187,26 @@ void MixAddOperation::executePixel(float output[4], float x, float y, PixelSampl
 	clampIfNeeded(output);
 }
 
+void MixAddOperation::mixRow(float *output, const float *value, const float *color2, int width)
+{
+	for (int x = 0; x < width; x++, output += COM_NUMBER_OF_CHANNELS, value += COM_NUMBER_OF_CHANNELS, color2 += COM_NUMBER_OF_CHANNELS) {
+		const float fac = mixFactor(value, color2);
+#ifdef __SSE__
+		const __m128 v = _mm_set1_ps(fac);
+		mix_store_rgb(output, _mm_add_ps(_mm_loadu_ps(output), _mm_mul_ps(v, _mm_loadu_ps(color2))));
+#else
+		output[0] = output[0] + fac * color2[0];
+		output[1] = output[1] + fac * color2[1];
+		output[2] = output[2] + fac * color2[2];
+#endif
+	}
+}
+
 /* ******** Mix Blend Operation ******** */
 
 MixBlendOperation::MixBlendOperation() : MixBaseOperation()
 {
-	/* pass */
+	this->setBufferExecution(true);
 }
 
 void MixBlendOperation::executePixel(float output[4], float x, float y, PixelSampler sampler)
@@ -274,7 +347,7 @@ void MixColorOperation::executePixel(float output[4], float x, float y, PixelSam
 
 MixDarkenOperation::MixDarkenOperation() : MixBaseOperation()
 {
-	/* pass */
+	this->setBufferExecution(true);
 }
 
 void MixDarkenOperation::executePixel(float output[4], float x, float y, PixelSampler sampler)
@@ -308,11 +381,34 @@ void MixDarkenOperation::executePixel(float output[4], float x, float y, PixelSa
 	clampIfNeeded(output);
 }
 
+void MixDarkenOperation::mixRow(float *output, const float *value, const float *color2, int width)
+{
+	for (int x = 0; x < width; x++, output += COM_NUMBER_OF_CHANNELS, value += COM_NUMBER_OF_CHANNELS, color2 += COM_NUMBER_OF_CHANNELS) {
+		const float fac = mixFactor(value, color2);
+#ifdef __SSE__
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 v = _mm_set1_ps(fac);
+		const __m128 vm = _mm_set1_ps(1.0f - fac);
+		const __m128 c2 = _mm_loadu_ps(color2);
+		mix_store_rgb(output, _mm_min_ps(_mm_add_ps(c2, _mm_mul_ps(_mm_sub_ps(one, c2), vm)), _mm_loadu_ps(output)));
+#else
+		const float facm = 1.0f - fac;
+		float tmp;
+		tmp = color2[0] + ((1.0f - color2[0]) * facm);
+		if (tmp < output[0]) output[0] = tmp;
+		tmp = color2[1] + ((1.0f - color2[1]) * facm);
+		if (tmp < output[1]) output[1] = tmp;
+		tmp = color2[2] + ((1.0f - color2[2]) * facm);
+		if (tmp < output[2]) output[2] = tmp;
+#endif
+	}
+}
+
 /* ******** Mix Difference Operation ******** */
 
 MixDifferenceOperation::MixDifferenceOperation() : MixBaseOperation()
 {
-	/* pass */
+	this->setBufferExecution(true);
 }
 
 void MixDifferenceOperation::executePixel(float output[4], float x, float y, PixelSampler sampler)
@@ -338,6 +434,25 @@ void MixDifferenceOperation::executePixel(float output[4], float x, float y, Pix
 	clampIfNeeded(output);
 }
 
+void MixDifferenceOperation::mixRow(float *output, const float *value, const float *color2, int width)
+{
+	for (int x = 0; x < width; x++, output += COM_NUMBER_OF_CHANNELS, value += COM_NUMBER_OF_CHANNELS, color2 += COM_NUMBER_OF_CHANNELS) {
+		const float fac = mixFactor(value, color2);
+#ifdef __SSE__
+		const __m128 v = _mm_set1_ps(fac);
+		const __m128 vm = _mm_set1_ps(1.0f - fac);
+		const __m128 c1 = _mm_loadu_ps(output);
+		const __m128 c2 = _mm_loadu_ps(color2);
+		mix_store_rgb(output, _mm_add_ps(_mm_mul_ps(vm, c1), _mm_mul_ps(v, _mm_andnot_ps(_mm_set1_ps(-0.0f), _mm_sub_ps(c1, c2)))));
+#else
+		const float facm = 1.0f - fac;
+		output[0] = facm * output[0] + fac * fabsf(output[0] - color2[0]);
+		output[1] = facm * output[1] + fac * fabsf(output[1] - color2[1]);
+		output[2] = facm * output[2] + fac * fabsf(output[2] - color2[2]);
+#endif
+	}
+}
+
 /* ******** Mix Difference Operation ******** */
 
 MixDivideOperation::MixDivideOperation() : MixBaseOperation()
@@ -530,7 +645,7 @@ void MixHueOperation::executePixel(float output[4], float x, float y, PixelSampl
 
 MixLightenOperation::MixLightenOperation() : MixBaseOperation()
 {
-	/* pass */
+	this->setBufferExecution(true);
 }
 
 void MixLightenOperation::executePixel(float output[4], float x, float y, PixelSampler sampler)
@@ -562,6 +677,26 @@ void MixLightenOperation::executePixel(float output[4], float x, float y, PixelS
 	clampIfNeeded(output);
 }
 
+void MixLightenOperation::mixRow(float *output, const float *value, const float *color2, int width)
+{
+	for (int x = 0; x < width; x++, output += COM_NUMBER_OF_CHANNELS, value += COM_NUMBER_OF_CHANNELS, color2 += COM_NUMBER_OF_CHANNELS) {
+		const float fac = mixFactor(value, color2);
+#ifdef __SSE__
+		const __m128 v = _mm_set1_ps(fac);
+		const __m128 c2 = _mm_loadu_ps(color2);
+		mix_store_rgb(output, _mm_max_ps(_mm_mul_ps(v, c2), _mm_loadu_ps(output)));
+#else
+		float tmp;
+		tmp = fac * color2[0];
+		if (tmp > output[0]) output[0] = tmp;
+		tmp = fac * color2[1];
+		if (tmp > output[1]) output[1] = tmp;
+		tmp = fac * color2[2];
+		if (tmp > output[2]) output[2] = tmp;
+#endif
+	}
+}
+
 /* ******** Mix Linear Light Operation ******** */
 
 MixLinearLightOperation::MixLinearLightOperation() : MixBaseOperation()
@@ -605,7 +740,7 @@ void MixLinearLightOperation::executePixel(float output[4], float x, float y, Pi
 
 MixMultiplyOperation::MixMultiplyOperation() : MixBaseOperation()
 {
-	/* pass */
+	this->setBufferExecution(true);
 }
 
 void MixMultiplyOperation::executePixel(float output[4], float x, float y, PixelSampler sampler)
@@ -631,6 +766,24 @@ void MixMultiplyOperation::executePixel(float output[4], float x, float y, Pixel
 	clampIfNeeded(output);
 }
 
+void MixMultiplyOperation::mixRow(float *output, const float *value, const float *color2, int width)
+{
+	for (int x = 0; x < width; x++, output += COM_NUMBER_OF_CHANNELS, value += COM_NUMBER_OF_CHANNELS, color2 += COM_NUMBER_OF_CHANNELS) {
+		const float fac = mixFactor(value, color2);
+#ifdef __SSE__
+		const __m128 v = _mm_set1_ps(fac);
+		const __m128 vm = _mm_set1_ps(1.0f - fac);
+		const __m128 c2 = _mm_loadu_ps(color2);
+		mix_store_rgb(output, _mm_mul_ps(_mm_loadu_ps(output), _mm_add_ps(vm, _mm_mul_ps(v, c2))));
+#else
+		const float facm = 1.0f - fac;
+		output[0] = output[0] * (facm + fac * color2[0]);
+		output[1] = output[1] * (facm + fac * color2[1]);
+		output[2] = output[2] * (facm + fac * color2[2]);
+#endif
+	}
+}
+
 /* ******** Mix Ovelray Operation ******** */
 
 MixOverlayOperation::MixOverlayOperation() : MixBaseOperation()
@@ -721,7 +874,7 @@ void MixSaturationOperation::executePixel(float output[4], float x, float y, Pix
 
 MixScreenOperation::MixScreenOperation() : MixBaseOperation()
 {
-	/* pass */
+	this->setBufferExecution(true);
 }
 
 void MixScreenOperation::executePixel(float output[4], float x, float y, PixelSampler sampler)
@@ -748,6 +901,25 @@ void MixScreenOperation::executePixel(float output[4], float x, float y, PixelSa
 	clampIfNeeded(output);
 }
 
+void MixScreenOperation::mixRow(float *output, const float *value, const float *color2, int width)
+{
+	for (int x = 0; x < width; x++, output += COM_NUMBER_OF_CHANNELS, value += COM_NUMBER_OF_CHANNELS, color2 += COM_NUMBER_OF_CHANNELS) {
+		const float fac = mixFactor(value, color2);
+#ifdef __SSE__
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 v = _mm_set1_ps(fac);
+		const __m128 vm = _mm_set1_ps(1.0f - fac);
+		const __m128 c2 = _mm_loadu_ps(color2);
+		mix_store_rgb(output, _mm_sub_ps(one, _mm_mul_ps(_mm_add_ps(vm, _mm_mul_ps(v, _mm_sub_ps(one, c2))), _mm_sub_ps(one, _mm_loadu_ps(output)))));
+#else
+		const float facm = 1.0f - fac;
+		output[0] = 1.0f - (facm + fac * (1.0f - color2[0])) * (1.0f - output[0]);
+		output[1] = 1.0f - (facm + fac * (1.0f - color2[1])) * (1.0f - output[1]);
+		output[2] = 1.0f - (facm + fac * (1.0f - color2[2])) * (1.0f - output[2]);
+#endif
+	}
+}
+
 /* ******** Mix Soft Light Operation ******** */
 
 MixSoftLightOperation::MixSoftLightOperation() : MixBaseOperation()
@@ -789,7 +961,7 @@ void MixSoftLightOperation::executePixel(float output[4], float x, float y, Pixe
 
 MixSubtractOperation::MixSubtractOperation() : MixBaseOperation()
 {
-	/* pass */
+	this->setBufferExecution(true);
 }
 
 void MixSubtractOperation::executePixel(float output[4], float x, float y, PixelSampler sampler)
@@ -814,6 +986,21 @@ void MixSubtractOperation::executePixel(float output[4], float x, float y, Pixel
 	clampIfNeeded(output);
 }
 
+void MixSubtractOperation::mixRow(float *output, const float *value, const float *color2, int width)
+{
+	for (int x = 0; x < width; x++, output += COM_NUMBER_OF_CHANNELS, value += COM_NUMBER_OF_CHANNELS, color2 += COM_NUMBER_OF_CHANNELS) {
+		const float fac = mixFactor(value, color2);
+#ifdef __SSE__
+		const __m128 v = _mm_set1_ps(fac);
+		mix_store_rgb(output, _mm_sub_ps(_mm_loadu_ps(output), _mm_mul_ps(v, _mm_loadu_ps(color2))));
+#else
+		output[0] = output[0] - fac * color2[0];
+		output[1] = output[1] - fac * color2[1];
+		output[2] = output[2] - fac * color2[2];
+#endif
+	}
+}
+
 /* ******** Mix Value Operation ******** */
 
 MixValueOperation::MixValueOperation() : MixBaseOperation()
@@ -50,6 +50,18 @@ protected:
 			CLAMP(color[3], 0.0f, 1.0f);
 		}
 	}
+
+	inline float mixFactor(const float value[4], const float color2[4])
+	{
+		return (this->m_valueAlphaMultiply) ? value[0] * color2[3] : value[0];
+	}
+
+	/**
+	 * mix a row of pixels for executeBuffer
+	 * @param output holds the first color when called and receives the result
+	 * @note the alpha of the first color is kept, clamping is done by the caller
+	 */
+	virtual void mixRow(float *output, const float *value, const float *color2, int width);
 	
 public:
 	/**
@@ -61,6 +73,11 @@ public:
 	 * the inner loop of this program
 	 */
 	void executePixel(float output[4], float x, float y, PixelSampler sampler);
+
+	/**
+	 * calculate a whole region, only used by operations that implement mixRow
+	 */
+	void executeBuffer(MemoryBuffer *output, rcti *rect);
 	
 	/**
 	 * Initialize the execution
@@ -81,6 +98,8 @@ public:
 };
 
 class MixAddOperation : public MixBaseOperation {
+protected:
+	void mixRow(float *output, const float *value, const float *color2, int width);
 public:
 	MixAddOperation();
 	void executePixel(float output[4], float x, float y, PixelSampler sampler);
@@ -105,12 +124,16 @@ public:
 };
 
 class MixDarkenOperation : public MixBaseOperation {
+protected:
+	void mixRow(float *output, const float *value, const float *color2, int width);
 public:
 	MixDarkenOperation();
 	void executePixel(float output[4], float x, float y, PixelSampler sampler);
 };
 
 class MixDifferenceOperation : public MixBaseOperation {
+protected:
+	void mixRow(float *output, const float *value, const float *color2, int width);
 public:
 	MixDifferenceOperation();
 	void executePixel(float output[4], float x, float y, PixelSampler sampler);
@@ -141,6 +164,8 @@ public:
 };
 
 class MixLightenOperation : public MixBaseOperation {
+protected:
+	void mixRow(float *output, const float *value, const float *color2, int width);
 public:
 	MixLightenOperation();
 	void executePixel(float output[4], float x, float y, PixelSampler sampler);
@@ -153,6 +178,8 @@ public:
 };
 
 class MixMultiplyOperation : public MixBaseOperation {
+protected:
+	void mixRow(float *output, const float *value, const float *color2, int width);
 public:
 	MixMultiplyOperation();
 	void executePixel(float output[4], float x, float y, PixelSampler sampler);
@@ -171,6 +198,8 @@ public:
 };
 
 class MixScreenOperation : public MixBaseOperation {
+protected:
+	void mixRow(float *output, const float *value, const float *color2, int width);
 public:
 	MixScreenOperation();
 	void executePixel(float output[4], float x, float y, PixelSampler sampler);
@@ -183,6 +212,8 @@ public:
 };
 
 class MixSubtractOperation : public MixBaseOperation {
+protected:
+	void mixRow(float *output, const float *value, const float *color2, int width);
 public:
 	MixSubtractOperation();
 	void executePixel(float output[4], float x, float y, PixelSampler sampler);
@@ -30,6 +30,7 @@ ReadBufferOperation::ReadBufferOperation() : NodeOperation()
 	this->m_single_value = false;
 	this->m_offset = 0;
 	this->m_buffer = NULL;
+	this->setBufferExecution(true);
 }
 
 void *ReadBufferOperation::initializeTileData(rcti *rect)
@@ -92,6 +93,36 @@ void ReadBufferOperation::executePixel(float output[4], float x, float y, float
 	}
 }
 
+void ReadBufferOperation::executeBuffer(MemoryBuffer *output, rcti *rect)
+{
+	rcti overlap;
+	int y;
+
+	if (m_single_value) {
+		/* write buffer has a single value stored at (0,0) */
+		float color[4];
+		m_buffer->read(color, 0, 0);
+		output->fill(rect, color);
+	}
+	else if (BLI_rcti_isect(rect, m_buffer->getRect(), &overlap) && BLI_rcti_compare(rect, &overlap)) {
+		const int width = BLI_rcti_size_x(rect);
+		for (y = rect->ymin; y < rect->ymax; y++) {
+			m_buffer->readRow(output->getElem(rect->xmin, y), rect->xmin, y, width);
+		}
+	}
+	else {
+		/* partially outside the buffer, read() clips to zero */
+		int x;
+		for (y = rect->ymin; y < rect->ymax; y++) {
+			float *buffer = output->getElem(rect->xmin, y);
+			for (x = rect->xmin; x < rect->xmax; x++) {
+				m_buffer->read(buffer, x, y);
+				buffer += COM_NUMBER_OF_CHANNELS;
+			}
+		}
+	}
+}
+
 bool ReadBufferOperation::determineDependingAreaOfInterest(rcti *input, ReadBufferOperation *readOperation, rcti *output)
 {
 	if (this == readOperation) {
@@ -25,6 +25,7 @@
 SetValueOperation::SetValueOperation() : NodeOperation()
 {
 	this->addOutputSocket(COM_DT_VALUE);
+	this->setBufferExecution(true);
 }
 
 void SetValueOperation::executePixel(float output[4], float x, float y, PixelSampler sampler)
@@ -32,6 +33,12 @@ void SetValueOperation::executePixel(float output[4], float x, float y, PixelSam
 	output[0] = this->m_value;
 }
 
+void SetValueOperation::executeBuffer(MemoryBuffer *output, rcti *rect)
+{
+	const float value[4] = {this->m_value, this->m_value, this->m_value, this->m_value};
+	output->fill(rect, value);
+}
+
 void SetValueOperation::determineResolution(unsigned int resolution[2], unsigned int preferredResolution[2])
 {
 	resolution[0] = preferredResolution[0];
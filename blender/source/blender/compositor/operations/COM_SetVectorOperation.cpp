@@ -26,6 +26,7 @@
 SetVectorOperation::SetVectorOperation() : NodeOperation()
 {
 	this->addOutputSocket(COM_DT_VECTOR);
+	this->setBufferExecution(true);
 }
 
 void SetVectorOperation::executePixel(float output[4], float x, float y, PixelSampler sampler)
@@ -36,6 +37,12 @@ void SetVectorOperation::executePixel(float output[4], float x, float y, PixelSa
 	output[3] = this->m_w;
 }
 
+void SetVectorOperation::executeBuffer(MemoryBuffer *output, rcti *rect)
+{
+	const float vector[4] = {this->m_x, this->m_y, this->m_z, this->m_w};
+	output->fill(rect, vector);
+}
+
 void SetVectorOperation::determineResolution(unsigned int resolution[2], unsigned int preferredResolution[2])
 {
 	resolution[0] = preferredResolution[0];
@@ -62,6 +62,9 @@ public:
 
 	void *initializeTileData(rcti *rect);
 
+	/* the z buffer is only read through MemoryBuffer.convertToValueBuffer */
+	bool canReadPackedBuffer(unsigned int inputSocketIndex) const { return inputSocketIndex == 1; }
+
 	void setVectorBlurSettings(NodeBlurData *settings) { this->m_settings = settings; }
 	bool determineDependingAreaOfInterest(rcti *input, ReadBufferOperation *readOperation, rcti *output);
 protected:
@@ -24,6 +24,8 @@
 #include "COM_defines.h"
 #include <stdio.h>
 #include "COM_OpenCLDevice.h"
+#include "COM_ExecutionGroup.h"
+#include "MEM_guardedalloc.h"
 
 WriteBufferOperation::WriteBufferOperation() : NodeOperation()
 {
@@ -31,6 +33,8 @@ WriteBufferOperation::WriteBufferOperation() : NodeOperation()
 	this->m_memoryProxy = new MemoryProxy();
 	this->m_memoryProxy->setWriteBufferOperation(this);
 	this->m_memoryProxy->setExecutor(NULL);
+	this->m_cacheKey = COM_BUFFER_CACHE_NO_KEY;
+	this->m_cached = false;
 }
 WriteBufferOperation::~WriteBufferOperation()
 {
@@ -47,20 +51,58 @@ void WriteBufferOperation::executePixel(float output[4], float x, float y, Pixel
 
 void WriteBufferOperation::initExecution()
 {
+	MemoryBuffer *buffer = NULL;
+
 	this->m_input = this->getInputOperation(0);
-	this->m_memoryProxy->allocate(this->m_width, this->m_height);
+	this->m_memoryProxy->resetConsumers();
+	if (this->m_cacheKey != COM_BUFFER_CACHE_NO_KEY) {
+		buffer = BufferCache::acquire(this->m_cacheKey, this->m_width, this->m_height);
+	}
+
+	if (buffer) {
+		this->m_memoryProxy->setBuffer(buffer);
+		this->m_cached = true;
+	}
+	else {
+		this->m_memoryProxy->allocate(this->m_width, this->m_height);
+		this->m_cached = false;
+	}
 }
 
 void WriteBufferOperation::deinitExecution()
 {
 	this->m_input = NULL;
-	this->m_memoryProxy->free();
+	releaseMemoryBuffer();
+}
+
+void WriteBufferOperation::releaseMemoryBuffer()
+{
+	ExecutionGroup *executor = this->m_memoryProxy->getExecutor();
+
+	if (this->m_memoryProxy->getBuffer() == NULL) {
+		return;
+	}
+
+	/* only keep buffers that have been calculated completely, an execution can be cancelled
+	 * and the viewer only calculates the area that is visible */
+	if (this->m_cacheKey != COM_BUFFER_CACHE_NO_KEY && executor && (this->m_cached || executor->isComplete())) {
+		BufferCache::release(this->m_cacheKey, this->m_memoryProxy->detachBuffer());
+	}
+	else {
+		this->m_memoryProxy->free();
+	}
 }
 
 void WriteBufferOperation::executeRegion(rcti *rect, unsigned int tileNumber)
 {
 	MemoryBuffer *memoryBuffer = this->m_memoryProxy->getBuffer();
-	float *buffer = memoryBuffer->getBuffer();
+	/* packed buffers are calculated a row at a time and then converted */
+	const bool packed = memoryBuffer->isPacked();
+	float *row = NULL;
+	if (packed) {
+		row = (float *)MEM_mallocN(sizeof(float) * BLI_rcti_size_x(rect) * COM_NUMBER_OF_CHANNELS, __func__);
+	}
+
 	if (this->m_input->isComplex()) {
 		void *data = this->m_input->initializeTileData(rect);
 		int x1 = rect->xmin;
@@ -71,10 +113,13 @@ void WriteBufferOperation::executeRegion(rcti *rect, unsigned int tileNumber)
 		int y;
 		bool breaked = false;
 		for (y = y1; y < y2 && (!breaked); y++) {
-			int offset4 = (y * memoryBuffer->getWidth() + x1) * COM_NUMBER_OF_CHANNELS;
+			float *buffer = packed ? row : memoryBuffer->getElem(x1, y);
 			for (x = x1; x < x2; x++) {
-				this->m_input->read(&(buffer[offset4]), x, y, data);
-				offset4 += COM_NUMBER_OF_CHANNELS;
+				this->m_input->read(buffer, x, y, data);
+				buffer += COM_NUMBER_OF_CHANNELS;
+			}
+			if (packed) {
+				memoryBuffer->writeRow(x1, y, x2 - x1, row);
 			}
 			if (isBreaked()) {
 				breaked = true;
@@ -86,6 +131,25 @@ void WriteBufferOperation::executeRegion(rcti *rect, unsigned int tileNumber)
 			data = NULL;
 		}
 	}
+	else if (this->m_memoryProxy->getExecutor()->isBufferExecution()) {
+		/* every operation of the group handles whole regions, write directly into the buffer.
+		 * the region is calculated in bands of rows, to check for a break like the other paths */
+		MemoryBuffer *temp = packed ? new MemoryBuffer(NULL, rect) : NULL;
+		MemoryBuffer *output = packed ? temp : memoryBuffer;
+		rcti band = *rect;
+		bool breaked = false;
+		for (band.ymin = rect->ymin; band.ymin < rect->ymax && (!breaked); band.ymin = band.ymax) {
+			band.ymax = min(band.ymin + COM_BUFFER_EXECUTION_ROWS, rect->ymax);
+			this->m_input->readBuffer(output, &band);
+			if (isBreaked()) {
+				breaked = true;
+			}
+		}
+		if (temp) {
+			memoryBuffer->copyContentFrom(temp);
+			delete temp;
+		}
+	}
 	else {
 		int x1 = rect->xmin;
 		int y1 = rect->ymin;
@@ -96,16 +160,23 @@ void WriteBufferOperation::executeRegion(rcti *rect, unsigned int tileNumber)
 		int y;
 		bool breaked = false;
 		for (y = y1; y < y2 && (!breaked); y++) {
-			int offset4 = (y * memoryBuffer->getWidth() + x1) * COM_NUMBER_OF_CHANNELS;
+			float *buffer = packed ? row : memoryBuffer->getElem(x1, y);
 			for (x = x1; x < x2; x++) {
-				this->m_input->read(&(buffer[offset4]), x, y, COM_PS_NEAREST);
-				offset4 += COM_NUMBER_OF_CHANNELS;
+				this->m_input->read(buffer, x, y, COM_PS_NEAREST);
+				buffer += COM_NUMBER_OF_CHANNELS;
+			}
+			if (packed) {
+				memoryBuffer->writeRow(x1, y, x2 - x1, row);
 			}
 			if (isBreaked()) {
 				breaked = true;
 			}
 		}
 	}
+
+	if (row) {
+		MEM_freeN(row);
+	}
 	memoryBuffer->setCreatedState();
 }
 
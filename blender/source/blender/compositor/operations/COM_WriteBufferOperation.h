@@ -26,6 +26,7 @@
 #include "COM_NodeOperation.h"
 #include "COM_MemoryProxy.h"
 #include "COM_SocketReader.h"
+#include "COM_BufferCache.h"
 /**
  * @brief Operation to write to a tile
  * @ingroup Operation
@@ -34,6 +35,8 @@ class WriteBufferOperation : public NodeOperation {
 	MemoryProxy *m_memoryProxy;
 	bool m_single_value; /* single value stored in buffer */
 	NodeOperation *m_input;
+	uint64_t m_cacheKey; /* key of the buffer in the BufferCache */
+	bool m_cached; /* buffer was calculated by an earlier execution */
 public:
 	WriteBufferOperation();
 	~WriteBufferOperation();
@@ -42,10 +45,17 @@ public:
 	void executePixel(float output[4], float x, float y, PixelSampler sampler);
 	const bool isWriteBufferOperation() const { return true; }
 	bool isSingleValue() const { return m_single_value; }
+	void setCacheKey(uint64_t key) { this->m_cacheKey = key; }
+	bool isCached() const { return this->m_cached; }
 	
 	void executeRegion(rcti *rect, unsigned int tileNumber);
 	void initExecution();
 	void deinitExecution();
+
+	/**
+	 * @brief free the buffer, or hand it to the BufferCache, once no ExecutionGroup has to read it anymore
+	 */
+	void releaseMemoryBuffer();
 	void executeOpenCLRegion(OpenCLDevice *device, rcti *rect, unsigned int chunkNumber, MemoryBuffer **memoryBuffers, MemoryBuffer *outputBuffer);
 	void determineResolution(unsigned int resolution[2], unsigned int preferredResolution[2]);
 	void readResolutionFromInputSocket();
@@ -59,7 +59,10 @@
 #endif
 
 static MEM_CacheLimiterC *limitor = NULL;
-static pthread_mutex_t limitor_lock = BLI_MUTEX_INITIALIZER;
+/* items are only destroyed while enforcing limits, which is done with the lock
+ * held for writing. gets hold it for reading, so that handles they touch stay
+ * valid without serializing them */
+static ThreadRWMutex limitor_lock = BLI_RWLOCK_INITIALIZER;
 
 typedef struct MovieCache {
 	char name[64];
@@ -82,7 +85,10 @@ typedef struct MovieCache {
 	void *last_userkey;
 
 	int totseg, *points, proxy, render_flags;  /* for visual statistics optimization */
-	int pad;
+
+	/* set when the cache limiter destroyed items, which leaves keys to be removed,
+	 * only accessed with limitor_lock held, puts to one cache are not concurrent */
+	int has_unused_keys;
 } MovieCache;
 
 typedef struct MovieCacheKey {
@@ -186,6 +192,8 @@ static void IMB_moviecache_destructor(void *p)
 		item->ibuf = NULL;
 		item->c_handle = NULL;
 
+		cache->has_unused_keys = TRUE;
+
 		/* force cached segments to be updated */
 		if (cache->points) {
 			MEM_freeN(cache->points);
@@ -310,6 +318,7 @@ static void do_moviecache_put(MovieCache *cache, void *userkey, ImBuf *ibuf, int
 {
 	MovieCacheKey *key;
 	MovieCacheItem *item;
+	int has_unused_keys;
 
 	if (!limitor)
 		IMB_moviecache_init();
@@ -341,20 +350,38 @@ static void do_moviecache_put(MovieCache *cache, void *userkey, ImBuf *ibuf, int
 		memcpy(cache->last_userkey, userkey, cache->keysize);
 	}
 
-	if (need_lock)
-		BLI_mutex_lock(&limitor_lock);
+	/* the cache limiter is thread safe, inserting referenced makes sure the new
+	 * item is not destroyed by limits enforced from another thread meanwhile */
+	item->c_handle = MEM_CacheLimiter_insert_ref(limitor, item);
+
+	/* size accounting is cheap, so only take the lock exclusively when the
+	 * cache is over its limit and items have to be destroyed */
+	if (need_lock) {
+		size_t mem_limit = MEM_CacheLimiter_get_maximum();
 
-	item->c_handle = MEM_CacheLimiter_insert(limitor, item);
+		if (mem_limit && MEM_CacheLimiter_get_memory_in_use(limitor) > mem_limit) {
+			BLI_rw_mutex_lock(&limitor_lock, THREAD_LOCK_WRITE);
+			MEM_CacheLimiter_enforce_limits(limitor);
+			BLI_rw_mutex_unlock(&limitor_lock);
+		}
+
+		BLI_rw_mutex_lock(&limitor_lock, THREAD_LOCK_READ);
+	}
+	else {
+		MEM_CacheLimiter_enforce_limits(limitor);
+	}
 
-	MEM_CacheLimiter_ref(item->c_handle);
-	MEM_CacheLimiter_enforce_limits(limitor);
 	MEM_CacheLimiter_unref(item->c_handle);
 
+	has_unused_keys = cache->has_unused_keys;
+	cache->has_unused_keys = FALSE;
+
 	if (need_lock)
-		BLI_mutex_unlock(&limitor_lock);
+		BLI_rw_mutex_unlock(&limitor_lock);
 
 	/* cache limiter can't remove unused keys which points to destoryed values */
-	check_unused_keys(cache);
+	if (has_unused_keys)
+		check_unused_keys(cache);
 
 	if (cache->points) {
 		MEM_freeN(cache->points);
@@ -375,7 +402,9 @@ int IMB_moviecache_put_if_possible(MovieCache *cache, void *userkey, ImBuf *ibuf
 	elem_size = IMB_get_size_in_memory(ibuf);
 	mem_limit = MEM_CacheLimiter_get_maximum();
 
-	BLI_mutex_lock(&limitor_lock);
+	/* only serializes conditional puts, memory may still be freed or taken
+	 * by regular puts from other threads meanwhile */
+	BLI_rw_mutex_lock(&limitor_lock, THREAD_LOCK_WRITE);
 	mem_in_use = MEM_CacheLimiter_get_memory_in_use(limitor);
 
 	if (mem_in_use + elem_size <= mem_limit) {
@@ -383,7 +412,7 @@ int IMB_moviecache_put_if_possible(MovieCache *cache, void *userkey, ImBuf *ibuf
 		result = TRUE;
 	}
 
-	BLI_mutex_unlock(&limitor_lock);
+	BLI_rw_mutex_unlock(&limitor_lock);
 
 	return result;
 }
@@ -398,15 +427,20 @@ ImBuf *IMB_moviecache_get(MovieCache *cache, void *userkey)
 	item = (MovieCacheItem *)BLI_ghash_lookup(cache->hash, &key);
 
 	if (item) {
+		ImBuf *ibuf = NULL;
+
+		BLI_rw_mutex_lock(&limitor_lock, THREAD_LOCK_READ);
+
 		if (item->ibuf) {
-			BLI_mutex_lock(&limitor_lock);
 			MEM_CacheLimiter_touch(item->c_handle);
-			BLI_mutex_unlock(&limitor_lock);
 
 			IMB_refImBuf(item->ibuf);
-
-			return item->ibuf;
+			ibuf = item->ibuf;
 		}
+
+		BLI_rw_mutex_unlock(&limitor_lock);
+
+		return ibuf;
 	}
 
 	return NULL;
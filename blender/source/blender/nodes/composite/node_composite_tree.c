@@ -260,6 +260,19 @@ void ntreeCompositExecTree(bNodeTree *ntree, RenderData *rd, int rendering, int
 	(void)do_preview;
 }
 
+void ntreeCompositBenchmark(bNodeTree *ntree, RenderData *rd, int iterations,
+                            const ColorManagedViewSettings *view_settings,
+                            const ColorManagedDisplaySettings *display_settings)
+{
+#ifdef WITH_COMPOSITOR
+	COM_benchmark(rd, ntree, iterations, view_settings, display_settings);
+#else
+	(void)ntree, (void)rd, (void)iterations;
+	(void)view_settings, (void)display_settings;
+	printf("Compositor benchmark: Blender was built without the compositor\n");
+#endif
+}
+
 /* *********************************************** */
 
 /* based on rules, force sockets hidden always */
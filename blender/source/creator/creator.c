@@ -244,6 +244,7 @@ static int print_help(int UNUSED(argc), const char **UNUSED(argv), void *data)
 	BLI_argsPrintArgDoc(ba, "--render-anim");
 	BLI_argsPrintArgDoc(ba, "--scene");
 	BLI_argsPrintArgDoc(ba, "--render-frame");
+	BLI_argsPrintArgDoc(ba, "--compositor-benchmark");
 	BLI_argsPrintArgDoc(ba, "--frame-start");
 	BLI_argsPrintArgDoc(ba, "--frame-end");
 	BLI_argsPrintArgDoc(ba, "--frame-jump");
@@ -309,6 +310,7 @@ static int print_help(int UNUSED(argc), const char **UNUSED(argv), void *data)
 	printf("\n");
 	BLI_argsPrintArgDoc(ba, "--debug-fpe");
 	BLI_argsPrintArgDoc(ba, "--disable-crash-handler");
+	BLI_argsPrintArgDoc(ba, "--lockfree-malloc");
 
 	printf("\n");
 	printf("Misc Options:\n");
@@ -401,6 +403,12 @@ static int disable_crash_handler(int UNUSED(argc), const char **UNUSED(argv), vo
 	return 0;
 }
 
+static int lockfree_malloc(int UNUSED(argc), const char **UNUSED(argv), void *UNUSED(data))
+{
+	/* handled in main() before anything is allocated */
+	return 0;
+}
+
 static int background_mode(int UNUSED(argc), const char **UNUSED(argv), void *UNUSED(data))
 {
 	G.background = 1;
@@ -1025,6 +1033,34 @@ static int render_animation(int UNUSED(argc), const char **UNUSED(argv), void *d
 	return 0;
 }
 
+static int compositor_benchmark(int argc, const char **argv, void *data)
+{
+	bContext *C = data;
+	Scene *scene = CTX_data_scene(C);
+	if (scene) {
+		if (argc > 1) {
+			int iterations = MAX2(atoi(argv[1]), 1);
+
+			if (scene->use_nodes && scene->nodetree) {
+				ntreeCompositBenchmark(scene->nodetree, &scene->r, iterations,
+				                       &scene->view_settings, &scene->display_settings);
+			}
+			else {
+				printf("\nError: scene '%s' does not use compositing nodes.\n", scene->id.name + 2);
+			}
+			return 1;
+		}
+		else {
+			printf("\nError: number of iterations must follow '--compositor-benchmark'.\n");
+			return 0;
+		}
+	}
+	else {
+		printf("\nError: no blend loaded. cannot use '--compositor-benchmark'.\n");
+		return 0;
+	}
+}
+
 static int set_scene(int argc, const char **argv, void *data)
 {
 	if (argc > 1) {
@@ -1355,6 +1391,7 @@ static void setupArguments(bContext *C, bArgs *ba, SYS_SystemHandle *syshandle)
 	BLI_argsAdd(ba, 1, "-Y", "--disable-autoexec", "\n\tDisable automatic python script execution (pydrivers & startup scripts)" PY_DISABLE_AUTO, disable_python, NULL);
 
 	BLI_argsAdd(ba, 1, NULL, "--disable-crash-handler", "\n\tDisable the crash handler", disable_crash_handler, NULL);
+	BLI_argsAdd(ba, 1, NULL, "--lockfree-malloc", "\n\tUse the lock-free memory allocator, faster for many threads but without guarded blocks", lockfree_malloc, NULL);
 
 #undef PY_ENABLE_AUTO
 #undef PY_DISABLE_AUTO
@@ -1416,6 +1453,7 @@ static void setupArguments(bContext *C, bArgs *ba, SYS_SystemHandle *syshandle)
 	BLI_argsAdd(ba, 4, "-g", NULL, game_doc, set_ge_parameters, syshandle);
 	BLI_argsAdd(ba, 4, "-f", "--render-frame", "<frame>\n\tRender frame <frame> and save it.\n\t+<frame> start frame relative, -<frame> end frame relative.", render_frame, C);
 	BLI_argsAdd(ba, 4, "-a", "--render-anim", "\n\tRender frames from start to end (inclusive)", render_animation, C);
+	BLI_argsAdd(ba, 4, NULL, "--compositor-benchmark", "<iterations>\n\tExecute the compositing nodes of the scene <iterations> times and print the chunks per second and the idle time of every thread (use with -b)", compositor_benchmark, C);
 	BLI_argsAdd(ba, 4, "-S", "--scene", "<name>\n\tSet the active scene <name> for rendering", set_scene, C);
 	BLI_argsAdd(ba, 4, "-s", "--frame-start", "<frame>\n\tSet start to frame <frame> (use before the -a argument)", set_start_frame, C);
 	BLI_argsAdd(ba, 4, "-e", "--frame-end", "<frame>\n\tSet end to frame <frame> (use before the -a argument)", set_end_frame, C);
@@ -1454,8 +1492,9 @@ int main(int argc, const char **UNUSED(argv_c)) /* Do not mess with const */
 int main(int argc, const char **argv)
 #endif
 {
-	bContext *C = CTX_create();
+	bContext *C;
 	SYS_SystemHandle syshandle;
+	int i;
 
 #ifndef WITH_PYTHON_MODULE
 	bArgs *ba;
@@ -1464,7 +1503,26 @@ int main(int argc, const char **argv)
 #ifdef WIN32
 	wchar_t **argv_16 = CommandLineToArgvW(GetCommandLineW(), &argc);
 	int argci = 0;
-	char **argv = MEM_mallocN(argc * sizeof(char *), "argv array");
+	char **argv;
+#endif
+
+	/* the allocator can only be switched before anything is allocated */
+	for (i = 1; i < argc; i++) {
+#ifdef WIN32
+		if (wcscmp(argv_16[i], L"--lockfree-malloc") == 0) {
+#else
+		if (strcmp(argv[i], "--lockfree-malloc") == 0) {
+#endif
+			if (!MEM_use_lockfree_allocator())
+				printf("Failed to switch to the lock-free memory allocator\n");
+			break;
+		}
+	}
+
+	C = CTX_create();
+
+#ifdef WIN32
+	argv = MEM_mallocN(argc * sizeof(char *), "argv array");
 	for (argci = 0; argci < argc; argci++) {
 		argv[argci] = alloc_utf_8_from_16(argv_16[argci], 0);
 	}